@@ -63,12 +63,14 @@ struct Object
     int m_class;             // object class
     float m_score;           // detection score (0.0, 1.0)
 
-	int64		m_timestamp; // timestamp
+	int64		m_timestamp; // capture time of the sensor data [ns], 0 if unknown
+	int64		m_proc_timestamp; // time when the object was detected [ns], 0 if unknown
     cv::Point3f m_pos_2D;    // position in image + depth value
     cv::Rect    m_bb;        // bounding box in image
     cv::Mat     m_mask;      // object mask (CV_8U type)
     float       m_angle;     // object orientation
     cv::Point3f m_speed;     // changes in image and depth
+    int         m_source;    // index of the sensor (camera), which produced the object
 };
 
 /**
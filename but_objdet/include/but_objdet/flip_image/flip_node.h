@@ -35,29 +35,28 @@
 
 #include "but_objdet_msgs/DetectionArray.h"
 #include "but_objdet/tracker/tracker_kalman.h"
-
-
-// Indicates if to visualize detections and predictions in a window
-#define VISUAL_OUTPUT 1
+#include "but_objdet/stats/metrics.h"
 
 
 namespace but_objdet
 {
 
 /**
- * A class implementing the tracker node, which creates and maintains a Kalman filter
- * tracker for each detected object (if there is no detection of an object for
- * some time / number of frames, the tracker for that object is canceled).
- * It also advertises a service for prediction of the next state of detections,
- * (either of all of the currently maintained or of some specified object class or
- * object id).
+ * A class implementing the flip node, which flips incoming RGB and depth images
+ * upside down and republishes them on /cam3d/... topics.
  *
  * @author Tomas Hodan, Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
  */
 class FlipImageNode
 {
 public:
-	FlipImageNode();
+    /**
+     * Constructor.
+     * @param nh  NodeHandle used to subscribe and advertise topics.
+     * @param pnh  Private NodeHandle used to read parameters.
+     */
+	FlipImageNode(ros::NodeHandle nh = ros::NodeHandle(),
+	              ros::NodeHandle pnh = ros::NodeHandle("~"));
 	~FlipImageNode();
 
 private:
@@ -76,9 +75,17 @@ private:
 	void newImageCallback(const sensor_msgs::ImageConstPtr &imageMsg);
 
         void newDepthCallback(const sensor_msgs::ImageConstPtr &imageMsg);
+
+    /**
+     * Returns a new Image message containing the given image flipped upside down.
+     * @param imageMsg  Image message.
+     * @return  Flipped image message.
+     */
+	sensor_msgs::ImagePtr flipImage(const sensor_msgs::ImageConstPtr &imageMsg);
   
 
     ros::NodeHandle nh; // NodeHandle is the main access point for communication with ROS system
+    ros::NodeHandle pnh; // Private NodeHandle (parameters of the node)
 	
 	
 	ros::Subscriber imgSub;
@@ -86,6 +93,11 @@ private:
         ros::Subscriber depthSub;
         ros::Publisher depthPub;
 	std::string winName;
+	bool visualOutput; // Show flipped images in a window (~visual_output)
+
+	MetricsRegistry metrics; // Metrics published as diagnostics
+	MetricHistogram *flipTime, *publishTime;
+	MetricCounter *imageCount, *depthCount;
 };
 
 }
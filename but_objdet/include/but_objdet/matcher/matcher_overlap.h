@@ -46,8 +46,10 @@ public:
      * MatcherOverlap constructor.
      * @param min  The bounding boxes are considered to be matching each other if
      * their overlapping area represents at least min% of each of them.
+     * @param oneToOne  If true, each prediction is matched with one detection
+     * at most (the most overlapping one).
      */
-	MatcherOverlap(float min=50);
+	MatcherOverlap(float min=50, bool oneToOne=false);
 
     /**
      * A function to set the minimal overlap.
@@ -56,13 +58,48 @@ public:
      */
 	void setMinOverlap(float min=50);
 
+    /**
+     * A function to set if a prediction can be matched with more detections.
+     * @param oneToOne  If true, each prediction is matched with one detection
+     * at most (the most overlapping one).
+     */
+	void setOneToOne(bool oneToOne=true);
+
 	/**
      * Implementation of the virtual matching function from the Matcher abstract class.
      */
 	void match(const Objects &detections, const Objects &predictions, Matches &matches);
 
 private:
+    /**
+     * A similar pair of a detection and a prediction.
+     */
+	struct Candidate
+	{
+		float overlapped;
+		int detId;
+		int predId;
+
+		// The most overlapping pairs first (ties in the order of detections
+		// and predictions, so the result doesn't depend on sorting)
+		bool operator<(const Candidate &c) const
+		{
+			if(overlapped != c.overlapped) return overlapped > c.overlapped;
+			if(detId != c.detId) return detId < c.detId;
+			return predId < c.predId;
+		}
+	};
+
+	void matchOneToOne(const Objects &detections, const Objects &predictions, Matches &matches);
+
+    /**
+     * Overlapping percentage of a detection and a prediction (0 if they are
+     * not similar).
+     */
+	float overlap(const Object &detection, const Object &prediction) const;
+
 	float minOverlap;
+	bool oneToOne;
 };
 
 }
@@ -0,0 +1,109 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Layout of the binary log of frames, detections and predictions.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _LOG_FORMAT_
+#define _LOG_FORMAT_
+
+#include <stdint.h>
+
+/*
+ * The log is a file header followed by records. Each record consists of
+ * a LogRecordHeader and a payload padded to a multiple of 8 bytes:
+ *  - LOG_RECORD_FRAME: LogFrameHeader followed by raw or encoded image data,
+ *  - LOG_RECORD_DETECTIONS: serialized DetectionArray message,
+ *  - LOG_RECORD_PREDICTIONS: serialized PredictDetections response.
+ * Records are only appended, so a log cut off by a crash stays readable up
+ * to its last complete record (LogWriter removes the incomplete one before
+ * appending to the log).
+ */
+
+#define BUT_OBJDET_LOG_MAGIC    "BODLOG\0"
+#define BUT_OBJDET_LOG_VERSION  2
+
+
+namespace but_objdet
+{
+
+/**
+ * Types of log records.
+ */
+enum LogRecordType {
+    LOG_RECORD_FRAME = 1,
+    LOG_RECORD_DETECTIONS = 2,
+    LOG_RECORD_PREDICTIONS = 3
+};
+
+/**
+ * Encodings of frame data.
+ */
+enum LogFrameEncoding {
+    LOG_FRAME_RAW = 0,
+    LOG_FRAME_JPEG = 1,
+    LOG_FRAME_PNG = 2
+};
+
+/**
+ * Header of the log file.
+ */
+struct LogFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+/**
+ * Header of a record.
+ */
+struct LogRecordHeader
+{
+    uint32_t type;         // LogRecordType
+    uint32_t size;         // Size of the payload (without padding)
+    int64_t stamp;         // Stamp of the data (header stamp, request time) [ns]
+    int64_t recordTime;    // Wall time of recording [ns]
+};
+
+/**
+ * Header of a frame payload.
+ */
+struct LogFrameHeader
+{
+    uint32_t rows;         // Size of the stored image
+    uint32_t cols;
+    uint32_t type;         // OpenCV type of the image
+    uint32_t encoding;     // LogFrameEncoding
+    float scale;           // Scale of the stored image relative to the original
+    uint32_t seq;          // Header seq of the image message
+    char imgEncoding[24];  // Encoding of the image message (e.g. "bgr8")
+    char frameId[32];      // Frame id of the image message (possibly truncated)
+};
+
+}
+
+#endif // _LOG_FORMAT_
+
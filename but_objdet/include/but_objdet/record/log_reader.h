@@ -0,0 +1,173 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Memory-mapped reading and replay of the binary log written
+ * by LogWriter.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _LOG_READER_
+#define _LOG_READER_
+
+#include <cstddef>
+#include <string>
+#include <boost/function.hpp>
+#include <opencv2/opencv.hpp>
+#include <sensor_msgs/Image.h>
+
+#include "but_objdet_msgs/DetectionArray.h"
+#include "but_objdet/PredictDetections.h"
+#include "but_objdet/record/log_format.h"
+
+
+namespace but_objdet
+{
+
+/**
+ * One record of the log (its payload points into the mapped file).
+ */
+struct LogRecord
+{
+    LogRecordType type;
+    int64_t stamp;         // Stamp of the data [ns]
+    int64_t recordTime;    // Wall time of recording [ns]
+    const uint8_t *data;   // Payload
+    uint32_t size;         // Size of the payload
+};
+
+/**
+ * A class reading the log written by LogWriter. The file is mapped into
+ * memory, so records are read without copying and the log can be read
+ * repeatedly (e.g. by benchmarks) without touching the disk again.
+ */
+class LogReader
+{
+public:
+    LogReader();
+    ~LogReader();
+
+    /**
+     * Maps the log into memory.
+     * @param filename  Name of the log file.
+     * @return  False if the file can't be mapped or is not a log of this version.
+     */
+    bool open(const std::string& filename);
+
+    /**
+     * Unmaps the log.
+     */
+    void close();
+
+    /**
+     * Tests if the log is opened.
+     */
+    bool isOpen() const { return base != NULL; }
+
+    /**
+     * Reads the next record.
+     * @param record  (output) Read record.
+     * @return  False at the end of the log (an incomplete last record is ignored).
+     */
+    bool next(LogRecord& record);
+
+    /**
+     * Starts reading from the first record again.
+     */
+    void rewind();
+
+    /**
+     * Decodes a frame record.
+     * @param record  Record of the LOG_RECORD_FRAME type.
+     * @param image  (output) Image (of the stored size).
+     * @param imageMsg  (output, optional) Header and encoding of the original
+     * image message (its data are not filled).
+     * @return  False if the record can't be decoded.
+     */
+    static bool decodeFrame(const LogRecord& record, cv::Mat& image,
+                            sensor_msgs::Image *imageMsg = NULL);
+
+    /**
+     * Decodes a detections record.
+     */
+    static bool decodeDetections(const LogRecord& record, but_objdet_msgs::DetectionArray& detArray);
+
+    /**
+     * Decodes a predictions record.
+     */
+    static bool decodePredictions(const LogRecord& record, but_objdet::PredictDetections::Response& response);
+
+private:
+    const uint8_t *base;
+    size_t length;
+    size_t offset;
+};
+
+/**
+ * A class replaying the log by calling given functions for its records,
+ * either with the recorded timing (scaled by a rate) or as fast as possible.
+ * It doesn't need a running ROS master, so it can drive detector, matcher
+ * and tracker classes directly as well as publish the data to running nodes.
+ */
+class LogPlayer
+{
+public:
+    typedef boost::function<void (const sensor_msgs::Image&, const cv::Mat&)> FrameCallback;
+    typedef boost::function<void (const but_objdet_msgs::DetectionArray&)> DetectionsCallback;
+    typedef boost::function<void (const ros::Time&, const but_objdet::PredictDetections::Response&)> PredictionsCallback;
+
+    /**
+     * Constructor.
+     * @param reader  Opened log.
+     */
+    LogPlayer(LogReader& reader);
+
+    /**
+     * Sets the speed of replay.
+     * @param rate  Multiple of the recorded speed, 0 = as fast as possible.
+     */
+    void setRate(double rate) { this->rate = rate; }
+
+    void onFrame(const FrameCallback& cb) { frameCb = cb; }
+    void onDetections(const DetectionsCallback& cb) { detectionsCb = cb; }
+    void onPredictions(const PredictionsCallback& cb) { predictionsCb = cb; }
+
+    /**
+     * Replays the whole log (from the current position of the reader).
+     * @param ok  Optional function, replay stops when it returns false.
+     * @return  Number of replayed records.
+     */
+    unsigned int play(const boost::function<bool ()>& ok = boost::function<bool ()>());
+
+private:
+    LogReader& reader;
+    double rate;
+    FrameCallback frameCb;
+    DetectionsCallback detectionsCb;
+    PredictionsCallback predictionsCb;
+};
+
+}
+
+#endif // _LOG_READER_
+
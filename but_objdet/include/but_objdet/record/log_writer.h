@@ -0,0 +1,127 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Recording of frames, detections and predictions into a binary log.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _LOG_WRITER_
+#define _LOG_WRITER_
+
+#include <cstdio>
+#include <string>
+#include <boost/thread/mutex.hpp>
+#include <opencv2/opencv.hpp>
+#include <sensor_msgs/Image.h>
+
+#include "but_objdet_msgs/DetectionArray.h"
+#include "but_objdet/PredictDetections.h"
+#include "but_objdet/record/log_format.h"
+
+
+namespace but_objdet
+{
+
+/**
+ * A class appending frames, detections and predictions into a binary log
+ * (see log_format.h), which can be replayed by LogReader / LogPlayer.
+ * All write functions can be called from several threads.
+ */
+class LogWriter
+{
+public:
+    LogWriter();
+    ~LogWriter();
+
+    /**
+     * Opens a log for appending (a new log is created if the file doesn't exist).
+     * An incomplete record at the end of the log is removed first.
+     * @param filename  Name of the log file.
+     * @return  False if the file can't be opened or is not a log of this version.
+     */
+    bool open(const std::string& filename);
+
+    /**
+     * Closes the log.
+     */
+    void close();
+
+    /**
+     * Tests if the log is opened.
+     */
+    bool isOpen() const { return file != NULL; }
+
+    /**
+     * Sets how frames are stored.
+     * @param scale  Scale of stored frames (e.g. 0.5 = half resolution).
+     * @param encoding  LOG_FRAME_RAW, LOG_FRAME_JPEG or LOG_FRAME_PNG.
+     * @param quality  JPEG quality (0 - 100) or PNG compression level (0 - 9).
+     */
+    void setFrameFormat(float scale, LogFrameEncoding encoding = LOG_FRAME_RAW, int quality = -1);
+
+    /**
+     * Appends a frame.
+     * @param imageMsg  Image message the frame was received in (only its header
+     * and encoding are stored).
+     * @param image  Image data.
+     */
+    bool writeFrame(const sensor_msgs::Image& imageMsg, const cv::Mat& image);
+
+    /**
+     * Appends detections.
+     */
+    bool writeDetections(const but_objdet_msgs::DetectionArray& detArray);
+
+    /**
+     * Appends a response of the prediction service.
+     * @param stamp  Time, for which the predictions were requested.
+     * @param response  Response of the service.
+     */
+    bool writePredictions(const ros::Time& stamp, const but_objdet::PredictDetections::Response& response);
+
+    /**
+     * Writes buffered records into the file.
+     */
+    void flush();
+
+private:
+    /**
+     * Appends a record consisting of two parts of payload.
+     */
+    bool writeRecord(LogRecordType type, int64_t stamp,
+                     const void *data1, uint32_t size1,
+                     const void *data2, uint32_t size2);
+
+    FILE *file;
+    boost::mutex mutex;
+
+    float frameScale;
+    LogFrameEncoding frameEncoding;
+    int frameQuality;
+};
+
+}
+
+#endif // _LOG_WRITER_
+
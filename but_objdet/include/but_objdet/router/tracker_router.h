@@ -0,0 +1,157 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Router of tracker services to tracker nodes tracking
+ * different classes of objects.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _TRACKER_ROUTER_
+#define _TRACKER_ROUTER_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <ros/ros.h> // Main header of ROS
+#include <boost/scoped_ptr.hpp>
+
+#include "but_objdet/PredictDetections.h" // Autogenerated service class
+#include "but_objdet/GetObjects.h" // Autogenerated service class
+#include "but_objdet/PredictDetectionsBatch.h" // Autogenerated service class
+#include "but_objdet/GetTrackHistory.h" // Autogenerated service class
+#include "but_objdet/tracker/worker_pool.h"
+
+
+namespace but_objdet
+{
+
+/**
+ * A node providing the prediction, batch prediction, get objects and track
+ * history services of several tracker nodes (shards), each of them tracking
+ * some classes of objects. A request for one class is passed to the shard
+ * tracking the class, other requests are passed to all the shards at once
+ * and their responses are merged. Objects and classes listed in a batch
+ * or history request are split among their shards. A request fails if any
+ * of its shards fails (a merged response would silently miss objects of that
+ * shard).
+ *
+ * Shards are given by parameters:
+ *  - shards: namespaces of the shards (service_namespace of each tracker),
+ *  - shard_classes: a list of classes of each shard (a shard without
+ *    classes receives requests for classes not listed elsewhere).
+ */
+class TrackerRouter
+{
+public:
+    /**
+     * Constructor.
+     * @param nh  NodeHandle used to advertise services.
+     * @param pnh  Private NodeHandle used to read parameters.
+     */
+    TrackerRouter(ros::NodeHandle nh = ros::NodeHandle(),
+                  ros::NodeHandle pnh = ros::NodeHandle("~"));
+
+private:
+    /**
+     * A tracker node serving some classes.
+     */
+    struct Shard
+    {
+        std::string ns;                   // Namespace of the services
+        ros::ServiceClient predictClient; // Persistent connections
+        ros::ServiceClient objectsClient;
+        ros::ServiceClient batchClient;
+        ros::ServiceClient historyClient;
+    };
+
+    /**
+     * A function implementing the prediction service.
+     */
+    bool predictDetections(but_objdet::PredictDetections::Request &req,
+                           but_objdet::PredictDetections::Response &res);
+
+    /**
+     * A function implementing the get objects service.
+     */
+    bool getObjects(but_objdet::GetObjects::Request &req,
+                    but_objdet::GetObjects::Response &res);
+
+    /**
+     * A function implementing the batch prediction service.
+     */
+    bool predictDetectionsBatch(but_objdet::PredictDetectionsBatch::Request &req,
+                                but_objdet::PredictDetectionsBatch::Response &res);
+
+    /**
+     * A function implementing the track history service.
+     */
+    bool getTrackHistory(but_objdet::GetTrackHistory::Request &req,
+                         but_objdet::GetTrackHistory::Response &res);
+
+    /**
+     * Shards serving a request for a class (-1 = all shards).
+     */
+    void selectShards(int classId, std::vector<unsigned int> &selected) const;
+
+    /**
+     * Splits items of a request (objects or classes) among shards of their
+     * classes.
+     * @param itemClasses  Class of each item.
+     * @param selected  (output) Indices of the shards, which got some items.
+     * @param items  (output) Indices of the items of each selected shard
+     * (in the order of the request).
+     */
+    void splitItems(const std::vector<int32_t> &itemClasses, std::vector<unsigned int> &selected,
+                    std::vector<std::vector<int32_t> > &items) const;
+
+    /**
+     * Calls a service of several shards at once.
+     * @param selected  Indices of the shards.
+     * @param client  Client of the service in Shard.
+     * @param service  Name of the service (without the namespace of a shard).
+     * @param srvs  Requests for the shards (filled by the caller) and
+     * (output) their responses.
+     * @return  False if the call of any of the shards failed.
+     */
+    template <typename S>
+    bool callShards(const std::vector<unsigned int> &selected,
+                    ros::ServiceClient Shard::*client, const std::string &service,
+                    std::vector<S> &srvs);
+
+    std::vector<Shard> shards;
+    std::map<int, std::vector<unsigned int> > classShards; // Shards of each listed class
+    std::vector<unsigned int> defaultShards; // Shards of other classes
+    boost::scoped_ptr<WorkerPool> workers; // Threads calling the shards
+
+    ros::NodeHandle nh;
+    ros::NodeHandle pnh;
+    ros::ServiceServer predictionSRV;
+    ros::ServiceServer objectsSRV;
+    ros::ServiceServer predictionBatchSRV;
+    ros::ServiceServer historySRV;
+};
+
+}
+
+#endif // _TRACKER_ROUTER_
@@ -36,10 +36,27 @@ namespace but_objdet
      */
 	const std::string BUT_OBJDET_PredictDetections_SRV("/but_objdet/predict_detections");
 
+	/**
+     * Name of a service to obtain predictions of several objects and classes
+     * at once (provided by tracker).
+     */
+	const std::string BUT_OBJDET_PredictDetectionsBatch_SRV("/but_objdet/predict_detections_batch");
+
 	/**
      * Name of a service to obtain objects (provided by tracker).
      */
 	const std::string BUT_OBJDET_GetObjects_SRV("/but_objdet/get_objects");
+
+	/**
+     * Name of a service to obtain history of tracked objects (provided by tracker).
+     */
+	const std::string BUT_OBJDET_GetTrackHistory_SRV("/but_objdet/get_track_history");
+
+	/**
+     * Name of a service switching publishing of images with tracks (provided
+     * by tracker).
+     */
+	const std::string BUT_OBJDET_SetVisualization_SRV("/but_objdet/set_visualization");
 }
 
 #endif // BUT_OBJDET_SERVICES_LIST_H
@@ -0,0 +1,136 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Per-class histograms of latencies between pipeline stages.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _LATENCY_STATS_
+#define _LATENCY_STATS_
+
+#include <map>
+#include <string>
+#include <stdint.h>
+#include <boost/thread/mutex.hpp>
+
+// Buckets of a histogram - values below 32ns are exact, above them each
+// power of two is split into 16 buckets (the relative error is below 7%)
+#define LATENCY_SUB_BUCKETS  16
+#define LATENCY_BUCKETS      (2 * LATENCY_SUB_BUCKETS + (63 - 5) * LATENCY_SUB_BUCKETS)
+
+
+namespace but_objdet
+{
+
+/**
+ * A histogram of latencies with logarithmically spaced buckets. Values are
+ * added without locks, so several threads can add them at once, the other
+ * methods are called by one thread (see take() to read the histogram while
+ * values are added).
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    /**
+     * Adds a latency to the histogram.
+     * @param ns  Latency in nanoseconds (negative values are counted as 0).
+     */
+    void add(int64_t ns);
+
+    /**
+     * Removes all values from the histogram.
+     */
+    void clear();
+
+    /**
+     * Moves the values into another histogram (the buckets are moved one
+     * by one, so a value added meanwhile is moved or stays in this one).
+     * @param values  (output) The moved values (the previous ones are removed).
+     */
+    void take(LatencyHistogram& values);
+
+    /**
+     * Returns an approximate percentile of the added latencies.
+     * @param p  Percentile from the interval (0, 100].
+     * @return  Latency in miliseconds (0 if the histogram is empty).
+     */
+    double percentile(double p) const;
+
+    uint64_t count() const { return n; }
+    double meanMs() const { return n ? (double)sum / n / 1e6 : 0.0; }
+    double maxMs() const { return max / 1e6; }
+
+private:
+    static int bucketOf(uint64_t ns);
+    static uint64_t upperBound(int bucket);
+
+    volatile uint32_t buckets[LATENCY_BUCKETS];
+    volatile uint64_t n;
+    volatile int64_t sum;
+    volatile int64_t max;
+};
+
+/**
+ * Latencies of one pipeline stage (e.g. capture -> detection) collected
+ * separately for each object class and periodically written to the log.
+ * All methods can be called from several threads.
+ */
+class LatencyStats
+{
+public:
+    /**
+     * Constructor.
+     * @param name  Name of the measured stage used in reports.
+     */
+    LatencyStats(const std::string& name = "");
+
+    /**
+     * Adds a latency measured for an object.
+     * @param objClass  Class of the object.
+     * @param fromNs  Time of the beginning of the stage [ns], 0 if unknown
+     * (the latency is ignored then).
+     * @param toNs  Time of the end of the stage [ns].
+     */
+    void add(int objClass, int64_t fromNs, int64_t toNs);
+
+    /**
+     * Writes percentiles of latencies of each class into the ROS log
+     * and starts a new measuring period.
+     */
+    void report();
+
+private:
+    typedef std::map<int, LatencyHistogram> Histograms;
+
+    std::string name;
+    Histograms histograms;
+    boost::mutex mutex;
+};
+
+}
+
+#endif // _LATENCY_STATS_
+
@@ -0,0 +1,201 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Counters, gauges and histograms of durations updated without
+ * locks on hot paths of nodes and published as diagnostics.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _METRICS_
+#define _METRICS_
+
+#include <map>
+#include <string>
+#include <stdint.h>
+#include <time.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <ros/ros.h> // Main header of ROS
+#include <diagnostic_msgs/DiagnosticStatus.h>
+
+#include "but_objdet/stats/latency_stats.h"
+
+
+namespace but_objdet
+{
+
+/**
+ * Current time of the monotonic clock in nanoseconds.
+ */
+inline int64_t metricsNowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * A counter of events (e.g. processed frames).
+ */
+class MetricCounter
+{
+public:
+    MetricCounter() : value(0) {}
+
+    void add(uint64_t n = 1) { __sync_fetch_and_add(&value, n); }
+    uint64_t get() const { return value; }
+
+private:
+    volatile uint64_t value;
+};
+
+/**
+ * A current value (e.g. the number of tracks).
+ */
+class MetricGauge
+{
+public:
+    MetricGauge() : value(0) {}
+
+    void set(int64_t v) { __sync_lock_test_and_set(&value, v); }
+    void add(int64_t d) { __sync_fetch_and_add(&value, d); }
+    int64_t get() const { return value; }
+
+private:
+    volatile int64_t value;
+};
+
+/**
+ * Statistics of durations collected by a histogram since the last summary.
+ */
+struct MetricSummary
+{
+    uint64_t count;
+    double meanMs;
+    double p50Ms;
+    double p90Ms;
+    double p99Ms;
+    double maxMs;
+};
+
+/**
+ * A histogram of durations (see LatencyHistogram). Values are added without
+ * locks from any thread, a summary is taken by one thread periodically
+ * (values added meanwhile can be counted in the next one).
+ */
+class MetricHistogram
+{
+public:
+    /**
+     * Adds a duration.
+     * @param ns  Duration in nanoseconds (negative values are counted as 0).
+     */
+    void add(int64_t ns) { histogram.add(ns); }
+
+    /**
+     * Computes statistics of the added durations and removes them.
+     */
+    void collect(MetricSummary &summary);
+
+private:
+    LatencyHistogram histogram;
+};
+
+/**
+ * Measures duration of a scope and adds it to a histogram.
+ */
+class MetricTimer
+{
+public:
+    MetricTimer(MetricHistogram *histogram_) : histogram(histogram_), start(metricsNowNs()) {}
+    ~MetricTimer() { stop(); }
+
+    /**
+     * Ends the measurement before the end of the scope.
+     */
+    void stop()
+    {
+        if(histogram) {
+            histogram->add(metricsNowNs() - start);
+            histogram = NULL;
+        }
+    }
+
+private:
+    MetricHistogram *histogram;
+    int64_t start;
+};
+
+/**
+ * Named metrics of a node. Metrics are created during initialization and
+ * their pointers are used on hot paths (no lookups or locks are made there).
+ * A summary of all the metrics is published periodically as a diagnostic
+ * status.
+ */
+class MetricsRegistry
+{
+public:
+    /**
+     * Constructor.
+     * @param name  Name of the diagnostic status.
+     */
+    MetricsRegistry(const std::string &name = "");
+
+    /**
+     * Returns a metric of the given name (it is created if it doesn't
+     * exist). The metric exists as long as the registry.
+     */
+    MetricCounter *counter(const std::string &name);
+    MetricGauge *gauge(const std::string &name);
+    MetricHistogram *histogram(const std::string &name);
+
+    /**
+     * Writes values of all the metrics into a diagnostic status (statistics
+     * of histograms are computed since the last summary).
+     */
+    void summarize(diagnostic_msgs::DiagnosticStatus &status);
+
+    /**
+     * Starts publishing of summaries on the diagnostics topic.
+     * @param nh  NodeHandle used to advertise the topic.
+     * @param period  Period of summaries [s] (0 = never).
+     */
+    void start(ros::NodeHandle &nh, double period);
+
+private:
+    void timerCallback(const ros::WallTimerEvent &event);
+
+    std::string name;
+    std::map<std::string, boost::shared_ptr<MetricCounter> > counters;
+    std::map<std::string, boost::shared_ptr<MetricGauge> > gauges;
+    std::map<std::string, boost::shared_ptr<MetricHistogram> > histograms;
+    boost::mutex mutex; // Guards the maps (not the metrics)
+
+    ros::Publisher diagnosticsPub;
+    ros::WallTimer timer;
+};
+
+}
+
+#endif // _METRICS_
@@ -0,0 +1,186 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Trace spans of processing of frames by stages of the pipeline
+ * written into a file in the Chrome trace event format.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _TRACE_BUFFER_
+#define _TRACE_BUFFER_
+
+#include <cstdio>
+#include <string>
+#include <stdint.h>
+#include <time.h>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <ros/ros.h> // Main header of ROS
+
+
+namespace but_objdet
+{
+
+/**
+ * Current wall-clock time in nanoseconds (comparable with stamps of images
+ * and between processes).
+ */
+inline int64_t traceNowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Processing of a frame by one stage.
+ */
+struct TraceSpan
+{
+    const char *name; // Name of the stage (a string literal)
+    int64_t stamp;    // Stamp of the frame [ns]
+    uint32_t seq;     // Sequence number of the frame
+    int64_t start;    // Beginning and end of the processing [ns]
+    int64_t end;
+    int tid;          // Thread which processed the frame
+};
+
+/**
+ * Buffer of spans of one process. Spans are added without locks from any
+ * thread (they are dropped if the buffer is full) and a background thread
+ * appends them to a file, which can be opened by chrome://tracing or
+ * Perfetto (see but_objdet_trace_merge for merging files of several nodes).
+ * All nodes of a process (e.g. nodelets) share the buffer.
+ */
+class TraceBuffer
+{
+public:
+    /**
+     * Returns the buffer of this process.
+     */
+    static TraceBuffer &instance();
+
+    /**
+     * Starts writing of spans (the first call only, later calls just
+     * test if the buffer is open).
+     * @param path  The output file.
+     * @param process  Name of the process shown in the timeline.
+     * @param capacity  Number of spans kept until they are written
+     * (rounded up to a power of two).
+     * @return  False if the file cannot be created.
+     */
+    bool open(const std::string &path, const std::string &process, unsigned int capacity = 65536);
+
+    /**
+     * Writes the remaining spans and closes the file.
+     */
+    void close();
+
+    /**
+     * Tests if spans are written.
+     */
+    bool enabled() const { return active; }
+
+    /**
+     * Adds a span (nothing is done if the buffer isn't open). The thread
+     * of the span is set to the calling one.
+     */
+    void add(const TraceSpan &span);
+
+    /**
+     * Number of spans dropped because the buffer was full.
+     */
+    uint64_t dropped() const { return droppedCount; }
+
+private:
+    struct Slot
+    {
+        volatile uint64_t seq; // Position for which the slot is free (+1 once written)
+        TraceSpan span;
+    };
+
+    TraceBuffer();
+    ~TraceBuffer();
+
+    void writeLoop();
+    void drain();
+
+    Slot *slots;
+    uint64_t mask;
+    volatile uint64_t head; // Next position to be written
+    uint64_t tail; // Next position to be read (by the writer thread)
+    volatile uint64_t droppedCount;
+    volatile bool active;
+
+    FILE *file;
+    int pid;
+    boost::thread writer;
+    volatile bool running;
+    boost::mutex mutex; // Guards opening and closing
+};
+
+/**
+ * Records a span of a stage processing a frame from the construction
+ * to the end of the scope (or to stop()).
+ */
+class TraceScope
+{
+public:
+    TraceScope(const char *name, const ros::Time &stamp, uint32_t seq = 0)
+        : active(TraceBuffer::instance().enabled())
+    {
+        if(active) {
+            span.name = name;
+            span.stamp = stamp.toNSec();
+            span.seq = seq;
+            span.start = traceNowNs();
+        }
+    }
+
+    ~TraceScope() { stop(); }
+
+    void stop()
+    {
+        if(active) {
+            span.end = traceNowNs();
+            TraceBuffer::instance().add(span);
+            active = false;
+        }
+    }
+
+private:
+    bool active;
+    TraceSpan span;
+};
+
+/**
+ * Opens the trace buffer of the process if a node is given the ~trace_file
+ * parameter.
+ * @param pnh  Private NodeHandle of the node.
+ */
+void traceInit(ros::NodeHandle &pnh);
+
+}
+
+#endif // _TRACE_BUFFER_
@@ -0,0 +1,184 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: DetectionArray deserialized only for detections of selected
+ * classes.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _FILTERED_DETECTIONS_
+#define _FILTERED_DETECTIONS_
+
+#include <set>
+#include <boost/shared_ptr.hpp>
+#include <ros/serialization.h>
+#include <ros/message_traits.h>
+
+#include "but_objdet_msgs/DetectionArray.h"
+
+
+namespace but_objdet
+{
+
+/**
+ * A DetectionArray, from which only detections of the given classes are
+ * deserialized. Other detections are skipped just by reading lengths of
+ * their variable fields, i.e. their masks are neither copied nor allocated.
+ *
+ * It is received from the detection topic instead of a DetectionArray
+ * (it has the same type and MD5 sum), the classes are set by the function
+ * creating received messages:
+ *
+ *   ros::SubscribeOptions ops;
+ *   ops.init<FilteredDetections>(topic, 10, callback, createFunction);
+ */
+struct FilteredDetections
+{
+    typedef boost::shared_ptr<FilteredDetections> Ptr;
+    typedef boost::shared_ptr<FilteredDetections const> ConstPtr;
+
+    FilteredDetections(const std::set<int> *classes_ = NULL) : classes(classes_), skipped(0) {}
+
+    /**
+     * Tests if detections of a class are deserialized.
+     */
+    bool accepts(int objClass) const
+    {
+        return !classes || classes->empty() || classes->count(objClass) > 0;
+    }
+
+    but_objdet_msgs::DetectionArray array; // Detections of the accepted classes
+    const std::set<int> *classes;          // Accepted classes (NULL or empty = all)
+    uint32_t skipped;                      // Number of skipped detections
+};
+
+}
+
+
+namespace ros
+{
+namespace message_traits
+{
+
+template<> struct MD5Sum<but_objdet::FilteredDetections>
+{
+    static const char *value() { return MD5Sum<but_objdet_msgs::DetectionArray>::value(); }
+    static const char *value(const but_objdet::FilteredDetections&) { return value(); }
+};
+
+template<> struct DataType<but_objdet::FilteredDetections>
+{
+    static const char *value() { return DataType<but_objdet_msgs::DetectionArray>::value(); }
+    static const char *value(const but_objdet::FilteredDetections&) { return value(); }
+};
+
+template<> struct Definition<but_objdet::FilteredDetections>
+{
+    static const char *value() { return Definition<but_objdet_msgs::DetectionArray>::value(); }
+    static const char *value(const but_objdet::FilteredDetections&) { return value(); }
+};
+
+}
+
+namespace serialization
+{
+
+template<> struct Serializer<but_objdet::FilteredDetections>
+{
+    template<typename Stream>
+    inline static void write(Stream& stream, const but_objdet::FilteredDetections& m)
+    {
+        stream.next(m.array);
+    }
+
+    template<typename Stream>
+    inline static void read(Stream& stream, but_objdet::FilteredDetections& m)
+    {
+        stream.next(m.array.header);
+
+        uint32_t count;
+        stream.next(count);
+        m.array.detections.clear();
+        m.skipped = 0;
+
+        for(uint32_t i = 0; i < count; i++) {
+            uint8_t *start = stream.getData();
+
+            // Header, m_id and m_class are read to find out the class
+            std_msgs::Header header;
+            int32_t id, objClass;
+            stream.next(header);
+            stream.next(id);
+            stream.next(objClass);
+
+            if(m.accepts(objClass)) {
+                // The whole detection is deserialized from its beginning
+                uint32_t read = stream.getData() - start;
+                Stream detStream(start, stream.getLength() + read);
+                m.array.detections.push_back(but_objdet_msgs::Detection());
+                detStream.next(m.array.detections.back());
+                stream.advance(detStream.getData() - start - read);
+            }
+            else {
+                skipDetection(stream);
+                m.skipped++;
+            }
+        }
+    }
+
+    inline static uint32_t serializedLength(const but_objdet::FilteredDetections& m)
+    {
+        return serializationLength(m.array);
+    }
+
+private:
+    template<typename Stream>
+    inline static void skipBytes(Stream& stream)
+    {
+        uint32_t length;
+        stream.next(length);
+        stream.advance(length);
+    }
+
+    // Skips the rest of a Detection after m_class (the fields are in
+    // the order of Detection.msg)
+    template<typename Stream>
+    inline static void skipDetection(Stream& stream)
+    {
+        stream.advance(4 + 12 + 16); // m_score, m_pos_2D, m_bb
+        stream.advance(4 + 8);       // m_mask.header: seq, stamp
+        skipBytes(stream);           //   frame_id
+        stream.advance(4 + 4);       // m_mask.height, width
+        skipBytes(stream);           // m_mask.encoding
+        stream.advance(1 + 4);       // m_mask.is_bigendian, step
+        skipBytes(stream);           // m_mask.data
+        stream.advance(4 + 12 + 8 + 8); // m_angle, m_speed, m_timestamp, m_proc_timestamp
+        stream.advance(4);           // m_source
+    }
+};
+
+}
+}
+
+#endif // _FILTERED_DETECTIONS_
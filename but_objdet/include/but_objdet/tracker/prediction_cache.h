@@ -0,0 +1,159 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Cache of results of prediction requests shared by clients
+ * asking for the same predictions.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _PREDICTION_CACHE_
+#define _PREDICTION_CACHE_
+
+#include <cstddef>
+#include <map>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+
+namespace but_objdet
+{
+
+/**
+ * A cache of results (of type T) of requests (identified by Key) computed
+ * from one generation of data, e.g. from one snapshot of tracks. Entries
+ * are dropped as soon as a request for a newer generation comes, so the
+ * cache never returns a result of older data.
+ *
+ * Each entry has its own mutex held by the thread computing the result,
+ * so concurrent identical requests wait for that thread instead of
+ * computing the result again:
+ *
+ *   EntryPtr entry = cache.get(generation, key);
+ *   if(entry) {
+ *       boost::mutex::scoped_lock lock(entry->mutex);
+ *       if(!entry->result) entry->result = compute();
+ *   }
+ *
+ * All methods can be called from several threads.
+ */
+template <typename Key, typename T>
+class PredictionCache
+{
+public:
+    typedef boost::shared_ptr<const T> ResultPtr;
+
+    /**
+     * A cached result.
+     */
+    struct Entry
+    {
+        boost::mutex mutex; // Held while the result is being computed
+        ResultPtr result;   // NULL until the result is computed
+    };
+
+    typedef boost::shared_ptr<Entry> EntryPtr;
+
+    /**
+     * Constructor.
+     * @param maxEntries  Maximal number of results of one generation (0 =
+     * caching is disabled).
+     */
+    PredictionCache(size_t maxEntries_ = 16)
+        : maxEntries(maxEntries_), generation(0), nHits(0), nMisses(0)
+    {}
+
+    /**
+     * Sets the maximal number of results of one generation.
+     */
+    void setMaxEntries(size_t n)
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        maxEntries = n;
+    }
+
+    /**
+     * Returns the entry of a request (a new one is created if there is none).
+     * @param gen  Generation of the data the result is computed from.
+     * @param key  The request.
+     * @return  NULL if the result can't be cached (the data is older than
+     * the cached results or the cache is full).
+     */
+    EntryPtr get(uint32_t gen, const Key& key)
+    {
+        boost::mutex::scoped_lock lock(mutex);
+
+        // Newer data => all the results are invalid (the difference
+        // handles overflow of the generation)
+        if(maxEntries == 0 || (int32_t)(gen - generation) < 0) {
+            return EntryPtr();
+        }
+        if(gen != generation) {
+            entries.clear();
+            generation = gen;
+        }
+
+        typename Entries::iterator it = entries.find(key);
+        if(it != entries.end()) {
+            nHits++;
+            return it->second;
+        }
+
+        nMisses++;
+        if(entries.size() >= maxEntries) {
+            return EntryPtr();
+        }
+
+        EntryPtr entry(new Entry);
+        entries[key] = entry;
+        return entry;
+    }
+
+    /**
+     * Number of requests answered from the cache / computed since the start.
+     */
+    void stats(uint64_t& hits, uint64_t& misses)
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        hits = nHits;
+        misses = nMisses;
+    }
+
+private:
+    typedef std::map<Key, EntryPtr> Entries;
+
+    PredictionCache(const PredictionCache&);
+    PredictionCache& operator=(const PredictionCache&);
+
+    Entries entries;
+    size_t maxEntries;
+    uint32_t generation;
+    uint64_t nHits;
+    uint64_t nMisses;
+    boost::mutex mutex;
+};
+
+}
+
+#endif // _PREDICTION_CACHE_
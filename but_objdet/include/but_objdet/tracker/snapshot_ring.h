@@ -0,0 +1,156 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: A ring of immutable snapshots published by one writer and
+ * read by any number of readers without locks.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _SNAPSHOT_RING_
+#define _SNAPSHOT_RING_
+
+#include <cstddef>
+#include <sched.h>
+
+
+namespace but_objdet
+{
+
+/**
+ * A ring of N snapshots of type T. The writer prepares a new snapshot in
+ * a slot, which is neither the current one nor pinned by a reader, and
+ * publishes it by switching the index of the current slot. A reader pins
+ * the current slot for the time it reads it, so the slot is not reused
+ * until the reader releases it.
+ *
+ * Readers never wait for the writer or each other (they just retry if the
+ * current slot changes while being pinned), the writer waits only if all
+ * the other slots are pinned. Slots are reused, so storage (e.g. vectors)
+ * of older snapshots is recycled by the writer.
+ *
+ * Only one writer may call acquireWrite() / publish() at a time.
+ */
+template <typename T, int N = 4>
+class SnapshotRing
+{
+public:
+    /**
+     * A reader's reference to the current snapshot (the slot is pinned
+     * until the reference is destroyed).
+     */
+    class ReadRef
+    {
+    public:
+        explicit ReadRef(SnapshotRing& r) : ring(r), slot(r.pin()) {}
+        ~ReadRef() { ring.unpin(slot); }
+
+        const T& operator*() const { return ring.slots[slot]; }
+        const T* operator->() const { return &ring.slots[slot]; }
+
+    private:
+        ReadRef(const ReadRef&);
+        ReadRef& operator=(const ReadRef&);
+
+        SnapshotRing& ring;
+        int slot;
+    };
+
+    SnapshotRing() : current(0), writing(-1)
+    {
+        for(int i = 0; i < N; i++) pins[i] = 0;
+    }
+
+    /**
+     * Returns a slot to be filled by the writer (it contains an older
+     * snapshot, which can be either overwritten or updated).
+     */
+    T& acquireWrite()
+    {
+        for(;;) {
+            int cur = current;
+            for(int i = 1; i < N; i++) {
+                int s = (cur + i) % N;
+                if(pins[s] == 0) {
+                    writing = s;
+                    return slots[s];
+                }
+            }
+
+            // All the other slots are being read
+            sched_yield();
+        }
+    }
+
+    /**
+     * Makes the slot returned by the last acquireWrite() the current one.
+     */
+    void publish()
+    {
+        if(writing < 0) return;
+
+        // The snapshot has to be written before it is visible to readers
+        __sync_synchronize();
+        current = writing;
+        __sync_synchronize();
+        writing = -1;
+    }
+
+    /**
+     * The current snapshot seen by the writer (only the writer may use it
+     * without pinning, readers use ReadRef).
+     */
+    const T& last() const { return slots[current]; }
+
+private:
+    int pin()
+    {
+        for(;;) {
+            int s = current;
+            __sync_fetch_and_add(&pins[s], 1);
+
+            // The writer could have started to reuse the slot before it was
+            // pinned, it never reuses the current slot though
+            if(s == current) return s;
+
+            __sync_fetch_and_sub(&pins[s], 1);
+        }
+    }
+
+    void unpin(int s)
+    {
+        __sync_fetch_and_sub(&pins[s], 1);
+    }
+
+    SnapshotRing(const SnapshotRing&);
+    SnapshotRing& operator=(const SnapshotRing&);
+
+    T slots[N];
+    volatile int pins[N];
+    volatile int current;
+    int writing;
+};
+
+}
+
+#endif // _SNAPSHOT_RING_
@@ -0,0 +1,182 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Calibrated cameras producing detections and tables of objects
+ * identified by detectors of each camera.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _SOURCE_FUSION_
+#define _SOURCE_FUSION_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "but_objdet_msgs/Detection.h"
+
+// Maximal number of sources (sources of a track are kept as a bit mask)
+#define BUT_OBJDET_MAX_SOURCES 32
+
+
+namespace but_objdet
+{
+
+/**
+ * A calibrated camera. Its pose is given in a frame common to all cameras
+ * (in units of the depth of detections), the camera looks along its z axis
+ * with x pointing to the right and y down in the image.
+ */
+struct CameraModel
+{
+    CameraModel();
+
+    /**
+     * Sets the pose of the camera in the common frame.
+     * @param translation  Position of the camera (x, y, z).
+     * @param rotation  Orientation of the camera as a quaternion (x, y, z, w).
+     */
+    void setPose(const double translation[3], const double rotation[4]);
+
+    /**
+     * Transforms a point in the image with its depth into the common frame.
+     */
+    void toCommon(float u, float v, float depth, float p[3]) const;
+
+    /**
+     * Projects a point of the common frame into the image.
+     * @return  False if the point is not in front of the camera.
+     */
+    bool toImage(const float p[3], float &u, float &v, float &depth) const;
+
+    std::string frameId;  // Frame of detections of the camera
+    float fx, fy, cx, cy; // Intrinsic parameters [px]
+    float R[9];           // Rotation from the camera to the common frame (row-major)
+    float t[3];           // Position of the camera in the common frame
+};
+
+/**
+ * An object identified by a detector of a source, which is assigned to a track.
+ */
+struct SourceBinding
+{
+    SourceBinding(int source_, int objClass_, int localId_, int trackId_)
+        : source(source_), objClass(objClass_), localId(localId_), trackId(trackId_)
+    {}
+
+    int source;
+    int objClass;
+    int localId;   // ID assigned by the detector
+    int trackId;
+};
+
+/**
+ * Sources (cameras) of detections received by one tracker. A detection is
+ * transferred into the image of another camera using its position and depth
+ * (m_pos_2D) and poses of both cameras, so that tracks of all the cameras
+ * can be compared and updated in images of their own cameras.
+ *
+ * IDs assigned by detectors are valid just within their source, so each
+ * source has a table mapping IDs of its objects to IDs of tracks.
+ */
+class SourceFusion
+{
+public:
+    /**
+     * Adds a source.
+     * @return  Index of the source (m_source of its detections).
+     */
+    int addSource(const CameraModel &camera);
+
+    /**
+     * Tests if any sources are given (detections are not fused otherwise).
+     */
+    bool enabled() const { return !cameras.empty(); }
+
+    unsigned int size() const { return cameras.size(); }
+    const CameraModel &camera(int source) const { return cameras[source]; }
+
+    /**
+     * Returns the source of a detection - the source with the frame of
+     * the detection, or m_source if the frame is not known.
+     * @return  Index of the source, or -1 if it is not valid.
+     */
+    int sourceOf(const but_objdet_msgs::Detection &det) const;
+
+    /**
+     * Transfers a detection into the image of another source (the mask
+     * is left out, because it isn't valid in the other image).
+     * @param det  Detection with a valid m_source.
+     * @param to  The other source.
+     * @param out  (output) Detection in the image of the other source.
+     * @return  False if the detection has no depth or it isn't in front
+     * of the other camera.
+     */
+    bool transfer(const but_objdet_msgs::Detection &det, int to,
+                  but_objdet_msgs::Detection &out) const;
+
+    /**
+     * Adds a detection into an average of detections (combined measurements
+     * of one object by several sources).
+     * @param det  The detection (in the image of the average).
+     * @param count  Number of detections in the average so far.
+     * @param average  The average.
+     */
+    static void combine(const but_objdet_msgs::Detection &det, unsigned int count,
+                        but_objdet_msgs::Detection &average);
+
+    /**
+     * Returns the track of an object identified by a detector of a source.
+     * @return  ID of the track, or Detection::NO_ID.
+     */
+    int lookup(int source, int objClass, int localId) const;
+
+    /**
+     * Assigns a track to an object identified by a detector of a source
+     * (the track has to exist, it is unbound when it is removed).
+     */
+    void bind(int source, int objClass, int localId, int trackId);
+    void bind(const SourceBinding &b) { bind(b.source, b.objClass, b.localId, b.trackId); }
+
+    /**
+     * Tests if any object of a source is assigned to a track.
+     */
+    bool bound(int source, int objClass, int trackId) const;
+
+    /**
+     * Removes all assignments of a removed track.
+     */
+    void unbind(int objClass, int trackId);
+
+private:
+    typedef std::pair<int, int> ObjectKey; // Class and ID
+
+    std::vector<CameraModel> cameras;
+    std::vector<std::map<ObjectKey, int> > tables; // IDs of tracks of each source
+    std::multimap<ObjectKey, std::pair<int, int> > bindings; // Track -> source and its ID
+};
+
+}
+
+#endif // _SOURCE_FUSION_
@@ -0,0 +1,146 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Uniform grid over bounding boxes of tracked objects answering
+ * region and nearest neighbour queries.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _SPATIAL_GRID_
+#define _SPATIAL_GRID_
+
+#include <cstddef>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+
+namespace but_objdet
+{
+
+/**
+ * A bounding box with floating point coordinates.
+ */
+struct GridBox
+{
+    GridBox() : x(0), y(0), width(0), height(0) {}
+    GridBox(float x_, float y_, float w_, float h_) : x(x_), y(y_), width(w_), height(h_) {}
+
+    float x, y, width, height;
+};
+
+/**
+ * A uniform grid of cells, each cell lists boxes overlapping it. The lists
+ * are stored in one array (compressed rows), so the grid is built by two
+ * passes over the boxes and queries don't follow any pointers.
+ *
+ * Items are identified by indices of the boxes passed to build().
+ */
+class SpatialGrid
+{
+public:
+    /**
+     * Decides if an item can be returned by nearest().
+     */
+    class Filter
+    {
+    public:
+        virtual ~Filter() {}
+        virtual bool accept(uint32_t item) const = 0;
+    };
+
+    /**
+     * Constructor.
+     * @param cellSize  Size of a cell (e.g. in pixels), it is increased if the
+     * grid would have more than maxCells cells in one direction.
+     * @param maxCells  Maximal number of cells in one direction.
+     */
+    SpatialGrid(float cellSize = 64, int maxCells = 256);
+
+    /**
+     * Sets the size of a cell (used by the next build()).
+     */
+    void setCellSize(float cellSize);
+
+    /**
+     * Builds the grid over the given boxes (boxes with a negative size are
+     * not inserted).
+     */
+    void build(const std::vector<GridBox>& boxes);
+
+    /**
+     * Number of indexed boxes.
+     */
+    size_t size() const { return boxes.size(); }
+
+    /**
+     * Finds boxes intersecting a region.
+     * @param region  The region.
+     * @param result  (output) Indices of the boxes (each just once).
+     */
+    void queryRegion(const GridBox& region, std::vector<uint32_t>& result) const;
+
+    /**
+     * Finds k boxes nearest to a point (the distance to a box is zero if
+     * the point is inside it).
+     * @param x, y  The point.
+     * @param k  Maximal number of returned boxes.
+     * @param result  (output) Indices of the boxes from the nearest one.
+     * @param filter  If not NULL, only accepted boxes are returned.
+     */
+    void nearest(float x, float y, unsigned int k, std::vector<uint32_t>& result,
+                 const Filter *filter = NULL) const;
+
+    /**
+     * Squared distance of a point to a box.
+     */
+    static float distance2(const GridBox& box, float x, float y);
+
+private:
+    /**
+     * Column / row of a cell containing a coordinate (clamped to the grid).
+     */
+    int column(float x) const;
+    int row(float y) const;
+
+    /**
+     * Adds accepted boxes listed in a cell to candidates of nearest().
+     */
+    void collect(int c, int r, float x, float y, const Filter *filter,
+                 std::vector<std::pair<float, uint32_t> >& candidates) const;
+
+    float cellSize;
+    float cell;            // Size of a cell used by the current grid
+    int maxCells;
+    float originX, originY;
+    int cols, rows;
+
+    std::vector<uint32_t> cellStart; // Start of the list of each cell in items
+    std::vector<uint32_t> items;     // Lists of boxes overlapping cells
+    std::vector<GridBox> boxes;
+};
+
+}
+
+#endif // _SPATIAL_GRID_
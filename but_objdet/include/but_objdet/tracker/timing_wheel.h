@@ -0,0 +1,123 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Hierarchical timing wheel used for expiry of tracks.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _TIMING_WHEEL_
+#define _TIMING_WHEEL_
+
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+// Number of levels of the wheel and number of buckets of each level
+// (4 levels of 64 buckets cover 2^24 ticks)
+#define TIMING_WHEEL_LEVELS 4
+#define TIMING_WHEEL_BITS   6
+#define TIMING_WHEEL_SIZE   (1 << TIMING_WHEEL_BITS)
+
+
+namespace but_objdet
+{
+
+/**
+ * A hierarchical timing wheel. Timers are scheduled, rescheduled and
+ * cancelled in constant time; advancing the time costs one step per
+ * elapsed tick plus occasional cascading of timers from higher levels.
+ * The time is given from outside (e.g. stamps of received messages),
+ * so the wheel works with simulated time as well.
+ */
+class TimingWheel
+{
+public:
+    typedef uint32_t TimerId;
+    static const TimerId INVALID_TIMER = 0xffffffff;
+
+    /**
+     * Constructor.
+     * @param tickMs  Resolution of the wheel in miliseconds.
+     */
+    TimingWheel(int64_t tickMs = 10);
+
+    /**
+     * Schedules a timer.
+     * @param payload  Value returned when the timer expires.
+     * @param expiresMs  Time of expiry in miliseconds.
+     * @return  Id of the timer.
+     */
+    TimerId schedule(uint64_t payload, int64_t expiresMs);
+
+    /**
+     * Changes the time of expiry of a timer.
+     */
+    void reschedule(TimerId id, int64_t expiresMs);
+
+    /**
+     * Cancels a timer (ids of expired or cancelled timers are ignored).
+     */
+    void cancel(TimerId id);
+
+    /**
+     * Advances the time of the wheel (moving it backwards is ignored).
+     * @param nowMs  Current time in miliseconds.
+     * @param expired  (output) Payloads of expired timers are appended here.
+     */
+    void advance(int64_t nowMs, std::vector<uint64_t>& expired);
+
+    /**
+     * Number of scheduled timers.
+     */
+    size_t size() const { return count; }
+
+private:
+    struct Timer
+    {
+        uint64_t payload;
+        int64_t expires;     // Tick of expiry
+        TimerId prev;
+        TimerId next;
+        int16_t level;       // -1 = not scheduled
+        int16_t bucket;
+    };
+
+    void link(TimerId id);
+    void unlink(TimerId id);
+    void fire(int level, int bucket, std::vector<uint64_t>& expired);
+    void cascade(int level, int bucket);
+
+    int64_t tickMs;
+    int64_t now;             // Current tick
+    bool started;            // The time was set by the first advance()
+    std::vector<Timer> timers;
+    std::vector<TimerId> freeTimers;
+    TimerId heads[TIMING_WHEEL_LEVELS][TIMING_WHEEL_SIZE];
+    size_t count;
+};
+
+}
+
+#endif // _TIMING_WHEEL_
+
@@ -0,0 +1,189 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Limits of the number of tracks with eviction of the least
+ * valuable ones.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _TRACK_EVICTION_
+#define _TRACK_EVICTION_
+
+#include <cstddef>
+#include <map>
+#include <set>
+#include <stdint.h>
+
+
+namespace but_objdet
+{
+
+/**
+ * Number of tracks removed because of the limits.
+ */
+struct EvictionCounters
+{
+    EvictionCounters() : evicted(0), rejected(0) {}
+
+    uint64_t evicted;  // Tracks removed to make room for new ones
+    uint64_t rejected; // New tracks not created (less valuable than all others)
+};
+
+/**
+ * Keeps the number of tracks (of all classes and of each class) under
+ * limits. Tracks are ordered by a priority combining the score of the last
+ * detection and the time of the last update, a new track replaces the one
+ * with the lowest priority when a limit is reached.
+ *
+ * The priority is the time of the update shifted by score * scoreWeight,
+ * i.e. a detection with the score 1.0 keeps the track as long as a more
+ * recent update by scoreWeight miliseconds would. It doesn't change between
+ * updates, so tracks are kept in ordered sets and all operations take
+ * O(log n) time.
+ *
+ * Tracks are identified by a key given by the caller (e.g. a TrackHandle),
+ * the caller keeps the priority of each track. The class isn't thread-safe.
+ */
+class TrackEviction
+{
+public:
+    /**
+     * Result of admit().
+     */
+    enum Admission
+    {
+        ADMIT,  // There is room for a new track
+        EVICT,  // A track has to be removed first
+        REJECT  // The new track shouldn't be created
+    };
+
+    /**
+     * Constructor.
+     * @param maxTracks  Maximal number of tracks (0 = unlimited).
+     * @param maxClassTracks  Maximal number of tracks of one class (0 = unlimited).
+     * @param scoreWeight  Weight of the detection score [ms].
+     */
+    TrackEviction(size_t maxTracks = 0, size_t maxClassTracks = 0, int64_t scoreWeight = 1000);
+
+    /**
+     * Sets the limits and the weight of the score (see the constructor),
+     * the current tracks are evicted by the next admit().
+     */
+    void setLimits(size_t maxTracks, size_t maxClassTracks, int64_t scoreWeight);
+
+    /**
+     * Sets the maximal number of tracks of a class (0 = unlimited).
+     */
+    void setClassLimit(int objClass, size_t maxTracks);
+
+    /**
+     * Maximal number of tracks of a class.
+     */
+    size_t classLimit(int objClass) const;
+
+    /**
+     * Priority of a track (tracks with a lower priority are evicted first).
+     * @param score  Score of the last detection (clamped to [0, 1]).
+     * @param timeMs  Time of the last update.
+     */
+    int64_t priority(float score, int64_t timeMs) const;
+
+    /**
+     * Decides if a new track can be created. It has to be called again
+     * after the returned victim is removed (there can be more of them
+     * after the limits were lowered).
+     * @param objClass  Class of the new track.
+     * @param priority  Priority of the new track.
+     * @param victim  (output) Key of the track to be removed (EVICT only).
+     * @param victimClass  (output) Class of the track to be removed (EVICT only).
+     */
+    Admission admit(int objClass, int64_t priority, uint64_t& victim, int& victimClass);
+
+    /**
+     * Adds a track.
+     */
+    void insert(int objClass, uint64_t key, int64_t priority);
+
+    /**
+     * Removes a track.
+     * @param priority  The last priority of the track.
+     */
+    void remove(int objClass, uint64_t key, int64_t priority);
+
+    /**
+     * Changes the priority of a track after its update.
+     */
+    void update(int objClass, uint64_t key, int64_t oldPriority, int64_t newPriority);
+
+    /**
+     * Number of tracks.
+     */
+    size_t size() const { return all.size(); }
+
+    /**
+     * Maximal number of tracks (0 = unlimited).
+     */
+    size_t limit() const { return maxTracks; }
+
+    /**
+     * Number of removed tracks of each class since the start.
+     */
+    const std::map<int, EvictionCounters>& counters() const { return classCounters; }
+
+    /**
+     * Number of removed tracks of all classes since the start.
+     */
+    const EvictionCounters& totals() const { return totalCounters; }
+
+private:
+    struct Entry
+    {
+        Entry(int64_t p, uint64_t k, int c) : priority(p), key(k), objClass(c) {}
+
+        bool operator<(const Entry& e) const
+        {
+            return (priority != e.priority) ? priority < e.priority : key < e.key;
+        }
+
+        int64_t priority;
+        uint64_t key;
+        int objClass;
+    };
+
+    typedef std::set<Entry> Entries;
+
+    size_t maxTracks;
+    size_t maxClassTracks;
+    int64_t scoreWeight;
+    std::map<int, size_t> classLimits;
+
+    Entries all;                          // Tracks of all classes
+    std::map<int, Entries> classes;       // Tracks of each class
+    std::map<int, EvictionCounters> classCounters;
+    EvictionCounters totalCounters;
+};
+
+}
+
+#endif // _TRACK_EVICTION_
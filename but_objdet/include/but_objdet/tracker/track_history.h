@@ -0,0 +1,150 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Bounded history of filtered states of tracks stored in one
+ * pooled arena.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _TRACK_HISTORY_
+#define _TRACK_HISTORY_
+
+#include <cstddef>
+#include <map>
+#include <vector>
+#include <stdint.h>
+
+
+namespace but_objdet
+{
+
+/**
+ * One sample of the history - the filtered bounding box and its velocity.
+ */
+struct HistorySample
+{
+    int64_t msTime;       // Time of the update in miliseconds
+    float position[4];    // x, y, width, height
+    float velocity[4];    // Velocities of the above [px/s]
+};
+
+/**
+ * A ring buffer of samples of one track, the samples are stored in the arena.
+ */
+struct HistoryRing
+{
+    enum { INVALID = 0xffffffff };
+
+    HistoryRing() : offset(INVALID), capacity(0), head(0), count(0) {}
+
+    bool valid() const { return offset != INVALID; }
+
+    uint32_t offset;   // The first sample of the ring in the arena
+    uint32_t capacity; // Number of samples of the ring
+    uint32_t head;     // Position of the next sample to be written
+    uint32_t count;    // Number of valid samples
+};
+
+/**
+ * An arena, from which rings of all tracks are allocated. Released rings
+ * are kept in free lists (by their capacity) and reused by new tracks, so
+ * the memory doesn't grow above the configured number of samples.
+ *
+ * Capacity of rings can be set for each class of objects separately.
+ * The arena isn't thread-safe.
+ */
+class HistoryArena
+{
+public:
+    /**
+     * Constructor.
+     * @param maxSamples  Maximal number of samples of all the tracks.
+     * @param defaultCapacity  Number of samples of one track.
+     */
+    HistoryArena(size_t maxSamples = 100000, uint32_t defaultCapacity = 100);
+
+    /**
+     * Sets limits of the arena (the already allocated rings are not changed).
+     * @param maxSamples  Maximal number of samples of all the tracks.
+     * @param defaultCapacity  Number of samples of one track.
+     */
+    void setLimits(size_t maxSamples, uint32_t defaultCapacity);
+
+    /**
+     * Sets the number of samples of tracks of a class (0 = no history).
+     */
+    void setClassCapacity(int objClass, uint32_t capacity);
+
+    /**
+     * Number of samples of tracks of a class.
+     */
+    uint32_t classCapacity(int objClass) const;
+
+    /**
+     * Allocates a ring for a new track of a class.
+     * @return  False if the arena is full (the ring stays invalid).
+     */
+    bool allocate(HistoryRing& ring, int objClass);
+
+    /**
+     * Returns the ring of a removed track to the arena.
+     */
+    void release(HistoryRing& ring);
+
+    /**
+     * Adds a sample into a ring (the oldest sample is overwritten if the ring is full).
+     * Samples of a ring are kept in the order of their time.
+     * @return  False if the sample is older than the newest one in the ring
+     * (it isn't added then).
+     */
+    bool push(HistoryRing& ring, const HistorySample& sample);
+
+    /**
+     * Returns samples of a ring from a time window.
+     * @param ring  The ring.
+     * @param fromMs, toMs  The window in miliseconds (inclusive).
+     * @param decimation  Every decimation-th sample is returned (counted from
+     * the newest one in the window, 0 and 1 = all samples).
+     * @param samples  (output) Samples from the oldest one.
+     */
+    void query(const HistoryRing& ring, int64_t fromMs, int64_t toMs, unsigned int decimation,
+               std::vector<HistorySample>& samples) const;
+
+    /**
+     * Number of samples allocated to tracks.
+     */
+    size_t used() const { return usedSamples; }
+
+private:
+    std::vector<HistorySample> samples;
+    std::map<uint32_t, std::vector<uint32_t> > freeRings; // Offsets of free rings by capacity
+    std::map<int, uint32_t> capacities;                   // Capacity of each class
+    size_t maxSamples;
+    uint32_t defaultCapacity;
+    size_t usedSamples;
+};
+
+}
+
+#endif // _TRACK_HISTORY_
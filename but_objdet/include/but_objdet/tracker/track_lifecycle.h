@@ -0,0 +1,149 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Lifecycle of tracks (tentative -> confirmed -> lost -> removed).
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _TRACK_LIFECYCLE_
+#define _TRACK_LIFECYCLE_
+
+#include <vector>
+#include <stdint.h>
+
+#include "but_objdet/tracker/timing_wheel.h"
+
+// States of a track (the values are bits, so that they can be combined into
+// a mask; they are equal to the constants of TrackState message)
+#define BUT_OBJDET_TRACK_TENTATIVE  1
+#define BUT_OBJDET_TRACK_CONFIRMED  2
+#define BUT_OBJDET_TRACK_LOST       4
+
+
+namespace but_objdet
+{
+
+/**
+ * Lifecycle data of a track.
+ */
+struct TrackStatus
+{
+    TrackStatus()
+        : state(BUT_OBJDET_TRACK_TENTATIVE), hits(0), misses(0)
+        , timer(TimingWheel::INVALID_TIMER)
+    {}
+
+    uint8_t state;       // BUT_OBJDET_TRACK_*
+    int hits;            // Number of detections
+    int misses;          // Number of consecutive frames without detection
+    TimingWheel::TimerId timer; // Expiry timer
+};
+
+/**
+ * A class managing states of tracks:
+ *  - a new track is tentative until it is detected confirmHits times,
+ *  - a tentative track missed in more than tentativeMaxMisses consecutive
+ *    frames is removed,
+ *  - a confirmed track missed in maxMisses consecutive frames is lost,
+ *  - a lost track detected again is confirmed again,
+ *  - any track not detected for expiryMs is removed.
+ * The expiry is driven by the time of received data through a timing wheel,
+ * i.e. it doesn't depend on the number of tracks or on the frame rate.
+ */
+class TrackLifecycle
+{
+public:
+    /**
+     * Constructor.
+     * @param confirmHits  Number of detections needed to confirm a track.
+     * @param tentativeMaxMisses  Number of misses tolerated for a tentative track.
+     * @param maxMisses  Number of misses after which a track is lost.
+     * @param expiryMs  Time without detection after which a track is removed.
+     */
+    TrackLifecycle(int confirmHits = 3, int tentativeMaxMisses = 1,
+                   int maxMisses = 5, int64_t expiryMs = 5000);
+
+    /**
+     * Changes the parameters (see the constructor).
+     */
+    void setParams(int confirmHits, int tentativeMaxMisses, int maxMisses, int64_t expiryMs);
+
+    /**
+     * Starts the lifecycle of a new (already detected) track.
+     * @param status  Status of the track.
+     * @param key  Value identifying the track returned by expire().
+     * @param timeMs  Time of the detection.
+     */
+    void created(TrackStatus& status, uint64_t key, int64_t timeMs);
+
+    /**
+     * Continues the lifecycle of a restored track (the state and counters
+     * of the status are kept).
+     * @param status  Status of the track.
+     * @param key  Value identifying the track returned by expire().
+     * @param timeMs  Time of the last detection.
+     */
+    void restored(TrackStatus& status, uint64_t key, int64_t timeMs);
+
+    /**
+     * Time without detection after which a track is removed.
+     */
+    int64_t expiry() const { return expiryMs; }
+
+    /**
+     * The track was detected.
+     */
+    void hit(TrackStatus& status, int64_t timeMs);
+
+    /**
+     * The track was not detected in a frame, where it could be.
+     * @return  True if the track should be removed.
+     */
+    bool miss(TrackStatus& status);
+
+    /**
+     * The track is removed (before its expiry).
+     */
+    void removed(TrackStatus& status);
+
+    /**
+     * Advances the time.
+     * @param timeMs  Current time.
+     * @param expired  (output) Keys of expired tracks (they are already
+     * considered removed, i.e. removed() mustn't be called for them).
+     */
+    void expire(int64_t timeMs, std::vector<uint64_t>& expired);
+
+private:
+    int confirmHits;
+    int tentativeMaxMisses;
+    int maxMisses;
+    int64_t expiryMs;
+    TimingWheel wheel;
+};
+
+}
+
+#endif // _TRACK_LIFECYCLE_
+
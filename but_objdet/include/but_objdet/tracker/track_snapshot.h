@@ -0,0 +1,237 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Immutable snapshot of tracks answering prediction requests
+ * independently of the tracker updating the tracks.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _TRACK_SNAPSHOT_
+#define _TRACK_SNAPSHOT_
+
+#include <map>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+#include "but_objdet_msgs/Detection.h"
+#include "but_objdet_msgs/TrackState.h"
+#include "but_objdet/tracker/tracker_kalman.h"
+#include "but_objdet/tracker/tracker_imm.h"
+#include "but_objdet/tracker/spatial_grid.h"
+
+// Number of tracked parameters (x, y, width and height of the bounding box)
+#define BUT_OBJDET_TRACK_PARAMS 4
+
+
+namespace but_objdet
+{
+
+/**
+ * A copy of the filtered state of one track. Predictions are computed
+ * in a closed form from the state, so any number of threads can use the
+ * view at once without touching the filter.
+ */
+struct TrackView
+{
+    /**
+     * Fills the view from a filter (the state of the filter is not changed).
+     * @param tracker  Kalman filter of the track.
+     * @return  False if the filter doesn't provide its state.
+     */
+    bool setState(TrackerKalman& tracker);
+    bool setState(IMMTracker& tracker);
+
+    /**
+     * Fills the view from a state received from a tracker (e.g. in
+     * a PredictionArray), so that it can be extrapolated to another time.
+     * @param det  The detection corresponding to the state.
+     * @param state  Filtered state of the track.
+     * @param ms  Time of the state in miliseconds.
+     */
+    void fromState(const but_objdet_msgs::Detection& det,
+                   const but_objdet_msgs::TrackState& state, int64 ms);
+
+    /**
+     * Predicts the detection of the object for the given time.
+     * @param ms  Miliseconds passed since the last update of the track.
+     * @param state  (output) If not NULL, the predicted filtered state (with
+     * a compact covariance) is stored here.
+     * @return  The last detection moved to the predicted position, with speed
+     * set from the filtered velocity.
+     */
+    but_objdet_msgs::Detection predict(int64 ms, but_objdet_msgs::TrackState *state = NULL) const;
+
+    /**
+     * Predicts just the bounding box (cheaper than predict(), e.g. to filter
+     * tracks before their predictions are made).
+     * @param ms  Miliseconds passed since the last update of the track.
+     * @param bb  (output) x, y, width and height of the bounding box.
+     */
+    void predictBox(int64 ms, float bb[BUT_OBJDET_TRACK_PARAMS]) const;
+
+    /**
+     * Change of the position caused by a unit acceleration in t seconds.
+     */
+    float accelTerm(float t) const
+    {
+        if(nDerivs != 3) return 0.0f;
+        return kinematic ? 0.5f * t * t : 0.5f * t;
+    }
+
+    but_objdet_msgs::Detection det; // The last detection
+    int64 msTime;                   // Time of the last update in miliseconds
+    uint8_t state;                  // BUT_OBJDET_TRACK_* state
+    bool hasState;                  // The filtered state is valid
+    int nDerivs;                    // Number of derivates in the state (2 or 3)
+    bool kinematic;                 // The acceleration moves the position by t^2/2
+                                    // (by t/2 as in TrackerKalman otherwise)
+    float x[BUT_OBJDET_TRACK_PARAMS][3]; // Position, velocity, acceleration
+    float P[BUT_OBJDET_TRACK_PARAMS][6]; // Unique entries of the 3x3 covariance
+    float q[BUT_OBJDET_TRACK_PARAMS][3]; // Diagonal of the process noise
+};
+
+/**
+ * Tracks at the time of the last update of the tracker. A snapshot isn't
+ * changed once it is published (see SnapshotRing).
+ *
+ * Boxes of the tracks at the time of the snapshot (the filtered box of
+ * tracks updated at that time, the predicted one of the others) are indexed
+ * by a spatial grid.
+ */
+class TrackSnapshot
+{
+public:
+    typedef std::vector<uint32_t> IndexList;
+
+    TrackSnapshot() : count(0), frameNum(0), generationNum(0), timeMs(0) {}
+
+    /**
+     * Starts a new snapshot (storage of the previous content is kept).
+     * @param frame  Number of the tracker update.
+     * @param generation  Number of the snapshot (tracks can be published
+     * several times between updates by detections, e.g. after optical flow).
+     * @param time  Time of the update in miliseconds.
+     */
+    void clear(uint32_t frame, uint32_t generation, int64 time);
+
+    /**
+     * Sets the size of a cell of the spatial index (used by the next finish()).
+     */
+    void setCellSize(float cellSize) { grid.setCellSize(cellSize); }
+
+    /**
+     * Adds a track, its state has to be filled by the caller.
+     * @return  The view of the track.
+     */
+    TrackView& add(int objClass, int id);
+
+    /**
+     * Builds lookup structures, it has to be called after all tracks are added.
+     */
+    void finish();
+
+    /**
+     * Views of all the tracks.
+     */
+    const std::vector<TrackView>& views() const { return tracks; }
+
+    /**
+     * Indices of all the tracks of a class.
+     */
+    const IndexList& classIndices(int objClass) const;
+
+    /**
+     * Index of the track of the given class and id or -1 if there is none.
+     */
+    int find(int objClass, int id) const;
+
+    /**
+     * Finds tracks of all classes with the given id.
+     * @param result  (output) Indices of the tracks.
+     */
+    void findId(int id, IndexList& result) const;
+
+    /**
+     * Finds tracks, whose box intersects a region.
+     * @param result  (output) Indices of the tracks.
+     */
+    void queryRegion(const GridBox& region, IndexList& result) const { grid.queryRegion(region, result); }
+
+    /**
+     * Finds k tracks nearest to a point.
+     * @param result  (output) Indices of the tracks from the nearest one.
+     * @param filter  If not NULL, only accepted tracks are returned.
+     */
+    void nearest(float x, float y, unsigned int k, IndexList& result,
+                 const SpatialGrid::Filter *filter = NULL) const
+    {
+        grid.nearest(x, y, k, result, filter);
+    }
+
+    /**
+     * Box of a track at the time of the snapshot.
+     */
+    const GridBox& box(uint32_t index) const { return boxes[index]; }
+
+    /**
+     * Number of the tracker update the snapshot was made after.
+     */
+    uint32_t frame() const { return frameNum; }
+
+    /**
+     * Number of the snapshot, it differs for any two published snapshots
+     * (results computed from a snapshot can be cached under it).
+     */
+    uint32_t generation() const { return generationNum; }
+
+    /**
+     * Time of the tracker update in miliseconds.
+     */
+    int64 time() const { return timeMs; }
+
+private:
+    typedef std::pair<uint64_t, uint32_t> KeyIndex;
+
+    static uint64_t key(int objClass, int id)
+    {
+        return ((uint64_t)(uint32_t)objClass << 32) | (uint32_t)id;
+    }
+
+    std::vector<TrackView> tracks;
+    std::vector<KeyIndex> keys;          // Sorted by key
+    std::vector<KeyIndex> ids;           // Sorted by object id
+    std::map<int, IndexList> classes;
+    std::vector<GridBox> boxes;          // Boxes at the time of the snapshot
+    SpatialGrid grid;                    // Index of the boxes
+    IndexList empty;
+    uint32_t count;
+    uint32_t frameNum;
+    uint32_t generationNum;
+    int64 timeMs;
+};
+
+}
+
+#endif // _TRACK_SNAPSHOT_
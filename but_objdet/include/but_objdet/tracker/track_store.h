@@ -0,0 +1,189 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Tracks and states of their filters saved into a file, so that
+ * a restarted tracker continues tracking.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _TRACK_STORE_
+#define _TRACK_STORE_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "but_objdet_msgs/Detection.h"
+
+/*
+ * The file consists of a TrackFileHeader followed by nClasses StoredClass
+ * records, nTracks StoredTrack records and a data section with serialized
+ * Detection messages (each padded to a multiple of 8 bytes). All records
+ * have fixed sizes, so they are used directly in the mapped file.
+ *
+ * A new version of the format has to change BUT_OBJDET_TRACKS_VERSION,
+ * files of other versions are ignored.
+ */
+
+#define BUT_OBJDET_TRACKS_MAGIC    "BODTRK\0"
+#define BUT_OBJDET_TRACKS_VERSION  2
+
+// Maximal size of a stored filter state (4 parameters with 2 derivates)
+#define BUT_OBJDET_STORED_STATE    12
+
+
+namespace but_objdet
+{
+
+/**
+ * Header of the file.
+ */
+struct TrackFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t trackSize;    // sizeof(StoredTrack)
+    int64_t time;          // Time of the last update of the tracks [ms]
+    uint32_t frame;        // Number of the last update
+    uint32_t nClasses;
+    uint32_t nTracks;
+    uint32_t dataSize;     // Size of the data section
+};
+
+/**
+ * The last ID assigned by the tracker to an object of a class.
+ */
+struct StoredClass
+{
+    int32_t objClass;
+    int32_t lastId;
+};
+
+/**
+ * A track and the state of its Kalman filter.
+ */
+struct StoredTrack
+{
+    int32_t objClass;
+    int32_t id;
+    int64_t msTime;           // Time of the last update [ms]
+    uint8_t state;            // BUT_OBJDET_TRACK_*
+    uint8_t secDerivate;      // The filter estimates acceleration
+    uint16_t stateSize;       // Size of the filter state
+    int32_t hits;             // Lifecycle counters
+    int32_t misses;
+    uint32_t detectionOffset; // The last detection in the data section
+    uint32_t detectionSize;
+    uint32_t reserved;
+    float x[BUT_OBJDET_STORED_STATE];                           // Filtered state
+    float P[BUT_OBJDET_STORED_STATE * BUT_OBJDET_STORED_STATE]; // Its covariance (stateSize x stateSize)
+};
+
+/**
+ * Collects tracks and writes them into a file. The file is written under
+ * a temporary name and renamed, so a reader never sees a partially written
+ * file (and a crash during writing leaves the previous file).
+ */
+class TrackStoreWriter
+{
+public:
+    /**
+     * Starts a new content of the file.
+     * @param time  Time of the last update of the tracks [ms].
+     * @param frame  Number of the last update.
+     */
+    void clear(int64_t time, uint32_t frame);
+
+    /**
+     * Adds the last ID assigned to objects of a class.
+     */
+    void addClass(int objClass, int lastId);
+
+    /**
+     * Adds a track (detectionOffset and detectionSize are filled here).
+     * @param track  The track.
+     * @param det  The last detection of the track.
+     */
+    void addTrack(const StoredTrack& track, const but_objdet_msgs::Detection& det);
+
+    /**
+     * Writes the collected tracks into a file.
+     * @return  False if the file can't be written.
+     */
+    bool write(const std::string& filename);
+
+private:
+    TrackFileHeader header;
+    std::vector<StoredClass> classes;
+    std::vector<StoredTrack> tracks;
+    std::vector<uint8_t> data;
+};
+
+/**
+ * Reads tracks from a file written by TrackStoreWriter. The file is mapped
+ * into memory and the tracks are read in place.
+ */
+class TrackStoreReader
+{
+public:
+    TrackStoreReader();
+    ~TrackStoreReader();
+
+    /**
+     * Maps the file into memory.
+     * @return  False if the file doesn't exist or is not valid.
+     */
+    bool open(const std::string& filename);
+
+    /**
+     * Unmaps the file.
+     */
+    void close();
+
+    const TrackFileHeader& header() const { return *fileHeader; }
+    const StoredClass& storedClass(uint32_t i) const { return classes[i]; }
+    const StoredTrack& track(uint32_t i) const { return tracks[i]; }
+
+    /**
+     * Deserializes the last detection of a track.
+     * @return  False if the detection can't be deserialized.
+     */
+    bool detection(uint32_t i, but_objdet_msgs::Detection& det) const;
+
+private:
+    TrackStoreReader(const TrackStoreReader&);
+    TrackStoreReader& operator=(const TrackStoreReader&);
+
+    const uint8_t *base;
+    size_t length;
+    const TrackFileHeader *fileHeader;
+    const StoredClass *classes;
+    const StoredTrack *tracks;
+    const uint8_t *data;
+};
+
+}
+
+#endif // _TRACK_STORE_
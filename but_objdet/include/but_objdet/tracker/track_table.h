@@ -0,0 +1,318 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Flat storage of tracked objects addressed by (class, id).
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _TRACK_TABLE_
+#define _TRACK_TABLE_
+
+#include <cstddef>
+#include <map>
+#include <vector>
+#include <stdint.h>
+
+
+namespace but_objdet
+{
+
+/**
+ * A handle of a track stored in TrackTable. A handle of a removed track
+ * is detected (its generation doesn't match the slot any more), so handles
+ * can be kept outside the table safely.
+ */
+struct TrackHandle
+{
+    TrackHandle() : slot(0xffffffff), generation(0) {}
+    TrackHandle(uint32_t s, uint32_t g) : slot(s), generation(g) {}
+
+    bool valid() const { return slot != 0xffffffff; }
+    bool operator==(const TrackHandle& h) const { return slot == h.slot && generation == h.generation; }
+    bool operator!=(const TrackHandle& h) const { return !(*this == h); }
+
+    uint32_t slot;
+    uint32_t generation;
+};
+
+/**
+ * A slot map storing tracks (values of type T) in one contiguous array.
+ * Removed slots are reused, a track is found by (class, id) through
+ * an open-addressing hash table and tracks of all classes / of one class
+ * are iterated over dense lists of slot indices, so all operations take
+ * a constant time regardless of the number of tracks.
+ *
+ * Values are stored inline in the slots, i.e. they are copied when the
+ * array grows (reserve() can be used to avoid it). A pointer to a value is
+ * valid until the next insertion, a handle until the track is removed.
+ */
+template <typename T>
+class TrackTable
+{
+public:
+    typedef std::vector<uint32_t> SlotList;
+
+    TrackTable() : count(0) { rehash(16); }
+
+    /**
+     * Reserves space for the given number of tracks.
+     */
+    void reserve(size_t n)
+    {
+        slots.reserve(n);
+        all.reserve(n);
+        if(n * 2 > hash.size()) rehash(n * 2);
+    }
+
+    /**
+     * Number of stored tracks.
+     */
+    size_t size() const { return count; }
+
+    /**
+     * Inserts a new track (an existing track with the same class and id
+     * is replaced).
+     * @return  Handle of the track.
+     */
+    TrackHandle insert(int objClass, int id, const T& value)
+    {
+        TrackHandle h = find(objClass, id);
+        if(h.valid()) {
+            slots[h.slot].value = value;
+            return h;
+        }
+
+        uint32_t s;
+        if(!freeSlots.empty()) {
+            s = freeSlots.back();
+            freeSlots.pop_back();
+            slots[s].value = value;
+        }
+        else {
+            s = slots.size();
+            slots.push_back(Slot());
+            slots[s].value = value;
+            slots[s].generation = 1;
+        }
+
+        Slot &slot = slots[s];
+        slot.objClass = objClass;
+        slot.id = id;
+        slot.used = true;
+
+        // Grow the hash table before the slot is listed, rehash() inserts
+        // all the listed slots and the new one is inserted just below
+        if((count + 1) * 2 > hash.size()) rehash(hash.size() * 2);
+
+        slot.allIndex = all.size();
+        all.push_back(s);
+
+        SlotList &list = classLists[objClass];
+        slot.classIndex = list.size();
+        list.push_back(s);
+
+        hashInsert(s);
+        count++;
+
+        return TrackHandle(s, slot.generation);
+    }
+
+    /**
+     * Finds a track.
+     * @return  Handle of the track (invalid if there is no such track).
+     */
+    TrackHandle find(int objClass, int id) const
+    {
+        size_t mask = hash.size() - 1;
+        for(size_t i = hashKey(objClass, id) & mask; hash[i] != EMPTY; i = (i + 1) & mask) {
+            const Slot &slot = slots[hash[i]];
+            if(slot.objClass == objClass && slot.id == id) {
+                return TrackHandle(hash[i], slot.generation);
+            }
+        }
+        return TrackHandle();
+    }
+
+    /**
+     * Returns the track of the given handle (NULL if it was removed).
+     */
+    T *get(const TrackHandle& h)
+    {
+        if(h.slot >= slots.size() || !slots[h.slot].used || slots[h.slot].generation != h.generation) {
+            return NULL;
+        }
+        return &slots[h.slot].value;
+    }
+
+    /**
+     * Removes a track.
+     * @return  False if the track was already removed.
+     */
+    bool erase(const TrackHandle& h)
+    {
+        if(!get(h)) return false;
+
+        uint32_t s = h.slot;
+        Slot &slot = slots[s];
+
+        hashErase(s);
+
+        // Remove from the dense lists (the last item is moved to its place)
+        uint32_t last = all.back();
+        all[slot.allIndex] = last;
+        slots[last].allIndex = slot.allIndex;
+        all.pop_back();
+
+        SlotList &list = classLists[slot.objClass];
+        last = list.back();
+        list[slot.classIndex] = last;
+        slots[last].classIndex = slot.classIndex;
+        list.pop_back();
+
+        slot.value = T(); // Release resources held by the value
+        slot.used = false;
+        slot.generation++;
+        freeSlots.push_back(s);
+        count--;
+
+        return true;
+    }
+
+    /**
+     * Removes all tracks.
+     */
+    void clear()
+    {
+        slots.clear();
+        freeSlots.clear();
+        all.clear();
+        classLists.clear();
+        count = 0;
+        rehash(16);
+    }
+
+    /**
+     * Slot indices of all tracks.
+     */
+    const SlotList& allSlots() const { return all; }
+
+    /**
+     * Slot indices of tracks of the given class.
+     */
+    const SlotList& classSlots(int objClass) const
+    {
+        typename ClassLists::const_iterator it = classLists.find(objClass);
+        return (it != classLists.end()) ? it->second : emptyList;
+    }
+
+    /**
+     * Access to a track by its slot index (from allSlots() or classSlots()).
+     */
+    T& at(uint32_t s) { return slots[s].value; }
+    const T& at(uint32_t s) const { return slots[s].value; }
+    int classOf(uint32_t s) const { return slots[s].objClass; }
+    int idOf(uint32_t s) const { return slots[s].id; }
+    TrackHandle handleOf(uint32_t s) const { return TrackHandle(s, slots[s].generation); }
+
+private:
+    struct Slot
+    {
+        Slot() : objClass(0), id(0), generation(0), allIndex(0), classIndex(0), used(false) {}
+
+        T value;
+        int objClass;
+        int id;
+        uint32_t generation;
+        uint32_t allIndex;     // Position in the list of all tracks
+        uint32_t classIndex;   // Position in the list of tracks of the class
+        bool used;
+    };
+
+    typedef std::map<int, SlotList> ClassLists;
+
+    enum { EMPTY = 0xffffffff }; // Empty entry of the hash table
+
+    static size_t hashKey(int objClass, int id)
+    {
+        uint64_t k = ((uint64_t)(uint32_t)objClass << 32) | (uint32_t)id;
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        return (size_t)k;
+    }
+
+    void hashInsert(uint32_t s)
+    {
+        size_t mask = hash.size() - 1;
+        size_t i = hashKey(slots[s].objClass, slots[s].id) & mask;
+        while(hash[i] != EMPTY) i = (i + 1) & mask;
+        hash[i] = s;
+    }
+
+    // Linear probing with backward shift deletion (no tombstones are needed)
+    void hashErase(uint32_t s)
+    {
+        size_t mask = hash.size() - 1;
+        size_t i = hashKey(slots[s].objClass, slots[s].id) & mask;
+        while(hash[i] != s) i = (i + 1) & mask;
+
+        size_t j = i;
+        for(;;) {
+            hash[i] = EMPTY;
+            for(;;) {
+                j = (j + 1) & mask;
+                if(hash[j] == EMPTY) return;
+                size_t home = hashKey(slots[hash[j]].objClass, slots[hash[j]].id) & mask;
+                // Move the entry if its home position is not in (i, j]
+                if(i <= j ? (home <= i || home > j) : (home <= i && home > j)) break;
+            }
+            hash[i] = hash[j];
+            i = j;
+        }
+    }
+
+    void rehash(size_t n)
+    {
+        size_t capacity = 16;
+        while(capacity < n) capacity <<= 1;
+
+        hash.assign(capacity, (uint32_t)EMPTY);
+        for(size_t i = 0; i < all.size(); i++) {
+            hashInsert(all[i]);
+        }
+    }
+
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+    std::vector<uint32_t> hash;
+    SlotList all;
+    ClassLists classLists;
+    SlotList emptyList;
+    size_t count;
+};
+
+}
+
+#endif // _TRACK_TABLE_
+
@@ -74,6 +74,19 @@ public:
 	 * counted from the measurement and prediction.
 	*/
     virtual const cv::Mat& update(const cv::Mat& measurement, int64 miliseconds) = 0;
+
+    /**
+     * Prediction of the full state, i.e. of the measured parameters and their
+     * derivatives, together with its uncertainty.
+     * @param miliseconds  Number of miliseconds passed since the last update
+     * (0 = the current filtered state).
+     * @param state  (output) A matrix with a row for each parameter and columns
+     * for position, velocity and acceleration (CV_32F).
+     * @param covariance  (output) A matrix with a row for each parameter and
+     * columns for var(p), cov(p,v), cov(p,a), var(v), cov(v,a), var(a) (CV_32F).
+     * @return  False if the tracker doesn't provide its state.
+     */
+    virtual bool predictState(int64 /*miliseconds*/, cv::Mat& /*state*/, cv::Mat& /*covariance*/) { return false; }
 };
 
 }
@@ -0,0 +1,159 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Visual tracker moving a bounding box by sparse optical flow
+ * of feature points inside it.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _TRACKER_FLOW_
+#define _TRACKER_FLOW_
+
+#include <vector>
+#include "but_objdet/tracker/visual_tracker.h"
+
+namespace but_objdet
+{
+
+class TrackerFlow;
+
+/**
+ * Consecutive images shared by flow trackers. Points of all the trackers
+ * are followed into a new image by one call of the pyramidal Lucas-Kanade
+ * method, so pyramids of the images are built once per image, not once
+ * per tracker.
+ */
+class FlowFrames
+{
+public:
+    /**
+     * Constructor.
+     * @param window  Size of the window of the Lucas-Kanade method.
+     * @param levels  Number of levels of the pyramids.
+     */
+    FlowFrames(cv::Size window = cv::Size(15, 15), int levels = 3);
+    ~FlowFrames();
+
+    /**
+     * Follows points of all the trackers from the previous image into the
+     * next one. It has to be called for every image, before init() or update()
+     * of the trackers.
+     * @param gray  Grayscale image (CV_8U).
+     */
+    void next(const cv::Mat& gray);
+
+    /**
+     * The last image.
+     */
+    const cv::Mat& current() const { return frame; }
+
+private:
+    friend class TrackerFlow;
+
+    FlowFrames(const FlowFrames&);
+    FlowFrames& operator=(const FlowFrames&);
+
+    std::vector<TrackerFlow *> trackers;
+    cv::Mat frame;
+    cv::Size window;
+    int levels;
+
+    // Buffers of points of all the trackers (reused between images)
+    std::vector<cv::Point2f> prevPoints, nextPoints;
+    std::vector<uchar> status;
+    std::vector<float> errors;
+};
+
+/**
+ * A visual tracker moving a bounding box by the median motion of feature
+ * points inside it (and scaling it by the median change of their distances).
+ * Points are found again when too many of them are lost. The motion is
+ * measured, so it doesn't depend on any motion model.
+ *
+ * Trackers are moved by FlowFrames::next(), update() just returns the result
+ * for the last image. The confidence is the fraction of points, which were
+ * followed successfully.
+ */
+class TrackerFlow : public VisualTracker
+{
+public:
+    /**
+     * Constructor.
+     * @param frames  Images shared by the trackers (it must exist longer than
+     * the tracker).
+     * @param maxPoints  Maximal number of points in the box.
+     * @param minTracked  The object is lost if a lower fraction of points is
+     * followed.
+     */
+    TrackerFlow(FlowFrames *frames, int maxPoints = 20, float minTracked = 0.5f);
+    virtual ~TrackerFlow();
+
+    /**
+     * Implementation of the virtual function from the VisualTracker abstract
+     * class (the image has to be the last image given to FlowFrames::next()).
+     */
+    bool init(const cv::Mat& gray, const cv::Rect& bb);
+
+    /**
+     * Implementation of the virtual function from the VisualTracker abstract
+     * class (the image has to be the last image given to FlowFrames::next()).
+     */
+    bool update(const cv::Mat& gray, cv::Rect& bb);
+
+    /**
+     * Implementation of the virtual function from the VisualTracker abstract class.
+     */
+    float confidence() const { return tracked; }
+
+private:
+    friend class FlowFrames;
+
+    TrackerFlow(const TrackerFlow&);
+    TrackerFlow& operator=(const TrackerFlow&);
+
+    /**
+     * Finds points to be followed inside the box.
+     */
+    void seed(const cv::Mat& gray);
+
+    /**
+     * Moves the box according to the followed points.
+     * @param moved  New positions of the points.
+     * @param status  Nonzero for points, which were followed.
+     */
+    void move(const cv::Point2f *moved, const uchar *status, const cv::Mat& gray);
+
+    FlowFrames *frames;
+    int maxPoints;
+    float minTracked;
+
+    std::vector<cv::Point2f> points; // Points in the last image
+    cv::Rect_<float> box;            // The box in the last image
+    bool lost;
+    float tracked;                   // Fraction of points followed into the last image
+};
+
+}
+
+#endif // _TRACKER_FLOW_
@@ -0,0 +1,218 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Tracker mixing Kalman filters with several motion models (IMM).
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _TRACKER_IMM_
+#define _TRACKER_IMM_
+
+#include <vector>
+#include "but_objdet/tracker/tracker.h"
+#include "but_objdet/tracker/worker_pool.h"
+
+namespace but_objdet
+{
+
+/**
+ * A tracker based on the Interacting Multiple Model estimator. Three Kalman
+ * filters with different motion models - constant position (standing
+ * objects), constant velocity and constant acceleration (maneuvering ones) -
+ * run in parallel, their states are mixed before each update according to
+ * probabilities of the models, which follow how well each filter predicted
+ * the measurements. The estimate is the mixture of the filters, so a standing
+ * object isn't moved by a noisy velocity and a turning one isn't lost.
+ *
+ * Measured parameters are independent (as in TrackerKalman), so each filter
+ * is a fixed-size 3x3 Kalman filter of each parameter computed without any
+ * allocation. The state has the same layout as the one of TrackerKalman with
+ * the second derivate (positions, velocities, accelerations), so the tracker
+ * can replace it (the acceleration moves the position by t^2/2 though, see
+ * TrackView).
+ */
+class IMMTracker : public Tracker
+{
+public:
+    enum Model
+    {
+        CONSTANT_POSITION = 0,
+        CONSTANT_VELOCITY,
+        CONSTANT_ACCELERATION,
+        MODELS
+    };
+
+    enum { MAX_PARAMS = 4 };
+
+    /**
+     * Constructor.
+     * @param measurementNoise  Standard deviation of measurements [units].
+     * @param switchProbability  Probability of a change of the motion model
+     * between two updates.
+     */
+    IMMTracker(float measurementNoise = 10.0f, float switchProbability = 0.05f);
+
+    /**
+     * Copy constructor and assignment (copies don't share the returned matrices).
+     */
+    IMMTracker(const IMMTracker& imm);
+    IMMTracker& operator=(const IMMTracker& imm);
+
+    /**
+     * Implementation of the virtual function from the Tracker abstract class
+     * (at most MAX_PARAMS parameters, all the models are used regardless
+     * of secDerivate).
+     */
+    bool init(const cv::Mat& measurement, bool secDerivate = true);
+
+    /**
+     * Implementation of the virtual function from the Tracker abstract class.
+     */
+    const cv::Mat& predict(int64 miliseconds = 1000);
+
+    /**
+     * Implementation of the virtual function from the Tracker abstract class.
+     */
+    const cv::Mat& update(const cv::Mat& measurement, int64 miliseconds = 1000);
+
+    /**
+     * Implementation of the virtual function from the Tracker abstract class
+     * (the mean and the covariance of the mixture).
+     */
+    bool predictState(int64 miliseconds, cv::Mat& state, cv::Mat& covariance);
+
+    /**
+     * Updates several trackers. The filters of one model are updated for all
+     * the trackers at once (the same computation for each of them), groups of
+     * trackers are updated in parallel.
+     * @param trackers  The trackers.
+     * @param measurements  A measurement of each tracker.
+     * @param miliseconds  Time since the last update of each tracker.
+     * @param pool  Threads running the updates.
+     */
+    static void updateAll(const std::vector<IMMTracker *>& trackers,
+                          const std::vector<cv::Mat>& measurements,
+                          const std::vector<int64>& miliseconds,
+                          WorkerPool& pool = WorkerPool::shared());
+
+    /**
+     * Probability of a motion model.
+     */
+    float probability(Model model) const { return mu[model]; }
+
+    /**
+     * Process noise of the mixture for one second (diagonal, valid after init).
+     */
+    const cv::Mat& processNoiseCov() const { return noiseCov; }
+
+    /**
+     * State of the mixture and its covariance (empty before init).
+     */
+    const cv::Mat& statePost() const { return state; }
+    const cv::Mat& errorCovPost() const { return covariance; }
+
+    /**
+     * The state always contains the second derivate.
+     */
+    bool secondDerivate() const { return true; }
+
+    /**
+     * Initializes all the filters with a saved state (see statePost()).
+     * @param state  Mixed state (a column vector).
+     * @param covariance  Error covariance of the state.
+     * @param secDerivate  The state contains the second derivate.
+     * @return  False if sizes of the state and of the covariance don't match.
+     */
+    bool restore(const cv::Mat& state, const cv::Mat& covariance, bool secDerivate = true);
+
+    /**
+     * Moves the filtered state forward in time without a measurement.
+     * @param miliseconds  Elapsed time.
+     */
+    void advance(int64 miliseconds);
+
+private:
+    /**
+     * Kalman filter of one parameter (position, velocity, acceleration).
+     */
+    struct Filter
+    {
+        float x[3];
+        float P[3][3];
+    };
+
+    /**
+     * Mixes states of the filters according to the probabilities of models.
+     */
+    void mix();
+
+    /**
+     * Predicts and corrects the filter of a model.
+     * @param z  The measurement (nParams values).
+     * @return  Log-likelihood of the measurement.
+     */
+    float filter(int model, float seconds, const float *z);
+
+    /**
+     * Predicts the filter of a model without a measurement.
+     */
+    void propagate(int model, float seconds);
+
+    /**
+     * New probabilities of the models after a measurement.
+     */
+    void weigh(const float *logLikelihood);
+
+    /**
+     * Mixture of the filters (statePost() and errorCovPost()).
+     */
+    void combine();
+
+    /**
+     * Reads a measurement.
+     * @return  False if it doesn't have nParams values.
+     */
+    bool measurementValues(const cv::Mat& measurement, float *z) const;
+
+    /**
+     * Updates a group of trackers (see updateAll()).
+     */
+    static void updateGroup(size_t group, const std::vector<IMMTracker *> *trackers,
+                            const std::vector<cv::Mat> *measurements,
+                            const std::vector<int64> *miliseconds);
+
+    int nParams;
+    float measurementNoise;
+    float switchProbability;
+
+    Filter filters[MODELS][MAX_PARAMS];
+    float mu[MODELS];    // Probabilities of the models
+    float prior[MODELS]; // Probabilities of the models before the measurement
+
+    cv::Mat state, covariance, noiseCov, temp;
+};
+
+}
+
+#endif // _TRACKER_IMM_
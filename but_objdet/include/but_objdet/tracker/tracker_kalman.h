@@ -45,6 +45,13 @@ class TrackerKalman : public Tracker
 public:
     TrackerKalman();
     virtual ~TrackerKalman();
+
+    /**
+     * Copy constructor and assignment make a deep copy of the filter (trackers
+     * are stored by value in TrackTable, so copies must not share the state).
+     */
+    TrackerKalman(const TrackerKalman& tk);
+    TrackerKalman& operator=(const TrackerKalman& tk);
     
 	/**
      * Implementation of the virtual function from the Tracker abstract class.
@@ -61,6 +68,42 @@ public:
      */
 	const cv::Mat& update(const cv::Mat& measurement, int64 miliseconds = 1000);
 
+    /**
+     * Implementation of the virtual function from the Tracker abstract class.
+     */
+	bool predictState(int64 miliseconds, cv::Mat& state, cv::Mat& covariance);
+
+    /**
+     * Process noise covariance of the filter (valid after init).
+     */
+	const cv::Mat& processNoiseCov() const { return KF.processNoiseCov; }
+
+    /**
+     * Filtered state of the filter and its error covariance (empty before init).
+     */
+	const cv::Mat& statePost() const { return KF.statePost; }
+	const cv::Mat& errorCovPost() const { return KF.errorCovPost; }
+
+    /**
+     * Tests if the filter estimates the second derivate (acceleration).
+     */
+	bool secondDerivate() const { return _secDerivate; }
+
+    /**
+     * Initializes the filter with a saved state (see statePost()).
+     * @param state  Filtered state (a column vector).
+     * @param covariance  Error covariance of the state.
+     * @param secDerivate  The state contains the second derivate.
+     * @return  False if sizes of the state and of the covariance don't match.
+     */
+	bool restore(const cv::Mat& state, const cv::Mat& covariance, bool secDerivate = true);
+
+    /**
+     * Moves the filtered state forward in time without a measurement.
+     * @param miliseconds  Elapsed time.
+     */
+	void advance(int64 miliseconds);
+
 private:
     /**
      * Modification of Kalman filter's transition matrix according to elapsed time.
@@ -29,20 +29,100 @@
 #ifndef _TRACKER_KALMAN_NODE_
 #define _TRACKER_KALMAN_NODE_
 
+#include <deque>
 #include <map>
+#include <set>
 #include <ros/ros.h> // Main header of ROS
+#include <ros/callback_queue.h>
 #include <sensor_msgs/Image.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include "but_objdet_msgs/DetectionArray.h"
+#include "but_objdet_msgs/TrackState.h"
+#include "but_objdet_msgs/PredictionArray.h"
+#include "but_objdet/PredictDetections.h" // Autogenerated service class
+#include "but_objdet/PredictDetectionsBatch.h" // Autogenerated service class
+#include "but_objdet/GetObjects.h" // Autogenerated service class
+#include "but_objdet/GetTrackHistory.h" // Autogenerated service class
+#include "but_objdet/SetVisualization.h" // Autogenerated service class
 #include "but_objdet/tracker/tracker_kalman.h"
+#include "but_objdet/tracker/tracker_imm.h"
+#include "but_objdet/tracker/tracker_flow.h"
+#include "but_objdet/matcher/matcher_overlap.h"
+#include "but_objdet/tracker/track_table.h"
+#include "but_objdet/tracker/track_lifecycle.h"
+#include "but_objdet/tracker/track_history.h"
+#include "but_objdet/tracker/track_eviction.h"
+#include "but_objdet/tracker/track_store.h"
+#include "but_objdet/tracker/filtered_detections.h"
+#include "but_objdet/tracker/source_fusion.h"
+#include "but_objdet/tracker/track_snapshot.h"
+#include "but_objdet/tracker/snapshot_ring.h"
+#include "but_objdet/tracker/prediction_cache.h"
+#include "but_objdet/transport/shm_transport.h"
+#include "but_objdet/stats/latency_stats.h"
+#include "but_objdet/stats/metrics.h"
 
 
-// Indicates if to visualize detections and predictions in a window
-#define VISUAL_OUTPUT 1
+namespace but_objdet
+{
 
+/**
+ * A prediction request (used as a key of cached responses).
+ */
+struct PredictionKey
+{
+    PredictionKey(int64 time_, int classId_, int objectId_, uint8_t stateMask_, bool fullState_)
+        : time(time_), classId(classId_), objectId(objectId_)
+        , stateMask(stateMask_), fullState(fullState_)
+    {}
 
-namespace but_objdet
+    bool operator<(const PredictionKey &k) const
+    {
+        if(time != k.time) return time < k.time;
+        if(classId != k.classId) return classId < k.classId;
+        if(objectId != k.objectId) return objectId < k.objectId;
+        if(stateMask != k.stateMask) return stateMask < k.stateMask;
+        return fullState < k.fullState;
+    }
+
+    int64 time;
+    int classId;
+    int objectId;
+    uint8_t stateMask;
+    bool fullState;
+};
+
+typedef PredictionCache<PredictionKey, but_objdet::PredictDetections::Response> PredictionResponseCache;
+
+/**
+ * Identification of a received DetectionArray. Detectors on the same host
+ * publish their detections both through shared memory and to the topic,
+ * so the copy received later is recognized and ignored. Just the header
+ * is compared, the content of the copies can differ (e.g. masks aren't
+ * transferred through shared memory).
+ */
+struct DeliveryKey
 {
+    DeliveryKey(const but_objdet_msgs::DetectionArray &detArray)
+        : stamp(detArray.header.stamp.toNSec()), seq(detArray.header.seq)
+        , frameId(detArray.header.frame_id)
+    {}
+
+    bool operator==(const DeliveryKey &k) const
+    {
+        return stamp == k.stamp && seq == k.seq && frameId == k.frameId;
+    }
+
+    uint64_t stamp;
+    uint32_t seq;
+    std::string frameId;
+};
 
 /**
   * A structure storing data related to a detection of a particular object.
@@ -50,9 +130,16 @@ namespace but_objdet
 struct DetM
 {
     but_objdet_msgs::Detection det; // Detection
-    TrackerKalman *kf; // Kalman filter for tracking of this detection
-    int ttl; // Time to live
-    int msTime; // Time of detection in milliseconds
+    TrackerKalman kf; // Kalman filter for tracking of this detection
+    IMMTracker imm; // Filter with several motion models (used instead of kf if selected)
+    TrackStatus status; // State of the track
+    int64 msTime; // Time of detection in milliseconds
+    uint32_t frame; // Number of the last frame (DetectionArray) with this detection
+    HistoryRing history; // History of filtered states (stored in the arena)
+    int64 priority; // Priority of the track when tracks are evicted
+    uint32_t sources; // Sources, which detected the object in the last update (bit mask)
+    boost::shared_ptr<TrackerFlow> flow; // Optical flow tracking between detections (optional,
+                                         // FlowFrames refer to it, so it can't move with the slot)
 };
 
 /**
@@ -63,12 +150,34 @@ struct DetM
  * (either of all of the currently maintained or of some specified object class or
  * object id).
  *
+ * Detections are processed by one thread and the services by a pool of
+ * threads (each group has its own callback queue), so a burst of detections
+ * doesn't delay predictions and vice versa. After each update the tracks are
+ * published as an immutable snapshot, which the services read without locks.
+ *
+ * Tracks of different classes are independent, so classes can be split among
+ * several tracker nodes (shards), each of them tracking its own classes (see
+ * the classes parameter) and providing the services in its own namespace.
+ * TrackerRouter provides the services of all the shards under the usual names.
+ *
+ * One node can track objects seen by several cameras (sources, see the sources
+ * parameter). Each track is kept in the image of one camera, detections
+ * of the other cameras are transferred into it using their depth and poses
+ * of the cameras, and all detections of an object in one DetectionArray
+ * update its filter at once.
+ *
  * @author Tomas Hodan, Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
  */
 class TrackerKalmanNode
 {
 public:
-	TrackerKalmanNode();
+    /**
+     * Constructor.
+     * @param nh  NodeHandle used to advertise services and subscribe topics.
+     * @param pnh  Private NodeHandle used to read parameters.
+     */
+	TrackerKalmanNode(ros::NodeHandle nh = ros::NodeHandle(),
+	                  ros::NodeHandle pnh = ros::NodeHandle("~"));
 	~TrackerKalmanNode();
 
 private:
@@ -85,7 +194,25 @@ private:
      */
 	bool predictDetections(but_objdet::PredictDetections::Request &req,
 						   but_objdet::PredictDetections::Response &res);
+
+    /**
+     * Predicts tracks required by a request of the prediction service.
+     * @param snapshot  Snapshot of the tracks.
+     * @param key  The request.
+     * @param res  (output) Response of the service.
+     */
+	void makePredictions(const TrackSnapshot &snapshot, const PredictionKey &key,
+	                     but_objdet::PredictDetections::Response &res);
         
+    /**
+     * A function implementing the batch prediction service.
+     * @param req  Service request.
+     * @param res  Service response.
+     * @return  Success / failure of the service.
+     */
+	bool predictDetectionsBatch(but_objdet::PredictDetectionsBatch::Request &req,
+	                            but_objdet::PredictDetectionsBatch::Response &res);
+
     /**
      * A function implementing the get objects service.
      * @param req  Service request.
@@ -95,12 +222,54 @@ private:
 	bool getObjects(but_objdet::GetObjects::Request &req,
 						   but_objdet::GetObjects::Response &res);
 
+    /**
+     * A function implementing the track history service.
+     * @param req  Service request.
+     * @param res  Service response.
+     * @return  Success / failure of the service.
+     */
+	bool getTrackHistory(but_objdet::GetTrackHistory::Request &req,
+	                     but_objdet::GetTrackHistory::Response &res);
+
+    /**
+     * Selects tracks required by a service request.
+     * @param snapshot  Snapshot of the tracks.
+     * @param classId  Class of the tracks (-1 = all classes).
+     * @param objectId  Id of the track (-1 = all tracks of the class), without
+     * a class tracks of all classes with the id are selected.
+     * @param buffer  Storage for the result if it is not a list kept by the snapshot.
+     * @return  Indices of the selected tracks in the snapshot, or NULL if all
+     * the tracks are selected.
+     */
+	const TrackSnapshot::IndexList* selectTracks(const TrackSnapshot &snapshot,
+	                                             int classId, int objectId,
+	                                             TrackSnapshot::IndexList &buffer);
+
+    /**
+     * Publishes the current tracks as a new snapshot (called by the thread
+     * updating the tracks).
+     * @param time  Time of the update in miliseconds.
+     */
+	void publishSnapshot(int64 time);
+
+    /**
+     * Publishes predictions of all confirmed tracks.
+     * @param snapshot  Snapshot of the tracks.
+     * @param stamp  Time of the predictions.
+     */
+	void publishPredictions(const TrackSnapshot &snapshot, const ros::Time &stamp);
+
+    /**
+     * A timer callback publishing predictions at a fixed rate.
+     */
+	void predictionTimerCallback(const ros::WallTimerEvent &event);
+
     /**
      * Conversion from a ROS Time to miliseconds.
      * @param stamp  ROS Time.
      * @return  Miliseconds.
      */
-	int rosTimeToMs(ros::Time stamp);
+	int64 rosTimeToMs(ros::Time stamp);
 
     /**
      * A callback function called when new detections are received.
@@ -108,42 +277,304 @@ private:
      */
 	void newDataCallback(const but_objdet_msgs::DetectionArrayConstPtr &detArrayMsg);
 
+    /**
+     * Tests if detections are received for the first time (through shared
+     * memory or the topic).
+     * @param detArray  Received detections.
+     */
+	bool firstDelivery(const but_objdet_msgs::DetectionArray &detArray);
+
+    /**
+     * A callback function called when new detections are received by a shard
+     * (only detections of its classes are deserialized).
+     * @param detections  Detections of the classes of the shard.
+     */
+	void filteredDataCallback(const FilteredDetections::ConstPtr &detections);
+
+    /**
+     * Creates a message for received detections (used by the subscription
+     * of a shard).
+     */
+	FilteredDetections::Ptr createFilteredDetections();
+
+    /**
+     * A callback function called when new detections are received from
+     * the topic of a source.
+     * @param detArrayMsg  DetectionArray message.
+     * @param source  Index of the source.
+     */
+	void sourceDataCallback(const but_objdet_msgs::DetectionArrayConstPtr &detArrayMsg, int source);
+
+    /**
+     * Converts detections of several sources into measurements of tracks
+     * - each detection gets the ID of its track and it is transferred into
+     * the image of the track, detections of one track are averaged.
+     * @param detections  Received detections.
+     * @param time  Time of the detections in miliseconds.
+     * @param measurements  (output) Measurements of tracks.
+     * @param observers  (output) Sources of each measurement (bit masks).
+     * @param sourceMask  (output) Sources of the received detections (bit mask).
+     * @param bindings  (output) Objects identified by detectors, which get new
+     * tracks (they are bound, when the tracks are created).
+     */
+	void fuseDetections(const std::vector<but_objdet_msgs::Detection> &detections, int64 time,
+	                    std::vector<but_objdet_msgs::Detection> &measurements,
+	                    std::vector<uint32_t> &observers, uint32_t &sourceMask,
+	                    std::vector<SourceBinding> &bindings);
+
+    /**
+     * Matches detections of a source with predictions of tracks (each track
+     * is matched at most once).
+     * @param detections  Detections of the source.
+     * @param indices  Indices of the matched detections.
+     * @param source  The source.
+     * @param ownTracks  Match with tracks in the image of the source, or with
+     * tracks of other sources (transferred into the image).
+     * @param time  Time of the detections in miliseconds.
+     * @param claimed  Tracks already matched with detections of the source.
+     * @param ids  (output) IDs of the matched tracks (Detection::NO_ID if none).
+     */
+	void matchTracks(const std::vector<but_objdet_msgs::Detection> &detections,
+	                 const std::vector<unsigned int> &indices, int source, bool ownTracks,
+	                 int64 time, const std::set<std::pair<int, int> > &claimed,
+	                 std::vector<int> &ids);
+
+    /**
+     * Tests if tracks of a class are maintained by this node.
+     */
+	bool ownsClass(int objClass) const
+	{
+		return ownedClasses.empty() || ownedClasses.count(objClass) > 0;
+	}
+
+    /**
+     * Updates the track of a detection or creates a new one.
+     * @param det  Detection (with an ID).
+     * @param time  Time of the detection in miliseconds.
+     * @param sources  Sources, which detected the object (bit mask).
+     */
+	void updateTrack(const but_objdet_msgs::Detection &det, int64 time, uint32_t sources = 0);
+
+    /**
+     * Removes tracks with the lowest priority if a new track would exceed
+     * the limits of the number of tracks.
+     * @param objClass  Class of the new track.
+     * @param priority  Priority of the new track.
+     * @return  False if the new track shouldn't be created.
+     */
+	bool makeRoom(int objClass, int64 priority);
+
+    /**
+     * Removes a track with all its data (its lifecycle has to be finished
+     * by the caller).
+     * @param h  Handle of the track.
+     */
+	void eraseTrack(const TrackHandle &h);
+
+    /**
+     * Assigns IDs to detections without them by matching the detections
+     * with predictions of tracks (each track is matched at most once).
+     * @param detections  Received detections.
+     * @param indices  Indices of detections without an ID.
+     * @param time  Time of the detections in miliseconds.
+     * @param ids  (output) IDs of the detections given by indices.
+     */
+	void associateDetections(const std::vector<but_objdet_msgs::Detection> &detections,
+	                         const std::vector<unsigned int> &indices,
+	                         int64 time, std::vector<int> &ids);
+
+    /**
+     * Generates a new object ID unique within a class.
+     * @param objClass  Class of the object.
+     */
+	int getNewObjectID(int objClass);
+
+    /**
+     * Resets the filter of a new track selected by the motion_model parameter
+     * (just that one of the filters is used).
+     * @param detM  The track.
+     */
+	void createFilter(DetM &detM);
+
+    /**
+     * The filter of a track selected by the motion_model parameter.
+     * @param detM  The track.
+     */
+	Tracker &motion(DetM &detM) { return immTracking ? static_cast<Tracker &>(detM.imm) : detM.kf; }
+
     /**
      * A callback function called when a new Image is received. The image is used just
      * for visualization of detections and predictions, thus it doesn't influence
-     * functionality of this node in any way.
+     * functionality of this node in any way (it is just passed to the render
+     * thread, an image not rendered yet is replaced by the new one).
      * @param imageMsg  Image message.
      */
 	void newImageCallback(const sensor_msgs::ImageConstPtr &imageMsg);
 
     /**
-     * Memory of currently considered detections.
-     * 
+     * A callback function called when a new Image is received and tracks
+     * are followed by optical flow between detections. Boxes moved by the flow
+     * are used as measurements of the tracks (they don't count as detections
+     * in the lifecycle of the tracks).
+     * @param imageMsg  Image message.
+     */
+	void flowImageCallback(const sensor_msgs::ImageConstPtr &imageMsg);
+
+    /**
+     * The render thread - draws tracks into the latest received image
+     * and publishes it (at most at the visualization rate).
+     */
+	void renderLoop();
+
+    /**
+     * Draws tracks into an image and publishes it.
+     * @param imageMsg  Image message.
+     */
+	void renderImage(const sensor_msgs::ImageConstPtr &imageMsg);
+
+    /**
+     * A function implementing the service switching the visualization.
+     * @param req  Service request.
+     * @param res  Service response.
+     * @return  Success / failure of the service.
+     */
+	bool setVisualization(but_objdet::SetVisualization::Request &req,
+	                      but_objdet::SetVisualization::Response &res);
+
+    /**
+     * A timer callback writing latencies of received detections into the log.
      */
-	
-	typedef std::map<int, DetM> _DetMem; //m_id
-        typedef std::map<int, _DetMem> DetMem; //m_class
-        DetMem detectionMem;
+	void reportLatency(const ros::WallTimerEvent &event);
+
+    /**
+     * Writes all tracks into the track store file.
+     */
+	void saveTracks();
+
+    /**
+     * Restores tracks from the track store file (tracks are moved to the
+     * current time, expired tracks are left out).
+     * @return  Time of the restored tracks in miliseconds (0 if there are none).
+     */
+	int64 loadTracks();
+
+    /**
+     * A timer callback saving tracks periodically.
+     */
+	void trackStoreTimerCallback(const ros::WallTimerEvent &event);
+
+    /**
+     * A timer callback publishing the number of tracks, of tracks removed
+     * because of the limits and statistics of the prediction cache.
+     */
+	void publishDiagnostics(const ros::WallTimerEvent &event);
+
+    /**
+     * Memory of currently considered detections (tracks) addressed by class
+     * and id of the object.
+     */
+	TrackTable<DetM> tracks;
 
 	/**
-	 * If a detection of an object didn't occur in the specified number of
-	 * last detections (specified by a value of this variable),
-	 * it is not considered any more.
+	 * States of tracks (tentative, confirmed, lost) and their expiry when
+	 * an object isn't detected for some time.
 	 */
-	int defaultTtl;
+	TrackLifecycle lifecycle;
 
-    /**
-	 * If a detection of an object doesn't occur again during this period,
-	 * it is not considered any more.
+	/**
+	 * Number of received DetectionArrays.
 	 */
-	int defaultTtlTime;
+	uint32_t frameCounter;
+
+	/**
+	 * Number of published snapshots (tracks are also published after updates
+	 * by optical flow, so this isn't the number of frames).
+	 */
+	uint32_t snapshotCounter;
+
+	bool associateAnonymous; // Assign IDs to detections without them
+	MatcherOverlap matcher; // Matching of detections without IDs with tracks
+	std::map<int, int> lastObjectIDs; // Last assigned object ID of each class
+	double gridCellSize; // Size of a cell of the spatial index of tracks [px]
+	std::set<int> ownedClasses; // Classes tracked by this node (empty = all)
+	std::string serviceNamespace; // Prefix of names of services and topics of a shard
+	SourceFusion fusion; // Cameras, whose tracks are fused
+	std::vector<std::string> sourceTopics; // Topics of detections of each source ("" = the common one)
+	HistoryArena historyArena; // Storage of histories of all tracks
+	TrackEviction eviction; // Limits of the number of tracks
+	EvictionCounters reportedEvictions; // Totals at the time of the last diagnostics
+	bool flowTracking; // Tracks are followed by optical flow between detections
+	FlowFrames flowFrames; // Images shared by the flow trackers of all tracks
+	bool immTracking; // Tracks are filtered by IMMTracker instead of TrackerKalman
+
+    /**
+     * Guards tracks, which are updated from the ingest thread and from the
+     * thread reading detections from shared memory.
+     */
+    boost::mutex memMutex;
+
+    /**
+     * Snapshots of tracks read by the services and the visualization.
+     */
+	SnapshotRing<TrackSnapshot> snapshots;
+
+    /**
+     * Responses of the prediction service computed from the current snapshot
+     * (clients asking for predictions at the same time share them).
+     */
+	PredictionResponseCache predictionCache;
+	int predictionCacheQuantum; // Request times are rounded to multiples of this [ms]
+
+	ros::CallbackQueue ingestQueue; // Detections
+	ros::CallbackQueue serviceQueue; // Prediction and GetObjects services
+	boost::scoped_ptr<ros::AsyncSpinner> ingestSpinner;
+	boost::scoped_ptr<ros::AsyncSpinner> serviceSpinner;
 
     ros::NodeHandle nh; // NodeHandle is the main access point for communication with ROS system
+    ros::NodeHandle pnh; // Private NodeHandle (parameters of the node)
 	ros::ServiceServer predictionSRV;
+	ros::ServiceServer predictionBatchSRV;
 	ros::ServiceServer objectsSRV; //service for providing objects
+	ros::ServiceServer historySRV; // Service providing history of objects
 	ros::Subscriber detSub;
+	std::vector<ros::Subscriber> sourceSubs; // Topics of sources
+	ros::Publisher predictionsPub; // Predictions pushed to detectors
+	ros::WallTimer predictionTimer; // Publishing of predictions at a fixed rate
+	bool predictionsOnUpdate; // Publish predictions after every update
 	ros::Subscriber imgSub;
-	std::string winName;
+	ros::Subscriber flowSub; // Images for the optical flow (served by the ingest thread)
+	ShmDetectionSubscriber shmSub; // Detections received through shared memory
+	bool shmTransport; // Detections are received both through shared memory and the topic
+	std::deque<DeliveryKey> deliveries; // Arrays received just once so far
+	boost::mutex deliveryMutex; // Guards deliveries (shared memory and the topic have their own threads)
+	LatencyStats detectionLatency; // Capture -> detector output
+	LatencyStats transportLatency; // Detector output -> tracker input
+	LatencyStats inputLatency; // Capture -> tracker input
+	ros::WallTimer latencyTimer; // Periodic report of latencies
+	MetricsRegistry metrics; // Durations of processing (published with diagnostics)
+	MetricHistogram *ingestTime, *ingestWaitTime, *expireTime, *predictTime, *flowTime;
+	MetricCounter *detectionCount, *predictCount;
+	MetricGauge *trackCount;
+	ros::Publisher diagnosticsPub; // Track limits and evictions
+	std::string trackStoreFile; // Tracks are saved here for a restart ("" = never)
+	ros::WallTimer trackStoreTimer;
+	ros::WallTimer diagnosticsTimer;
+
+	bool visualOutput; // Publish images with detections and predictions
+	double visualizationRate; // Maximal rate of the images [Hz] (0 = no limit)
+	ros::Publisher annotatedPub; // Images with detections and predictions
+	ros::ServiceServer visualizationSRV; // Switching of the visualization
+	boost::mutex visualizationMutex; // Guards switching of the visualization
+
+    /**
+     * The render thread and the latest image waiting for it (the mutex guards
+     * the image and the rate).
+     */
+	boost::thread renderThread;
+	boost::mutex renderMutex;
+	boost::condition_variable renderCondition;
+	sensor_msgs::ImageConstPtr pendingImage;
+	bool renderRunning;
 };
 
 }
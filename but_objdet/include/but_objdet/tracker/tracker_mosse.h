@@ -0,0 +1,108 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Visual tracker based on an adaptive correlation filter (MOSSE).
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _TRACKER_MOSSE_
+#define _TRACKER_MOSSE_
+
+#include "but_objdet/tracker/visual_tracker.h"
+
+namespace but_objdet
+{
+
+/**
+ * A visual tracker based on the Minimum Output Sum of Squared Error filter
+ * (Bolme et al., 2010). The filter is learned in the frequency domain, so
+ * that its correlation with the image of the object gives a sharp peak
+ * in the center of the object. The object is found in the next image as the
+ * peak of the correlation and the filter is then adapted to the new image.
+ * The box keeps its size.
+ *
+ * The confidence is the peak-to-sidelobe ratio of the correlation (about
+ * 20-60 for a well tracked object, below 7 for a lost one).
+ */
+class TrackerMosse : public VisualTracker
+{
+public:
+    /**
+     * Constructor.
+     * @param maxSize  Maximal width and height of the filter (larger objects
+     * are tracked in downscaled images).
+     * @param learningRate  Weight of a new image in the adapted filter.
+     * @param minPsr  The object is lost if the confidence falls below it.
+     */
+    TrackerMosse(int maxSize = 64, float learningRate = 0.125f, float minPsr = 7.0f);
+
+    /**
+     * Implementation of the virtual function from the VisualTracker abstract class.
+     */
+    bool init(const cv::Mat& gray, const cv::Rect& bb);
+
+    /**
+     * Implementation of the virtual function from the VisualTracker abstract class.
+     */
+    bool update(const cv::Mat& gray, cv::Rect& bb);
+
+    /**
+     * Implementation of the virtual function from the VisualTracker abstract class.
+     */
+    float confidence() const { return psr; }
+
+private:
+    /**
+     * Returns the spectrum of the image around the center of the object.
+     */
+    void spectrum(const cv::Mat& gray, cv::Mat& F) const;
+
+    /**
+     * Returns the spectrum of a patch (normalized and windowed).
+     */
+    void patchSpectrum(const cv::Mat& patch, cv::Mat& F) const;
+
+    /**
+     * Adds a spectrum of the object into the filter.
+     * @param rate  Weight of the spectrum (1 = the filter is replaced).
+     */
+    void train(const cv::Mat& F, float rate);
+
+    int maxSize;
+    float learningRate;
+    float minPsr;
+
+    cv::Size filterSize;  // Size of the filter
+    float scale;          // Pixels of the image per pixel of the filter
+    cv::Size2f boxSize;   // Size of the bounding box
+    cv::Point2f center;   // Center of the object in the image
+    cv::Mat window;       // Cosine window reducing effects of edges of the patch
+    cv::Mat G;            // Spectrum of the desired output (a Gaussian peak)
+    cv::Mat A, B;         // Numerator and denominator of the filter
+    float psr;            // Peak-to-sidelobe ratio of the last update
+};
+
+}
+
+#endif // _TRACKER_MOSSE_
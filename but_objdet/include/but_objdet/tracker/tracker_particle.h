@@ -0,0 +1,158 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Tracker based on a particle filter.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _TRACKER_PARTICLE_
+#define _TRACKER_PARTICLE_
+
+#include <vector>
+#include "but_objdet/tracker/tracker.h"
+#include "but_objdet/tracker/worker_pool.h"
+
+namespace but_objdet
+{
+
+/**
+ * A tracker based on a particle filter. Each particle is a hypothesis of
+ * positions and velocities of the measured parameters, the velocities
+ * change randomly (so objects changing their motion abruptly, e.g. people,
+ * aren't lost like by the Kalman filter with constant acceleration).
+ * Particles are weighted by a Gaussian likelihood of measurements and
+ * resampled (systematic resampling) when too few of them have significant
+ * weights. If no particle explains a measurement, the filter starts again
+ * from the measurement.
+ *
+ * Particles are stored by components (all positions of the first parameter,
+ * all positions of the second one, ..., velocities), so that the propagation
+ * and the weighting are simple loops over arrays, which are vectorized by
+ * the compiler. Each tracker has its own random generator, so updates of
+ * several trackers can run in parallel (see updateAll()) with the same results.
+ */
+class ParticleTracker : public Tracker
+{
+public:
+    /**
+     * Constructor.
+     * @param particles  Number of particles.
+     * @param seed  Seed of the random generator (0 = a different one for each
+     * tracker, tests can set it to get repeatable results).
+     * @param positionNoise  Random change of positions [units/s^0.5].
+     * @param velocityNoise  Random change of velocities [units/s/s^0.5].
+     * @param measurementNoise  Standard deviation of measurements [units].
+     * The measurement noise has to be positive and the other ones non-negative,
+     * init() fails otherwise.
+     */
+    ParticleTracker(int particles = 256, uint64 seed = 0, float positionNoise = 2.0f,
+                    float velocityNoise = 20.0f, float measurementNoise = 10.0f);
+
+    /**
+     * Copy constructor and assignment (copies don't share the returned matrix).
+     */
+    ParticleTracker(const ParticleTracker& pt);
+    ParticleTracker& operator=(const ParticleTracker& pt);
+
+    /**
+     * Implementation of the virtual function from the Tracker abstract class.
+     * The motion model is always constant velocity with random changes (the
+     * acceleration isn't estimated, secDerivate is ignored).
+     */
+    bool init(const cv::Mat& measurement, bool secDerivate = true);
+
+    /**
+     * Implementation of the virtual function from the Tracker abstract class.
+     * The prediction is a column with positions followed by velocities.
+     */
+    const cv::Mat& predict(int64 miliseconds = 1000);
+
+    /**
+     * Implementation of the virtual function from the Tracker abstract class.
+     * The estimate is a column with positions followed by velocities.
+     */
+    const cv::Mat& update(const cv::Mat& measurement, int64 miliseconds = 1000);
+
+    /**
+     * Implementation of the virtual function from the Tracker abstract class.
+     */
+    bool predictState(int64 miliseconds, cv::Mat& state, cv::Mat& covariance);
+
+    /**
+     * Updates several trackers in parallel.
+     * @param trackers  The trackers.
+     * @param measurements  A measurement of each tracker.
+     * @param miliseconds  Time since the last update of each tracker.
+     * @param pool  Threads running the updates.
+     */
+    static void updateAll(const std::vector<ParticleTracker *>& trackers,
+                          const std::vector<cv::Mat>& measurements,
+                          const std::vector<int64>& miliseconds,
+                          WorkerPool& pool = WorkerPool::shared());
+
+    /**
+     * Number of particles.
+     */
+    int particleCount() const { return count; }
+
+private:
+    /**
+     * Moves the particles forward in time (with random changes).
+     */
+    void propagate(float seconds);
+
+    /**
+     * Weighted means of positions and velocities.
+     */
+    void estimate(std::vector<double>& means) const;
+
+    /**
+     * Replaces the particles by copies of them chosen according to their
+     * weights (systematic resampling).
+     */
+    void resample();
+
+    /**
+     * Spreads the particles around a measurement (with velocities around zero).
+     */
+    void spread(const cv::Mat& measurement);
+
+    float *component(int i) { return &particles[i * count]; }
+    const float *component(int i) const { return &particles[i * count]; }
+
+    int count;       // Number of particles
+    int nParams;     // Number of measured parameters
+    float positionNoise, velocityNoise, measurementNoise;
+    cv::RNG rng;
+
+    std::vector<float> particles; // Positions of all parameters, then velocities (count each)
+    std::vector<float> weights;   // Normalized weights of the particles
+    std::vector<float> noise, likelihood, resampled; // Buffers
+    std::vector<int> indices;
+    cv::Mat temp;
+};
+
+}
+
+#endif // _TRACKER_PARTICLE_
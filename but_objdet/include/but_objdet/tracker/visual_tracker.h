@@ -0,0 +1,74 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Interface of trackers following an object in images.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _VISUAL_TRACKER_
+#define _VISUAL_TRACKER_
+
+#include <opencv2/opencv.hpp>
+
+namespace but_objdet
+{
+
+/**
+ * An abstract class of trackers, which follow a bounding box of an object
+ * from one image to the next one (unlike Tracker, which predicts
+ * measurements without looking at the images). Detectors can use them to
+ * provide objects for frames between keyframes, where the full detection
+ * isn't run.
+ */
+class VisualTracker
+{
+public:
+	virtual ~VisualTracker() {}
+
+    /**
+     * Initialization with the first image of the object.
+     * @param gray  Grayscale image (CV_8U).
+     * @param bb  Bounding box of the object in the image.
+     * @return  False if the object cannot be tracked (e.g. the box is too small).
+     */
+    virtual bool init(const cv::Mat& gray, const cv::Rect& bb) = 0;
+
+    /**
+     * Finds the object in the next image.
+     * @param gray  Grayscale image (CV_8U).
+     * @param bb  (input/output) Bounding box of the object in the previous
+     * image, the box in the given image on return.
+     * @return  False if the object was lost (the box isn't changed then).
+     */
+    virtual bool update(const cv::Mat& gray, cv::Rect& bb) = 0;
+
+    /**
+     * Confidence of the last update (the scale depends on the tracker).
+     */
+    virtual float confidence() const = 0;
+};
+
+}
+
+#endif // _VISUAL_TRACKER_
@@ -0,0 +1,100 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Threads running the same job for many tracks in parallel.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _WORKER_POOL_
+#define _WORKER_POOL_
+
+#include <cstddef>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace but_objdet
+{
+
+/**
+ * A pool of threads, which run a job for a range of indices (e.g. updates
+ * of all tracks). The calling thread takes part in the job and run() returns
+ * when all the indices are done. Indices are taken one by one, so slower
+ * items don't hold the other threads.
+ */
+class WorkerPool
+{
+public:
+    typedef boost::function<void (size_t)> Job;
+
+    /**
+     * Constructor.
+     * @param threads  Number of threads besides the calling one (0 = the job
+     * runs just in the calling thread).
+     */
+    explicit WorkerPool(int threads);
+    ~WorkerPool();
+
+    /**
+     * The pool shared by all trackers of a process (one thread less than
+     * the number of cores).
+     */
+    static WorkerPool &shared();
+
+    /**
+     * Calls the job for indices 0 .. count-1 and waits for all of them.
+     * Concurrent calls are run one after another.
+     */
+    void run(size_t count, const Job &job);
+
+    /**
+     * Number of threads running a job including the calling one.
+     */
+    int size() const { return (int)threads.size() + 1; }
+
+private:
+    WorkerPool(const WorkerPool&);
+    WorkerPool& operator=(const WorkerPool&);
+
+    void workerLoop();
+    void work();
+
+    std::vector<boost::thread *> threads;
+    boost::mutex runMutex; // Serializes jobs
+    boost::mutex mutex;    // Guards the state of the current job
+    boost::condition_variable started, finished;
+
+    const Job *job;
+    size_t count;
+    volatile size_t next;  // Next index to be taken
+    unsigned int generation; // Number of started jobs
+    int busy;              // Threads working on the current job
+    bool stopping;
+};
+
+}
+
+#endif // _WORKER_POOL_
@@ -0,0 +1,207 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Shared-memory ring buffer transferring detections between
+ * nodes running on the same host.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _SHM_RING_
+#define _SHM_RING_
+
+#include <cstddef>
+#include <string>
+#include <stdint.h>
+
+// Maximal number of detections stored in one slot of the ring (a larger
+// DetectionArray is split into several consecutive slots)
+#define BUT_OBJDET_SHM_MAX_DETECTIONS 32
+
+// Maximal length of the frame_id of detections including the terminating zero
+// (a longer one is truncated)
+#define BUT_OBJDET_SHM_FRAME_ID 64
+
+// Slot flags
+#define BUT_OBJDET_SHM_LAST_PART 1     // the last slot of a DetectionArray
+
+
+namespace but_objdet
+{
+
+/**
+ * A fixed-layout record of one detection (the same items as Detection message,
+ * except the mask, which is not transferred through shared memory).
+ */
+struct ShmDetection
+{
+    int64_t m_timestamp;      // Capture time [ns]
+    int64_t m_proc_timestamp; // Detection time [ns]
+    int32_t m_id;
+    int32_t m_class;
+    float   m_score;
+    float   m_pos_2D[3];
+    int32_t m_bb[4];       // x, y, width, height
+    float   m_angle;
+    float   m_speed[3];
+    int32_t m_source;
+};
+
+/**
+ * One slot of the ring - a part of a DetectionArray.
+ */
+struct ShmDetectionSlot
+{
+    volatile uint64_t sequence; // Slot sequence number (managed by ShmRing)
+
+    int64_t  stamp;        // Header stamp of the DetectionArray [ns]
+    uint32_t frameSeq;     // Header seq of the DetectionArray
+    uint32_t part;         // Index of this part within the DetectionArray
+    uint32_t flags;        // BUT_OBJDET_SHM_* flags
+    uint32_t count;        // Number of valid detections
+    uint32_t producer;     // Producer of the slot (see ShmRing::addProducer())
+    int64_t  writeTime;    // CLOCK_MONOTONIC time of writing [ns]
+    char     frameId[BUT_OBJDET_SHM_FRAME_ID]; // Header frame_id of the DetectionArray
+
+    ShmDetection detections[BUT_OBJDET_SHM_MAX_DETECTIONS];
+};
+
+/**
+ * Header placed at the beginning of the shared memory segment.
+ */
+struct ShmRingHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;     // Number of slots (power of two)
+    uint32_t slotSize;     // sizeof(ShmDetectionSlot)
+
+    char pad0[64];
+    volatile uint64_t head; // Next position to be written (producers)
+    char pad1[64];
+    volatile uint64_t tail; // Next position to be read (consumer)
+    char pad2[64];
+    volatile int32_t futex; // Incremented on every write, consumers sleep on it
+    volatile int32_t waiters; // Number of consumers sleeping on the futex
+    volatile uint32_t dropped; // Number of slots dropped because the ring was full
+    volatile uint32_t producers; // Number of producers, which opened the ring
+};
+
+/**
+ * A bounded multi-producer / single-consumer ring of detection slots placed
+ * in POSIX shared memory, so that it can be shared by processes running
+ * on the same host. A consumer waiting for new data sleeps on a futex, which
+ * is woken up by producers.
+ *
+ * The segment is created by the first process opening it, the other processes
+ * just map it.
+ */
+class ShmRing
+{
+public:
+    ShmRing();
+    ~ShmRing();
+
+    /**
+     * Opens (and creates if it doesn't exist) the shared memory ring.
+     * @param name  Name of the shared memory segment (e.g. "but_objdet_detections").
+     * @param capacity  Number of slots, rounded up to a power of two (used only
+     * when the segment is created).
+     * @return  True if the ring was successfully opened, False otherwise.
+     */
+    bool open(const std::string& name, unsigned int capacity = 64);
+
+    /**
+     * Unmaps the shared memory segment.
+     */
+    void close();
+
+    /**
+     * Removes the shared memory segment from the system (already mapped rings
+     * stay valid until they are closed).
+     * @param name  Name of the shared memory segment.
+     */
+    static void unlink(const std::string& name);
+
+    /**
+     * Tests if the ring is opened.
+     */
+    bool isOpen() const { return header != NULL; }
+
+    /**
+     * Writes a slot into the ring and wakes up a waiting consumer.
+     * @param slot  Slot to be written (its sequence is ignored).
+     * @return  False if the ring is full and the slot was dropped.
+     */
+    bool push(const ShmDetectionSlot& slot);
+
+    /**
+     * Reads the oldest slot from the ring without blocking.
+     * @param slot  (output) Read slot.
+     * @return  False if the ring is empty.
+     */
+    bool pop(ShmDetectionSlot& slot);
+
+    /**
+     * Reads the oldest slot from the ring. If the ring is empty, it spins
+     * for a while and then sleeps on the futex until some data is written.
+     * @param slot  (output) Read slot.
+     * @param timeoutMs  Maximal time to wait in miliseconds.
+     * @return  False if nothing was read until timeout.
+     */
+    bool pop(ShmDetectionSlot& slot, int timeoutMs);
+
+    /**
+     * Registers a new producer. Slots of several producers can be interleaved
+     * in the ring, so each producer marks its slots with its own number.
+     * @return  Number of the producer (unique for the segment).
+     */
+    uint32_t addProducer();
+
+    /**
+     * Wakes up all consumers waiting on the ring (e.g. when shutting down).
+     */
+    void wakeAll();
+
+    /**
+     * Number of slots dropped because the ring was full.
+     */
+    uint32_t dropped() const { return header ? header->dropped : 0; }
+
+    /**
+     * Returns CLOCK_MONOTONIC time in nanoseconds (the clock is system-wide,
+     * so it can be compared across processes).
+     */
+    static int64_t monotonicNs();
+
+private:
+    ShmRingHeader *header;
+    ShmDetectionSlot *slots;
+    size_t mappedSize;
+    uint64_t mask;
+};
+
+}
+
+#endif // _SHM_RING_
+
@@ -0,0 +1,160 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Transfer of DetectionArray messages through a shared-memory ring.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef _SHM_TRANSPORT_
+#define _SHM_TRANSPORT_
+
+#include <map>
+#include <ros/ros.h> // Main header of ROS
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+#include "but_objdet_msgs/DetectionArray.h"
+#include "but_objdet/transport/shm_ring.h"
+
+namespace but_objdet
+{
+
+/**
+ * Default name of the shared memory segment used to transfer detections.
+ */
+const std::string BUT_OBJDET_Detections_SHM("but_objdet_detections");
+
+/**
+ * A class writing DetectionArray messages into a shared-memory ring. It is
+ * intended to be used alongside the ROS publisher by detector nodes running
+ * on the same host as the tracker.
+ */
+class ShmDetectionPublisher
+{
+public:
+    ShmDetectionPublisher() : producer(0) {}
+
+    /**
+     * Opens the shared-memory ring.
+     * @param name  Name of the shared memory segment.
+     * @param capacity  Number of slots of the ring (if it is created).
+     * @return  True if the ring was opened.
+     */
+    bool open(const std::string& name = BUT_OBJDET_Detections_SHM, unsigned int capacity = 64);
+
+    /**
+     * Writes detections into the ring (masks are not transferred).
+     * @param detArray  Detections to be written.
+     * @return  False if (a part of) the detections was dropped because the ring was full.
+     */
+    bool publish(const but_objdet_msgs::DetectionArray& detArray);
+
+private:
+    ShmRing ring;
+    ShmDetectionSlot slot;
+    uint32_t producer;
+};
+
+/**
+ * Reassembles DetectionArray messages from slots read from the ring. Slots
+ * of several producers can be interleaved, slots of one producer come
+ * in the order, in which they were written. An array, some of whose slots
+ * were dropped (the ring was full), is thrown away.
+ */
+class ShmDetectionAssembler
+{
+public:
+    ShmDetectionAssembler() : incompleteCount(0) {}
+
+    /**
+     * Adds a slot read from the ring.
+     * @param slot  The slot.
+     * @return  The DetectionArray, if the slot is its last part (NULL otherwise).
+     */
+    but_objdet_msgs::DetectionArrayPtr add(const ShmDetectionSlot& slot);
+
+    /**
+     * Number of arrays thrown away, because some of their slots were dropped.
+     */
+    uint32_t incomplete() const { return incompleteCount; }
+
+private:
+    /**
+     * An array of a producer, which is being received.
+     */
+    struct Partial
+    {
+        Partial() : nextPart(0) {}
+
+        but_objdet_msgs::DetectionArrayPtr array;
+        uint32_t nextPart;
+    };
+
+    std::map<uint32_t, Partial> partial; // Indexed by producers
+    uint32_t incompleteCount;
+};
+
+/**
+ * A class reading DetectionArray messages from a shared-memory ring in its own
+ * thread. The given callback is called from that thread.
+ */
+class ShmDetectionSubscriber
+{
+public:
+    typedef boost::function<void (const but_objdet_msgs::DetectionArrayConstPtr&)> Callback;
+
+    ShmDetectionSubscriber();
+    ~ShmDetectionSubscriber();
+
+    /**
+     * Opens the shared-memory ring and starts the reading thread.
+     * @param name  Name of the shared memory segment.
+     * @param callback  Function called for each received DetectionArray.
+     * @param capacity  Number of slots of the ring (if it is created).
+     * @return  True if the ring was opened.
+     */
+    bool start(const std::string& name, const Callback& callback, unsigned int capacity = 64);
+
+    /**
+     * Stops the reading thread and closes the ring.
+     */
+    void stop();
+
+private:
+    /**
+     * Main function of the reading thread.
+     */
+    void run();
+
+    ShmRing ring;
+    ShmDetectionAssembler assembler;
+    Callback callback;
+    boost::thread thread;
+    volatile bool running;
+};
+
+}
+
+#endif // _SHM_TRANSPORT_
+
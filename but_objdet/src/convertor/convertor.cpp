@@ -51,6 +51,9 @@ Object Convertor::detectionToButObject(const Detection &detection)
     object.m_class = detection.m_class;
     object.m_score = detection.m_score;
     
+    object.m_timestamp = detection.m_timestamp.toNSec();
+    object.m_proc_timestamp = detection.m_proc_timestamp.toNSec();
+    
     object.m_pos_2D.x = detection.m_pos_2D.x;
     object.m_pos_2D.y = detection.m_pos_2D.y;
     object.m_pos_2D.z = detection.m_pos_2D.z;
@@ -65,6 +68,8 @@ Object Convertor::detectionToButObject(const Detection &detection)
     object.m_speed.x = detection.m_speed.x;
     object.m_speed.y = detection.m_speed.y;
     object.m_speed.z = detection.m_speed.z;
+    
+    object.m_source = detection.m_source;
         
     // Convert Image msg to Mat
     try {
@@ -107,6 +112,9 @@ Detection Convertor::butObjectToDetection(const Object &object, std_msgs::Header
     detection.m_class = object.m_class;
     detection.m_score = object.m_score;
     
+    detection.m_timestamp.fromNSec(object.m_timestamp);
+    detection.m_proc_timestamp.fromNSec(object.m_proc_timestamp);
+    
     detection.m_pos_2D.x = object.m_pos_2D.x;
     detection.m_pos_2D.y = object.m_pos_2D.y;
     detection.m_pos_2D.z = object.m_pos_2D.z;
@@ -121,6 +129,8 @@ Detection Convertor::butObjectToDetection(const Object &object, std_msgs::Header
     detection.m_speed.x = object.m_speed.x;
     detection.m_speed.y = object.m_speed.y;
     detection.m_speed.z = object.m_speed.z;
+    
+    detection.m_source = object.m_source;
 
 
     // Convert Mat to Image msg
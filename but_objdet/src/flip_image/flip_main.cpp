@@ -0,0 +1,56 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: Michal Kapinus
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Date: 01/04/2012
+ * Description: Standalone executable of the flip node (the same node can be
+ * loaded as a nodelet, see flip_nodelet.cpp).
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ros/ros.h> // Main header of ROS
+#include <opencv2/highgui/highgui.hpp>
+
+#include "but_objdet/flip_image/flip_node.h"
+
+
+/* =============================================================================
+ * Main function
+ */
+int main(int argc, char **argv)
+{
+    // ROS initialization (the last argument is the name of a ROS node)
+    ros::init(argc, argv, "but_flip_image");
+
+    // Create the object managing connection with ROS system
+    but_objdet::FlipImageNode *node = new but_objdet::FlipImageNode();
+    
+    // Enters a loop, calling message callbacks
+    while(ros::ok()) {
+        cv::waitKey(10); // Process window events
+        ros::spinOnce(); // Call all the message callbacks waiting to be called
+    }
+    
+    delete node;
+    
+    return 0;
+}
@@ -37,6 +37,7 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <cv_bridge/cv_bridge.h>
 
+#include "but_objdet/stats/trace_buffer.h"
 #include "but_objdet/flip_image/flip_node.h"
 
 
@@ -45,10 +46,6 @@ using namespace std;
 using namespace cv;
 using namespace but_objdet_msgs;
 
-// If set to 1, detections will be visualized. If a tracker node is used, it is
-// better to visualize the detections together with predictions there.
-#define VISUAL_OUTPUT 0
-
 const string imageTopicIn = "/camera/rgb/image_color";
 const string depthTopicIn = "/camera/depth/image";
 const string imageTopicOut = "/cam3d/rgb/image";
@@ -62,9 +59,19 @@ namespace but_objdet
 /* -----------------------------------------------------------------------------
  * Constructor
  */
-FlipImageNode::FlipImageNode()
+FlipImageNode::FlipImageNode(ros::NodeHandle nh_, ros::NodeHandle pnh_)
+    : nh(nh_)
+    , pnh(pnh_)
+    , metrics("but_objdet_flip")
 {   
-    
+    // Create a window to vizualize the flipped video (off by default, it is
+    // better to visualize the detections together with predictions
+    // in the tracker node)
+    pnh.param("visual_output", visualOutput, false);
+    if(visualOutput) {
+        winName = "Flipped image";
+        namedWindow(winName, CV_WINDOW_AUTOSIZE);
+    }
 
     rosInit(); // ROS-related initialization
 }
@@ -75,13 +82,6 @@ FlipImageNode::FlipImageNode()
  */
 FlipImageNode::~FlipImageNode()
 {
-    
-	
-    
-    // Create a window to vizualize the incoming video, detections and predictions
-    if(VISUAL_OUTPUT) {
-        namedWindow(winName, CV_WINDOW_AUTOSIZE);
-    }
 }
 
 
@@ -101,6 +101,18 @@ void FlipImageNode::rosInit()
    
     depthPub = nh.advertise<sensor_msgs::Image>(depthTopicOut, 1);
     
+    // Durations of flipping and publishing (published as diagnostics)
+    flipTime = metrics.histogram("flip");
+    publishTime = metrics.histogram("publish");
+    imageCount = metrics.counter("images");
+    depthCount = metrics.counter("depth images");
+
+    double metricsPeriod;
+    pnh.param("metrics_period", metricsPeriod, 5.0);
+    metrics.start(nh, metricsPeriod);
+
+    // Spans of flipped frames (~trace_file)
+    traceInit(pnh);
     
     // Inform that the tracker is running (it will be written into console)
     ROS_INFO("Flipper is runnging...");
@@ -109,92 +121,89 @@ void FlipImageNode::rosInit()
 
 
 /* -----------------------------------------------------------------------------
- * Callback function called when new Image is received. The image is used just
- * for visualization of detections and predictions, thus it doesn't influence
- * functionality of this node in any way.
+ * Flips an image upside down. The input message data are not copied, the image
+ * is flipped directly into the data of a new message, which is published
+ * as a shared pointer (so that it is not copied by a nodelet subscriber).
+ */
+sensor_msgs::ImagePtr FlipImageNode::flipImage(const sensor_msgs::ImageConstPtr &imageMsg)
+{
+    // Get an OpenCV Mat sharing data with the image message
+    cv_bridge::CvImageConstPtr cv_ptr = cv_bridge::toCvShare(imageMsg);
+
+    sensor_msgs::ImagePtr flipped(new sensor_msgs::Image);
+    flipped->header = imageMsg->header;
+    flipped->height = imageMsg->height;
+    flipped->width = imageMsg->width;
+    flipped->encoding = imageMsg->encoding;
+    flipped->is_bigendian = imageMsg->is_bigendian;
+    flipped->step = cv_ptr->image.cols * cv_ptr->image.elemSize();
+    flipped->data.resize(flipped->step * flipped->height);
+
+    if(!flipped->data.empty()) {
+        Mat flippedImage(cv_ptr->image.rows, cv_ptr->image.cols, cv_ptr->image.type(),
+                         &flipped->data[0], flipped->step);
+        cv::flip(cv_ptr->image, flippedImage, 0);
+    }
+
+    return flipped;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Callback function called when new Image is received. The image is flipped
+ * and published.
  */
 void FlipImageNode::newImageCallback(const sensor_msgs::ImageConstPtr &imageMsg)
 {
+    TraceScope span("flip image", imageMsg->header.stamp, imageMsg->header.seq);
+    imageCount->add();
 
-    // Get an OpenCV Mat from the image message
-    
-    cv_bridge::CvImagePtr cv_ptr(new cv_bridge::CvImage);
+    sensor_msgs::ImagePtr flipped;
     try {
-        
-        cv_ptr = cv_bridge::toCvCopy(imageMsg, imageMsg->encoding);
-	
-    }    catch (cv_bridge::Exception& e) {
+        MetricTimer timer(flipTime);
+        flipped = flipImage(imageMsg);
+    }
+    catch (cv_bridge::Exception& e) {
         ROS_ERROR("cv_bridge exception: %s", e.what());
         return;
     }
+
+    MetricTimer timer(publishTime);
+    imgPub.publish(flipped);
+    timer.stop();
     
-    cv::flip(cv_ptr->image,cv_ptr->image,0);
-      
-    
-   
-    
-    imgPub.publish(cv_ptr->toImageMsg());
-    
-    if(VISUAL_OUTPUT) {
-        imshow(winName, cv_ptr->image);
+    if(visualOutput) {
+        imshow(winName, cv_bridge::toCvShare(flipped)->image);
     }
 }
 
 
 /* -----------------------------------------------------------------------------
- * Callback function called when new Image is received. The image is used just
- * for visualization of detections and predictions, thus it doesn't influence
- * functionality of this node in any way.
+ * Callback function called when new depth Image is received. The image is
+ * flipped and published.
  */
 void FlipImageNode::newDepthCallback(const sensor_msgs::ImageConstPtr &imageMsg)
 {
+    TraceScope span("flip depth", imageMsg->header.stamp, imageMsg->header.seq);
+    depthCount->add();
 
-    // Get an OpenCV Mat from the image message
-    
-    cv_bridge::CvImagePtr cv_ptr(new cv_bridge::CvImage);
+    sensor_msgs::ImagePtr flipped;
     try {
-        
-        cv_ptr = cv_bridge::toCvCopy(imageMsg, imageMsg->encoding);
-	
-    }    catch (cv_bridge::Exception& e) {
+        MetricTimer timer(flipTime);
+        flipped = flipImage(imageMsg);
+    }
+    catch (cv_bridge::Exception& e) {
         ROS_ERROR("cv_bridge exception: %s", e.what());
         return;
     }
-    
-    cv::flip(cv_ptr->image,cv_ptr->image,0);
-      
-    
-   
-    
-    depthPub.publish(cv_ptr->toImageMsg());
-    
-    if(VISUAL_OUTPUT) {
-        imshow(winName, cv_ptr->image);
-    }
-}
-}
-
-
-
-/* =============================================================================
- * Main function
- */
-int main(int argc, char **argv)
-{
-    // ROS initialization (the last argument is the name of a ROS node)
-    ros::init(argc, argv, "but_flip_image");
 
-    // Create the object managing connection with ROS system
-    but_objdet::FlipImageNode *node = new but_objdet::FlipImageNode();
+    MetricTimer timer(publishTime);
+    depthPub.publish(flipped);
+    timer.stop();
     
-    // Enters a loop, calling message callbacks
-    while(ros::ok()) {
-        waitKey(10); // Process window events
-        ros::spinOnce(); // Call all the message callbacks waiting to be called
+    if(visualOutput) {
+        imshow(winName, cv_bridge::toCvShare(flipped)->image);
     }
-    
-    delete node;
-    
-    return 0;
+}
 }
 
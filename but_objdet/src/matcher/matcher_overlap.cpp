@@ -25,6 +25,7 @@
  * along with this file.  If not, see <http://www.gnu.org/licenses/>.
  */
  
+#include <algorithm>
 #include "but_objdet/matcher/matcher_overlap.h"
  
 using namespace std;
@@ -36,9 +37,10 @@ namespace but_objdet
 /* -----------------------------------------------------------------------------
  * Constructor
  */
- MatcherOverlap::MatcherOverlap(float min)
+ MatcherOverlap::MatcherOverlap(float min, bool oneToOne_)
  {
     minOverlap = min;
+    oneToOne = oneToOne_;
  }
  
  
@@ -53,62 +55,20 @@ void MatcherOverlap::match(const Objects &detections, const Objects &predictions
 {
     matches.resize(detections.size());
     
+    if(oneToOne) {
+        matchOneToOne(detections, predictions, matches);
+        return;
+    }
+    
     // Take each detection and find the most overlapping prediction
     for(unsigned int i = 0; i < detections.size(); i++) {
     
-        // Get left/right X and top/bottom Y coordinates of detection BB
-        int detLeftX = detections[i].m_bb.x;
-        int detRightX = detections[i].m_bb.x + detections[i].m_bb.width;
-        int detTopY = detections[i].m_bb.y;
-        int detBottomY = detections[i].m_bb.y + detections[i].m_bb.height;
-        
-        // Area of detection BB
-        float detArea = detections[i].m_bb.width * detections[i].m_bb.height;
-        
         float bestOverlapped = 0; // The best overlapping percentage so far
         int bestPredId = -1; // The most similar prediction so far
         
         // Go through all predictions and find the most similar one
         for(unsigned int j = 0; j < predictions.size(); j++) {
-        
-            // If the prediction is not from the same class, do not consider it
-            if(detections[i].m_class != predictions[j].m_class) continue;
-        
-            float overlapped = 0; // Overlapping percentage (the smaller one of both BBs)
-        
-            // Get left/right X and top/bottom Y coordinates of prediction BB
-            int predLeftX = predictions[j].m_bb.x;
-            int predRightX = predictions[j].m_bb.x + predictions[j].m_bb.width;
-            int predTopY = predictions[j].m_bb.y;
-            int predBottomY = predictions[j].m_bb.y + predictions[j].m_bb.height;
-            
-            // Area of prediction BB
-            float predArea = predictions[i].m_bb.width * predictions[j].m_bb.height;
-            
-            // Test if detection BB overlaps with prediction BB
-            if(detRightX > predLeftX && detLeftX < predRightX && // Test if the BBs overlap in X direction
-               detBottomY > predTopY && detTopY < predBottomY) { // Test if the BBs overlap in Y direction
-                
-                // Get left/right X and top/bottom Y coordinates of the overlapped region
-                int overlapLeftX = max(detLeftX, predLeftX);
-                int overlapRightX = min(detRightX, predRightX);
-                int overlapTopY = max(detTopY, predTopY);
-                int overlapBottomY = min(detBottomY, predBottomY);
-                
-                // Calculate area of the overlapped region
-                float overlapArea = (overlapRightX - overlapLeftX) * (overlapBottomY - overlapTopY);
-                
-                // Calculate how many percent of detection BB is overlapped
-                // (do the same also for predicition BB)
-                float detOverlapped = (overlapArea * 100) / detArea;
-                float predOverlapped = (overlapArea * 100) / predArea;
-                
-                // Overlapping area must represent more than minOverlap%
-                // (for both, detection BB and prediction BB)
-                if(detOverlapped >= minOverlap && predOverlapped >= minOverlap) {
-                   overlapped = min(detOverlapped, predOverlapped);
-                }
-            }
+            float overlapped = overlap(detections[i], predictions[j]);
             
             // Test if this prediction is the best so far
             if(overlapped > bestOverlapped) {
@@ -125,6 +85,96 @@ void MatcherOverlap::match(const Objects &detections, const Objects &predictions
 }
 
 
+/* -----------------------------------------------------------------------------
+ * Matching, where each prediction is assigned to one detection at most
+ *
+ * Pairs are assigned greedily from the most overlapping one, so a prediction
+ * is given to the detection overlapping it the most.
+ */
+void MatcherOverlap::matchOneToOne(const Objects &detections, const Objects &predictions, Matches &matches)
+{
+    // All the similar pairs
+    vector<Candidate> candidates;
+    for(unsigned int i = 0; i < detections.size(); i++) {
+        matches[i].detId = i;
+        matches[i].predId = -1;
+        
+        for(unsigned int j = 0; j < predictions.size(); j++) {
+            float overlapped = overlap(detections[i], predictions[j]);
+            if(overlapped > 0) {
+                Candidate c = { overlapped, (int)i, (int)j };
+                candidates.push_back(c);
+            }
+        }
+    }
+    
+    sort(candidates.begin(), candidates.end());
+    
+    vector<bool> predUsed(predictions.size(), false);
+    for(unsigned int k = 0; k < candidates.size(); k++) {
+        const Candidate &c = candidates[k];
+        if(matches[c.detId].predId != -1 || predUsed[c.predId]) continue;
+        
+        matches[c.detId].predId = c.predId;
+        predUsed[c.predId] = true;
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Returns the overlapping percentage of a detection and a prediction (the
+ * smaller one of both BBs), or 0 if they are not similar
+ */
+float MatcherOverlap::overlap(const Object &detection, const Object &prediction) const
+{
+    // If the prediction is not from the same class, do not consider it
+    if(detection.m_class != prediction.m_class) return 0;
+    
+    // Get left/right X and top/bottom Y coordinates of detection BB
+    int detLeftX = detection.m_bb.x;
+    int detRightX = detection.m_bb.x + detection.m_bb.width;
+    int detTopY = detection.m_bb.y;
+    int detBottomY = detection.m_bb.y + detection.m_bb.height;
+    
+    // Get left/right X and top/bottom Y coordinates of prediction BB
+    int predLeftX = prediction.m_bb.x;
+    int predRightX = prediction.m_bb.x + prediction.m_bb.width;
+    int predTopY = prediction.m_bb.y;
+    int predBottomY = prediction.m_bb.y + prediction.m_bb.height;
+    
+    // Test if detection BB overlaps with prediction BB
+    if(!(detRightX > predLeftX && detLeftX < predRightX && // Test if the BBs overlap in X direction
+         detBottomY > predTopY && detTopY < predBottomY)) { // Test if the BBs overlap in Y direction
+        return 0;
+    }
+    
+    // Areas of detection and prediction BBs
+    float detArea = detection.m_bb.width * detection.m_bb.height;
+    float predArea = prediction.m_bb.width * prediction.m_bb.height;
+    
+    // Get left/right X and top/bottom Y coordinates of the overlapped region
+    int overlapLeftX = max(detLeftX, predLeftX);
+    int overlapRightX = min(detRightX, predRightX);
+    int overlapTopY = max(detTopY, predTopY);
+    int overlapBottomY = min(detBottomY, predBottomY);
+    
+    // Calculate area of the overlapped region
+    float overlapArea = (overlapRightX - overlapLeftX) * (overlapBottomY - overlapTopY);
+    
+    // Calculate how many percent of detection BB is overlapped
+    // (do the same also for predicition BB)
+    float detOverlapped = (overlapArea * 100) / detArea;
+    float predOverlapped = (overlapArea * 100) / predArea;
+    
+    // Overlapping area must represent more than minOverlap%
+    // (for both, detection BB and prediction BB)
+    if(detOverlapped >= minOverlap && predOverlapped >= minOverlap) {
+       return min(detOverlapped, predOverlapped);
+    }
+    return 0;
+}
+
+
 /* -----------------------------------------------------------------------------
  * Sets minimum overlap (in percent) which must be between a detection
  * and a prediction to be considered as similar (the overlapping
@@ -135,5 +185,14 @@ void MatcherOverlap::match(const Objects &detections, const Objects &predictions
     minOverlap = min;
  }
  
+ 
+/* -----------------------------------------------------------------------------
+ * Sets if a prediction can be matched with one detection at most
+ */
+ void MatcherOverlap::setOneToOne(bool oneToOne_)
+ {
+    oneToOne = oneToOne_;
+ }
+ 
  }
 
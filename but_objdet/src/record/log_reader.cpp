@@ -0,0 +1,312 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <ros/ros.h> // Main header of ROS
+#include <ros/serialization.h>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "but_objdet/record/log_reader.h"
+
+using namespace std;
+using namespace cv;
+using namespace but_objdet_msgs;
+
+
+namespace but_objdet
+{
+
+/* -----------------------------------------------------------------------------
+ * Deserializes a ROS message from a record
+ */
+template <typename M>
+static bool deserializeMsg(const LogRecord& record, M& msg)
+{
+    try {
+        ros::serialization::IStream stream(const_cast<uint8_t *>(record.data), record.size);
+        ros::serialization::deserialize(stream, msg);
+    }
+    catch(std::exception& e) {
+        ROS_ERROR("Failed to deserialize a log record: %s", e.what());
+        return false;
+    }
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+LogReader::LogReader()
+    : base(NULL)
+    , length(0)
+    , offset(0)
+{
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Destructor
+ */
+LogReader::~LogReader()
+{
+    close();
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Maps the log into memory
+ */
+bool LogReader::open(const string& filename)
+{
+    close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(LogFileHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    void *ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(ptr == MAP_FAILED) return false;
+
+    // Records are read sequentially
+    madvise(ptr, st.st_size, MADV_SEQUENTIAL);
+
+    const LogFileHeader *header = (const LogFileHeader *)ptr;
+    if(memcmp(header->magic, BUT_OBJDET_LOG_MAGIC, sizeof(header->magic)) != 0
+       || header->version != BUT_OBJDET_LOG_VERSION) {
+        ROS_ERROR("File %s is not a log of version %d.", filename.c_str(), BUT_OBJDET_LOG_VERSION);
+        munmap(ptr, st.st_size);
+        return false;
+    }
+
+    base = (const uint8_t *)ptr;
+    length = st.st_size;
+    offset = sizeof(LogFileHeader);
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Unmaps the log
+ */
+void LogReader::close()
+{
+    if(base) {
+        munmap(const_cast<uint8_t *>(base), length);
+        base = NULL;
+        length = 0;
+        offset = 0;
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Reads the next record
+ */
+bool LogReader::next(LogRecord& record)
+{
+    if(!base || offset + sizeof(LogRecordHeader) > length) return false;
+
+    LogRecordHeader rh;
+    memcpy(&rh, base + offset, sizeof(rh));
+
+    size_t payload = offset + sizeof(rh);
+    if(payload + rh.size > length) return false; // Incomplete record
+
+    record.type = (LogRecordType)rh.type;
+    record.stamp = rh.stamp;
+    record.recordTime = rh.recordTime;
+    record.data = base + payload;
+    record.size = rh.size;
+
+    offset = payload + ((rh.size + 7) & ~(size_t)7);
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Starts reading from the first record again
+ */
+void LogReader::rewind()
+{
+    if(base) offset = sizeof(LogFileHeader);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Decodes a frame record (raw frames are not copied, the image points
+ * into the mapped log)
+ */
+bool LogReader::decodeFrame(const LogRecord& record, Mat& image, sensor_msgs::Image *imageMsg)
+{
+    if(record.type != LOG_RECORD_FRAME || record.size < sizeof(LogFrameHeader)) return false;
+
+    LogFrameHeader fh;
+    memcpy(&fh, record.data, sizeof(fh));
+
+    const uint8_t *data = record.data + sizeof(fh);
+    uint32_t size = record.size - sizeof(fh);
+
+    if(fh.encoding == LOG_FRAME_RAW) {
+        Mat raw(fh.rows, fh.cols, fh.type, const_cast<uint8_t *>(data));
+        if(raw.total() * raw.elemSize() != size) return false;
+        image = raw;
+    }
+    else {
+        image = imdecode(Mat(1, size, CV_8U, const_cast<uint8_t *>(data)), -1);
+        if(image.empty()) return false;
+    }
+
+    if(imageMsg) {
+        fh.imgEncoding[sizeof(fh.imgEncoding) - 1] = 0;
+        fh.frameId[sizeof(fh.frameId) - 1] = 0;
+
+        imageMsg->header.stamp.fromNSec(record.stamp);
+        imageMsg->header.seq = fh.seq;
+        imageMsg->header.frame_id = fh.frameId;
+        imageMsg->encoding = fh.imgEncoding;
+        imageMsg->height = image.rows;
+        imageMsg->width = image.cols;
+        imageMsg->step = image.cols * image.elemSize();
+    }
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Decodes a detections record
+ */
+bool LogReader::decodeDetections(const LogRecord& record, DetectionArray& detArray)
+{
+    if(record.type != LOG_RECORD_DETECTIONS) return false;
+
+    return deserializeMsg(record, detArray);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Decodes a predictions record
+ */
+bool LogReader::decodePredictions(const LogRecord& record, PredictDetections::Response& response)
+{
+    if(record.type != LOG_RECORD_PREDICTIONS) return false;
+
+    return deserializeMsg(record, response);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+LogPlayer::LogPlayer(LogReader& reader_)
+    : reader(reader_)
+    , rate(1.0)
+{
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Replays the log
+ */
+unsigned int LogPlayer::play(const boost::function<bool ()>& ok)
+{
+    LogRecord record;
+    unsigned int count = 0;
+    int64_t firstRecordTime = 0;
+    ros::WallTime start;
+
+    while(reader.next(record)) {
+        if(ok && !ok()) break;
+
+        // Wait until the record should be replayed
+        if(rate > 0) {
+            if(count == 0) {
+                firstRecordTime = record.recordTime;
+                start = ros::WallTime::now();
+            }
+            else {
+                double elapsed = (ros::WallTime::now() - start).toSec();
+                double wait = (record.recordTime - firstRecordTime) / 1e9 / rate - elapsed;
+                if(wait > 0) ros::WallDuration(wait).sleep();
+            }
+        }
+        count++;
+
+        switch(record.type) {
+            case LOG_RECORD_FRAME:
+                if(frameCb) {
+                    Mat image;
+                    sensor_msgs::Image imageMsg;
+                    if(LogReader::decodeFrame(record, image, &imageMsg)) {
+                        frameCb(imageMsg, image);
+                    }
+                }
+                break;
+
+            case LOG_RECORD_DETECTIONS:
+                if(detectionsCb) {
+                    DetectionArray detArray;
+                    if(LogReader::decodeDetections(record, detArray)) {
+                        detectionsCb(detArray);
+                    }
+                }
+                break;
+
+            case LOG_RECORD_PREDICTIONS:
+                if(predictionsCb) {
+                    PredictDetections::Response response;
+                    if(LogReader::decodePredictions(record, response)) {
+                        ros::Time stamp;
+                        stamp.fromNSec(record.stamp);
+                        predictionsCb(stamp, response);
+                    }
+                }
+                break;
+
+            default:
+                break; // Unknown records are skipped
+        }
+    }
+
+    return count;
+}
+
+}
+
@@ -0,0 +1,301 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Replay of a log recorded by LogWriter. It either publishes
+ * the recorded frames (and detections) to running nodes, or runs the matcher
+ * and the Kalman trackers directly on the recorded data without ROS master
+ * and reports how long the processing took (deterministic benchmark).
+ *
+ * Usage: but_objdet_replay LOG [-r RATE] [-p] [-d] [-i IMAGE_TOPIC]
+ *   -r RATE  multiple of the recorded speed, 0 = as fast as possible
+ *            (default 1 when publishing, 0 otherwise)
+ *   -p       publish frames to IMAGE_TOPIC (default /camera/rgb/image_color)
+ *   -d       publish also the recorded detections
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+#include <ros/ros.h> // Main header of ROS
+#include <cv_bridge/cv_bridge.h>
+
+#include "but_objdet/record/log_reader.h"
+#include "but_objdet/matcher/matcher_overlap.h"
+#include "but_objdet/convertor/convertor.h"
+#include "but_objdet/tracker/tracker_kalman.h"
+#include "but_objdet/stats/latency_stats.h"
+
+using namespace std;
+using namespace cv;
+using namespace but_objdet;
+using namespace but_objdet_msgs;
+
+
+/* =============================================================================
+ * Publishing of the recorded data to running nodes
+ */
+class ReplayPublisher
+{
+public:
+    ReplayPublisher(const string& imageTopic, bool publishDetections)
+    {
+        imagePub = nh.advertise<sensor_msgs::Image>(imageTopic, 10);
+        if(publishDetections) {
+            detectionsPub = nh.advertise<DetectionArray>("/but_objdet/detections", 10);
+        }
+    }
+
+    void frame(const sensor_msgs::Image& imageMsg, const Mat& image)
+    {
+        cv_bridge::CvImage cvImage;
+        cvImage.header = imageMsg.header;
+        cvImage.encoding = imageMsg.encoding;
+        cvImage.image = image;
+        imagePub.publish(cvImage.toImageMsg());
+    }
+
+    void detections(const DetectionArray& detArray)
+    {
+        if(detectionsPub) detectionsPub.publish(detArray);
+    }
+
+private:
+    ros::NodeHandle nh;
+    ros::Publisher imagePub;
+    ros::Publisher detectionsPub;
+};
+
+
+/* =============================================================================
+ * Matcher and trackers running directly on the recorded data
+ */
+class ReplayBenchmark
+{
+public:
+    ReplayBenchmark()
+        : arrays(0)
+        , requests(0)
+        , correctIds(0)
+        , switchedIds(0)
+        , missedIds(0)
+    {
+        matcher.setMinOverlap(50);
+    }
+
+    ~ReplayBenchmark()
+    {
+        Tracks::iterator it;
+        for(it = tracks.begin(); it != tracks.end(); it++) {
+            delete it->second.kf;
+        }
+    }
+
+    // Matches the detections with the last predictions and updates the trackers
+    void detections(const DetectionArray& detArray)
+    {
+        int64_t start = ros::WallTime::now().toNSec();
+        int64 ms = stampToMs(detArray.header.stamp);
+
+        Objects objects = Convertor::detectionsToButObjects(detArray.detections);
+        Matches matches;
+        matcher.match(objects, predictions, matches);
+        scoreMatches(objects, matches);
+
+        for(unsigned int i = 0; i < objects.size(); i++) {
+            const Object &obj = objects[i];
+            Mat measurement(1, 4, CV_32F);
+            measurement.at<float>(0) = obj.m_bb.x;
+            measurement.at<float>(1) = obj.m_bb.y;
+            measurement.at<float>(2) = obj.m_bb.width;
+            measurement.at<float>(3) = obj.m_bb.height;
+
+            Track &track = tracks[make_pair(obj.m_class, obj.m_id)];
+            if(!track.kf) {
+                track.kf = new TrackerKalman();
+                track.kf->init(measurement, true);
+            }
+            else {
+                track.kf->update(measurement, ms - track.msTime);
+            }
+            track.msTime = ms;
+        }
+
+        detectionTime.add(ros::WallTime::now().toNSec() - start);
+        arrays++;
+    }
+
+    // Predicts all tracks for the time of a recorded request
+    void predictionRequest(const ros::Time& stamp, const PredictDetections::Response& response)
+    {
+        int64_t start = ros::WallTime::now().toNSec();
+        int64 ms = stampToMs(stamp);
+
+        predictions.clear();
+        Tracks::iterator it;
+        for(it = tracks.begin(); it != tracks.end(); it++) {
+            Mat state, cov;
+            it->second.kf->predictState(ms - it->second.msTime, state, cov);
+
+            Object pred;
+            pred.m_class = it->first.first;
+            pred.m_id = it->first.second;
+            pred.m_bb = cv::Rect(state.at<float>(0, 0), state.at<float>(1, 0),
+                             state.at<float>(2, 0), state.at<float>(3, 0));
+            predictions.push_back(pred);
+        }
+
+        predictionTime.add(ros::WallTime::now().toNSec() - start);
+        requests++;
+    }
+
+    void report()
+    {
+        printf("Detection arrays: %u, tracks: %u, prediction requests: %u\n",
+               arrays, (unsigned int)tracks.size(), requests);
+        printf("Matching + update [ms]: mean = %.4f, p50 = %.4f, p99 = %.4f, max = %.4f\n",
+               detectionTime.meanMs(), detectionTime.percentile(50),
+               detectionTime.percentile(99), detectionTime.maxMs());
+        printf("Prediction [ms]: mean = %.4f, p50 = %.4f, p99 = %.4f, max = %.4f\n",
+               predictionTime.meanMs(), predictionTime.percentile(50),
+               predictionTime.percentile(99), predictionTime.maxMs());
+        printf("Matched IDs: %u correct, %u switched, %u missed\n",
+               correctIds, switchedIds, missedIds);
+    }
+
+private:
+    struct Track
+    {
+        Track() : kf(NULL), msTime(0) {}
+        TrackerKalman *kf;
+        int64 msTime;
+    };
+    typedef map<pair<int, int>, Track> Tracks;
+
+    static int64 stampToMs(const ros::Time& stamp)
+    {
+        return (int64)stamp.sec * 1000 + stamp.nsec / 1000000;
+    }
+
+    // Compares IDs of the matched predictions with the recorded IDs
+    // of the detections (a detection of a predicted object should be
+    // matched with its prediction)
+    void scoreMatches(const Objects& objects, const Matches& matches)
+    {
+        for(unsigned int i = 0; i < matches.size(); i++) {
+            const Object &obj = objects[matches[i].detId];
+
+            bool predicted = false;
+            for(unsigned int j = 0; j < predictions.size() && !predicted; j++) {
+                predicted = predictions[j].m_class == obj.m_class && predictions[j].m_id == obj.m_id;
+            }
+
+            if(matches[i].predId == -1) {
+                if(predicted) missedIds++;
+            }
+            else if(predictions[matches[i].predId].m_id == obj.m_id) {
+                correctIds++;
+            }
+            else {
+                switchedIds++;
+            }
+        }
+    }
+
+    MatcherOverlap matcher;
+    Tracks tracks;
+    Objects predictions;
+    LatencyHistogram detectionTime;
+    LatencyHistogram predictionTime;
+    unsigned int arrays;
+    unsigned int requests;
+    unsigned int correctIds;  // Detections matched with the prediction of their object
+    unsigned int switchedIds; // Detections matched with a prediction of another object
+    unsigned int missedIds;   // Detections of predicted objects left unmatched
+};
+
+
+/* =============================================================================
+ * Main function
+ */
+int main(int argc, char **argv)
+{
+    if(argc < 2) {
+        printf("Usage: %s LOG [-r RATE] [-p] [-d] [-i IMAGE_TOPIC]\n", argv[0]);
+        return 1;
+    }
+
+    string imageTopic = "/camera/rgb/image_color";
+    double rate = -1;
+    bool publish = false;
+    bool publishDetections = false;
+
+    for(int i = 2; i < argc; i++) {
+        if(strcmp(argv[i], "-r") == 0 && i + 1 < argc) rate = atof(argv[++i]);
+        else if(strcmp(argv[i], "-i") == 0 && i + 1 < argc) imageTopic = argv[++i];
+        else if(strcmp(argv[i], "-p") == 0) publish = true;
+        else if(strcmp(argv[i], "-d") == 0) publishDetections = true;
+    }
+
+    LogReader reader;
+    if(!reader.open(argv[1])) {
+        printf("Cannot open log %s.\n", argv[1]);
+        return 1;
+    }
+
+    LogPlayer player(reader);
+
+    // Publish to running nodes
+    if(publish || publishDetections) {
+        ros::init(argc, argv, "but_objdet_replay");
+        ReplayPublisher pub(imageTopic, publishDetections);
+
+        player.setRate(rate < 0 ? 1.0 : rate);
+        if(publish) player.onFrame(boost::bind(&ReplayPublisher::frame, &pub, _1, _2));
+        player.onDetections(boost::bind(&ReplayPublisher::detections, &pub, _1));
+
+        unsigned int count = player.play(boost::bind(&ros::ok));
+        printf("Replayed %u records.\n", count);
+    }
+    
+    // Benchmark without ROS master
+    else {
+        ReplayBenchmark bench;
+
+        player.setRate(rate < 0 ? 0.0 : rate);
+        player.onDetections(boost::bind(&ReplayBenchmark::detections, &bench, _1));
+        player.onPredictions(boost::bind(&ReplayBenchmark::predictionRequest, &bench, _1, _2));
+
+        int64_t start = ros::WallTime::now().toNSec();
+        unsigned int count = player.play();
+        double elapsed = (ros::WallTime::now().toNSec() - start) / 1e6;
+
+        printf("Replayed %u records in %.2f ms.\n", count, elapsed);
+        bench.report();
+    }
+
+    return 0;
+}
+
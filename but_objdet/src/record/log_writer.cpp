@@ -0,0 +1,320 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <ros/ros.h> // Main header of ROS
+#include <ros/serialization.h>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "but_objdet/record/log_writer.h"
+
+using namespace std;
+using namespace cv;
+using namespace but_objdet_msgs;
+
+
+namespace but_objdet
+{
+
+/* -----------------------------------------------------------------------------
+ * Serializes a ROS message into a buffer
+ */
+template <typename M>
+static void serializeMsg(const M& msg, vector<uint8_t>& buffer)
+{
+    uint32_t size = ros::serialization::serializationLength(msg);
+    buffer.resize(size);
+    if(size == 0) return;
+
+    ros::serialization::OStream stream(&buffer[0], size);
+    ros::serialization::serialize(stream, msg);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Removes an incomplete record from the end of a log (e.g. one cut off
+ * by a crash), so that records appended after it can be read
+ */
+static bool truncateIncomplete(const string& filename)
+{
+    int fd = ::open(filename.c_str(), O_RDWR);
+    if(fd < 0) return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    // Records are walked as LogReader does, a record with complete payload
+    // is kept (its missing padding is filled with zeros by ftruncate)
+    off_t length = st.st_size;
+    off_t end = sizeof(LogFileHeader);
+    LogRecordHeader rh;
+    while(end + (off_t)sizeof(rh) <= length
+          && pread(fd, &rh, sizeof(rh), end) == (ssize_t)sizeof(rh)
+          && end + (off_t)sizeof(rh) + (off_t)rh.size <= length) {
+        end += sizeof(rh) + (((off_t)rh.size + 7) & ~(off_t)7);
+    }
+
+    bool ok = true;
+    if(end != length) {
+        if(end < length) {
+            ROS_WARN("Incomplete record at the end of %s was removed (%ld bytes).",
+                     filename.c_str(), (long)(length - end));
+        }
+        ok = ftruncate(fd, end) == 0;
+    }
+
+    ::close(fd);
+    return ok;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+LogWriter::LogWriter()
+    : file(NULL)
+    , frameScale(1.0f)
+    , frameEncoding(LOG_FRAME_RAW)
+    , frameQuality(-1)
+{
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Destructor
+ */
+LogWriter::~LogWriter()
+{
+    close();
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Opens the log for appending
+ */
+bool LogWriter::open(const string& filename)
+{
+    close();
+
+    boost::mutex::scoped_lock lock(mutex);
+
+    // Check the header of an existing log
+    LogFileHeader header;
+    FILE *f = fopen(filename.c_str(), "rb");
+    if(f) {
+        size_t n = fread(&header, 1, sizeof(header), f);
+        fclose(f);
+
+        if(n > 0 && (n < sizeof(header)
+                     || memcmp(header.magic, BUT_OBJDET_LOG_MAGIC, sizeof(header.magic)) != 0
+                     || header.version != BUT_OBJDET_LOG_VERSION)) {
+            ROS_ERROR("File %s is not a log of version %d.", filename.c_str(), BUT_OBJDET_LOG_VERSION);
+            return false;
+        }
+        if(n > 0) {
+            if(!truncateIncomplete(filename)) {
+                ROS_ERROR("Cannot remove an incomplete record from the end of %s.", filename.c_str());
+                return false;
+            }
+            file = fopen(filename.c_str(), "ab");
+            return file != NULL;
+        }
+    }
+
+    // Create a new log
+    file = fopen(filename.c_str(), "wb");
+    if(!file) return false;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BUT_OBJDET_LOG_MAGIC, sizeof(header.magic));
+    header.version = BUT_OBJDET_LOG_VERSION;
+    fwrite(&header, sizeof(header), 1, file);
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Closes the log
+ */
+void LogWriter::close()
+{
+    boost::mutex::scoped_lock lock(mutex);
+
+    if(file) {
+        fclose(file);
+        file = NULL;
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Sets how frames are stored
+ */
+void LogWriter::setFrameFormat(float scale, LogFrameEncoding encoding, int quality)
+{
+    frameScale = (scale > 0) ? scale : 1.0f;
+    frameEncoding = encoding;
+    frameQuality = quality;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Appends a frame
+ */
+bool LogWriter::writeFrame(const sensor_msgs::Image& imageMsg, const Mat& image)
+{
+    if(!file) return false;
+
+    // Downscale (and make the data continuous)
+    Mat stored;
+    if(frameScale != 1.0f) {
+        resize(image, stored, Size(), frameScale, frameScale, INTER_AREA);
+    }
+    else if(!image.isContinuous()) {
+        stored = image.clone();
+    }
+    else {
+        stored = image;
+    }
+
+    LogFrameHeader fh;
+    memset(&fh, 0, sizeof(fh));
+    fh.rows = stored.rows;
+    fh.cols = stored.cols;
+    fh.type = stored.type();
+    fh.scale = frameScale;
+    fh.seq = imageMsg.header.seq;
+    strncpy(fh.imgEncoding, imageMsg.encoding.c_str(), sizeof(fh.imgEncoding) - 1);
+    strncpy(fh.frameId, imageMsg.header.frame_id.c_str(), sizeof(fh.frameId) - 1);
+
+    // JPEG can store only 8-bit images, other ones are stored using PNG
+    // (float images are always stored raw)
+    fh.encoding = frameEncoding;
+    if(fh.encoding == LOG_FRAME_JPEG && stored.depth() != CV_8U) {
+        fh.encoding = LOG_FRAME_PNG;
+    }
+    if(fh.encoding == LOG_FRAME_PNG && stored.depth() != CV_8U && stored.depth() != CV_16U) {
+        fh.encoding = LOG_FRAME_RAW;
+    }
+
+    const void *data = stored.data;
+    uint32_t size = stored.total() * stored.elemSize();
+
+    vector<uchar> encoded;
+    if(fh.encoding != LOG_FRAME_RAW) {
+        vector<int> params;
+        if(frameQuality >= 0) {
+            params.push_back(fh.encoding == LOG_FRAME_JPEG ? CV_IMWRITE_JPEG_QUALITY : CV_IMWRITE_PNG_COMPRESSION);
+            params.push_back(frameQuality);
+        }
+        if(!imencode(fh.encoding == LOG_FRAME_JPEG ? ".jpg" : ".png", stored, encoded, params)) {
+            return false;
+        }
+        data = encoded.empty() ? NULL : &encoded[0];
+        size = encoded.size();
+    }
+
+    return writeRecord(LOG_RECORD_FRAME, imageMsg.header.stamp.toNSec(), &fh, sizeof(fh), data, size);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Appends detections
+ */
+bool LogWriter::writeDetections(const DetectionArray& detArray)
+{
+    if(!file) return false;
+
+    vector<uint8_t> buffer;
+    serializeMsg(detArray, buffer);
+
+    return writeRecord(LOG_RECORD_DETECTIONS, detArray.header.stamp.toNSec(),
+                       buffer.empty() ? NULL : &buffer[0], buffer.size(), NULL, 0);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Appends a response of the prediction service
+ */
+bool LogWriter::writePredictions(const ros::Time& stamp, const PredictDetections::Response& response)
+{
+    if(!file) return false;
+
+    vector<uint8_t> buffer;
+    serializeMsg(response, buffer);
+
+    return writeRecord(LOG_RECORD_PREDICTIONS, stamp.toNSec(),
+                       buffer.empty() ? NULL : &buffer[0], buffer.size(), NULL, 0);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Writes buffered records into the file
+ */
+void LogWriter::flush()
+{
+    boost::mutex::scoped_lock lock(mutex);
+
+    if(file) fflush(file);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Appends a record
+ */
+bool LogWriter::writeRecord(LogRecordType type, int64_t stamp,
+                            const void *data1, uint32_t size1,
+                            const void *data2, uint32_t size2)
+{
+    static const char padding[8] = {0};
+
+    LogRecordHeader rh;
+    rh.type = type;
+    rh.size = size1 + size2;
+    rh.stamp = stamp;
+    rh.recordTime = ros::WallTime::now().toNSec();
+
+    boost::mutex::scoped_lock lock(mutex);
+    if(!file) return false;
+
+    bool ok = fwrite(&rh, sizeof(rh), 1, file) == 1;
+    if(size1) ok = ok && fwrite(data1, size1, 1, file) == 1;
+    if(size2) ok = ok && fwrite(data2, size2, 1, file) == 1;
+    if(rh.size % 8) ok = ok && fwrite(padding, 8 - rh.size % 8, 1, file) == 1;
+
+    return ok;
+}
+
+}
+
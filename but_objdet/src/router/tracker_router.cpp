@@ -0,0 +1,433 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <string>
+#include <boost/bind.hpp>
+
+#include "but_objdet/services_list.h" // Names of services provided by but_objdet package
+#include "but_objdet/tracker/spatial_grid.h"
+#include "but_objdet/router/tracker_router.h"
+
+using namespace std;
+using namespace but_objdet_msgs;
+
+
+namespace but_objdet
+{
+
+/* -----------------------------------------------------------------------------
+ * Calls a service of the i-th selected shard
+ */
+template <typename S>
+static void callShard(size_t i, const vector<ros::ServiceClient *> *clients,
+                      const vector<string> *names, vector<S> *srvs, vector<char> *ok)
+{
+    ros::ServiceClient &client = *(*clients)[i];
+
+    // The connection is opened again if the shard was restarted
+    if(!client.isValid()) {
+        client = ros::NodeHandle().serviceClient<S>((*names)[i], true);
+    }
+    (*ok)[i] = client.call((*srvs)[i]);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+TrackerRouter::TrackerRouter(ros::NodeHandle nh_, ros::NodeHandle pnh_)
+    : nh(nh_)
+    , pnh(pnh_)
+{
+    XmlRpc::XmlRpcValue shardList, classLists;
+    if(!pnh.getParam("shards", shardList) || shardList.getType() != XmlRpc::XmlRpcValue::TypeArray) {
+        ROS_ERROR("No shards given (the shards parameter).");
+        return;
+    }
+    bool hasClasses = pnh.getParam("shard_classes", classLists) &&
+                      classLists.getType() == XmlRpc::XmlRpcValue::TypeArray;
+
+    shards.resize(shardList.size());
+    for(int i = 0; i < shardList.size(); i++) {
+        Shard &shard = shards[i];
+        shard.ns = static_cast<string>(shardList[i]);
+        shard.predictClient = nh.serviceClient<but_objdet::PredictDetections>(
+            shard.ns + BUT_OBJDET_PredictDetections_SRV, true);
+        shard.objectsClient = nh.serviceClient<but_objdet::GetObjects>(
+            shard.ns + BUT_OBJDET_GetObjects_SRV, true);
+        shard.batchClient = nh.serviceClient<but_objdet::PredictDetectionsBatch>(
+            shard.ns + BUT_OBJDET_PredictDetectionsBatch_SRV, true);
+        shard.historyClient = nh.serviceClient<but_objdet::GetTrackHistory>(
+            shard.ns + BUT_OBJDET_GetTrackHistory_SRV, true);
+
+        // Classes of the shard
+        if(hasClasses && i < classLists.size() &&
+           classLists[i].getType() == XmlRpc::XmlRpcValue::TypeArray && classLists[i].size() > 0) {
+            for(int j = 0; j < classLists[i].size(); j++) {
+                int objClass = classLists[i][j];
+                classShards[objClass].push_back(i);
+            }
+        }
+        else {
+            defaultShards.push_back(i);
+        }
+    }
+
+    // Shards are called at once by a fixed set of threads (the thread
+    // of the service takes part as well)
+    workers.reset(new WorkerPool(max((int)shards.size() - 1, 0)));
+
+    // Services of the shards are provided under the usual names
+    predictionSRV = nh.advertiseService(BUT_OBJDET_PredictDetections_SRV,
+        &TrackerRouter::predictDetections, this);
+    objectsSRV = nh.advertiseService(BUT_OBJDET_GetObjects_SRV,
+        &TrackerRouter::getObjects, this);
+    predictionBatchSRV = nh.advertiseService(BUT_OBJDET_PredictDetectionsBatch_SRV,
+        &TrackerRouter::predictDetectionsBatch, this);
+    historySRV = nh.advertiseService(BUT_OBJDET_GetTrackHistory_SRV,
+        &TrackerRouter::getTrackHistory, this);
+
+    ROS_INFO("Tracker router is running (%u shards)...", (unsigned int)shards.size());
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Function implementing the prediction service
+ */
+bool TrackerRouter::predictDetections(but_objdet::PredictDetections::Request &req,
+                                      but_objdet::PredictDetections::Response &res)
+{
+    vector<unsigned int> selected;
+    selectShards(req.class_id, selected);
+
+    vector<but_objdet::PredictDetections> srvs(selected.size());
+    for(unsigned int i = 0; i < srvs.size(); i++) {
+        srvs[i].request = req;
+    }
+
+    if(!callShards(selected, &Shard::predictClient, BUT_OBJDET_PredictDetections_SRV, srvs)) {
+        return false;
+    }
+
+    // Responses of all the shards one after another
+    for(unsigned int i = 0; i < srvs.size(); i++) {
+        const but_objdet::PredictDetections::Response &r = srvs[i].response;
+        res.predictions.insert(res.predictions.end(), r.predictions.begin(), r.predictions.end());
+        res.states.insert(res.states.end(), r.states.begin(), r.states.end());
+    }
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Function implementing the get objects service
+ */
+bool TrackerRouter::getObjects(but_objdet::GetObjects::Request &req,
+                               but_objdet::GetObjects::Response &res)
+{
+    vector<unsigned int> selected;
+    selectShards(req.class_id, selected);
+
+    vector<but_objdet::GetObjects> srvs(selected.size());
+    for(unsigned int i = 0; i < srvs.size(); i++) {
+        srvs[i].request = req;
+    }
+
+    if(!callShards(selected, &Shard::objectsClient, BUT_OBJDET_GetObjects_SRV, srvs)) {
+        return false;
+    }
+
+    // The nearest objects of all the shards are sorted again and only
+    // k of them are kept
+    if(req.query == but_objdet::GetObjects::Request::QUERY_NEAREST && selected.size() > 1) {
+        vector<pair<float, pair<unsigned int, unsigned int> > > nearest;
+        for(unsigned int i = 0; i < srvs.size(); i++) {
+            const vector<Detection> &objects = srvs[i].response.objects;
+            for(unsigned int j = 0; j < objects.size(); j++) {
+                const Rect &bb = objects[j].m_bb;
+                float d = SpatialGrid::distance2(GridBox(bb.x, bb.y, bb.width, bb.height), req.x, req.y);
+                nearest.push_back(make_pair(d, make_pair(i, j)));
+            }
+        }
+
+        stable_sort(nearest.begin(), nearest.end());
+        if(nearest.size() > req.k) {
+            nearest.resize(req.k);
+        }
+
+        for(unsigned int n = 0; n < nearest.size(); n++) {
+            const but_objdet::GetObjects::Response &r = srvs[nearest[n].second.first].response;
+            unsigned int j = nearest[n].second.second;
+            res.objects.push_back(r.objects[j]);
+            if(req.full_state && j < r.states.size()) {
+                res.states.push_back(r.states[j]);
+            }
+        }
+
+        return true;
+    }
+
+    for(unsigned int i = 0; i < srvs.size(); i++) {
+        const but_objdet::GetObjects::Response &r = srvs[i].response;
+        res.objects.insert(res.objects.end(), r.objects.begin(), r.objects.end());
+        res.states.insert(res.states.end(), r.states.begin(), r.states.end());
+    }
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Function implementing the batch prediction service
+ */
+bool TrackerRouter::predictDetectionsBatch(but_objdet::PredictDetectionsBatch::Request &req,
+                                           but_objdet::PredictDetectionsBatch::Response &res)
+{
+    if(req.object_classes.size() != req.object_ids.size()) {
+        ROS_ERROR("%s: object_classes and object_ids differ in size.",
+                  BUT_OBJDET_PredictDetectionsBatch_SRV.c_str());
+        return false;
+    }
+
+    // Objects and classes of the request are split among their shards
+    // (items of the request are objects followed by classes)
+    unsigned int nObjects = req.object_ids.size();
+    vector<int32_t> itemClasses(req.object_classes);
+    itemClasses.insert(itemClasses.end(), req.class_ids.begin(), req.class_ids.end());
+    bool all = itemClasses.empty();
+
+    vector<unsigned int> selected;
+    vector<vector<int32_t> > items;
+    if(all) {
+        selectShards(-1, selected);
+    }
+    else {
+        splitItems(itemClasses, selected, items);
+    }
+
+    vector<but_objdet::PredictDetectionsBatch> srvs(selected.size());
+    for(unsigned int i = 0; i < srvs.size(); i++) {
+        but_objdet::PredictDetectionsBatch::Request &r = srvs[i].request;
+        r = req;
+        if(all) continue;
+
+        r.object_classes.clear();
+        r.object_ids.clear();
+        r.class_ids.clear();
+        for(unsigned int j = 0; j < items[i].size(); j++) {
+            unsigned int item = items[i][j];
+            if(item < nObjects) {
+                r.object_classes.push_back(req.object_classes[item]);
+                r.object_ids.push_back(req.object_ids[item]);
+            }
+            else {
+                r.class_ids.push_back(req.class_ids[item - nObjects]);
+            }
+        }
+    }
+
+    if(!callShards(selected, &Shard::batchClient, BUT_OBJDET_PredictDetectionsBatch_SRV, srvs)) {
+        return false;
+    }
+
+    // Predictions are merged in the order of the request (request_index
+    // of a shard refers to the items of the shard)
+    vector<pair<int32_t, pair<unsigned int, unsigned int> > > order;
+    for(unsigned int i = 0; i < srvs.size(); i++) {
+        const vector<int32_t> &index = srvs[i].response.request_index;
+        for(unsigned int j = 0; j < index.size(); j++) {
+            int32_t item = -1;
+            if(!all && index[j] >= 0 && (unsigned int)index[j] < items[i].size()) {
+                item = items[i][index[j]];
+            }
+            order.push_back(make_pair(item, make_pair(i, j)));
+        }
+    }
+    stable_sort(order.begin(), order.end());
+
+    for(unsigned int n = 0; n < order.size(); n++) {
+        const but_objdet::PredictDetectionsBatch::Response &r = srvs[order[n].second.first].response;
+        unsigned int j = order[n].second.second;
+        if(j >= r.predictions.size()) continue;
+
+        res.predictions.push_back(r.predictions[j]);
+        res.request_index.push_back(order[n].first);
+        if(req.full_state && j < r.states.size()) {
+            res.states.push_back(r.states[j]);
+        }
+    }
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Function implementing the track history service
+ */
+bool TrackerRouter::getTrackHistory(but_objdet::GetTrackHistory::Request &req,
+                                    but_objdet::GetTrackHistory::Response &res)
+{
+    if(req.object_classes.size() != req.object_ids.size()) {
+        ROS_ERROR("%s: object_classes and object_ids differ in size.",
+                  BUT_OBJDET_GetTrackHistory_SRV.c_str());
+        return false;
+    }
+
+    // Objects of the request are split among their shards, without objects
+    // the request goes to the shards of the class
+    bool all = req.object_ids.empty();
+    vector<unsigned int> selected;
+    vector<vector<int32_t> > items;
+    if(all) {
+        selectShards(req.class_id, selected);
+    }
+    else {
+        splitItems(req.object_classes, selected, items);
+    }
+
+    vector<but_objdet::GetTrackHistory> srvs(selected.size());
+    for(unsigned int i = 0; i < srvs.size(); i++) {
+        but_objdet::GetTrackHistory::Request &r = srvs[i].request;
+        r = req;
+        if(all) continue;
+
+        r.object_classes.clear();
+        r.object_ids.clear();
+        for(unsigned int j = 0; j < items[i].size(); j++) {
+            r.object_classes.push_back(req.object_classes[items[i][j]]);
+            r.object_ids.push_back(req.object_ids[items[i][j]]);
+        }
+    }
+
+    if(!callShards(selected, &Shard::historyClient, BUT_OBJDET_GetTrackHistory_SRV, srvs)) {
+        return false;
+    }
+
+    // Histories are merged in the order of the requested objects (the first
+    // request of an object counts)
+    map<pair<int, int>, int32_t> objectItems;
+    for(int i = (int)req.object_ids.size() - 1; i >= 0; i--) {
+        objectItems[make_pair(req.object_classes[i], req.object_ids[i])] = i;
+    }
+
+    vector<pair<int32_t, pair<unsigned int, unsigned int> > > order;
+    for(unsigned int i = 0; i < srvs.size(); i++) {
+        const vector<TrackHistory> &histories = srvs[i].response.histories;
+        for(unsigned int j = 0; j < histories.size(); j++) {
+            map<pair<int, int>, int32_t>::const_iterator it =
+                objectItems.find(make_pair(histories[j].m_class, histories[j].m_id));
+            order.push_back(make_pair((it != objectItems.end()) ? it->second : -1, make_pair(i, j)));
+        }
+    }
+    stable_sort(order.begin(), order.end());
+
+    res.histories.reserve(order.size());
+    for(unsigned int n = 0; n < order.size(); n++) {
+        res.histories.push_back(srvs[order[n].second.first].response.histories[order[n].second.second]);
+    }
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Selects shards serving a request for a class
+ */
+void TrackerRouter::selectShards(int classId, vector<unsigned int> &selected) const
+{
+    selected.clear();
+
+    if(classId == -1) {
+        for(unsigned int i = 0; i < shards.size(); i++) {
+            selected.push_back(i);
+        }
+        return;
+    }
+
+    map<int, vector<unsigned int> >::const_iterator it = classShards.find(classId);
+    selected = (it != classShards.end()) ? it->second : defaultShards;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Splits items of a request among shards of their classes
+ */
+void TrackerRouter::splitItems(const vector<int32_t> &itemClasses, vector<unsigned int> &selected,
+                               vector<vector<int32_t> > &items) const
+{
+    selected.clear();
+    items.clear();
+
+    vector<int> position(shards.size(), -1); // Index of each shard in selected
+    vector<unsigned int> owners;
+    for(unsigned int i = 0; i < itemClasses.size(); i++) {
+        selectShards(itemClasses[i], owners);
+        for(unsigned int s = 0; s < owners.size(); s++) {
+            int &p = position[owners[s]];
+            if(p < 0) {
+                p = selected.size();
+                selected.push_back(owners[s]);
+                items.push_back(vector<int32_t>());
+            }
+            items[p].push_back(i);
+        }
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Calls a service of several shards at once
+ */
+template <typename S>
+bool TrackerRouter::callShards(const vector<unsigned int> &selected,
+                               ros::ServiceClient Shard::*client, const string &service,
+                               vector<S> &srvs)
+{
+    vector<ros::ServiceClient *> clients(selected.size());
+    vector<string> names(selected.size());
+    vector<char> ok(selected.size(), 0);
+    for(unsigned int i = 0; i < selected.size(); i++) {
+        Shard &shard = shards[selected[i]];
+        clients[i] = &(shard.*client);
+        names[i] = shard.ns + service;
+    }
+
+    workers->run(selected.size(), boost::bind(&callShard<S>, _1, &clients, &names, &srvs, &ok));
+
+    bool all = true;
+    for(unsigned int i = 0; i < selected.size(); i++) {
+        if(!ok[i]) {
+            ROS_WARN("Service %s of shard %s failed.", service.c_str(), shards[selected[i]].ns.c_str());
+            all = false;
+        }
+    }
+
+    return all;
+}
+
+}
@@ -0,0 +1,48 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Executable of the router of tracker services.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ros/ros.h> // Main header of ROS
+
+#include "but_objdet/router/tracker_router.h"
+
+
+/* =============================================================================
+ * Main function
+ */
+int main(int argc, char **argv)
+{
+    // ROS initialization (the last argument is the name of a ROS node)
+    ros::init(argc, argv, "but_tracker_router");
+
+    // Create the object managing connection with ROS system
+    but_objdet::TrackerRouter router;
+
+    // Requests are processed one by one (calls of the shards run in parallel)
+    ros::spin();
+
+    return 0;
+}
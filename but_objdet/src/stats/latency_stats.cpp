@@ -0,0 +1,193 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <algorithm>
+#include <ros/ros.h> // Main header of ROS
+
+#include "but_objdet/stats/latency_stats.h"
+
+using namespace std;
+
+
+namespace but_objdet
+{
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+LatencyHistogram::LatencyHistogram()
+{
+    clear();
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Bucket of a value - the position of the highest bit gives the power of two,
+ * the next bits the bucket within it
+ */
+int LatencyHistogram::bucketOf(uint64_t ns)
+{
+    if(ns < 2 * LATENCY_SUB_BUCKETS) return (int)ns;
+
+    int exponent = 63 - __builtin_clzll(ns); // >= 5
+    int sub = (int)(ns >> (exponent - 4)) & (LATENCY_SUB_BUCKETS - 1);
+
+    return 2 * LATENCY_SUB_BUCKETS + (exponent - 5) * LATENCY_SUB_BUCKETS + sub;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * The highest value of a bucket
+ */
+uint64_t LatencyHistogram::upperBound(int bucket)
+{
+    if(bucket < 2 * LATENCY_SUB_BUCKETS) return bucket;
+
+    int exponent = (bucket - 2 * LATENCY_SUB_BUCKETS) / LATENCY_SUB_BUCKETS + 5;
+    int sub = (bucket - 2 * LATENCY_SUB_BUCKETS) % LATENCY_SUB_BUCKETS;
+
+    return ((uint64_t)(LATENCY_SUB_BUCKETS + sub + 1) << (exponent - 4)) - 1;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Adds a latency
+ */
+void LatencyHistogram::add(int64_t ns)
+{
+    if(ns < 0) ns = 0;
+
+    __sync_fetch_and_add(&buckets[bucketOf(ns)], 1);
+    __sync_fetch_and_add(&n, 1);
+    __sync_fetch_and_add(&sum, ns);
+
+    int64_t current = max;
+    while(ns > current) {
+        int64_t previous = __sync_val_compare_and_swap(&max, current, ns);
+        if(previous == current) break;
+        current = previous;
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Removes all values
+ */
+void LatencyHistogram::clear()
+{
+    for(int i = 0; i < LATENCY_BUCKETS; i++) {
+        buckets[i] = 0;
+    }
+    n = 0;
+    sum = 0;
+    max = 0;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Moves the values into another histogram
+ */
+void LatencyHistogram::take(LatencyHistogram& values)
+{
+    // The count is given by the taken buckets, so that it matches them
+    uint64_t count = 0;
+    for(int i = 0; i < LATENCY_BUCKETS; i++) {
+        values.buckets[i] = __sync_fetch_and_and(&buckets[i], 0);
+        count += values.buckets[i];
+    }
+    __sync_fetch_and_sub(&n, count);
+    values.n = count;
+    values.sum = __sync_fetch_and_and(&sum, 0);
+    values.max = __sync_lock_test_and_set(&max, 0);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Returns an approximate percentile (upper bound of the bucket containing it)
+ */
+double LatencyHistogram::percentile(double p) const
+{
+    if(n == 0) return 0.0;
+
+    uint64_t rank = (uint64_t)ceil(p / 100.0 * n);
+    if(rank == 0) rank = 1;
+
+    uint64_t cumulative = 0;
+    for(int i = 0; i < LATENCY_BUCKETS; i++) {
+        cumulative += buckets[i];
+        if(cumulative >= rank) {
+            return std::min((double)upperBound(i), (double)max) / 1e6;
+        }
+    }
+
+    return maxMs();
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+LatencyStats::LatencyStats(const string& name_)
+    : name(name_)
+{
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Adds a latency measured for an object of the given class
+ */
+void LatencyStats::add(int objClass, int64_t fromNs, int64_t toNs)
+{
+    if(fromNs == 0) return;
+
+    boost::mutex::scoped_lock lock(mutex);
+    histograms[objClass].add(toNs - fromNs);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Writes the collected latencies into the log and clears them
+ */
+void LatencyStats::report()
+{
+    boost::mutex::scoped_lock lock(mutex);
+
+    Histograms::iterator it;
+    for(it = histograms.begin(); it != histograms.end(); it++) {
+        LatencyHistogram &h = it->second;
+        if(h.count() == 0) continue;
+
+        ROS_INFO("Latency %s, class %d: n = %lu, mean = %.2f ms, p50 = %.2f ms, "
+                 "p90 = %.2f ms, p99 = %.2f ms, max = %.2f ms",
+                 name.c_str(), it->first, (unsigned long)h.count(), h.meanMs(),
+                 h.percentile(50), h.percentile(90), h.percentile(99), h.maxMs());
+        h.clear();
+    }
+}
+
+}
+
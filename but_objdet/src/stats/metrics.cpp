@@ -0,0 +1,182 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+#include "but_objdet/stats/metrics.h"
+
+using namespace std;
+
+const string metricsTopic = "/diagnostics";
+
+
+namespace but_objdet
+{
+
+/**
+ * Creates a key-value pair of a diagnostic status.
+ */
+static diagnostic_msgs::KeyValue metricValue(const string &key, const char *format, double value)
+{
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), format, value);
+
+    diagnostic_msgs::KeyValue kv;
+    kv.key = key;
+    kv.value = buffer;
+    return kv;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Computes statistics of the added durations and removes them
+ */
+void MetricHistogram::collect(MetricSummary &summary)
+{
+    LatencyHistogram values;
+    histogram.take(values);
+
+    summary.count = values.count();
+    summary.meanMs = values.meanMs();
+    summary.p50Ms = values.percentile(50);
+    summary.p90Ms = values.percentile(90);
+    summary.p99Ms = values.percentile(99);
+    summary.maxMs = values.maxMs();
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+MetricsRegistry::MetricsRegistry(const string &name_)
+    : name(name_)
+{
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Returns a counter (it is created if it doesn't exist)
+ */
+MetricCounter *MetricsRegistry::counter(const string &metric)
+{
+    boost::mutex::scoped_lock lock(mutex);
+
+    boost::shared_ptr<MetricCounter> &m = counters[metric];
+    if(!m) m.reset(new MetricCounter);
+    return m.get();
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Returns a gauge (it is created if it doesn't exist)
+ */
+MetricGauge *MetricsRegistry::gauge(const string &metric)
+{
+    boost::mutex::scoped_lock lock(mutex);
+
+    boost::shared_ptr<MetricGauge> &m = gauges[metric];
+    if(!m) m.reset(new MetricGauge);
+    return m.get();
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Returns a histogram (it is created if it doesn't exist)
+ */
+MetricHistogram *MetricsRegistry::histogram(const string &metric)
+{
+    boost::mutex::scoped_lock lock(mutex);
+
+    boost::shared_ptr<MetricHistogram> &m = histograms[metric];
+    if(!m) m.reset(new MetricHistogram);
+    return m.get();
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Writes values of all the metrics into a diagnostic status
+ */
+void MetricsRegistry::summarize(diagnostic_msgs::DiagnosticStatus &status)
+{
+    boost::mutex::scoped_lock lock(mutex);
+
+    status.name = name;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.message = "OK";
+    status.values.clear();
+
+    map<string, boost::shared_ptr<MetricCounter> >::const_iterator c;
+    for(c = counters.begin(); c != counters.end(); ++c) {
+        status.values.push_back(metricValue(c->first, "%.0f", (double)c->second->get()));
+    }
+
+    map<string, boost::shared_ptr<MetricGauge> >::const_iterator g;
+    for(g = gauges.begin(); g != gauges.end(); ++g) {
+        status.values.push_back(metricValue(g->first, "%.0f", (double)g->second->get()));
+    }
+
+    map<string, boost::shared_ptr<MetricHistogram> >::const_iterator h;
+    for(h = histograms.begin(); h != histograms.end(); ++h) {
+        MetricSummary s;
+        h->second->collect(s);
+
+        status.values.push_back(metricValue(h->first + " count", "%.0f", (double)s.count));
+        status.values.push_back(metricValue(h->first + " mean [ms]", "%.3f", s.meanMs));
+        status.values.push_back(metricValue(h->first + " p50 [ms]", "%.3f", s.p50Ms));
+        status.values.push_back(metricValue(h->first + " p90 [ms]", "%.3f", s.p90Ms));
+        status.values.push_back(metricValue(h->first + " p99 [ms]", "%.3f", s.p99Ms));
+        status.values.push_back(metricValue(h->first + " max [ms]", "%.3f", s.maxMs));
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Starts publishing of summaries
+ */
+void MetricsRegistry::start(ros::NodeHandle &nh, double period)
+{
+    if(period <= 0) return;
+
+    diagnosticsPub = nh.advertise<diagnostic_msgs::DiagnosticArray>(metricsTopic, 1);
+    timer = nh.createWallTimer(ros::WallDuration(period), &MetricsRegistry::timerCallback, this);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Publishes a summary
+ */
+void MetricsRegistry::timerCallback(const ros::WallTimerEvent &event)
+{
+    diagnostic_msgs::DiagnosticArrayPtr array(new diagnostic_msgs::DiagnosticArray);
+    array->header.stamp = ros::Time::now();
+    array->status.resize(1);
+    summarize(array->status[0]);
+
+    diagnosticsPub.publish(array);
+}
+
+}
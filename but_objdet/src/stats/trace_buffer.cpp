@@ -0,0 +1,250 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <boost/bind.hpp>
+
+#include "but_objdet/stats/trace_buffer.h"
+
+using namespace std;
+
+
+namespace but_objdet
+{
+
+/**
+ * Returns ID of the calling thread (as shown by the system tools).
+ */
+static int threadId()
+{
+    static __thread int tid = 0;
+    if(tid == 0) {
+        tid = (int)syscall(SYS_gettid);
+    }
+    return tid;
+}
+
+/**
+ * Writes a time in microseconds (with the precision of nanoseconds).
+ */
+static void writeMicros(FILE *file, int64_t ns)
+{
+    fprintf(file, "%lld.%03d", (long long)(ns / 1000), (int)(ns % 1000));
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Returns the buffer of this process
+ */
+TraceBuffer &TraceBuffer::instance()
+{
+    static TraceBuffer buffer;
+    return buffer;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+TraceBuffer::TraceBuffer()
+    : slots(NULL)
+    , mask(0)
+    , head(0)
+    , tail(0)
+    , droppedCount(0)
+    , active(false)
+    , file(NULL)
+    , pid(getpid())
+    , running(false)
+{
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Destructor
+ */
+TraceBuffer::~TraceBuffer()
+{
+    close();
+
+    // The slots are kept until now, a thread could still be adding a span
+    delete[] slots;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Starts writing of spans
+ */
+bool TraceBuffer::open(const string &path, const string &process, unsigned int capacity)
+{
+    boost::mutex::scoped_lock lock(mutex);
+
+    // The buffer is opened just once (spans could be still added into
+    // the slots after it was closed)
+    if(slots) return file != NULL;
+
+    file = fopen(path.c_str(), "w");
+    if(!file) return false;
+
+    unsigned int size = 1;
+    while(size < capacity) size <<= 1;
+
+    slots = new Slot[size];
+    for(unsigned int i = 0; i < size; i++) {
+        slots[i].seq = i;
+    }
+    mask = size - 1;
+    head = tail = 0;
+
+    // The array isn't closed until close() (viewers accept that), so that
+    // the file can be read while the process is running
+    fprintf(file, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"%s\"}}",
+            pid, process.c_str());
+
+    running = true;
+    writer = boost::thread(boost::bind(&TraceBuffer::writeLoop, this));
+
+    __sync_synchronize();
+    active = true;
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Writes the remaining spans and closes the file
+ */
+void TraceBuffer::close()
+{
+    boost::mutex::scoped_lock lock(mutex);
+
+    if(!file) return;
+
+    active = false;
+    running = false;
+    writer.join();
+
+    drain();
+    fprintf(file, "\n]\n");
+    fclose(file);
+    file = NULL;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Adds a span
+ */
+void TraceBuffer::add(const TraceSpan &span)
+{
+    if(!active) return;
+
+    // A position is reserved by moving the head, the slot is marked as
+    // written once the span is copied into it
+    uint64_t pos = head;
+    Slot *slot;
+    for(;;) {
+        slot = &slots[pos & mask];
+        uint64_t seq = slot->seq;
+
+        if(seq == pos) {
+            if(__sync_bool_compare_and_swap(&head, pos, pos + 1)) break;
+        }
+        else if(seq < pos) {
+            // The writer hasn't read the slot yet (the buffer is full)
+            __sync_fetch_and_add(&droppedCount, 1);
+            return;
+        }
+        pos = head;
+    }
+
+    slot->span = span;
+    slot->span.tid = threadId();
+
+    __sync_synchronize();
+    slot->seq = pos + 1;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Thread writing spans into the file
+ */
+void TraceBuffer::writeLoop()
+{
+    while(running) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+        drain();
+        fflush(file);
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Writes all the added spans
+ */
+void TraceBuffer::drain()
+{
+    for(;;) {
+        Slot &slot = slots[tail & mask];
+        if(slot.seq != tail + 1) break;
+
+        __sync_synchronize();
+        TraceSpan span = slot.span;
+        __sync_synchronize();
+        slot.seq = tail + mask + 1;
+        tail++;
+
+        fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"but_objdet\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":",
+                span.name, pid, span.tid);
+        writeMicros(file, span.start);
+        fprintf(file, ",\"dur\":");
+        writeMicros(file, span.end - span.start);
+        fprintf(file, ",\"args\":{\"stamp\":%lld,\"seq\":%u}}", (long long)span.stamp, span.seq);
+    }
+}
+
+
+/* =============================================================================
+ * Opens the trace buffer of the process if a node is given the parameter
+ */
+void traceInit(ros::NodeHandle &pnh)
+{
+    string traceFile;
+    int bufferSize;
+    pnh.param("trace_file", traceFile, string(""));
+    pnh.param("trace_buffer_size", bufferSize, 65536);
+    if(traceFile.empty()) return;
+
+    if(TraceBuffer::instance().open(traceFile, ros::this_node::getName(), max(bufferSize, 1))) {
+        ROS_INFO("Writing trace spans into %s.", traceFile.c_str());
+    }
+    else {
+        ROS_ERROR("Failed to create trace file %s.", traceFile.c_str());
+    }
+}
+
+}
@@ -0,0 +1,276 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Merges trace files written by nodes (~trace_file parameter)
+ * into one timeline. Spans of one frame (the same stamp) are connected by
+ * flow arrows starting at the capture of the frame, so a slow frame can be
+ * followed through the whole pipeline in chrome://tracing or Perfetto.
+ * Clocks of the hosts are expected to be synchronized (e.g. by NTP).
+ *
+ * Usage: but_objdet_trace_merge OUTPUT TRACE [TRACE ...]
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+using namespace std;
+
+
+/* =============================================================================
+ * A span read from a trace file
+ */
+struct Span
+{
+    string json; // The event with the pid of the merged trace
+    int pid, tid;
+    int64_t start, end; // [ns]
+    int64_t stamp;      // [ns]
+    unsigned int seq;
+
+    bool operator<(const Span &other) const { return start < other.start; }
+};
+
+
+/* =============================================================================
+ * Returns position of the value of a field in an event, or NULL
+ */
+static const char *findField(const string &json, const char *field)
+{
+    string key = string("\"") + field + "\":";
+    size_t pos = json.find(key);
+    return (pos != string::npos) ? json.c_str() + pos + key.size() : NULL;
+}
+
+
+/* =============================================================================
+ * Reads a time in microseconds as nanoseconds (without rounding errors)
+ */
+static int64_t parseMicros(const char *text)
+{
+    char *end;
+    int64_t ns = strtoll(text, &end, 10) * 1000;
+    if(*end == '.') {
+        int64_t scale = 100;
+        for(const char *p = end + 1; *p >= '0' && *p <= '9'; p++) {
+            ns += (*p - '0') * scale;
+            scale /= 10;
+        }
+    }
+    return ns;
+}
+
+
+/* =============================================================================
+ * Replaces the pid of an event
+ */
+static string replacePid(const string &json, int pid)
+{
+    size_t pos = json.find("\"pid\":");
+    if(pos == string::npos) return json;
+
+    pos += 6;
+    size_t end = pos;
+    while(end < json.size() && (isdigit(json[end]) || json[end] == '-')) end++;
+
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%d", pid);
+    return json.substr(0, pos) + buffer + json.substr(end);
+}
+
+
+/* =============================================================================
+ * Writes a time in microseconds
+ */
+static void writeMicros(FILE *file, int64_t ns)
+{
+    fprintf(file, "%lld.%03d", (long long)(ns / 1000), (int)(ns % 1000));
+}
+
+
+/* =============================================================================
+ * Reads events of a trace file (written by TraceBuffer, one event per line)
+ */
+static bool readTrace(const char *path, int pid, vector<string> &metadata, vector<Span> &spans)
+{
+    ifstream in(path);
+    if(!in) return false;
+
+    string line;
+    while(getline(in, line)) {
+        size_t begin = line.find('{');
+        size_t end = line.rfind('}');
+        if(begin == string::npos || end == string::npos) continue;
+
+        string json = replacePid(line.substr(begin, end - begin + 1), pid);
+        const char *ph = findField(json, "ph");
+        if(!ph) continue;
+
+        if(strncmp(ph, "\"M\"", 3) == 0) {
+            metadata.push_back(json);
+            continue;
+        }
+
+        const char *ts = findField(json, "ts");
+        const char *dur = findField(json, "dur");
+        const char *tid = findField(json, "tid");
+        const char *stamp = findField(json, "stamp");
+        const char *seq = findField(json, "seq");
+        if(strncmp(ph, "\"X\"", 3) != 0 || !ts || !dur || !tid || !stamp) continue;
+
+        Span span;
+        span.json = json;
+        span.pid = pid;
+        span.tid = atoi(tid);
+        span.start = parseMicros(ts);
+        span.end = span.start + parseMicros(dur);
+        span.stamp = strtoll(stamp, NULL, 10);
+        span.seq = seq ? strtoul(seq, NULL, 10) : 0;
+        spans.push_back(span);
+    }
+
+    return true;
+}
+
+
+/* =============================================================================
+ * Returns a lane, which is free at the given time (captures of frames, which
+ * are processed at the same time, are shown in several lanes, so that spans
+ * of one lane don't overlap)
+ */
+static int freeLane(vector<int64_t> &laneEnds, int64_t start, int64_t end)
+{
+    unsigned int lane = 0;
+    while(lane < laneEnds.size() && laneEnds[lane] > start) lane++;
+
+    if(lane == laneEnds.size()) laneEnds.push_back(end);
+    else laneEnds[lane] = end;
+
+    return (int)lane;
+}
+
+
+/* =============================================================================
+ * Writes a flow event connecting spans of a frame
+ */
+static void writeFlow(FILE *file, const char *ph, int64_t id, int pid, int tid, int64_t ts)
+{
+    fprintf(file, ",\n{\"name\":\"frame\",\"cat\":\"frame\",\"ph\":\"%s\",\"id\":%lld,\"pid\":%d,\"tid\":%d,\"ts\":",
+            ph, (long long)id, pid, tid);
+    writeMicros(file, ts);
+    fprintf(file, "%s}", (ph[0] == 'f') ? ",\"bp\":\"e\"" : "");
+}
+
+
+/* =============================================================================
+ * Main function
+ */
+int main(int argc, char **argv)
+{
+    if(argc < 3) {
+        printf("Usage: %s OUTPUT TRACE [TRACE ...]\n", argv[0]);
+        return 1;
+    }
+
+    // Processes of different files (possibly of different hosts) get their
+    // own pids, 0 is the camera
+    vector<string> metadata;
+    vector<Span> spans;
+    for(int i = 2; i < argc; i++) {
+        if(!readTrace(argv[i], i - 1, metadata, spans)) {
+            printf("Cannot read trace %s.\n", argv[i]);
+            return 1;
+        }
+    }
+    stable_sort(spans.begin(), spans.end());
+
+    // Spans of each frame (unstamped frames can't be connected)
+    map<int64_t, vector<unsigned int> > frames;
+    for(unsigned int i = 0; i < spans.size(); i++) {
+        if(spans[i].stamp != 0) {
+            frames[spans[i].stamp].push_back(i);
+        }
+    }
+
+    FILE *file = fopen(argv[1], "w");
+    if(!file) {
+        printf("Cannot create %s.\n", argv[1]);
+        return 1;
+    }
+
+    fprintf(file, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"camera\"}}");
+    for(unsigned int i = 0; i < metadata.size(); i++) {
+        fprintf(file, ",\n%s", metadata[i].c_str());
+    }
+    for(unsigned int i = 0; i < spans.size(); i++) {
+        fprintf(file, ",\n%s", spans[i].json.c_str());
+    }
+
+    // The capture of each frame (from its stamp to the first span) and
+    // arrows through the spans of the frame, where it passes to another
+    // process (a frame can come back, e.g. predictions to its detector)
+    int64_t id = 0;
+    vector<int64_t> laneEnds;
+    map<int64_t, vector<unsigned int> >::const_iterator it;
+    for(it = frames.begin(); it != frames.end(); ++it, ++id) {
+        const vector<unsigned int> &indices = it->second;
+        const Span &first = spans[indices[0]];
+
+        int64_t captureEnd = max(first.start, it->first);
+        int lane = freeLane(laneEnds, it->first, captureEnd);
+        fprintf(file, ",\n{\"name\":\"capture\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":", lane);
+        writeMicros(file, it->first);
+        fprintf(file, ",\"dur\":");
+        writeMicros(file, captureEnd - it->first);
+        fprintf(file, ",\"args\":{\"stamp\":%lld,\"seq\":%u}}", (long long)it->first, first.seq);
+
+        vector<unsigned int> steps;
+        for(unsigned int i = 0; i < indices.size(); i++) {
+            const Span &span = spans[indices[i]];
+            if(!steps.empty() && spans[steps.back()].pid == span.pid) continue;
+            steps.push_back(indices[i]);
+        }
+
+        writeFlow(file, "s", id, 0, lane, it->first);
+        for(unsigned int i = 0; i < steps.size(); i++) {
+            const Span &span = spans[steps[i]];
+            writeFlow(file, (i + 1 < steps.size()) ? "t" : "f", id, span.pid, span.tid, span.start);
+        }
+    }
+
+    fprintf(file, "\n]\n");
+    fclose(file);
+
+    printf("Merged %u spans of %u frames into %s.\n", (unsigned int)spans.size(),
+           (unsigned int)frames.size(), argv[1]);
+
+    return 0;
+}
@@ -0,0 +1,270 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "but_objdet/tracker/source_fusion.h"
+
+using namespace std;
+using namespace but_objdet_msgs;
+
+
+namespace but_objdet
+{
+
+/**
+ * Rounds a coordinate to the nearest pixel.
+ */
+static int roundPx(float value)
+{
+    return (int)floor(value + 0.5f);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Constructor - a camera in the origin of the common frame
+ */
+CameraModel::CameraModel()
+    : fx(1), fy(1), cx(0), cy(0)
+{
+    for(int i = 0; i < 9; i++) {
+        R[i] = (i % 4 == 0) ? 1 : 0;
+    }
+    t[0] = t[1] = t[2] = 0;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Sets the pose of the camera in the common frame
+ */
+void CameraModel::setPose(const double translation[3], const double rotation[4])
+{
+    double x = rotation[0], y = rotation[1], z = rotation[2], w = rotation[3];
+    double n = sqrt(x * x + y * y + z * z + w * w);
+    if(n > 0) {
+        x /= n; y /= n; z /= n; w /= n;
+    }
+    else {
+        x = y = z = 0; w = 1;
+    }
+
+    R[0] = 1 - 2 * (y * y + z * z); R[1] = 2 * (x * y - z * w);     R[2] = 2 * (x * z + y * w);
+    R[3] = 2 * (x * y + z * w);     R[4] = 1 - 2 * (x * x + z * z); R[5] = 2 * (y * z - x * w);
+    R[6] = 2 * (x * z - y * w);     R[7] = 2 * (y * z + x * w);     R[8] = 1 - 2 * (x * x + y * y);
+
+    for(int i = 0; i < 3; i++) {
+        t[i] = translation[i];
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Transforms a point in the image with its depth into the common frame
+ */
+void CameraModel::toCommon(float u, float v, float depth, float p[3]) const
+{
+    float c[3] = { (u - cx) * depth / fx, (v - cy) * depth / fy, depth };
+
+    for(int i = 0; i < 3; i++) {
+        p[i] = R[3 * i] * c[0] + R[3 * i + 1] * c[1] + R[3 * i + 2] * c[2] + t[i];
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Projects a point of the common frame into the image
+ */
+bool CameraModel::toImage(const float p[3], float &u, float &v, float &depth) const
+{
+    // Inverse rotation is the transposed one
+    float d[3] = { p[0] - t[0], p[1] - t[1], p[2] - t[2] };
+    float c[3];
+    for(int i = 0; i < 3; i++) {
+        c[i] = R[i] * d[0] + R[3 + i] * d[1] + R[6 + i] * d[2];
+    }
+
+    if(c[2] <= 0) return false;
+
+    u = fx * c[0] / c[2] + cx;
+    v = fy * c[1] / c[2] + cy;
+    depth = c[2];
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Adds a source
+ */
+int SourceFusion::addSource(const CameraModel &camera)
+{
+    cameras.push_back(camera);
+    tables.push_back(map<ObjectKey, int>());
+
+    return cameras.size() - 1;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Returns the source of a detection
+ */
+int SourceFusion::sourceOf(const Detection &det) const
+{
+    if(!det.header.frame_id.empty()) {
+        for(unsigned int i = 0; i < cameras.size(); i++) {
+            if(cameras[i].frameId == det.header.frame_id) return i;
+        }
+    }
+
+    return (det.m_source >= 0 && det.m_source < (int)cameras.size()) ? det.m_source : -1;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Transfers a detection into the image of another source
+ */
+bool SourceFusion::transfer(const Detection &det, int to, Detection &out) const
+{
+    const CameraModel &src = cameras[det.m_source];
+    const CameraModel &dst = cameras[to];
+
+    float depth = det.m_pos_2D.z;
+    if(depth <= 0) return false;
+
+    float p[3], u, v, d;
+    src.toCommon(det.m_pos_2D.x, det.m_pos_2D.y, depth, p);
+    if(!dst.toImage(p, u, v, d)) return false;
+
+    // Sizes change with the focal length and the distance from the camera,
+    // the box keeps its position relative to the point
+    float sx = (dst.fx / src.fx) * (depth / d);
+    float sy = (dst.fy / src.fy) * (depth / d);
+
+    out = det;
+    out.header.frame_id = dst.frameId;
+    out.m_source = to;
+    out.m_pos_2D.x = u;
+    out.m_pos_2D.y = v;
+    out.m_pos_2D.z = d;
+    out.m_bb.x = roundPx(u + (det.m_bb.x - det.m_pos_2D.x) * sx);
+    out.m_bb.y = roundPx(v + (det.m_bb.y - det.m_pos_2D.y) * sy);
+    out.m_bb.width = roundPx(det.m_bb.width * sx);
+    out.m_bb.height = roundPx(det.m_bb.height * sy);
+    out.m_speed.x = det.m_speed.x * sx;
+    out.m_speed.y = det.m_speed.y * sy;
+    out.m_mask = sensor_msgs::Image();
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Adds a detection into an average of detections
+ */
+void SourceFusion::combine(const Detection &det, unsigned int count, Detection &average)
+{
+    if(count == 0) {
+        average = det;
+        return;
+    }
+
+    // Running average of the position and the box, the highest score and
+    // the latest times
+    float w = 1.0f / (count + 1);
+    average.m_pos_2D.x += (det.m_pos_2D.x - average.m_pos_2D.x) * w;
+    average.m_pos_2D.y += (det.m_pos_2D.y - average.m_pos_2D.y) * w;
+    average.m_pos_2D.z += (det.m_pos_2D.z - average.m_pos_2D.z) * w;
+    average.m_bb.x = roundPx(average.m_bb.x + (det.m_bb.x - average.m_bb.x) * w);
+    average.m_bb.y = roundPx(average.m_bb.y + (det.m_bb.y - average.m_bb.y) * w);
+    average.m_bb.width = roundPx(average.m_bb.width + (det.m_bb.width - average.m_bb.width) * w);
+    average.m_bb.height = roundPx(average.m_bb.height + (det.m_bb.height - average.m_bb.height) * w);
+    average.m_score = max(average.m_score, det.m_score);
+    average.m_timestamp = max(average.m_timestamp, det.m_timestamp);
+    average.m_proc_timestamp = max(average.m_proc_timestamp, det.m_proc_timestamp);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Returns the track of an object identified by a detector of a source
+ */
+int SourceFusion::lookup(int source, int objClass, int localId) const
+{
+    const map<ObjectKey, int> &table = tables[source];
+    map<ObjectKey, int>::const_iterator it = table.find(ObjectKey(objClass, localId));
+
+    return (it != table.end()) ? it->second : (int)Detection::NO_ID;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Assigns a track to an object identified by a detector of a source
+ */
+void SourceFusion::bind(int source, int objClass, int localId, int trackId)
+{
+    tables[source][ObjectKey(objClass, localId)] = trackId;
+    bindings.insert(make_pair(ObjectKey(objClass, trackId), make_pair(source, localId)));
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Tests if any object of a source is assigned to a track
+ */
+bool SourceFusion::bound(int source, int objClass, int trackId) const
+{
+    typedef multimap<ObjectKey, pair<int, int> >::const_iterator Iterator;
+    pair<Iterator, Iterator> range = bindings.equal_range(ObjectKey(objClass, trackId));
+
+    for(Iterator it = range.first; it != range.second; ++it) {
+        if(it->second.first == source) return true;
+    }
+
+    return false;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Removes all assignments of a removed track
+ */
+void SourceFusion::unbind(int objClass, int trackId)
+{
+    typedef multimap<ObjectKey, pair<int, int> >::iterator Iterator;
+    pair<Iterator, Iterator> range = bindings.equal_range(ObjectKey(objClass, trackId));
+
+    for(Iterator it = range.first; it != range.second; ++it) {
+        map<ObjectKey, int> &table = tables[it->second.first];
+        map<ObjectKey, int>::iterator entry = table.find(ObjectKey(objClass, it->second.second));
+
+        // The object could be assigned to another track since then
+        if(entry != table.end() && entry->second == trackId) {
+            table.erase(entry);
+        }
+    }
+
+    bindings.erase(range.first, range.second);
+}
+
+}
@@ -0,0 +1,264 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "but_objdet/tracker/spatial_grid.h"
+
+using namespace std;
+
+
+namespace but_objdet
+{
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+SpatialGrid::SpatialGrid(float cellSize_, int maxCells_)
+    : cellSize(cellSize_ > 0 ? cellSize_ : 64)
+    , cell(cellSize)
+    , maxCells(maxCells_ > 0 ? maxCells_ : 1)
+    , originX(0)
+    , originY(0)
+    , cols(0)
+    , rows(0)
+{
+    cellStart.assign(1, 0);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Sets the size of a cell
+ */
+void SpatialGrid::setCellSize(float cellSize_)
+{
+    if(cellSize_ > 0) cellSize = cellSize_;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Builds the grid
+ */
+void SpatialGrid::build(const vector<GridBox>& boxes_)
+{
+    boxes = boxes_;
+    items.clear();
+    cols = rows = 0;
+
+    // Bounds of all the valid boxes
+    bool any = false;
+    float minX = 0, minY = 0, maxX = 0, maxY = 0;
+    for(unsigned int i = 0; i < boxes.size(); i++) {
+        const GridBox &b = boxes[i];
+        if(b.width < 0 || b.height < 0) continue;
+
+        if(!any) {
+            minX = b.x; minY = b.y;
+            maxX = b.x + b.width; maxY = b.y + b.height;
+            any = true;
+        }
+        minX = min(minX, b.x);
+        minY = min(minY, b.y);
+        maxX = max(maxX, b.x + b.width);
+        maxY = max(maxY, b.y + b.height);
+    }
+
+    if(!any) {
+        cellStart.assign(1, 0);
+        return;
+    }
+
+    // Cells are enlarged if the boxes are spread too much
+    originX = minX;
+    originY = minY;
+    cell = max(cellSize, max((maxX - minX) / maxCells, (maxY - minY) / maxCells));
+    cols = min(maxCells, max(1, (int)ceil((maxX - minX) / cell)));
+    rows = min(maxCells, max(1, (int)ceil((maxY - minY) / cell)));
+
+    // 1) Count boxes in each cell
+    cellStart.assign(cols * rows + 1, 0);
+    for(unsigned int i = 0; i < boxes.size(); i++) {
+        const GridBox &b = boxes[i];
+        if(b.width < 0 || b.height < 0) continue;
+
+        int c0 = column(b.x), c1 = column(b.x + b.width);
+        int r0 = row(b.y), r1 = row(b.y + b.height);
+        for(int r = r0; r <= r1; r++) {
+            for(int c = c0; c <= c1; c++) {
+                cellStart[r * cols + c + 1]++;
+            }
+        }
+    }
+    for(unsigned int i = 1; i < cellStart.size(); i++) {
+        cellStart[i] += cellStart[i - 1];
+    }
+
+    // 2) Fill lists of the cells
+    items.resize(cellStart.back());
+    vector<uint32_t> pos(cellStart.begin(), cellStart.end() - 1);
+    for(unsigned int i = 0; i < boxes.size(); i++) {
+        const GridBox &b = boxes[i];
+        if(b.width < 0 || b.height < 0) continue;
+
+        int c0 = column(b.x), c1 = column(b.x + b.width);
+        int r0 = row(b.y), r1 = row(b.y + b.height);
+        for(int r = r0; r <= r1; r++) {
+            for(int c = c0; c <= c1; c++) {
+                items[pos[r * cols + c]++] = i;
+            }
+        }
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Finds boxes intersecting a region
+ */
+void SpatialGrid::queryRegion(const GridBox& region, vector<uint32_t>& result) const
+{
+    result.clear();
+    if(cols == 0) return;
+
+    float right = region.x + region.width;
+    float bottom = region.y + region.height;
+
+    int c0 = column(region.x), c1 = column(right);
+    int r0 = row(region.y), r1 = row(bottom);
+    for(int r = r0; r <= r1; r++) {
+        for(int c = c0; c <= c1; c++) {
+            int cellId = r * cols + c;
+            for(uint32_t k = cellStart[cellId]; k < cellStart[cellId + 1]; k++) {
+                const GridBox &b = boxes[items[k]];
+                if(b.x > right || b.x + b.width < region.x ||
+                   b.y > bottom || b.y + b.height < region.y) continue;
+
+                // A box overlapping more cells is reported just in the cell
+                // containing the top-left corner of its intersection with
+                // the region
+                if(column(max(b.x, region.x)) != c || row(max(b.y, region.y)) != r) continue;
+
+                result.push_back(items[k]);
+            }
+        }
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Finds k boxes nearest to a point
+ */
+void SpatialGrid::nearest(float x, float y, unsigned int k, vector<uint32_t>& result,
+                          const Filter *filter) const
+{
+    result.clear();
+    if(cols == 0 || k == 0) return;
+
+    vector<pair<float, uint32_t> > candidates;
+    int cx = column(x), cy = row(y);
+
+    // Rings of cells around the cell of the point are searched until the
+    // k-th nearest box is closer than any box outside the searched square
+    for(int d = 0; ; d++) {
+        int c0 = cx - d, c1 = cx + d;
+        int r0 = cy - d, r1 = cy + d;
+
+        for(int r = max(r0, 0); r <= min(r1, rows - 1); r++) {
+            if(r == r0 || r == r1) {
+                for(int c = max(c0, 0); c <= min(c1, cols - 1); c++) {
+                    collect(c, r, x, y, filter, candidates);
+                }
+            }
+            else {
+                if(c0 >= 0) collect(c0, r, x, y, filter, candidates);
+                if(c1 < cols && c1 != c0) collect(c1, r, x, y, filter, candidates);
+            }
+        }
+
+        bool covered = c0 <= 0 && r0 <= 0 && c1 >= cols - 1 && r1 >= rows - 1;
+        if(candidates.size() < k && !covered) continue;
+
+        // Boxes overlapping more cells are found more times
+        sort(candidates.begin(), candidates.end());
+        candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+        if(covered) break;
+
+        if(candidates.size() >= k) {
+            float bound = min(min(x - (originX + c0 * cell), originX + (c1 + 1) * cell - x),
+                              min(y - (originY + r0 * cell), originY + (r1 + 1) * cell - y));
+            if(bound >= 0 && candidates[k - 1].first <= bound * bound) break;
+        }
+    }
+
+    for(unsigned int i = 0; i < candidates.size() && i < k; i++) {
+        result.push_back(candidates[i].second);
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Adds boxes listed in a cell to candidates of nearest()
+ */
+void SpatialGrid::collect(int c, int r, float x, float y, const Filter *filter,
+                          vector<pair<float, uint32_t> >& candidates) const
+{
+    int cellId = r * cols + c;
+    for(uint32_t k = cellStart[cellId]; k < cellStart[cellId + 1]; k++) {
+        uint32_t item = items[k];
+        if(filter && !filter->accept(item)) continue;
+
+        candidates.push_back(make_pair(distance2(boxes[item], x, y), item));
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Squared distance of a point to a box
+ */
+float SpatialGrid::distance2(const GridBox& box, float x, float y)
+{
+    float dx = max(max(box.x - x, x - (box.x + box.width)), 0.0f);
+    float dy = max(max(box.y - y, y - (box.y + box.height)), 0.0f);
+    return dx * dx + dy * dy;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Column / row of a cell containing a coordinate
+ */
+int SpatialGrid::column(float x) const
+{
+    int c = (int)floor((x - originX) / cell);
+    return min(max(c, 0), cols - 1);
+}
+
+int SpatialGrid::row(float y) const
+{
+    int r = (int)floor((y - originY) / cell);
+    return min(max(r, 0), rows - 1);
+}
+
+}
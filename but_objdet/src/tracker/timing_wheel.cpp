@@ -0,0 +1,255 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "but_objdet/tracker/timing_wheel.h"
+
+using namespace std;
+
+// Number of ticks covered by all levels of the wheel
+#define TIMING_WHEEL_RANGE ((int64_t)1 << (TIMING_WHEEL_BITS * TIMING_WHEEL_LEVELS))
+
+
+namespace but_objdet
+{
+
+const TimingWheel::TimerId TimingWheel::INVALID_TIMER;
+
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+TimingWheel::TimingWheel(int64_t tickMs_)
+    : tickMs(tickMs_ > 0 ? tickMs_ : 1)
+    , now(0)
+    , started(false)
+    , count(0)
+{
+    for(int l = 0; l < TIMING_WHEEL_LEVELS; l++) {
+        for(int b = 0; b < TIMING_WHEEL_SIZE; b++) {
+            heads[l][b] = INVALID_TIMER;
+        }
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Schedules a timer
+ */
+TimingWheel::TimerId TimingWheel::schedule(uint64_t payload, int64_t expiresMs)
+{
+    TimerId id;
+    if(!freeTimers.empty()) {
+        id = freeTimers.back();
+        freeTimers.pop_back();
+    }
+    else {
+        id = timers.size();
+        timers.push_back(Timer());
+    }
+
+    Timer &t = timers[id];
+    t.payload = payload;
+    t.expires = (expiresMs + tickMs - 1) / tickMs;
+    t.level = -1;
+
+    link(id);
+    count++;
+
+    return id;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Changes the time of expiry of a timer
+ */
+void TimingWheel::reschedule(TimerId id, int64_t expiresMs)
+{
+    if(id >= timers.size() || timers[id].level < 0) return;
+
+    unlink(id);
+    timers[id].expires = (expiresMs + tickMs - 1) / tickMs;
+    link(id);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Cancels a timer
+ */
+void TimingWheel::cancel(TimerId id)
+{
+    if(id >= timers.size() || timers[id].level < 0) return;
+
+    unlink(id);
+    freeTimers.push_back(id);
+    count--;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Advances the time of the wheel and collects expired timers
+ */
+void TimingWheel::advance(int64_t nowMs, vector<uint64_t>& expired)
+{
+    int64_t target = nowMs / tickMs;
+
+    // The first time => only sets the current time (timers scheduled before
+    // are relinked relative to it)
+    if(!started) {
+        started = true;
+        now = target;
+
+        for(TimerId id = 0; id < timers.size(); id++) {
+            if(timers[id].level >= 0) {
+                unlink(id);
+                link(id);
+            }
+        }
+    }
+
+    if(target <= now) {
+        // Timers already due are fired (they were scheduled to the past)
+        fire(0, now & (TIMING_WHEEL_SIZE - 1), expired);
+        return;
+    }
+
+    // A long jump => relink all timers instead of stepping through the ticks
+    if(count == 0 || target - now >= TIMING_WHEEL_RANGE) {
+        now = target;
+
+        for(TimerId id = 0; id < timers.size(); id++) {
+            if(timers[id].level >= 0) {
+                unlink(id);
+                link(id);
+            }
+        }
+        fire(0, now & (TIMING_WHEEL_SIZE - 1), expired);
+        return;
+    }
+
+    // Timers scheduled to the past since the last advance are due now
+    fire(0, now & (TIMING_WHEEL_SIZE - 1), expired);
+
+    while(now < target) {
+        now++;
+
+        // Cascade timers from higher levels when a lower level wraps around
+        for(int l = 1; l < TIMING_WHEEL_LEVELS; l++) {
+            if((now & (((int64_t)1 << (TIMING_WHEEL_BITS * l)) - 1)) != 0) break;
+            cascade(l, (now >> (TIMING_WHEEL_BITS * l)) & (TIMING_WHEEL_SIZE - 1));
+        }
+
+        fire(0, now & (TIMING_WHEEL_SIZE - 1), expired);
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Inserts a timer into the bucket corresponding to its time of expiry
+ */
+void TimingWheel::link(TimerId id)
+{
+    Timer &t = timers[id];
+
+    // Timers beyond the range of the wheel are placed to the last bucket
+    // of the top level and relinked when it is reached
+    int64_t delta = t.expires - now;
+    int64_t maxDelta = TIMING_WHEEL_RANGE - (TIMING_WHEEL_RANGE >> TIMING_WHEEL_BITS);
+    if(delta < 0) delta = 0;
+    if(delta >= maxDelta) delta = maxDelta - 1;
+    int64_t expires = now + delta;
+
+    int level = 0;
+    while(level < TIMING_WHEEL_LEVELS - 1
+          && (expires >> (TIMING_WHEEL_BITS * (level + 1))) != (now >> (TIMING_WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+
+    t.level = level;
+    t.bucket = (expires >> (TIMING_WHEEL_BITS * level)) & (TIMING_WHEEL_SIZE - 1);
+    t.prev = INVALID_TIMER;
+    t.next = heads[level][t.bucket];
+    if(t.next != INVALID_TIMER) timers[t.next].prev = id;
+    heads[level][t.bucket] = id;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Removes a timer from its bucket
+ */
+void TimingWheel::unlink(TimerId id)
+{
+    Timer &t = timers[id];
+
+    if(t.prev != INVALID_TIMER) timers[t.prev].next = t.next;
+    else heads[t.level][t.bucket] = t.next;
+    if(t.next != INVALID_TIMER) timers[t.next].prev = t.prev;
+
+    t.level = -1;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Fires all due timers of a bucket
+ */
+void TimingWheel::fire(int level, int bucket, vector<uint64_t>& expired)
+{
+    TimerId id = heads[level][bucket];
+    while(id != INVALID_TIMER) {
+        TimerId next = timers[id].next;
+        if(timers[id].expires <= now) {
+            expired.push_back(timers[id].payload);
+            unlink(id);
+            freeTimers.push_back(id);
+            count--;
+        }
+        else if(level == 0) {
+            // A timer beyond the range of the wheel
+            unlink(id);
+            link(id);
+        }
+        id = next;
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Moves timers of a bucket of a higher level to lower levels
+ */
+void TimingWheel::cascade(int level, int bucket)
+{
+    TimerId id = heads[level][bucket];
+    heads[level][bucket] = INVALID_TIMER;
+
+    while(id != INVALID_TIMER) {
+        TimerId next = timers[id].next;
+        timers[id].level = -1;
+        link(id);
+        id = next;
+    }
+}
+
+}
+
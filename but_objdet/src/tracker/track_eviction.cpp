@@ -0,0 +1,164 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "but_objdet/tracker/track_eviction.h"
+
+using namespace std;
+
+
+namespace but_objdet
+{
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+TrackEviction::TrackEviction(size_t maxTracks_, size_t maxClassTracks_, int64_t scoreWeight_)
+    : maxTracks(maxTracks_)
+    , maxClassTracks(maxClassTracks_)
+    , scoreWeight(scoreWeight_)
+{
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Sets the limits
+ */
+void TrackEviction::setLimits(size_t maxTracks_, size_t maxClassTracks_, int64_t scoreWeight_)
+{
+    maxTracks = maxTracks_;
+    maxClassTracks = maxClassTracks_;
+    scoreWeight = scoreWeight_;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Sets the maximal number of tracks of a class
+ */
+void TrackEviction::setClassLimit(int objClass, size_t limit)
+{
+    classLimits[objClass] = limit;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Returns the maximal number of tracks of a class
+ */
+size_t TrackEviction::classLimit(int objClass) const
+{
+    map<int, size_t>::const_iterator it = classLimits.find(objClass);
+    return (it != classLimits.end()) ? it->second : maxClassTracks;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Computes the priority of a track
+ */
+int64_t TrackEviction::priority(float score, int64_t timeMs) const
+{
+    if(score < 0.0f) score = 0.0f;
+    if(score > 1.0f) score = 1.0f;
+
+    return timeMs + (int64_t)(score * scoreWeight);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Decides if a new track can be created
+ */
+TrackEviction::Admission TrackEviction::admit(int objClass, int64_t priority,
+                                              uint64_t& victim, int& victimClass)
+{
+    // The limit of the class is checked first, so that a full class replaces
+    // its own tracks rather than tracks of other classes
+    const Entries *entries = NULL;
+
+    size_t limit = classLimit(objClass);
+    map<int, Entries>::const_iterator it = classes.find(objClass);
+    if(limit > 0 && it != classes.end() && it->second.size() >= limit) {
+        entries = &it->second;
+    }
+    else if(maxTracks > 0 && all.size() >= maxTracks) {
+        entries = &all;
+    }
+
+    if(!entries) {
+        return ADMIT;
+    }
+
+    // The new track is kept only if it is more valuable than the worst one
+    const Entry &lowest = *entries->begin();
+    if(priority <= lowest.priority) {
+        classCounters[objClass].rejected++;
+        totalCounters.rejected++;
+        return REJECT;
+    }
+
+    victim = lowest.key;
+    victimClass = lowest.objClass;
+    classCounters[victimClass].evicted++;
+    totalCounters.evicted++;
+    return EVICT;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Adds a track
+ */
+void TrackEviction::insert(int objClass, uint64_t key, int64_t priority)
+{
+    Entry entry(priority, key, objClass);
+    all.insert(entry);
+    classes[objClass].insert(entry);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Removes a track
+ */
+void TrackEviction::remove(int objClass, uint64_t key, int64_t priority)
+{
+    Entry entry(priority, key, objClass);
+    all.erase(entry);
+
+    map<int, Entries>::iterator it = classes.find(objClass);
+    if(it != classes.end()) {
+        it->second.erase(entry);
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Changes the priority of a track
+ */
+void TrackEviction::update(int objClass, uint64_t key, int64_t oldPriority, int64_t newPriority)
+{
+    if(oldPriority == newPriority) return;
+
+    remove(objClass, key, oldPriority);
+    insert(objClass, key, newPriority);
+}
+
+}
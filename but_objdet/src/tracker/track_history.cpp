@@ -0,0 +1,172 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "but_objdet/tracker/track_history.h"
+
+using namespace std;
+
+
+namespace but_objdet
+{
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+HistoryArena::HistoryArena(size_t maxSamples_, uint32_t defaultCapacity_)
+    : maxSamples(maxSamples_)
+    , defaultCapacity(defaultCapacity_)
+    , usedSamples(0)
+{
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Sets limits of the arena
+ */
+void HistoryArena::setLimits(size_t maxSamples_, uint32_t defaultCapacity_)
+{
+    maxSamples = maxSamples_;
+    defaultCapacity = defaultCapacity_;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Sets the number of samples of tracks of a class
+ */
+void HistoryArena::setClassCapacity(int objClass, uint32_t capacity)
+{
+    capacities[objClass] = capacity;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Returns the number of samples of tracks of a class
+ */
+uint32_t HistoryArena::classCapacity(int objClass) const
+{
+    map<int, uint32_t>::const_iterator it = capacities.find(objClass);
+    return (it != capacities.end()) ? it->second : defaultCapacity;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Allocates a ring for a new track
+ */
+bool HistoryArena::allocate(HistoryRing& ring, int objClass)
+{
+    ring = HistoryRing();
+
+    uint32_t capacity = classCapacity(objClass);
+    if(capacity == 0 || usedSamples + capacity > maxSamples) {
+        return false;
+    }
+
+    // A released ring of the same capacity is reused, otherwise the arena
+    // grows (up to maxSamples, including the free rings)
+    vector<uint32_t> &free = freeRings[capacity];
+    if(!free.empty()) {
+        ring.offset = free.back();
+        free.pop_back();
+    }
+    else if(samples.size() + capacity <= maxSamples) {
+        ring.offset = samples.size();
+        samples.resize(samples.size() + capacity);
+    }
+    else {
+        return false;
+    }
+
+    ring.capacity = capacity;
+    usedSamples += capacity;
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Returns the ring of a removed track to the arena
+ */
+void HistoryArena::release(HistoryRing& ring)
+{
+    if(!ring.valid()) return;
+
+    freeRings[ring.capacity].push_back(ring.offset);
+    usedSamples -= ring.capacity;
+    ring = HistoryRing();
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Adds a sample into a ring
+ */
+bool HistoryArena::push(HistoryRing& ring, const HistorySample& sample)
+{
+    if(!ring.valid()) return false;
+
+    // A query stops at the first sample older than its window, so samples
+    // out of order (e.g. a late detection) are rejected
+    if(ring.count > 0) {
+        uint32_t newest = (ring.head + ring.capacity - 1) % ring.capacity;
+        if(sample.msTime < samples[ring.offset + newest].msTime) return false;
+    }
+
+    samples[ring.offset + ring.head] = sample;
+    ring.head = (ring.head + 1) % ring.capacity;
+    if(ring.count < ring.capacity) ring.count++;
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Returns samples of a ring from a time window
+ */
+void HistoryArena::query(const HistoryRing& ring, int64_t fromMs, int64_t toMs,
+                         unsigned int decimation, vector<HistorySample>& result) const
+{
+    result.clear();
+    if(!ring.valid()) return;
+    if(decimation == 0) decimation = 1;
+
+    // From the newest sample back to the beginning of the window (samples
+    // are in the order of time, see push())
+    unsigned int n = 0;
+    for(uint32_t i = 0; i < ring.count; i++) {
+        uint32_t pos = (ring.head + ring.capacity - 1 - i) % ring.capacity;
+        const HistorySample &sample = samples[ring.offset + pos];
+
+        if(sample.msTime > toMs) continue;
+        if(sample.msTime < fromMs) break;
+
+        if(n++ % decimation == 0) {
+            result.push_back(sample);
+        }
+    }
+
+    reverse(result.begin(), result.end());
+}
+
+}
@@ -0,0 +1,137 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "but_objdet/tracker/track_lifecycle.h"
+
+using namespace std;
+
+
+namespace but_objdet
+{
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+TrackLifecycle::TrackLifecycle(int confirmHits_, int tentativeMaxMisses_,
+                               int maxMisses_, int64_t expiryMs_)
+    : confirmHits(confirmHits_)
+    , tentativeMaxMisses(tentativeMaxMisses_)
+    , maxMisses(maxMisses_)
+    , expiryMs(expiryMs_)
+    , wheel(10)
+{
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Changes the parameters
+ */
+void TrackLifecycle::setParams(int confirmHits_, int tentativeMaxMisses_,
+                               int maxMisses_, int64_t expiryMs_)
+{
+    confirmHits = confirmHits_;
+    tentativeMaxMisses = tentativeMaxMisses_;
+    maxMisses = maxMisses_;
+    expiryMs = expiryMs_;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Starts the lifecycle of a new track
+ */
+void TrackLifecycle::created(TrackStatus& status, uint64_t key, int64_t timeMs)
+{
+    status.state = (confirmHits <= 1) ? BUT_OBJDET_TRACK_CONFIRMED : BUT_OBJDET_TRACK_TENTATIVE;
+    status.hits = 1;
+    status.misses = 0;
+    status.timer = wheel.schedule(key, timeMs + expiryMs);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Continues the lifecycle of a restored track
+ */
+void TrackLifecycle::restored(TrackStatus& status, uint64_t key, int64_t timeMs)
+{
+    status.timer = wheel.schedule(key, timeMs + expiryMs);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * The track was detected
+ */
+void TrackLifecycle::hit(TrackStatus& status, int64_t timeMs)
+{
+    status.hits++;
+    status.misses = 0;
+
+    if(status.state == BUT_OBJDET_TRACK_LOST
+       || (status.state == BUT_OBJDET_TRACK_TENTATIVE && status.hits >= confirmHits)) {
+        status.state = BUT_OBJDET_TRACK_CONFIRMED;
+    }
+
+    wheel.reschedule(status.timer, timeMs + expiryMs);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * The track was not detected
+ */
+bool TrackLifecycle::miss(TrackStatus& status)
+{
+    status.misses++;
+
+    if(status.state == BUT_OBJDET_TRACK_TENTATIVE) {
+        return status.misses > tentativeMaxMisses;
+    }
+    if(status.state == BUT_OBJDET_TRACK_CONFIRMED && status.misses >= maxMisses) {
+        status.state = BUT_OBJDET_TRACK_LOST;
+    }
+
+    return false;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * The track is removed
+ */
+void TrackLifecycle::removed(TrackStatus& status)
+{
+    wheel.cancel(status.timer);
+    status.timer = TimingWheel::INVALID_TIMER;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Advances the time and returns expired tracks
+ */
+void TrackLifecycle::expire(int64_t timeMs, vector<uint64_t>& expired)
+{
+    wheel.advance(timeMs, expired);
+}
+
+}
+
@@ -0,0 +1,320 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "but_objdet/tracker/track_snapshot.h"
+
+using namespace std;
+using namespace cv;
+using namespace but_objdet_msgs;
+
+
+namespace but_objdet
+{
+
+/* =============================================================================
+ * Copies the filtered state of a track from any tracker with the state
+ * of TrackerKalman (Q is its process noise for one second)
+ */
+static bool copyState(TrackView& view, Tracker& tracker, const Mat& Q, bool kinematic)
+{
+    Mat state, cov;
+    view.hasState = tracker.predictState(0, state, cov) && state.rows == BUT_OBJDET_TRACK_PARAMS;
+    if(!view.hasState) {
+        return false;
+    }
+
+    view.nDerivs = Q.rows / BUT_OBJDET_TRACK_PARAMS;
+    view.kinematic = kinematic;
+
+    for(int i = 0; i < BUT_OBJDET_TRACK_PARAMS; i++) {
+        for(int d = 0; d < 3; d++) {
+            view.x[i][d] = state.at<float>(i, d);
+            view.q[i][d] = (d < view.nDerivs) ? Q.at<float>(i + d * BUT_OBJDET_TRACK_PARAMS,
+                                                            i + d * BUT_OBJDET_TRACK_PARAMS) : 0.0f;
+        }
+        for(int c = 0; c < 6; c++) {
+            view.P[i][c] = cov.at<float>(i, c);
+        }
+    }
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Copies the filtered state of a track
+ */
+bool TrackView::setState(TrackerKalman& tracker)
+{
+    return copyState(*this, tracker, tracker.processNoiseCov(), false);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Copies the filtered state of a track (the mixture of the models)
+ */
+bool TrackView::setState(IMMTracker& tracker)
+{
+    return copyState(*this, tracker, tracker.processNoiseCov(), true);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Fills the view from a received state
+ */
+void TrackView::fromState(const Detection& det_, const TrackState& trackState, int64 ms)
+{
+    det = det_;
+    msTime = ms;
+    state = trackState.state;
+    hasState = true;
+    nDerivs = 3; // The acceleration is zero if the tracker doesn't estimate it
+    kinematic = trackState.kinematic;
+
+    for(int i = 0; i < BUT_OBJDET_TRACK_PARAMS; i++) {
+        x[i][0] = trackState.position[i];
+        x[i][1] = trackState.velocity[i];
+        x[i][2] = trackState.acceleration[i];
+
+        // The process noise isn't known, the covariance is just propagated
+        for(int d = 0; d < 3; d++) {
+            q[i][d] = 0.0f;
+        }
+        for(int c = 0; c < 6; c++) {
+            P[i][c] = trackState.covariance[i * 6 + c];
+        }
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Predicts the detection (and optionally the filtered state) of the object
+ */
+Detection TrackView::predict(int64 ms, TrackState *trackState) const
+{
+    Detection pred = det;
+
+    if(!hasState) {
+        if(trackState) {
+            *trackState = TrackState();
+        }
+        return pred;
+    }
+
+    // The same transition as the filter of the track uses (each parameter is
+    // independent, so it is applied to 3x3 blocks of the state):
+    //   x' = x + t * v + ta * a,  v' = v + t * a,  a' = a
+    // where ta is t^2/2 (IMMTracker) or t/2 (TrackerKalman)
+    float t = (ms > 0) ? ms / 1000.0f : 0.0f;
+    float F[3][3] = { { 1, t, accelTerm(t) },
+                      { 0, 1, (nDerivs == 3) ? t : 0 },
+                      { 0, 0, 1 } };
+
+    float px[BUT_OBJDET_TRACK_PARAMS][3];
+    float pP[BUT_OBJDET_TRACK_PARAMS][6];
+    for(int i = 0; i < BUT_OBJDET_TRACK_PARAMS; i++) {
+        for(int r = 0; r < 3; r++) {
+            px[i][r] = F[r][0] * x[i][0] + F[r][1] * x[i][1] + F[r][2] * x[i][2];
+        }
+
+        if(!trackState) continue;
+
+        // Full symmetric block of the covariance
+        const float *c = P[i];
+        float B[3][3] = { { c[0], c[1], c[2] },
+                          { c[1], c[3], c[4] },
+                          { c[2], c[4], c[5] } };
+
+        // F * B * F' + Q (without the noise if no time passed)
+        float FB[3][3];
+        for(int r = 0; r < 3; r++) {
+            for(int s = 0; s < 3; s++) {
+                FB[r][s] = F[r][0] * B[0][s] + F[r][1] * B[1][s] + F[r][2] * B[2][s];
+            }
+        }
+        int k = 0;
+        for(int r = 0; r < 3; r++) {
+            for(int s = r; s < 3; s++, k++) {
+                pP[i][k] = FB[r][0] * F[s][0] + FB[r][1] * F[s][1] + FB[r][2] * F[s][2];
+                if(r == s && ms > 0) {
+                    pP[i][k] += q[i][r];
+                }
+            }
+        }
+    }
+
+    pred.m_bb.x = px[0][0];
+    pred.m_bb.y = px[1][0];
+    pred.m_bb.width = px[2][0];
+    pred.m_bb.height = px[3][0];
+
+    // Speed of the center of the bounding box (depth is left as detected)
+    pred.m_speed.x = px[0][1] + 0.5f * px[2][1];
+    pred.m_speed.y = px[1][1] + 0.5f * px[3][1];
+
+    if(trackState) {
+        trackState->header = det.header;
+        trackState->m_id = det.m_id;
+        trackState->m_class = det.m_class;
+        trackState->state = state;
+        trackState->kinematic = kinematic;
+
+        for(int i = 0; i < BUT_OBJDET_TRACK_PARAMS; i++) {
+            trackState->position[i] = px[i][0];
+            trackState->velocity[i] = px[i][1];
+            trackState->acceleration[i] = px[i][2];
+
+            for(int j = 0; j < 6; j++) {
+                trackState->covariance[i * 6 + j] = pP[i][j];
+            }
+        }
+    }
+
+    return pred;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Predicts the bounding box of the object
+ */
+void TrackView::predictBox(int64 ms, float bb[BUT_OBJDET_TRACK_PARAMS]) const
+{
+    if(!hasState) {
+        bb[0] = det.m_bb.x;
+        bb[1] = det.m_bb.y;
+        bb[2] = det.m_bb.width;
+        bb[3] = det.m_bb.height;
+        return;
+    }
+
+    // The first row of the transition used by predict()
+    float t = (ms > 0) ? ms / 1000.0f : 0.0f;
+    float ta = accelTerm(t);
+    for(int i = 0; i < BUT_OBJDET_TRACK_PARAMS; i++) {
+        bb[i] = x[i][0] + t * x[i][1] + ta * x[i][2];
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Starts a new snapshot
+ */
+void TrackSnapshot::clear(uint32_t frame, uint32_t generation, int64 time)
+{
+    // Vectors keep their capacity, so a reused snapshot doesn't allocate
+    count = 0;
+    keys.clear();
+    ids.clear();
+    for(map<int, IndexList>::iterator it = classes.begin(); it != classes.end(); ++it) {
+        it->second.clear();
+    }
+    frameNum = frame;
+    generationNum = generation;
+    timeMs = time;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Adds a track
+ */
+TrackView& TrackSnapshot::add(int objClass, int id)
+{
+    if(count == tracks.size()) {
+        tracks.push_back(TrackView());
+    }
+
+    keys.push_back(KeyIndex(key(objClass, id), count));
+    ids.push_back(KeyIndex((uint64_t)(int64)id, count));
+    classes[objClass].push_back(count);
+
+    return tracks[count++];
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Builds lookup structures
+ */
+void TrackSnapshot::finish()
+{
+    // Views of removed tracks, which are left from the reused snapshot
+    tracks.resize(count);
+
+    sort(keys.begin(), keys.end());
+    sort(ids.begin(), ids.end());
+
+    // Spatial index of the boxes at the time of the snapshot
+    boxes.resize(count);
+    for(uint32_t i = 0; i < count; i++) {
+        float bb[BUT_OBJDET_TRACK_PARAMS];
+        tracks[i].predictBox(timeMs - tracks[i].msTime, bb);
+        boxes[i] = GridBox(bb[0], bb[1], bb[2], bb[3]);
+    }
+    grid.build(boxes);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Returns indices of all the tracks of a class
+ */
+const TrackSnapshot::IndexList& TrackSnapshot::classIndices(int objClass) const
+{
+    map<int, IndexList>::const_iterator it = classes.find(objClass);
+    return (it != classes.end()) ? it->second : empty;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Finds a track by its class and id
+ */
+int TrackSnapshot::find(int objClass, int id) const
+{
+    vector<KeyIndex>::const_iterator it = lower_bound(keys.begin(), keys.end(),
+        KeyIndex(key(objClass, id), 0));
+
+    if(it == keys.end() || it->first != key(objClass, id)) {
+        return -1;
+    }
+    return it->second;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Finds tracks of all classes with the given id
+ */
+void TrackSnapshot::findId(int id, IndexList& result) const
+{
+    result.clear();
+
+    uint64_t k = (uint64_t)(int64)id;
+    vector<KeyIndex>::const_iterator it = lower_bound(ids.begin(), ids.end(), KeyIndex(k, 0));
+    for(; it != ids.end() && it->first == k; ++it) {
+        result.push_back(it->second);
+    }
+}
+
+}
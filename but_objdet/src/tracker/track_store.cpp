@@ -0,0 +1,237 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <ros/ros.h> // Main header of ROS
+#include <ros/serialization.h>
+
+#include "but_objdet/tracker/track_store.h"
+
+using namespace std;
+using namespace but_objdet_msgs;
+
+
+namespace but_objdet
+{
+
+/* -----------------------------------------------------------------------------
+ * Starts a new content of the file
+ */
+void TrackStoreWriter::clear(int64_t time, uint32_t frame)
+{
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BUT_OBJDET_TRACKS_MAGIC, sizeof(header.magic));
+    header.version = BUT_OBJDET_TRACKS_VERSION;
+    header.trackSize = sizeof(StoredTrack);
+    header.time = time;
+    header.frame = frame;
+
+    classes.clear();
+    tracks.clear();
+    data.clear();
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Adds the last ID assigned to objects of a class
+ */
+void TrackStoreWriter::addClass(int objClass, int lastId)
+{
+    StoredClass c;
+    c.objClass = objClass;
+    c.lastId = lastId;
+    classes.push_back(c);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Adds a track
+ */
+void TrackStoreWriter::addTrack(const StoredTrack& track, const Detection& det)
+{
+    tracks.push_back(track);
+    StoredTrack &t = tracks.back();
+
+    uint32_t size = ros::serialization::serializationLength(det);
+    t.detectionOffset = data.size();
+    t.detectionSize = size;
+    t.reserved = 0;
+
+    data.resize(data.size() + ((size + 7) & ~(uint32_t)7), 0);
+    if(size > 0) {
+        ros::serialization::OStream stream(&data[t.detectionOffset], size);
+        ros::serialization::serialize(stream, det);
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Writes the collected tracks into a file
+ */
+bool TrackStoreWriter::write(const string& filename)
+{
+    header.nClasses = classes.size();
+    header.nTracks = tracks.size();
+    header.dataSize = data.size();
+
+    string tmpName = filename + ".tmp";
+    FILE *file = fopen(tmpName.c_str(), "wb");
+    if(!file) return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if(ok && !classes.empty()) {
+        ok = fwrite(&classes[0], sizeof(StoredClass), classes.size(), file) == classes.size();
+    }
+    if(ok && !tracks.empty()) {
+        ok = fwrite(&tracks[0], sizeof(StoredTrack), tracks.size(), file) == tracks.size();
+    }
+    if(ok && !data.empty()) {
+        ok = fwrite(&data[0], 1, data.size(), file) == data.size();
+    }
+
+    // The content has to be on the disk before the file replaces the old one
+    ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = (fclose(file) == 0) && ok;
+
+    if(!ok || rename(tmpName.c_str(), filename.c_str()) != 0) {
+        unlink(tmpName.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+TrackStoreReader::TrackStoreReader()
+    : base(NULL)
+    , length(0)
+    , fileHeader(NULL)
+    , classes(NULL)
+    , tracks(NULL)
+    , data(NULL)
+{
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Destructor
+ */
+TrackStoreReader::~TrackStoreReader()
+{
+    close();
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Maps the file into memory
+ */
+bool TrackStoreReader::open(const string& filename)
+{
+    close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TrackFileHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    void *ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(ptr == MAP_FAILED) return false;
+
+    const TrackFileHeader *h = (const TrackFileHeader *)ptr;
+    size_t classesSize = (size_t)h->nClasses * sizeof(StoredClass);
+    size_t tracksSize = (size_t)h->nTracks * sizeof(StoredTrack);
+
+    if(memcmp(h->magic, BUT_OBJDET_TRACKS_MAGIC, sizeof(h->magic)) != 0
+       || h->version != BUT_OBJDET_TRACKS_VERSION
+       || h->trackSize != sizeof(StoredTrack)
+       || sizeof(TrackFileHeader) + classesSize + tracksSize + h->dataSize > (size_t)st.st_size) {
+        ROS_ERROR("File %s doesn't contain tracks of version %d.", filename.c_str(), BUT_OBJDET_TRACKS_VERSION);
+        munmap(ptr, st.st_size);
+        return false;
+    }
+
+    base = (const uint8_t *)ptr;
+    length = st.st_size;
+    fileHeader = h;
+    classes = (const StoredClass *)(base + sizeof(TrackFileHeader));
+    tracks = (const StoredTrack *)(base + sizeof(TrackFileHeader) + classesSize);
+    data = base + sizeof(TrackFileHeader) + classesSize + tracksSize;
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Unmaps the file
+ */
+void TrackStoreReader::close()
+{
+    if(base) {
+        munmap(const_cast<uint8_t *>(base), length);
+        base = NULL;
+        length = 0;
+        fileHeader = NULL;
+        classes = NULL;
+        tracks = NULL;
+        data = NULL;
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Deserializes the last detection of a track
+ */
+bool TrackStoreReader::detection(uint32_t i, Detection& det) const
+{
+    const StoredTrack &t = tracks[i];
+    if((size_t)t.detectionOffset + t.detectionSize > fileHeader->dataSize) return false;
+
+    try {
+        ros::serialization::IStream stream(const_cast<uint8_t *>(data + t.detectionOffset), t.detectionSize);
+        ros::serialization::deserialize(stream, det);
+    }
+    catch(std::exception& e) {
+        ROS_ERROR("Failed to deserialize a stored detection: %s", e.what());
+        return false;
+    }
+
+    return true;
+}
+
+}
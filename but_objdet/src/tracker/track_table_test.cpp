@@ -0,0 +1,119 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Test of TrackTable - tracks are inserted past several sizes
+ * of the hash table, removed and inserted again with the same ids (every
+ * track has to be found exactly once, removed tracks not at all).
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "but_objdet/tracker/track_table.h"
+
+using namespace std;
+using namespace but_objdet;
+
+
+#define NUM_CLASSES 3
+#define NUM_IDS 1000   // Per class, the hash table grows from 16 to 8192 entries
+#define NUM_ROUNDS 3
+
+// Checks that the tracks are exactly those of the given ids (a track with
+// a removed id must not be found, handles of present tracks must be valid)
+int check(TrackTable<int>& table, const vector<bool>& present, int round)
+{
+    int errors = 0;
+    size_t expected = 0;
+
+    for(int c = 0; c < NUM_CLASSES; c++) {
+        for(int id = 0; id < NUM_IDS; id++) {
+            bool shouldBe = present[c * NUM_IDS + id];
+            TrackHandle h = table.find(c, id);
+            int *value = table.get(h);
+
+            if(shouldBe) {
+                expected++;
+                if(!value || *value != c * NUM_IDS + id) errors++;
+            }
+            else if(h.valid()) {
+                errors++;
+            }
+        }
+        if(table.classSlots(c).size() != (size_t)count(present.begin() + c * NUM_IDS,
+                                                        present.begin() + (c + 1) * NUM_IDS, true)) {
+            errors++;
+        }
+    }
+
+    if(table.size() != expected || table.allSlots().size() != expected) {
+        errors++;
+    }
+    if(errors > 0) {
+        printf("Round %d: %d errors.\n", round, errors);
+    }
+
+    return errors;
+}
+
+int main()
+{
+    TrackTable<int> table;
+    vector<bool> present(NUM_CLASSES * NUM_IDS, false);
+    int errors = 0;
+
+    for(int round = 0; round < NUM_ROUNDS; round++) {
+        // Insert all the ids (the hash table is rehashed several times in
+        // the first round)
+        for(int id = 0; id < NUM_IDS; id++) {
+            for(int c = 0; c < NUM_CLASSES; c++) {
+                TrackHandle h = table.insert(c, id, c * NUM_IDS + id);
+                present[c * NUM_IDS + id] = true;
+                if(!table.get(h)) errors++;
+            }
+        }
+        errors += check(table, present, round);
+
+        // Remove every other id (and all in the last round), removed tracks
+        // must not be found any more
+        for(int c = 0; c < NUM_CLASSES; c++) {
+            for(int id = 0; id < NUM_IDS; id++) {
+                if(id % 2 == 0 || round == NUM_ROUNDS - 1) {
+                    if(!table.erase(table.find(c, id))) errors++;
+                    present[c * NUM_IDS + id] = false;
+                }
+            }
+        }
+        errors += check(table, present, round);
+    }
+
+    if(errors > 0) {
+        printf("FAILED\n");
+        return 1;
+    }
+    printf("OK\n");
+
+    return 0;
+}
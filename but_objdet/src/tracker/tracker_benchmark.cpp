@@ -0,0 +1,323 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Compares trackers on synthetic trajectories of boxes (the same
+ * random motion as in tracker_kalman_test.cpp, optionally with frequent
+ * changes of the velocity or with stops). Predictions for the time of each measurement
+ * are compared with the true box - the prediction is a miss if it overlaps
+ * less than 50% of the box or of itself (as in MatcherOverlap), which would
+ * break the track in the tracker node. Results are repeatable (fixed seeds).
+ *
+ * Usage: but_tracker_benchmark [-n TRAJECTORIES] [-s STEPS] [-p PARTICLES] [-e] [-m]
+ *   -n TRAJECTORIES  number of tracked boxes (default 200)
+ *   -s STEPS         measurements of each box (default 300)
+ *   -p PARTICLES     particles of ParticleTracker (default 256)
+ *   -e               erratic motion (besides the random acceleration, boxes
+ *                    change their velocity abruptly about every 2 seconds,
+ *                    like walking people)
+ *   -m               mixed motion (boxes also stop for a while about every
+ *                    3 seconds and start again)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "but_objdet/tracker/tracker_imm.h"
+#include "but_objdet/tracker/tracker_kalman.h"
+#include "but_objdet/tracker/tracker_particle.h"
+
+using namespace std;
+using namespace cv;
+using namespace but_objdet;
+
+// Size of the scene [px]
+const float sceneSize = 500;
+
+// Maximal velocity of erratic boxes [px/s]
+const float maxVelocity = 100;
+
+
+/* =============================================================================
+ * A box moving with a randomly changing acceleration (see update() in
+ * tracker_kalman_test.cpp), its center and size are measured with noise
+ */
+class Trajectory
+{
+public:
+    Trajectory(uint64 seed, bool erratic_, bool mixed_)
+        : rng(seed)
+        , erratic(erratic_)
+        , mixed(mixed_)
+        , stopped(false)
+    {
+        for(int i = 0; i < 4; i++) {
+            p[i] = (i < 2) ? sceneSize / 2 : 50;
+            v[i] = a[i] = 0;
+        }
+    }
+
+    /**
+     * Moves the box forward in time.
+     */
+    void step(int miliseconds)
+    {
+        float dt = miliseconds / 1000.0f;
+        if(mixed && rng.uniform(0.0f, 1.0f) < miliseconds / (stopped ? 1000.0f : 3000.0f)) {
+            stopped = !stopped;
+        }
+
+        for(int i = 0; i < 4; i++) {
+            bool position = (i < 2);
+
+            if(rng.uniform(0.0f, 1.0f) < miliseconds / 3000.0f) {
+                a[i] += position ? rng.uniform(-2, 3) : rng.uniform(-1, 2) / 5.0f;
+                a[i] = max(min(a[i], 2.0f), -2.0f);
+            }
+            if(erratic && position && rng.uniform(0.0f, 1.0f) < miliseconds / 2000.0f) {
+                v[i] = rng.uniform(-maxVelocity, maxVelocity);
+            }
+
+            // Boxes stay in the scene, their sizes between 20 and 70
+            float low = position ? 10 : 20, high = position ? sceneSize - 10 : 70;
+            if(p[i] < low) {
+                if(!position) p[i] = low;
+                v[i] = 0;
+                a[i] = 1;
+            }
+            if(p[i] > high) {
+                if(!position) p[i] = high;
+                v[i] = 0;
+                a[i] = -1;
+            }
+
+            // A stopped box keeps its position, it starts from zero velocity
+            if(stopped && position) {
+                v[i] = 0;
+                continue;
+            }
+
+            v[i] += dt * a[i];
+            p[i] += dt * (v[i] + a[i] / 2);
+        }
+    }
+
+    /**
+     * A noisy measurement of the box (a row with center x, y, width, height).
+     */
+    void measure(Mat& measurement)
+    {
+        measurement.create(1, 4, CV_32F);
+        for(int i = 0; i < 4; i++) {
+            measurement.at<float>(i) = p[i] + rng.uniform(-20, 21);
+        }
+    }
+
+    /**
+     * Tests if a predicted box overlaps the true one enough to be matched.
+     */
+    bool matches(const Mat& prediction) const
+    {
+        float w = max(prediction.at<float>(2), 1.0f), h = max(prediction.at<float>(3), 1.0f);
+        float overlapW = min(p[0] + p[2] / 2, prediction.at<float>(0) + w / 2) -
+                         max(p[0] - p[2] / 2, prediction.at<float>(0) - w / 2);
+        float overlapH = min(p[1] + p[3] / 2, prediction.at<float>(1) + h / 2) -
+                         max(p[1] - p[3] / 2, prediction.at<float>(1) - h / 2);
+        if(overlapW <= 0 || overlapH <= 0) return false;
+
+        float overlap = overlapW * overlapH;
+        return overlap >= 0.5f * p[2] * p[3] && overlap >= 0.5f * w * h;
+    }
+
+    /**
+     * Distance of a predicted center from the true one.
+     */
+    float error(const Mat& prediction) const
+    {
+        float dx = prediction.at<float>(0) - p[0], dy = prediction.at<float>(1) - p[1];
+        return sqrt(dx * dx + dy * dy);
+    }
+
+private:
+    RNG rng;
+    bool erratic, mixed, stopped;
+    float p[4], v[4], a[4]; // Center x, y, width and height and their derivatives
+};
+
+
+/* =============================================================================
+ * Results of a tracker
+ */
+struct Results
+{
+    Results() : error(0), misses(0), predictions(0), seconds(0) {}
+
+    void print(const char *name, int updates) const
+    {
+        printf("%-24s %10.2f %9.2f%% %12.2f\n", name, error / max(predictions, 1),
+               100.0 * misses / max(predictions, 1), 1e6 * seconds / max(updates, 1));
+    }
+
+    double error;     // Sum of errors of predicted centers [px]
+    int misses;       // Predictions not matching the true box
+    int predictions;
+    double seconds;   // Duration of updates
+};
+
+
+/* =============================================================================
+ * Main function
+ */
+int main(int argc, char **argv)
+{
+    int trajectoryCount = 200, steps = 300, particles = 256;
+    bool erratic = false, mixed = false;
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            trajectoryCount = max(atoi(argv[++i]), 1);
+        }
+        else if(strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            steps = max(atoi(argv[++i]), 1);
+        }
+        else if(strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            particles = max(atoi(argv[++i]), 1);
+        }
+        else if(strcmp(argv[i], "-e") == 0) {
+            erratic = true;
+        }
+        else if(strcmp(argv[i], "-m") == 0) {
+            mixed = true;
+        }
+        else {
+            printf("Usage: %s [-n TRAJECTORIES] [-s STEPS] [-p PARTICLES] [-e] [-m]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // The same boxes (seeded by their index) are given to all trackers
+    vector<Trajectory> trajectories;
+    vector<TrackerKalman> kalmans(trajectoryCount);
+    vector<IMMTracker> imms(trajectoryCount);
+    vector<IMMTracker *> immPointers;
+    vector<ParticleTracker> serialParticles, parallelParticles;
+    vector<ParticleTracker *> parallelPointers;
+    vector<Mat> measurements(trajectoryCount);
+    vector<int64> elapsed(trajectoryCount);
+
+    for(int i = 0; i < trajectoryCount; i++) {
+        trajectories.push_back(Trajectory(i + 1, erratic, mixed));
+        trajectories[i].step(100);
+        trajectories[i].measure(measurements[i]);
+
+        kalmans[i].init(measurements[i], true);
+        imms[i].init(measurements[i]);
+        immPointers.push_back(&imms[i]);
+        serialParticles.push_back(ParticleTracker(particles, trajectoryCount + i + 1));
+        serialParticles[i].init(measurements[i]);
+    }
+    parallelParticles = serialParticles;
+    for(int i = 0; i < trajectoryCount; i++) {
+        parallelPointers.push_back(&parallelParticles[i]);
+    }
+
+    Results kalman, imm, serial, parallel;
+    RNG timing(0x62656e63);
+
+    // IMM filters are updated in batches by the calling thread only, so that
+    // their cost is comparable with the one of TrackerKalman
+    WorkerPool callerOnly(0);
+    double tickFrequency = getTickFrequency();
+
+    for(int s = 0; s < steps; s++) {
+        for(int i = 0; i < trajectoryCount; i++) {
+            elapsed[i] = timing.uniform(100, 400);
+            trajectories[i].step((int)elapsed[i]);
+
+            // Predictions for the time of the measurement (before it is known)
+            const Mat *predictions[3] = { &kalmans[i].predict(elapsed[i]), &imms[i].predict(elapsed[i]),
+                                          &serialParticles[i].predict(elapsed[i]) };
+            Results *results[3] = { &kalman, &imm, &serial };
+            for(int t = 0; t < 3; t++) {
+                results[t]->error += trajectories[i].error(*predictions[t]);
+                results[t]->misses += trajectories[i].matches(*predictions[t]) ? 0 : 1;
+                results[t]->predictions++;
+            }
+
+            trajectories[i].measure(measurements[i]);
+        }
+
+        int64 start = getTickCount();
+        for(int i = 0; i < trajectoryCount; i++) {
+            kalmans[i].update(measurements[i], elapsed[i]);
+        }
+        int64 kalmanEnd = getTickCount();
+        IMMTracker::updateAll(immPointers, measurements, elapsed, callerOnly);
+        int64 immEnd = getTickCount();
+        for(int i = 0; i < trajectoryCount; i++) {
+            serialParticles[i].update(measurements[i], elapsed[i]);
+        }
+        int64 serialEnd = getTickCount();
+        ParticleTracker::updateAll(parallelPointers, measurements, elapsed);
+        int64 parallelEnd = getTickCount();
+
+        kalman.seconds += (kalmanEnd - start) / tickFrequency;
+        imm.seconds += (immEnd - kalmanEnd) / tickFrequency;
+        serial.seconds += (serialEnd - immEnd) / tickFrequency;
+        parallel.seconds += (parallelEnd - serialEnd) / tickFrequency;
+    }
+
+    // Parallel updates must give the same states as the serial ones
+    int differences = 0;
+    for(int i = 0; i < trajectoryCount; i++) {
+        const Mat &a = serialParticles[i].predict(0);
+        const Mat &b = parallelParticles[i].predict(0);
+        for(int j = 0; j < a.rows; j++) {
+            if(a.at<float>(j) != b.at<float>(j)) {
+                differences++;
+                break;
+            }
+        }
+    }
+
+    int updates = trajectoryCount * steps;
+    const char *motion = mixed ? (erratic ? "erratic mixed" : "mixed") : (erratic ? "erratic" : "test");
+    printf("%d trajectories, %d measurements each, %s motion, %d particles, %d threads\n\n",
+           trajectoryCount, steps, motion, particles, WorkerPool::shared().size());
+    printf("%-24s %10s %10s %12s\n", "tracker", "error [px]", "misses", "update [us]");
+    kalman.print("TrackerKalman (CA)", updates);
+    imm.print("IMMTracker", updates);
+    serial.print("ParticleTracker", updates);
+    printf("%-24s %10s %10s %12.2f\n", "ParticleTracker (pool)", "", "",
+           1e6 * parallel.seconds / max(updates, 1));
+
+    if(differences > 0) {
+        printf("\n%d trackers updated in parallel differ from the serial ones!\n", differences);
+        return 1;
+    }
+
+    return 0;
+}
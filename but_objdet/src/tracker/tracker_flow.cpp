@@ -0,0 +1,281 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "but_objdet/tracker/tracker_flow.h"
+
+using namespace cv;
+using namespace std;
+
+// Minimal number of points, which have to be followed
+const unsigned int minPoints = 4;
+
+// Minimal width and height of a tracked box [px]
+const int minBoxSize = 8;
+
+// Limits of the change of the size of the box between two images
+const float minScale = 0.8f;
+const float maxScale = 1.25f;
+
+
+namespace but_objdet
+{
+
+/* =============================================================================
+ * Returns the median of values (they are reordered)
+ */
+static float median(vector<float>& values)
+{
+    vector<float>::iterator middle = values.begin() + values.size() / 2;
+    nth_element(values.begin(), middle, values.end());
+    return *middle;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+FlowFrames::FlowFrames(Size window_, int levels_)
+    : window(window_)
+    , levels(levels_)
+{
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Destructor
+ */
+FlowFrames::~FlowFrames()
+{
+    for(unsigned int i = 0; i < trackers.size(); i++) {
+        trackers[i]->frames = NULL;
+        trackers[i]->lost = true;
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Follows points of all the trackers into the next image
+ */
+void FlowFrames::next(const Mat& gray)
+{
+    if(gray.empty()) return;
+
+    // Points of all the trackers are followed at once
+    prevPoints.clear();
+    for(unsigned int i = 0; i < trackers.size(); i++) {
+        if(!trackers[i]->lost) {
+            prevPoints.insert(prevPoints.end(), trackers[i]->points.begin(), trackers[i]->points.end());
+        }
+    }
+
+    if(!prevPoints.empty() && frame.size() == gray.size()) {
+        calcOpticalFlowPyrLK(frame, gray, prevPoints, nextPoints, status, errors, window, levels);
+    }
+    else {
+        nextPoints = prevPoints;
+        status.assign(prevPoints.size(), 0);
+    }
+
+    unsigned int offset = 0;
+    for(unsigned int i = 0; i < trackers.size(); i++) {
+        TrackerFlow *tracker = trackers[i];
+        if(tracker->lost) continue;
+
+        unsigned int count = (unsigned int)tracker->points.size();
+        if(count > 0) {
+            tracker->move(&nextPoints[offset], &status[offset], gray);
+        }
+        else {
+            tracker->lost = true;
+        }
+        offset += count;
+    }
+
+    gray.copyTo(frame);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+TrackerFlow::TrackerFlow(FlowFrames *frames_, int maxPoints_, float minTracked_)
+    : frames(frames_)
+    , maxPoints(max(maxPoints_, (int)minPoints))
+    , minTracked(minTracked_)
+    , lost(true)
+    , tracked(0)
+{
+    if(frames) {
+        frames->trackers.push_back(this);
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Destructor
+ */
+TrackerFlow::~TrackerFlow()
+{
+    if(frames) {
+        vector<TrackerFlow *>& trackers = frames->trackers;
+        trackers.erase(remove(trackers.begin(), trackers.end(), this), trackers.end());
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Initialization with the first image of the object
+ */
+bool TrackerFlow::init(const Mat& gray, const Rect& bb)
+{
+    lost = true;
+    tracked = 0;
+    points.clear();
+
+    Rect inside = bb & Rect(0, 0, gray.cols, gray.rows);
+    if(!frames || inside.width < minBoxSize || inside.height < minBoxSize) return false;
+
+    box = Rect_<float>((float)bb.x, (float)bb.y, (float)bb.width, (float)bb.height);
+    seed(gray);
+    if(points.size() < minPoints) return false;
+
+    lost = false;
+    tracked = 1;
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Returns the box moved into the last image
+ */
+bool TrackerFlow::update(const Mat& gray, Rect& bb)
+{
+    if(lost || !frames) return false;
+
+    bb = Rect(cvRound(box.x), cvRound(box.y), cvRound(box.width), cvRound(box.height));
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Finds points to be followed inside the box
+ */
+void TrackerFlow::seed(const Mat& gray)
+{
+    points.clear();
+
+    Rect roi = Rect(cvRound(box.x), cvRound(box.y), cvRound(box.width), cvRound(box.height))
+             & Rect(0, 0, gray.cols, gray.rows);
+    if(roi.width < minBoxSize || roi.height < minBoxSize) return;
+
+    // Corners are followed best, a grid is used for objects without them
+    int minDistance = max(2, min(roi.width, roi.height) / 8);
+    goodFeaturesToTrack(gray(roi), points, maxPoints, 0.01, minDistance);
+
+    if(points.size() < minPoints) {
+        points.clear();
+        for(int y = 0; y < 4; y++) {
+            for(int x = 0; x < 4; x++) {
+                points.push_back(Point2f(roi.width * (x + 0.5f) / 4, roi.height * (y + 0.5f) / 4));
+            }
+        }
+    }
+
+    for(unsigned int i = 0; i < points.size(); i++) {
+        points[i].x += roi.x;
+        points[i].y += roi.y;
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Moves the box according to the followed points
+ */
+void TrackerFlow::move(const Point2f *moved, const uchar *status, const Mat& gray)
+{
+    vector<Point2f> from, to;
+    for(unsigned int i = 0; i < points.size(); i++) {
+        const Point2f& p = moved[i];
+        if(status[i] && p.x >= 0 && p.y >= 0 && p.x < gray.cols && p.y < gray.rows) {
+            from.push_back(points[i]);
+            to.push_back(p);
+        }
+    }
+
+    tracked = points.empty() ? 0 : (float)to.size() / points.size();
+    if(to.size() < minPoints || tracked < minTracked) {
+        lost = true;
+        points.clear();
+        return;
+    }
+
+    // Median motion of the points
+    vector<float> dx(to.size()), dy(to.size());
+    for(unsigned int i = 0; i < to.size(); i++) {
+        dx[i] = to[i].x - from[i].x;
+        dy[i] = to[i].y - from[i].y;
+    }
+
+    // Median change of distances between the points
+    vector<float> ratios;
+    ratios.reserve(to.size() * (to.size() - 1) / 2);
+    for(unsigned int i = 0; i < to.size(); i++) {
+        for(unsigned int j = i + 1; j < to.size(); j++) {
+            float before = (float)norm(from[i] - from[j]);
+            if(before > 1) {
+                ratios.push_back((float)norm(to[i] - to[j]) / before);
+            }
+        }
+    }
+    float scale = ratios.empty() ? 1.0f : min(max(median(ratios), minScale), maxScale);
+
+    Point2f center(box.x + box.width * 0.5f + median(dx), box.y + box.height * 0.5f + median(dy));
+    if(center.x < 0 || center.y < 0 || center.x >= gray.cols || center.y >= gray.rows) {
+        lost = true;
+        points.clear();
+        return;
+    }
+
+    box.width *= scale;
+    box.height *= scale;
+    box.x = center.x - box.width * 0.5f;
+    box.y = center.y - box.height * 0.5f;
+
+    // New points are found when too many of them were lost
+    points.swap(to);
+    if((int)points.size() < maxPoints / 2) {
+        seed(gray);
+        if(points.size() < minPoints) {
+            lost = true;
+            points.clear();
+        }
+    }
+}
+
+}
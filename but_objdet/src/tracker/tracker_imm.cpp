@@ -0,0 +1,572 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <boost/bind.hpp>
+
+#include "but_objdet/tracker/tracker_imm.h"
+
+using namespace cv;
+using namespace std;
+
+// Intensities of the process noise of the models - random walk of the position
+// [units^2/s], white noise acceleration [units^2/s^3] and jerk [units^2/s^5]
+const float positionNoise = 25.0f;
+const float accelerationNoise = 400.0f;
+const float jerkNoise = 2000.0f;
+
+// Standard deviations of the velocity and of the acceleration of a new object
+const float initialVelocity = 50.0f;
+const float initialAcceleration = 50.0f;
+
+// Number of trackers, whose filters of one model are updated together
+const size_t groupSize = 32;
+
+
+namespace but_objdet
+{
+
+/* =============================================================================
+ * Transition and process noise of a model for one parameter (the noise is
+ * the discretized white noise acceleration / jerk, so the acceleration moves
+ * the position by t^2/2 - unlike in TrackerKalman, which uses t/2)
+ */
+static void transition(int model, float t, float F[3][3], float Q[3][3])
+{
+    memset(F, 0, 9 * sizeof(float));
+    memset(Q, 0, 9 * sizeof(float));
+    F[0][0] = 1;
+
+    switch(model) {
+    case IMMTracker::CONSTANT_POSITION:
+        Q[0][0] = positionNoise * t;
+        break;
+
+    case IMMTracker::CONSTANT_VELOCITY:
+        F[0][1] = t;
+        F[1][1] = 1;
+        Q[0][0] = accelerationNoise * t * t * t / 3;
+        Q[0][1] = Q[1][0] = accelerationNoise * t * t / 2;
+        Q[1][1] = accelerationNoise * t;
+        break;
+
+    default:
+        F[0][1] = t;
+        F[0][2] = 0.5f * t * t;
+        F[1][1] = 1;
+        F[1][2] = t;
+        F[2][2] = 1;
+        Q[0][0] = jerkNoise * t * t * t * t * t / 20;
+        Q[0][1] = Q[1][0] = jerkNoise * t * t * t * t / 8;
+        Q[0][2] = Q[2][0] = jerkNoise * t * t * t / 6;
+        Q[1][1] = jerkNoise * t * t * t / 3;
+        Q[1][2] = Q[2][1] = jerkNoise * t * t / 2;
+        Q[2][2] = jerkNoise * t;
+        break;
+    }
+}
+
+
+/* =============================================================================
+ * P = F * P * F' + Q
+ */
+static void propagateCovariance(const float F[3][3], const float Q[3][3], float P[3][3])
+{
+    float FP[3][3];
+    for(int r = 0; r < 3; r++) {
+        for(int s = 0; s < 3; s++) {
+            FP[r][s] = F[r][0] * P[0][s] + F[r][1] * P[1][s] + F[r][2] * P[2][s];
+        }
+    }
+    for(int r = 0; r < 3; r++) {
+        for(int s = 0; s < 3; s++) {
+            P[r][s] = FP[r][0] * F[s][0] + FP[r][1] * F[s][1] + FP[r][2] * F[s][2] + Q[r][s];
+        }
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+IMMTracker::IMMTracker(float measurementNoise_, float switchProbability_)
+    : nParams(0)
+    , measurementNoise(measurementNoise_)
+    , switchProbability(min(max(switchProbability_, 0.0f), 1.0f))
+{
+    for(int m = 0; m < MODELS; m++) {
+        mu[m] = prior[m] = 1.0f / MODELS;
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Copy constructor
+ */
+IMMTracker::IMMTracker(const IMMTracker& imm)
+{
+    *this = imm;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Assignment (matrices are cloned)
+ */
+IMMTracker& IMMTracker::operator=(const IMMTracker& imm)
+{
+    if(this == &imm) return *this;
+
+    nParams = imm.nParams;
+    measurementNoise = imm.measurementNoise;
+    switchProbability = imm.switchProbability;
+    memcpy(filters, imm.filters, sizeof(filters));
+    memcpy(mu, imm.mu, sizeof(mu));
+    memcpy(prior, imm.prior, sizeof(prior));
+    state = imm.state.clone();
+    covariance = imm.covariance.clone();
+    noiseCov = imm.noiseCov.clone();
+    temp = imm.temp.clone();
+
+    return *this;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Initialization with the first measurement
+ */
+bool IMMTracker::init(const Mat& measurement, bool secDerivate)
+{
+    if(measurement.dims != 2 || measurement.type() != CV_32F) return false;
+    if(measurement.rows != 1 && measurement.cols != 1) return false;
+    if(measurement.total() < 1 || (int)measurement.total() > MAX_PARAMS) return false;
+
+    nParams = (int)measurement.total();
+
+    // The derivatives aren't known, models without them just don't use them
+    float variances[3] = { measurementNoise * measurementNoise,
+                           initialVelocity * initialVelocity,
+                           initialAcceleration * initialAcceleration };
+    for(int m = 0; m < MODELS; m++) {
+        for(int i = 0; i < nParams; i++) {
+            Filter &f = filters[m][i];
+            memset(&f, 0, sizeof(f));
+            f.x[0] = measurement.at<float>(i);
+            for(int d = 0; d <= m; d++) {
+                f.P[d][d] = variances[d];
+            }
+        }
+        mu[m] = prior[m] = 1.0f / MODELS;
+    }
+
+    temp.create(3 * nParams, 1, CV_32F);
+    combine();
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Prediction for the given time since the last update
+ */
+const Mat& IMMTracker::predict(int64 miliseconds)
+{
+    if(nParams == 0) return temp;
+
+    float t = miliseconds / 1000.0f;
+    float F[MODELS][3][3], Q[3][3];
+    for(int m = 0; m < MODELS; m++) {
+        transition(m, t, F[m], Q);
+    }
+
+    for(int i = 0; i < nParams; i++) {
+        for(int d = 0; d < 3; d++) {
+            float x = 0;
+            for(int m = 0; m < MODELS; m++) {
+                const float *fx = filters[m][i].x;
+                x += mu[m] * (F[m][d][0] * fx[0] + F[m][d][1] * fx[1] + F[m][d][2] * fx[2]);
+            }
+            temp.at<float>(i + d * nParams) = x;
+        }
+    }
+
+    return temp;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Update with a new measurement
+ */
+const Mat& IMMTracker::update(const Mat& measurement, int64 miliseconds)
+{
+    float z[MAX_PARAMS];
+    if(nParams == 0 || !measurementValues(measurement, z)) return state;
+
+    mix();
+
+    float logLikelihood[MODELS];
+    for(int m = 0; m < MODELS; m++) {
+        logLikelihood[m] = filter(m, miliseconds / 1000.0f, z);
+    }
+
+    weigh(logLikelihood);
+    combine();
+
+    return state;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Prediction of the state of the mixture and of its uncertainty
+ */
+bool IMMTracker::predictState(int64 miliseconds, Mat& predicted, Mat& predictedCov)
+{
+    if(nParams == 0) return false;
+
+    float t = (miliseconds > 0) ? miliseconds / 1000.0f : 0.0f;
+    float F[MODELS][3][3], Q[MODELS][3][3];
+    for(int m = 0; m < MODELS; m++) {
+        transition(m, t, F[m], Q[m]);
+        if(miliseconds <= 0) {
+            memset(Q[m], 0, sizeof(Q[m]));
+        }
+    }
+
+    predicted.create(nParams, 3, CV_32F);
+    predictedCov.create(nParams, 6, CV_32F);
+
+    for(int i = 0; i < nParams; i++) {
+        Filter models[MODELS];
+        float mean[3] = { 0, 0, 0 };
+        for(int m = 0; m < MODELS; m++) {
+            const Filter &f = filters[m][i];
+            for(int r = 0; r < 3; r++) {
+                models[m].x[r] = F[m][r][0] * f.x[0] + F[m][r][1] * f.x[1] + F[m][r][2] * f.x[2];
+                mean[r] += mu[m] * models[m].x[r];
+            }
+            memcpy(models[m].P, f.P, sizeof(f.P));
+            propagateCovariance(F[m], Q[m], models[m].P);
+        }
+
+        // Covariances of the models and the spread of their means
+        int c = 0;
+        for(int r = 0; r < 3; r++) {
+            predicted.at<float>(i, r) = mean[r];
+            for(int s = r; s < 3; s++, c++) {
+                float value = 0;
+                for(int m = 0; m < MODELS; m++) {
+                    value += mu[m] * (models[m].P[r][s] + (models[m].x[r] - mean[r]) * (models[m].x[s] - mean[s]));
+                }
+                predictedCov.at<float>(i, c) = value;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Updates several trackers
+ */
+void IMMTracker::updateAll(const vector<IMMTracker *>& trackers, const vector<Mat>& measurements,
+                           const vector<int64>& miliseconds, WorkerPool& pool)
+{
+    size_t groups = (trackers.size() + groupSize - 1) / groupSize;
+    pool.run(groups, boost::bind(&IMMTracker::updateGroup, _1, &trackers, &measurements, &miliseconds));
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Updates a group of trackers
+ */
+void IMMTracker::updateGroup(size_t group, const vector<IMMTracker *> *trackers,
+                             const vector<Mat> *measurements, const vector<int64> *miliseconds)
+{
+    size_t begin = group * groupSize;
+    size_t count = min(groupSize, trackers->size() - begin);
+
+    float z[groupSize][MAX_PARAMS];
+    float logLikelihood[groupSize][MODELS];
+    bool valid[groupSize];
+
+    for(size_t k = 0; k < count; k++) {
+        IMMTracker *tracker = (*trackers)[begin + k];
+        valid[k] = tracker->nParams > 0 && tracker->measurementValues((*measurements)[begin + k], z[k]);
+        if(valid[k]) {
+            tracker->mix();
+        }
+    }
+
+    for(int m = 0; m < MODELS; m++) {
+        for(size_t k = 0; k < count; k++) {
+            if(valid[k]) {
+                logLikelihood[k][m] = (*trackers)[begin + k]->filter(m, (*miliseconds)[begin + k] / 1000.0f, z[k]);
+            }
+        }
+    }
+
+    for(size_t k = 0; k < count; k++) {
+        if(valid[k]) {
+            (*trackers)[begin + k]->weigh(logLikelihood[k]);
+            (*trackers)[begin + k]->combine();
+        }
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Initializes all the filters with a saved state
+ */
+bool IMMTracker::restore(const Mat& saved, const Mat& savedCov, bool secDerivate)
+{
+    int nDerivs = secDerivate ? 3 : 2;
+    if(saved.cols != 1 || saved.rows < nDerivs || saved.rows % nDerivs != 0 || saved.type() != CV_32F)
+        return false;
+    if(savedCov.rows != saved.rows || savedCov.cols != saved.rows || savedCov.type() != CV_32F)
+        return false;
+    if(!init(saved.rowRange(0, saved.rows / nDerivs), true))
+        return false;
+
+    for(int m = 0; m < MODELS; m++) {
+        for(int i = 0; i < nParams; i++) {
+            Filter &f = filters[m][i];
+            for(int r = 0; r <= m && r < nDerivs; r++) {
+                f.x[r] = saved.at<float>(i + r * nParams);
+                for(int s = 0; s <= m && s < nDerivs; s++) {
+                    f.P[r][s] = savedCov.at<float>(i + r * nParams, i + s * nParams);
+                }
+            }
+        }
+    }
+
+    combine();
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Moves the filtered state forward in time without a measurement
+ */
+void IMMTracker::advance(int64 miliseconds)
+{
+    if(nParams == 0) return;
+
+    mix();
+    for(int m = 0; m < MODELS; m++) {
+        propagate(m, miliseconds / 1000.0f);
+        mu[m] = prior[m];
+    }
+    combine();
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Mixes states of the filters
+ */
+void IMMTracker::mix()
+{
+    // Probabilities of the models after a possible switch and the weights of
+    // the filters mixed into the filter of each model
+    float weights[MODELS][MODELS];
+    for(int j = 0; j < MODELS; j++) {
+        prior[j] = 0;
+        for(int i = 0; i < MODELS; i++) {
+            weights[i][j] = mu[i] * ((i == j) ? 1 - switchProbability : switchProbability / (MODELS - 1));
+            prior[j] += weights[i][j];
+        }
+        for(int i = 0; i < MODELS; i++) {
+            weights[i][j] = (prior[j] > 0) ? weights[i][j] / prior[j] : ((i == j) ? 1.0f : 0.0f);
+        }
+    }
+
+    Filter mixed[MODELS][MAX_PARAMS];
+    for(int j = 0; j < MODELS; j++) {
+        for(int k = 0; k < nParams; k++) {
+            Filter &f = mixed[j][k];
+            for(int r = 0; r < 3; r++) {
+                f.x[r] = 0;
+                for(int i = 0; i < MODELS; i++) {
+                    f.x[r] += weights[i][j] * filters[i][k].x[r];
+                }
+            }
+            for(int r = 0; r < 3; r++) {
+                for(int s = 0; s < 3; s++) {
+                    f.P[r][s] = 0;
+                    for(int i = 0; i < MODELS; i++) {
+                        const Filter &g = filters[i][k];
+                        f.P[r][s] += weights[i][j] * (g.P[r][s] + (g.x[r] - f.x[r]) * (g.x[s] - f.x[s]));
+                    }
+                }
+            }
+        }
+    }
+
+    for(int j = 0; j < MODELS; j++) {
+        memcpy(filters[j], mixed[j], nParams * sizeof(Filter));
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Predicts and corrects the filter of a model
+ */
+float IMMTracker::filter(int model, float seconds, const float *z)
+{
+    float F[3][3], Q[3][3];
+    transition(model, seconds, F, Q);
+
+    float R = measurementNoise * measurementNoise;
+    float logLikelihood = 0;
+
+    for(int i = 0; i < nParams; i++) {
+        Filter &f = filters[model][i];
+
+        float x[3];
+        for(int r = 0; r < 3; r++) {
+            x[r] = F[r][0] * f.x[0] + F[r][1] * f.x[1] + F[r][2] * f.x[2];
+        }
+        propagateCovariance(F, Q, f.P);
+
+        // Just the position is measured
+        float S = f.P[0][0] + R;
+        float y = z[i] - x[0];
+        float K[3] = { f.P[0][0] / S, f.P[1][0] / S, f.P[2][0] / S };
+        float P0[3] = { f.P[0][0], f.P[0][1], f.P[0][2] };
+
+        for(int r = 0; r < 3; r++) {
+            f.x[r] = x[r] + K[r] * y;
+            for(int s = 0; s < 3; s++) {
+                f.P[r][s] -= K[r] * P0[s];
+            }
+        }
+
+        logLikelihood -= 0.5f * (y * y / S + log(2 * (float)CV_PI * S));
+    }
+
+    return logLikelihood;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Predicts the filter of a model without a measurement
+ */
+void IMMTracker::propagate(int model, float seconds)
+{
+    float F[3][3], Q[3][3];
+    transition(model, seconds, F, Q);
+
+    for(int i = 0; i < nParams; i++) {
+        Filter &f = filters[model][i];
+        float x[3];
+        for(int r = 0; r < 3; r++) {
+            x[r] = F[r][0] * f.x[0] + F[r][1] * f.x[1] + F[r][2] * f.x[2];
+        }
+        memcpy(f.x, x, sizeof(x));
+        propagateCovariance(F, Q, f.P);
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * New probabilities of the models
+ */
+void IMMTracker::weigh(const float *logLikelihood)
+{
+    float best = *max_element(logLikelihood, logLikelihood + MODELS);
+
+    float sum = 0;
+    for(int m = 0; m < MODELS; m++) {
+        mu[m] = prior[m] * exp(logLikelihood[m] - best);
+        sum += mu[m];
+    }
+    for(int m = 0; m < MODELS; m++) {
+        mu[m] = (sum > 0) ? mu[m] / sum : prior[m];
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Mixture of the filters
+ */
+void IMMTracker::combine()
+{
+    int n = 3 * nParams;
+    state.create(n, 1, CV_32F);
+    covariance.create(n, n, CV_32F);
+    covariance.setTo(Scalar(0));
+    noiseCov.create(n, n, CV_32F);
+    noiseCov.setTo(Scalar(0));
+
+    float F[3][3], Q[MODELS][3][3];
+    for(int m = 0; m < MODELS; m++) {
+        transition(m, 1.0f, F, Q[m]);
+    }
+
+    for(int i = 0; i < nParams; i++) {
+        float mean[3] = { 0, 0, 0 };
+        for(int m = 0; m < MODELS; m++) {
+            for(int r = 0; r < 3; r++) {
+                mean[r] += mu[m] * filters[m][i].x[r];
+            }
+        }
+
+        for(int r = 0; r < 3; r++) {
+            state.at<float>(i + r * nParams) = mean[r];
+            for(int s = 0; s < 3; s++) {
+                float value = 0;
+                for(int m = 0; m < MODELS; m++) {
+                    const Filter &f = filters[m][i];
+                    value += mu[m] * (f.P[r][s] + (f.x[r] - mean[r]) * (f.x[s] - mean[s]));
+                }
+                covariance.at<float>(i + r * nParams, i + s * nParams) = value;
+            }
+
+            float q = 0;
+            for(int m = 0; m < MODELS; m++) {
+                q += mu[m] * Q[m][r][r];
+            }
+            noiseCov.at<float>(i + r * nParams, i + r * nParams) = q;
+        }
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Reads a measurement
+ */
+bool IMMTracker::measurementValues(const Mat& measurement, float *z) const
+{
+    if((int)measurement.total() != nParams || measurement.type() != CV_32F) return false;
+
+    for(int i = 0; i < nParams; i++) {
+        z[i] = measurement.at<float>(i);
+    }
+    return true;
+}
+
+}
@@ -37,6 +37,7 @@ namespace but_objdet
 {
 
 TrackerKalman::TrackerKalman()
+	: _secDerivate(true)
 {
 }
 
@@ -44,6 +45,33 @@ TrackerKalman::~TrackerKalman()
 {
 }
 
+TrackerKalman::TrackerKalman(const TrackerKalman& tk)
+{
+	*this = tk;
+}
+
+TrackerKalman& TrackerKalman::operator=(const TrackerKalman& tk)
+{
+	if(this == &tk)
+		return *this;
+
+	//cv::Mat copies share data, so all the matrices have to be cloned
+	KF.statePre = tk.KF.statePre.clone();
+	KF.statePost = tk.KF.statePost.clone();
+	KF.transitionMatrix = tk.KF.transitionMatrix.clone();
+	KF.controlMatrix = tk.KF.controlMatrix.clone();
+	KF.measurementMatrix = tk.KF.measurementMatrix.clone();
+	KF.processNoiseCov = tk.KF.processNoiseCov.clone();
+	KF.measurementNoiseCov = tk.KF.measurementNoiseCov.clone();
+	KF.errorCovPre = tk.KF.errorCovPre.clone();
+	KF.gain = tk.KF.gain.clone();
+	KF.errorCovPost = tk.KF.errorCovPost.clone();
+	temp = tk.temp.clone();
+	_secDerivate = tk._secDerivate;
+
+	return *this;
+}
+
 bool TrackerKalman::init(const Mat& measurement, bool secDerivate)
 {
 	//only the values to predict can be accepet. so the measurement matrix have
@@ -180,6 +208,83 @@ const Mat& TrackerKalman::update(const Mat& measurement, int64 miliseconds)
 	return KF.correct(measurement.t());
 }
 
+bool TrackerKalman::restore(const Mat& state, const Mat& covariance, bool secDerivate)
+{
+	int nDerivs = secDerivate ? 3 : 2;
+	if(state.cols != 1 || state.rows < nDerivs || state.rows % nDerivs != 0 || state.type() != CV_32F)
+		return false;
+	if(covariance.rows != state.rows || covariance.cols != state.rows || covariance.type() != CV_32F)
+		return false;
+
+	//the filter is set up by the first measurement (positions of the state)
+	//and its state is replaced then
+	if(!init(state.rowRange(0, state.rows / nDerivs).t(), secDerivate))
+		return false;
+
+	state.copyTo(KF.statePost);
+	covariance.copyTo(KF.errorCovPost);
+
+	return true;
+}
+
+void TrackerKalman::advance(int64 miliseconds)
+{
+	if(KF.statePost.empty())
+		return;
+
+	//the a priori estimate becomes the filtered one (no measurement comes)
+	modifyTransMat(miliseconds);
+	KF.predict();
+	KF.statePre.copyTo(KF.statePost);
+	KF.errorCovPre.copyTo(KF.errorCovPost);
+}
+
+bool TrackerKalman::predictState(int64 miliseconds, Mat& state, Mat& covariance)
+{
+	if(KF.statePost.empty())
+		return false;
+
+	//number of derivates in the state (2 or 3) and of predicted parameters
+	int nDerivs = _secDerivate ? 3 : 2;
+	int nParams = KF.statePost.rows / nDerivs;
+
+	//a priori state and error covariance for the requested time, or the
+	//filtered ones if no time passed since the last update
+	Mat x, P;
+	if(miliseconds > 0)
+	{
+		modifyTransMat(miliseconds);
+		x = KF.transitionMatrix * KF.statePost;
+		P = KF.transitionMatrix * KF.errorCovPost * KF.transitionMatrix.t() + KF.processNoiseCov;
+	}
+	else
+	{
+		x = KF.statePost;
+		P = KF.errorCovPost;
+	}
+
+	//the parameters don't influence each other, so only the block of each
+	//parameter (its position and derivates) is returned
+	state.create(nParams, 3, CV_32F);
+	state.setTo(Scalar(0));
+	covariance.create(nParams, 6, CV_32F);
+	covariance.setTo(Scalar(0));
+
+	for(int i = 0; i < nParams; i++)
+	{
+		for(int d = 0; d < nDerivs; d++)
+			state.at<float>(i, d) = x.at<float>(i + d * nParams);
+
+		int c = 0;
+		for(int r = 0; r < 3; r++)
+			for(int s = r; s < 3; s++, c++)
+				if(r < nDerivs && s < nDerivs)
+					covariance.at<float>(i, c) = P.at<float>(i + r * nParams, i + s * nParams);
+	}
+
+	return true;
+}
+
 }
 
 
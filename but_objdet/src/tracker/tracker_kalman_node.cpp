@@ -25,19 +25,27 @@
  * along with this file.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <sstream>
 #include <ros/ros.h> // Main header of ROS
+#include <boost/thread/thread_time.hpp>
+#include <sensor_msgs/image_encodings.h>
 
 // ObjDet API
 #include "but_objdet/but_objdet.h" // Main objects of ObjDet API
 #include "but_objdet/services_list.h" // Names of services provided by but_objdet package
 #include "but_objdet/PredictDetections.h" // Autogenerated service class
+#include "but_objdet/PredictDetectionsBatch.h" // Autogenerated service class
 #include "but_objdet/GetObjects.h" // Autogenerated service class
+#include "but_objdet/GetTrackHistory.h" // Autogenerated service class
 #include "but_objdet_msgs/DetectionArray.h" // Message transfering detections/predictions
 
-#include <opencv2/highgui/highgui.hpp>
 #include <cv_bridge/cv_bridge.h>
 
 #include "but_objdet/tracker/tracker_kalman.h"
+#include "but_objdet/stats/trace_buffer.h"
 #include "but_objdet/tracker/tracker_kalman_node.h"
 #include <../../opt/ros/electric/stacks/ros_comm/utilities/rostime/include/ros/duration.h>
 
@@ -45,29 +53,258 @@ using namespace std;
 using namespace cv;
 using namespace but_objdet_msgs;
 
-// If set to 1, detections will be visualized. If a tracker node is used, it is
-// better to visualize the detections together with predictions there.
-#define VISUAL_OUTPUT 1
-
 const string imageTopic = "/cam3d/rgb/image";
 const string detectionTopic = "/but_objdet/detections";
+const string predictionTopic = "/but_objdet/predictions";
+const string diagnosticsTopic = "/diagnostics";
+const string annotatedImageTopic = "/but_objdet/tracker/image";
 
 
 namespace but_objdet
 {
 
+/**
+ * Selects tracks of a class (-1 = all classes) in the given states (0 = all
+ * states) in a snapshot.
+ */
+class TrackFilter : public SpatialGrid::Filter
+{
+public:
+    TrackFilter(const vector<TrackView> &views_, int classId_, uint8_t stateMask_)
+        : views(views_), classId(classId_), stateMask(stateMask_) {}
+
+    bool accept(uint32_t index) const
+    {
+        const TrackView &view = views[index];
+        return (classId == -1 || view.det.m_class == classId) &&
+               (stateMask == 0 || (view.state & stateMask));
+    }
+
+private:
+    const vector<TrackView> &views;
+    int classId;
+    uint8_t stateMask;
+};
+
+/**
+ * Creates a key-value pair of a diagnostic status.
+ */
+template <typename T>
+diagnostic_msgs::KeyValue keyValue(const string &key, const T &value)
+{
+    ostringstream ss;
+    ss << value;
+    
+    diagnostic_msgs::KeyValue kv;
+    kv.key = key;
+    kv.value = ss.str();
+    return kv;
+}
+
+/**
+ * Reads a number from a parameter (integers are accepted as well).
+ */
+double numberParam(XmlRpc::XmlRpcValue &value)
+{
+    if(value.getType() == XmlRpc::XmlRpcValue::TypeInt) {
+        return (int)value;
+    }
+    return (double)value;
+}
+
+/**
+ * Reads a list of numbers from a member of a parameter.
+ */
+bool numberListParam(XmlRpc::XmlRpcValue &param, const string &member, double *values, int size)
+{
+    if(!param.hasMember(member)) return false;
+    
+    XmlRpc::XmlRpcValue &list = param[member];
+    if(list.getType() != XmlRpc::XmlRpcValue::TypeArray || list.size() != size) {
+        ROS_ERROR("Parameter %s has to be a list of %d numbers.", member.c_str(), size);
+        return false;
+    }
+    
+    for(int i = 0; i < size; i++) {
+        values[i] = numberParam(list[i]);
+    }
+    return true;
+}
+
+
 /* -----------------------------------------------------------------------------
  * Constructor
  */
-TrackerKalmanNode::TrackerKalmanNode()
+TrackerKalmanNode::TrackerKalmanNode(ros::NodeHandle nh_, ros::NodeHandle pnh_)
+    : nh(nh_)
+    , pnh(pnh_)
+    , detectionLatency("capture -> detector output")
+    , transportLatency("detector output -> tracker input")
+    , inputLatency("capture -> tracker input")
+    , metrics(pnh_.getNamespace() + ": metrics")
+    , ingestTime(NULL), ingestWaitTime(NULL), expireTime(NULL), predictTime(NULL), flowTime(NULL)
+    , detectionCount(NULL), predictCount(NULL), trackCount(NULL)
 {   
-    defaultTtl = 5;
-    defaultTtlTime = 5000; // = 5s
+    // Lifecycle of tracks: a track is confirmed after confirm_hits detections,
+    // a tentative track is removed after more than tentative_max_misses missed
+    // frames, a confirmed one is lost after max_misses missed frames and any
+    // track is removed when it isn't detected during expiry_time [ms]
+    int confirmHits, tentativeMaxMisses, maxMisses, expiryTime;
+    pnh.param("confirm_hits", confirmHits, 3);
+    pnh.param("tentative_max_misses", tentativeMaxMisses, 1);
+    pnh.param("max_misses", maxMisses, 5);
+    pnh.param("expiry_time", expiryTime, 5000); // = 5s
+    lifecycle.setParams(confirmHits, tentativeMaxMisses, maxMisses, expiryTime);
+    frameCounter = 0;
+    snapshotCounter = 0;
+
+    // Detections without an ID (m_id = Detection::NO_ID) are associated with
+    // predictions of tracks and IDs are assigned by the tracker
+    double minOverlap;
+    pnh.param("associate", associateAnonymous, true);
+    pnh.param("min_overlap", minOverlap, 50.0);
+    matcher.setMinOverlap(minOverlap);
+    matcher.setOneToOne(true);
+
+    // Responses of the prediction service are cached for requests of the same
+    // predictions (prediction_cache_size responses for each snapshot at most,
+    // 0 = no caching), request times are rounded to prediction_cache_quantum
+    // [ms], so that requests of nearly the same time share the response
+    int cacheSize;
+    pnh.param("prediction_cache_size", cacheSize, 16);
+    pnh.param("prediction_cache_quantum", predictionCacheQuantum, 1);
+    predictionCache.setMaxEntries(max(cacheSize, 0));
+    
+    // A shard tracks just the listed classes (detections of other classes
+    // are not even deserialized) and provides services and predictions with
+    // names prefixed by service_namespace
+    XmlRpc::XmlRpcValue classList;
+    if(pnh.getParam("classes", classList) && classList.getType() == XmlRpc::XmlRpcValue::TypeArray) {
+        for(int i = 0; i < classList.size(); i++) {
+            int objClass = classList[i];
+            ownedClasses.insert(objClass);
+        }
+    }
+    pnh.param("service_namespace", serviceNamespace, std::string(""));
+    
+    // Sources of detections - cameras with known intrinsics [fx, fy, cx, cy]
+    // and poses in a common frame (translation [x, y, z] and rotation
+    // [x, y, z, w]), whose tracks are fused. A detection belongs to the source
+    // with its frame (header.frame_id) or to the one given by m_source,
+    // detections received from the topic of a source belong to the source.
+    // Depths of detections (m_pos_2D.z) are in units of the translations.
+    XmlRpc::XmlRpcValue sourceList;
+    if(pnh.getParam("sources", sourceList) && sourceList.getType() == XmlRpc::XmlRpcValue::TypeArray) {
+        if(sourceList.size() > BUT_OBJDET_MAX_SOURCES) {
+            ROS_ERROR("Only %d sources are supported.", BUT_OBJDET_MAX_SOURCES);
+        }
+        
+        for(int i = 0; i < sourceList.size() && i < BUT_OBJDET_MAX_SOURCES; i++) {
+            XmlRpc::XmlRpcValue &source = sourceList[i];
+            if(source.getType() != XmlRpc::XmlRpcValue::TypeStruct) {
+                ROS_ERROR("Source %d is not described by a dictionary.", i);
+                continue;
+            }
+            
+            CameraModel camera;
+            double intrinsics[4] = { 1, 1, 0, 0 };
+            double translation[3] = { 0, 0, 0 };
+            double rotation[4] = { 0, 0, 0, 1 };
+            numberListParam(source, "intrinsics", intrinsics, 4);
+            numberListParam(source, "translation", translation, 3);
+            numberListParam(source, "rotation", rotation, 4);
+            camera.fx = intrinsics[0];
+            camera.fy = intrinsics[1];
+            camera.cx = intrinsics[2];
+            camera.cy = intrinsics[3];
+            camera.setPose(translation, rotation);
+            if(source.hasMember("frame_id")) {
+                camera.frameId = static_cast<std::string>(source["frame_id"]);
+            }
+            
+            fusion.addSource(camera);
+            sourceTopics.push_back(source.hasMember("topic") ?
+                static_cast<std::string>(source["topic"]) : std::string(""));
+        }
+    }
+    
+    // Boxes of tracks are indexed by a grid for region and nearest queries
+    pnh.param("grid_cell_size", gridCellSize, 64.0);
+
+    // History of filtered states - history_length samples are kept for each
+    // track (or the length given for its class by history_classes and
+    // history_class_lengths), at most history_max_samples for all tracks
+    int historyLength, historyMaxSamples;
+    pnh.param("history_length", historyLength, 100);
+    pnh.param("history_max_samples", historyMaxSamples, 100000);
+    historyArena.setLimits(max(historyMaxSamples, 0), max(historyLength, 0));
+    
+    XmlRpc::XmlRpcValue historyClasses, historyClassLengths;
+    if(pnh.getParam("history_classes", historyClasses) &&
+       pnh.getParam("history_class_lengths", historyClassLengths) &&
+       historyClasses.getType() == XmlRpc::XmlRpcValue::TypeArray &&
+       historyClassLengths.getType() == XmlRpc::XmlRpcValue::TypeArray &&
+       historyClasses.size() == historyClassLengths.size()) {
+        for(int i = 0; i < historyClasses.size(); i++) {
+            int objClass = historyClasses[i];
+            int length = historyClassLengths[i];
+            historyArena.setClassCapacity(objClass, max(length, 0));
+        }
+    }
+    
+    // Limits of the number of tracks (0 = unlimited) - max_tracks of all
+    // classes and max_class_tracks of each class (or the limit given for
+    // the class by track_limit_classes and track_limits). When a limit is
+    // reached, a new track replaces the one with the lowest priority, which
+    // is the time of the last update plus eviction_score_weight [ms] times
+    // the score of the last detection (a new track with an even lower
+    // priority isn't created).
+    int maxTracks, maxClassTracks, scoreWeight;
+    pnh.param("max_tracks", maxTracks, 0);
+    pnh.param("max_class_tracks", maxClassTracks, 0);
+    pnh.param("eviction_score_weight", scoreWeight, 1000);
+    eviction.setLimits(max(maxTracks, 0), max(maxClassTracks, 0), scoreWeight);
+    
+    XmlRpc::XmlRpcValue limitClasses, limits;
+    if(pnh.getParam("track_limit_classes", limitClasses) &&
+       pnh.getParam("track_limits", limits) &&
+       limitClasses.getType() == XmlRpc::XmlRpcValue::TypeArray &&
+       limits.getType() == XmlRpc::XmlRpcValue::TypeArray &&
+       limitClasses.size() == limits.size()) {
+        for(int i = 0; i < limitClasses.size(); i++) {
+            int objClass = limitClasses[i];
+            int limit = limits[i];
+            eviction.setClassLimit(objClass, max(limit, 0));
+        }
+    }
 
-    // Window name (for visualization detections and predictions)
-    if(VISUAL_OUTPUT) {
-        winName = "Tracker (white = detections, red = predictions)";
+    // Tracks can be followed by optical flow in images between detections
+    // (detectors running just on keyframes), the boxes moved by the flow are
+    // measurements of the tracks. Images are taken from the same topic as
+    // the visualization, cameras of several sources aren't supported.
+    pnh.param("flow_tracking", flowTracking, false);
+    if(flowTracking && fusion.enabled()) {
+        ROS_WARN("Optical flow tracking isn't supported with several sources.");
+        flowTracking = false;
     }
+    
+    // Motion model of the tracks - "ca" (constant acceleration, TrackerKalman)
+    // or "imm" (IMMTracker mixing standing, constant velocity and constant
+    // acceleration models, fewer lost tracks of objects, which stop and start)
+    string motionModel;
+    pnh.param("motion_model", motionModel, string("ca"));
+    immTracking = (motionModel == "imm");
+    if(!immTracking && motionModel != "ca") {
+        ROS_WARN("Unknown motion model %s, constant acceleration is used.", motionModel.c_str());
+    }
+    
+    // Images with detections and predictions are published if visual_output
+    // is set (it can be switched by a service at runtime), at most
+    // at visualization_rate [Hz] (0 = no limit)
+    pnh.param("visual_output", visualOutput, true);
+    pnh.param("visualization_rate", visualizationRate, 10.0);
+    visualizationRate = max(visualizationRate, 0.0);
+    renderRunning = false;
 
     rosInit(); // ROS-related initialization
 }
@@ -78,21 +315,22 @@ TrackerKalmanNode::TrackerKalmanNode()
  */
 TrackerKalmanNode::~TrackerKalmanNode()
 {
+    shmSub.stop();
     
-	DetMem::iterator it;
-        for (it = detectionMem.begin(); it != detectionMem.end(); it++) {
-            _DetMem::iterator it2;
-            for (it2 = it->second.begin(); it2 != it->second.end(); it2++) {
-                delete it2->second.kf; // Free Kalman filter
-                
-
-            }  
-            
-        }
+    {
+        boost::mutex::scoped_lock lock(renderMutex);
+        renderRunning = false;
+    }
+    renderCondition.notify_all();
+    renderThread.join();
+    
+    // Callbacks can't be running when the node is being destroyed
+    if(serviceSpinner) serviceSpinner->stop();
+    if(ingestSpinner) ingestSpinner->stop();
     
-    // Create a window to vizualize the incoming video, detections and predictions
-    if(VISUAL_OUTPUT) {
-        namedWindow(winName, CV_WINDOW_AUTOSIZE);
+    // The last state of tracks for the next start
+    if(!trackStoreFile.empty()) {
+        saveTracks();
     }
 }
 
@@ -102,69 +340,275 @@ TrackerKalmanNode::~TrackerKalmanNode()
  */
 void TrackerKalmanNode::rosInit()
 {
+    // Durations of processing of detections and of the prediction service
+    // (published together with the diagnostics), they are created before
+    // anything delivering detections or requests is started
+    ingestTime = metrics.histogram("ingest");
+    ingestWaitTime = metrics.histogram("ingest lock wait");
+    expireTime = metrics.histogram("expiry");
+    predictTime = metrics.histogram("predict service");
+    flowTime = metrics.histogram("optical flow");
+    detectionCount = metrics.counter("detections");
+    predictCount = metrics.counter("prediction requests");
+    trackCount = metrics.gauge("tracks");
+    
+    // Spans of processed detections and predictions (~trace_file)
+    traceInit(pnh);
+    
+    // Detections and services are served by their own threads (the global
+    // queue is left for images of the visualization and for timers)
+    ros::NodeHandle ingestNh(nh);
+    ingestNh.setCallbackQueue(&ingestQueue);
+    ros::NodeHandle serviceNh(nh);
+    serviceNh.setCallbackQueue(&serviceQueue);
+    
+    int serviceThreads;
+    pnh.param("service_threads", serviceThreads, 2);
+    
+    // Tracks saved by the previous run are restored (so that detectors get
+    // predictions and IDs continue right after a restart) and the tracks are
+    // saved every track_store_period [s] and when the node stops
+    double storePeriod;
+    pnh.param("track_store", trackStoreFile, std::string(""));
+    pnh.param("track_store_period", storePeriod, 5.0);
+    
+    int64 time = 0;
+    if(!trackStoreFile.empty()) {
+        time = loadTracks();
+        if(storePeriod > 0) {
+            trackStoreTimer = serviceNh.createWallTimer(ros::WallDuration(storePeriod),
+                &TrackerKalmanNode::trackStoreTimerCallback, this);
+        }
+    }
+    
+    // The first snapshot is published before services are advertised
+    publishSnapshot(time);
+    
     // Create and advertise a service for prediction of detections
-    predictionSRV = nh.advertiseService(BUT_OBJDET_PredictDetections_SRV,
+    predictionSRV = serviceNh.advertiseService(serviceNamespace + BUT_OBJDET_PredictDetections_SRV,
         &TrackerKalmanNode::predictDetections, this);
 
+    // Create and advertise a service for prediction of several objects at once
+    predictionBatchSRV = serviceNh.advertiseService(serviceNamespace + BUT_OBJDET_PredictDetectionsBatch_SRV,
+        &TrackerKalmanNode::predictDetectionsBatch, this);
+
+    // Create and advertise a service for providing history of objects
+    historySRV = serviceNh.advertiseService(serviceNamespace + BUT_OBJDET_GetTrackHistory_SRV,
+        &TrackerKalmanNode::getTrackHistory, this);
+
     // Create and advertise a service for providing objects
-    objectsSRV = nh.advertiseService(BUT_OBJDET_GetObjects_SRV,
+    objectsSRV = serviceNh.advertiseService(serviceNamespace + BUT_OBJDET_GetObjects_SRV,
         &TrackerKalmanNode::getObjects, this);
     
+    // Optionally push predictions of confirmed tracks to detectors, either at
+    // a fixed rate [Hz] or after every update of tracks (detectors don't need
+    // to call the prediction service for every frame then)
+    double predictionRate;
+    pnh.param("prediction_rate", predictionRate, 0.0);
+    pnh.param("predictions_on_update", predictionsOnUpdate, false);
+    if(predictionRate > 0 || predictionsOnUpdate) {
+        predictionsPub = nh.advertise<PredictionArray>(serviceNamespace + predictionTopic, 10);
+    }
+    if(predictionRate > 0) {
+        predictionTimer = serviceNh.createWallTimer(ros::WallDuration(1.0 / predictionRate),
+            &TrackerKalmanNode::predictionTimerCallback, this);
+    }
+    
+    // Optionally receive detections through shared memory from detectors
+    // running on the same host (they still publish the topic for nodes on other
+    // hosts, the topic is subscribed too and the second copy of detections
+    // is ignored). The ring has just one reader, so shards can't share it.
+    std::string shmName;
+    pnh.param("shm_transport", shmTransport, false);
+    pnh.param("shm_name", shmName, BUT_OBJDET_Detections_SHM);
+    if(shmTransport && !ownedClasses.empty()) {
+        ROS_ERROR("Shared memory transport can't be used by a shard (parameter classes), "
+                  "detections are received just from the topic.");
+        shmTransport = false;
+    }
+    if(shmTransport && !shmSub.start(shmName, boost::bind(&TrackerKalmanNode::newDataCallback, this, _1))) {
+        ROS_ERROR("Failed to open shared memory ring %s.", shmName.c_str());
+        shmTransport = false;
+    }
+
+    // Sources with their own topics of detections
+    bool commonTopic = sourceTopics.empty();
+    for(unsigned int i = 0; i < sourceTopics.size(); i++) {
+        if(sourceTopics[i].empty()) {
+            commonTopic = true;
+            continue;
+        }
+        sourceSubs.push_back(ingestNh.subscribe<DetectionArray>(sourceTopics[i], 10,
+            boost::bind(&TrackerKalmanNode::sourceDataCallback, this, _1, (int)i)));
+    }
+
     // Subscribe to a topic with detections (published by a detector node)
-    detSub = nh.subscribe(detectionTopic, 10, &TrackerKalmanNode::newDataCallback, this);
+    if(commonTopic && ownedClasses.empty()) {
+        detSub = ingestNh.subscribe(detectionTopic, 10, &TrackerKalmanNode::newDataCallback, this);
+    }
+    else if(commonTopic) {
+        ros::SubscribeOptions ops;
+        ops.init<FilteredDetections>(detectionTopic, 10,
+            boost::bind(&TrackerKalmanNode::filteredDataCallback, this, _1),
+            boost::bind(&TrackerKalmanNode::createFilteredDetections, this));
+        detSub = ingestNh.subscribe(ops);
+    }
+    
+    // Images for the optical flow are processed by the ingest thread, in
+    // order with detections
+    if(flowTracking) {
+        flowSub = ingestNh.subscribe(imageTopic, 1, &TrackerKalmanNode::flowImageCallback, this);
+    }
     
-    if(VISUAL_OUTPUT) {
+    // Images with detections and predictions are rendered by their own
+    // thread, so the visualization doesn't delay detections and services
+    annotatedPub = nh.advertise<sensor_msgs::Image>(serviceNamespace + annotatedImageTopic, 1);
+    visualizationSRV = serviceNh.advertiseService(serviceNamespace + BUT_OBJDET_SetVisualization_SRV,
+        &TrackerKalmanNode::setVisualization, this);
+    renderRunning = true;
+    renderThread = boost::thread(&TrackerKalmanNode::renderLoop, this);
+    
+    if(visualOutput) {
         // Subscribe to a topic with images
-        imgSub = nh.subscribe(imageTopic, 10, &TrackerKalmanNode::newImageCallback, this);
+        imgSub = nh.subscribe(imageTopic, 1, &TrackerKalmanNode::newImageCallback, this);
+    }
+    
+    // Periodically report latencies of received detections (0 = never)
+    double reportPeriod;
+    pnh.param("latency_report_period", reportPeriod, 10.0);
+    if(reportPeriod > 0) {
+        latencyTimer = nh.createWallTimer(ros::WallDuration(reportPeriod),
+            &TrackerKalmanNode::reportLatency, this);
+    }
+    
+    // Periodically publish the number of tracks and evictions (0 = never)
+    double diagnosticsPeriod;
+    pnh.param("diagnostics_period", diagnosticsPeriod, 1.0);
+    if(diagnosticsPeriod > 0) {
+        diagnosticsPub = nh.advertise<diagnostic_msgs::DiagnosticArray>(diagnosticsTopic, 1);
+        diagnosticsTimer = nh.createWallTimer(ros::WallDuration(diagnosticsPeriod),
+            &TrackerKalmanNode::publishDiagnostics, this);
     }
     
+    // Detections have to be processed in order => just one thread
+    ingestSpinner.reset(new ros::AsyncSpinner(1, &ingestQueue));
+    ingestSpinner->start();
+    serviceSpinner.reset(new ros::AsyncSpinner(std::max(serviceThreads, 1), &serviceQueue));
+    serviceSpinner->start();
+    
     // Inform that the tracker is running (it will be written into console)
     ROS_INFO("Tracker is running...");
 }
 
 /* -----------------------------------------------------------------------------
- * Function implementing the detection service
- * 
+ * Function implementing the get objects service
  */
 bool TrackerKalmanNode::getObjects(but_objdet::GetObjects::Request &req,
-                                          but_objdet::GetObjects::Response &res)
+                                   but_objdet::GetObjects::Response &res)
 {
-    // Object ID was specified
-    if (req.object_id != -1) {
-       
+    SnapshotRing<TrackSnapshot>::ReadRef snapshot(snapshots);
+    const vector<TrackView> &views = snapshot->views();
+
+    TrackSnapshot::IndexList buffer;
+    const TrackSnapshot::IndexList *list = &buffer;
+    TrackFilter filter(views, req.class_id, req.state_mask);
+    
+    switch(req.query) {
+    case but_objdet::GetObjects::Request::QUERY_REGION:
+        snapshot->queryRegion(GridBox(req.region.x, req.region.y,
+                                      req.region.width, req.region.height), buffer);
+        break;
+        
+    case but_objdet::GetObjects::Request::QUERY_NEAREST:
+        // The filter is applied during the search, so that k objects
+        // are found if there are any
+        snapshot->nearest(req.x, req.y, req.k, buffer, &filter);
+        break;
+        
+    default:
+        list = selectTracks(*snapshot, req.class_id, req.object_id, buffer);
     }
-    // Class ID was specified => return all objects from that class
-    else if(req.class_id != -1) {
-		DetMem::iterator it;
-		it = detectionMem.find(req.class_id);
-		if (it == detectionMem.end())
-		{
-			
-			return true;
-		}
-        _DetMem::iterator it2;
-        for (it2 = it->second.begin(); it2 != it->second.end(); it2++) {
-           	but_objdet_msgs::Detection det = it2->second.det;
-			res.objects.push_back(det);
-           
-        }
-    }
-    // Nothing specified => return all stored objects
-    else {
-	DetMem::iterator it;
-        for (it = detectionMem.begin(); it != detectionMem.end(); it++) {
-            _DetMem::iterator it2;
-            for (it2 = it->second.begin(); it2 != it->second.end(); it2++) {
-                but_objdet_msgs::Detection det = it2->second.det;
-            	res.objects.push_back(det);
-                
+    unsigned int count = list ? list->size() : views.size();
+    
+    for(unsigned int i = 0; i < count; i++) {
+        uint32_t index = list ? (*list)[i] : i;
+        const TrackView &view = views[index];
+        
+        // Only tracks of the required class and in the required states
+        if(!filter.accept(index)) continue;
+        
+        // The last detection, or its box moved to the filtered position
+        // (the filtered state corresponds to the time of the last update)
+        if(!req.filtered && !req.full_state) {
+            res.objects.push_back(view.det);
+            continue;
+        }
+        
+        TrackState state;
+        Detection det = view.predict(0, req.full_state ? &state : NULL);
+        
+        res.objects.push_back(req.filtered ? det : view.det);
+        if(req.full_state) {
+            res.states.push_back(state);
+        }
+    }
+    
+    return true;
+}
 
 
-            }  
-            
+/* -----------------------------------------------------------------------------
+ * Function implementing the track history service
+ */
+bool TrackerKalmanNode::getTrackHistory(but_objdet::GetTrackHistory::Request &req,
+                                        but_objdet::GetTrackHistory::Response &res)
+{
+    if(req.object_classes.size() != req.object_ids.size()) {
+        ROS_ERROR("%s: object_classes and object_ids differ in size.",
+                  BUT_OBJDET_GetTrackHistory_SRV.c_str());
+        return false;
+    }
+    
+    int64 fromMs = req.start.isZero() ? numeric_limits<int64>::min() : rosTimeToMs(req.start);
+    int64 toMs = req.end.isZero() ? numeric_limits<int64>::max() : rosTimeToMs(req.end);
+    
+    // Histories are kept with tracks, which are updated by the ingest thread
+    // (unlike predictions, they are not copied into snapshots)
+    boost::mutex::scoped_lock lock(memMutex);
+    
+    TrackTable<DetM>::SlotList slots;
+    if(!req.object_ids.empty()) {
+        for(unsigned int i = 0; i < req.object_ids.size(); i++) {
+            TrackHandle h = tracks.find(req.object_classes[i], req.object_ids[i]);
+            if(h.valid()) slots.push_back(h.slot);
+        }
+    }
+    else if(req.class_id != -1) {
+        slots = tracks.classSlots(req.class_id);
+    }
+    else {
+        slots = tracks.allSlots();
+    }
+    
+    vector<HistorySample> samples;
+    res.histories.resize(slots.size());
+    for(unsigned int i = 0; i < slots.size(); i++) {
+        TrackHistory &history = res.histories[i];
+        history.m_id = tracks.idOf(slots[i]);
+        history.m_class = tracks.classOf(slots[i]);
+        
+        historyArena.query(tracks.at(slots[i]).history, fromMs, toMs, req.decimation, samples);
+        history.stamps.resize(samples.size());
+        history.positions.resize(samples.size() * 4);
+        history.velocities.resize(samples.size() * 4);
+        for(unsigned int j = 0; j < samples.size(); j++) {
+            history.stamps[j].fromNSec((uint64_t)samples[j].msTime * 1000000);
+            for(int k = 0; k < 4; k++) {
+                history.positions[j * 4 + k] = samples[j].position[k];
+                history.velocities[j * 4 + k] = samples[j].velocity[k];
+            }
         }
-	}
-     
+    }
     
     return true;
 }
@@ -175,275 +619,1340 @@ bool TrackerKalmanNode::getObjects(but_objdet::GetObjects::Request &req,
  */
 bool TrackerKalmanNode::predictDetections(but_objdet::PredictDetections::Request &req,
                                           but_objdet::PredictDetections::Response &res)
-{   
-    //ROS_INFO("New request: object_id: %d, class_id: %d", req.object_id, req.class_id);
-
-	//Object ID and Class ID was specified
-  
-    if(req.object_id != -1 && req.class_id != -1) {
-        
-		DetMem::iterator it = detectionMem.find(req.class_id);	
-		
-		if (it == detectionMem.end())
-		{
-			//no obj in this class
-			return true;
-		}
-
-		_DetMem::iterator it2 = it->second.find(req.object_id);
-		but_objdet_msgs::Detection det = it->second[req.object_id].det;
-		
-		// Request time in miliseconds from the time of detection
-                int predTime = rosTimeToMs(req.header.stamp) - detectionMem[req.class_id][req.object_id].msTime;
-
-                // Get prediction
-                Mat prediction = detectionMem[req.class_id][req.object_id].kf->predict(predTime);
-                det.m_bb.x = prediction.at<float>(0);
-                det.m_bb.y = prediction.at<float>(1);
-                det.m_bb.width = prediction.at<float>(2);
-                det.m_bb.height = prediction.at<float>(3);
+{
+    MetricTimer timer(predictTime);
+    TraceScope span("tracker predict", req.header.stamp, req.header.seq);
+    predictCount->add();
 
-                res.predictions.push_back(det);
+    // The snapshot isn't changed while it is read (the tracker publishes
+    // a new one instead)
+    SnapshotRing<TrackSnapshot>::ReadRef snapshot(snapshots);
 
+    //ROS_INFO("New request: object_id: %d, class_id: %d", req.object_id, req.class_id);
 
+    int64 reqTime = rosTimeToMs(req.header.stamp);
+    if(predictionCacheQuantum > 1) {
+        reqTime = (reqTime + predictionCacheQuantum / 2) / predictionCacheQuantum * predictionCacheQuantum;
     }
+
+    // (an object ID is considered only together with a class ID)
+    PredictionKey key(reqTime, req.class_id, (req.class_id != -1) ? req.object_id : -1,
+                      req.state_mask, req.full_state);
     
-    // Class ID was specified => return all detections from that class
-    else if(req.class_id != -1) {
-        _DetMem::iterator it;
-        for (it = detectionMem[req.class_id].begin(); it != detectionMem[req.class_id].end(); it++) {
-            
-                
-                but_objdet_msgs::Detection det = it->second.det;
-        
-                // Request time in miliseconds from the time of detection
-                int predTime = rosTimeToMs(req.header.stamp) - it->second.msTime;
-                
-                // Get prediction
-                Mat prediction = it->second.kf->predict(predTime);
-                det.m_bb.x = prediction.at<float>(0);
-                det.m_bb.y = prediction.at<float>(1);
-                det.m_bb.width = prediction.at<float>(2);
-                det.m_bb.height = prediction.at<float>(3);
-                
-                res.predictions.push_back(det);
-            
-        }
+    PredictionResponseCache::EntryPtr entry = predictionCache.get(snapshot->generation(), key);
+    if(!entry) {
+        makePredictions(*snapshot, key, res);
+        return true;
     }
     
-    // Nothing specified => return predictions for all stored detections
-    else {
-		DetMem::iterator it;
-        for (it = detectionMem.begin(); it != detectionMem.end(); it++) {
-            _DetMem::iterator it2;
-            for (it2 = it->second.begin(); it2 != it->second.end(); it2++) {
-                but_objdet_msgs::Detection det = it2->second.det;
-
-		        // Request time in miliseconds from the time of detection
-		        int predTime = rosTimeToMs(req.header.stamp) - it2->second.msTime;
-		        
-		        // Get prediction
-		        Mat prediction = it2->second.kf->predict(predTime);
-		        det.m_bb.x = prediction.at<float>(0);
-		        det.m_bb.y = prediction.at<float>(1);
-		        det.m_bb.width = prediction.at<float>(2);
-		        det.m_bb.height = prediction.at<float>(3);
-		        
-		        res.predictions.push_back(det);
-
-            }  
-            
+    // The first of identical requests computes the response, the others
+    // wait for it and copy it
+    PredictionResponseCache::ResultPtr result;
+    {
+        boost::mutex::scoped_lock lock(entry->mutex);
+        if(!entry->result) {
+            boost::shared_ptr<but_objdet::PredictDetections::Response> response(
+                new but_objdet::PredictDetections::Response);
+            makePredictions(*snapshot, key, *response);
+            entry->result = response;
         }
-
-
-
+        result = entry->result;
     }
+    res = *result;
     
     return true;
 }
 
 
 /* -----------------------------------------------------------------------------
- * Callback function called when new detections are received
+ * Predicts tracks required by a request of the prediction service
  */
-void TrackerKalmanNode::newDataCallback(const but_objdet_msgs::DetectionArrayConstPtr &detArrayMsg)
-{   
-   //ROS_ERROR("%d",detArrayMsg->detections.size());
+void TrackerKalmanNode::makePredictions(const TrackSnapshot &snapshot, const PredictionKey &key,
+                                        but_objdet::PredictDetections::Response &res)
+{
+    const vector<TrackView> &views = snapshot.views();
     
-    int detClass;
-	
-    for(unsigned int i = 0; i < detArrayMsg->detections.size(); i++) {
-		detClass = detArrayMsg->detections[i].m_class;
-		int detId = detArrayMsg->detections[i].m_id;
-
-		    
+    TrackSnapshot::IndexList buffer;
+    const TrackSnapshot::IndexList *list = selectTracks(snapshot, key.classId, key.objectId, buffer);
+    unsigned int count = list ? list->size() : views.size();
+    
+    res.predictions.reserve(count);
+    if(key.fullState) {
+        res.states.reserve(count);
+    }
+    
+    for(unsigned int i = 0; i < count; i++) {
+        const TrackView &view = views[list ? (*list)[i] : i];
         
-        // Check if the current detection is already in the memory
+        // Only tracks in the required states
+        if(key.stateMask != 0 && !(view.state & key.stateMask)) continue;
         
-		_DetMem::iterator it = detectionMem[detClass].find(detId);
+        // Request time in miliseconds from the time of detection
+        int64 predTime = key.time - view.msTime;
         
-        // When it was found
-        if(it != detectionMem[detClass].end()) {
-            //ROS_ERROR("Object ID found!");
-            detectionMem[detClass][detId].det = detArrayMsg->detections[i];
-            detectionMem[detClass][detId].ttl++;
-            
-            int time = rosTimeToMs(detArrayMsg->header.stamp);
-            int timeFromLastUpdate = time - detectionMem[detClass][detId].msTime;
-            detectionMem[detClass][detId].msTime = time;
-            
-            // Update
-            Mat newMeasurement(1, 4, CV_32F);
-		    newMeasurement.at<float>(0) = detectionMem[detClass][detId].det.m_bb.x;
-		    newMeasurement.at<float>(1) = detectionMem[detClass][detId].det.m_bb.y;
-		    newMeasurement.at<float>(2) = detectionMem[detClass][detId].det.m_bb.width;
-		    newMeasurement.at<float>(3) = detectionMem[detClass][detId].det.m_bb.height;
+        // Get prediction
+        TrackState state;
+        Detection det = view.predict(predTime, key.fullState ? &state : NULL);
+        
+        res.predictions.push_back(det);
+        if(key.fullState) {
+            res.states.push_back(state);
+        }
+    }
+}
 
-            
+
+/* -----------------------------------------------------------------------------
+ * Function implementing the batch prediction service
+ */
+bool TrackerKalmanNode::predictDetectionsBatch(but_objdet::PredictDetectionsBatch::Request &req,
+                                               but_objdet::PredictDetectionsBatch::Response &res)
+{
+    SnapshotRing<TrackSnapshot>::ReadRef snapshot(snapshots);
+    const vector<TrackView> &views = snapshot->views();
+    
+    if(req.object_classes.size() != req.object_ids.size()) {
+        ROS_ERROR("%s: object_classes and object_ids differ in size.",
+                  BUT_OBJDET_PredictDetectionsBatch_SRV.c_str());
+        return false;
+    }
+    
+    int64 reqTime = rosTimeToMs(req.header.stamp);
+    
+    // 1) Select the required tracks (pairs of indices of a track and of
+    // a request item) in the order of the request
+    vector<pair<uint32_t, int32_t> > selected;
+    for(unsigned int i = 0; i < req.object_ids.size(); i++) {
+        int index = snapshot->find(req.object_classes[i], req.object_ids[i]);
+        if(index >= 0) {
+            selected.push_back(make_pair((uint32_t)index, (int32_t)i));
         }
-        
-        // When it wasn't found => add it to memory
-        else {
-           // ROS_ERROR("Object ID not found!");
-            detectionMem[detClass][detId].det = detArrayMsg->detections[i];
-            detectionMem[detClass][detId].ttl = defaultTtl;
-            detectionMem[detClass][detId].kf = new TrackerKalman();
-            detectionMem[detClass][detId].msTime = rosTimeToMs(detArrayMsg->header.stamp);
-            
-		    // Initialization with the first measurement
-		    Mat initMeasurement(1, 4, CV_32F);
-		    initMeasurement.at<float>(0) = detectionMem[detClass][detId].det.m_bb.x;
-		    initMeasurement.at<float>(1) = detectionMem[detClass][detId].det.m_bb.y;
-		    initMeasurement.at<float>(2) = detectionMem[detClass][detId].det.m_bb.width;
-		    initMeasurement.at<float>(3) = detectionMem[detClass][detId].det.m_bb.height;
-            detectionMem[detClass][detId].kf->init(initMeasurement, true);
-            
+    }
+    for(unsigned int i = 0; i < req.class_ids.size(); i++) {
+        const TrackSnapshot::IndexList &list = snapshot->classIndices(req.class_ids[i]);
+        int32_t reqIndex = req.object_ids.size() + i;
+        for(unsigned int j = 0; j < list.size(); j++) {
+            selected.push_back(make_pair(list[j], reqIndex));
+        }
+    }
+    if(req.object_ids.empty() && req.class_ids.empty()) {
+        for(unsigned int i = 0; i < views.size(); i++) {
+            selected.push_back(make_pair((uint32_t)i, (int32_t)-1));
         }
     }
     
-    // Decrease TTL to all saved detections
-    _DetMem::iterator it;
-    vector<int> toBeRemoved; // Vector of IDs whose detection has TTL = 0
-    for (it = detectionMem[detClass].begin(); it != detectionMem[detClass].end(); it++) {
-        it->second.ttl--;
-        //std::cout << "TTL: " << it->second.ttl << " " << detectionMem.size() << std::endl;
-        
-        // If it didn't show up in the specified number of last detections
-        // or during the specified time period => mark it for removal
+    // 2) Filter the tracks by state and by the predicted bounding box (only
+    // the boxes are predicted in this pass)
+    bool useRegion = req.region.width > 0 && req.region.height > 0;
+    float regionRight = req.region.x + req.region.width;
+    float regionBottom = req.region.y + req.region.height;
+    
+    unsigned int count = 0;
+    for(unsigned int i = 0; i < selected.size(); i++) {
+        const TrackView &view = views[selected[i].first];
+        if(req.state_mask != 0 && !(view.state & req.state_mask)) continue;
         
-        //TODO: not working, why? if(it->second.ttl == 0 || (rosTimeToMs(ros::Time::now()) - it->second.msTime) > defaultTtlTime) {
-        if(it->second.ttl == 0)    {
-                toBeRemoved.push_back(it->second.det.m_id);
+        if(useRegion) {
+            float bb[BUT_OBJDET_TRACK_PARAMS];
+            view.predictBox(reqTime - view.msTime, bb);
+            if(bb[0] >= regionRight || bb[0] + bb[2] <= req.region.x ||
+               bb[1] >= regionBottom || bb[1] + bb[3] <= req.region.y) continue;
         }
+        
+        selected[count++] = selected[i];
     }
     
-    // Remove marked detections
-    for(unsigned int i = 0; i < toBeRemoved.size(); i++) {
-        delete detectionMem[detClass][toBeRemoved[i]].kf; // Free Kalman filter
-        detectionMem[detClass].erase(toBeRemoved[i]);
-      // ROS_ERROR("remove");
+    // 3) Predictions of the remaining tracks
+    res.predictions.resize(count);
+    res.request_index.resize(count);
+    if(req.full_state) {
+        res.states.resize(count);
     }
-
+    for(unsigned int i = 0; i < count; i++) {
+        const TrackView &view = views[selected[i].first];
+        res.predictions[i] = view.predict(reqTime - view.msTime,
+                                          req.full_state ? &res.states[i] : NULL);
+        res.request_index[i] = selected[i].second;
+    }
+    
+    return true;
 }
 
 
 /* -----------------------------------------------------------------------------
- * Callback function called when new Image is received. The image is used just
- * for visualization of detections and predictions, thus it doesn't influence
- * functionality of this node in any way.
+ * Selects indices of the tracks required by a service request
  */
-void TrackerKalmanNode::newImageCallback(const sensor_msgs::ImageConstPtr &imageMsg)
+const TrackSnapshot::IndexList* TrackerKalmanNode::selectTracks(const TrackSnapshot &snapshot,
+                                                               int classId, int objectId,
+                                                               TrackSnapshot::IndexList &buffer)
 {
-
-    // Get an OpenCV Mat from the image message
-    Mat image,image2;
-    try {
-        image2 = cv_bridge::toCvCopy(imageMsg)->image;
-	flip(image2, image, 0);
-    }    catch (cv_bridge::Exception& e) {
-        ROS_ERROR("cv_bridge exception: %s", e.what());
-        return;
+    // Object ID and Class ID was specified => just that object
+    if(classId != -1 && objectId != -1) {
+        int index = snapshot.find(classId, objectId);
+        buffer.clear();
+        if(index >= 0) buffer.push_back(index);
+        return &buffer;
     }
     
-    // Convert to 3 channels - so we can visualize BB in color
-    Mat img3ch;
-    if(image.channels() != 3) {
-        cvtColor(image, img3ch, CV_GRAY2RGB, 3);
+    // Object ID was specified without a class => objects of all classes with that ID
+    else if(objectId != -1) {
+        snapshot.findId(objectId, buffer);
+        return &buffer;
     }
-    else {
-        image.copyTo(img3ch);
+    
+    // Class ID was specified => all objects from that class
+    else if(classId != -1) {
+        return &snapshot.classIndices(classId);
     }
-  
-	DetMem::iterator it0;
-    _DetMem::iterator it;
-    for (it0 = detectionMem.begin(); it0 != detectionMem.end(); it0++) {
-    for (it = it0->second.begin(); it != it0->second.end(); it++) {
-        
-        // Visualize detection
-        Detection det = it->second.det;
-        rectangle(
-	        img3ch,
-	        cvPoint(det.m_bb.x, det.m_bb.y),
-	        cvPoint(det.m_bb.x + det.m_bb.width, det.m_bb.y + det.m_bb.height),
-	        cvScalar(255,255,255)
-	    );
-	    
-	    // Obtain and visualize corresponding prediction
-	    int predTime = rosTimeToMs(ros::Time::now()) - it->second.msTime;
-            
-	    Mat prediction = it->second.kf->predict(predTime);
-	    Detection pred;
-        pred.m_bb.x = prediction.at<float>(0);
-        pred.m_bb.y = prediction.at<float>(1);
-        pred.m_bb.width = prediction.at<float>(2);
-        pred.m_bb.height = prediction.at<float>(3);
+    
+    // Nothing specified => all objects
+    return NULL;
+}
 
-        rectangle(
-	        img3ch,
-	        cvPoint(pred.m_bb.x, pred.m_bb.y),
-	        cvPoint(pred.m_bb.x + pred.m_bb.width, pred.m_bb.y + pred.m_bb.height),
-	        cvScalar(0,0,255)
-	    );
-    }
-	}
+
+/* -----------------------------------------------------------------------------
+ * Publishes the current tracks as a new snapshot
+ */
+void TrackerKalmanNode::publishSnapshot(int64 time)
+{
+    TrackSnapshot &snapshot = snapshots.acquireWrite();
+    snapshot.clear(frameCounter, ++snapshotCounter, time);
+    snapshot.setCellSize(gridCellSize);
     
-    if(VISUAL_OUTPUT) {
-        imshow(winName, img3ch);
+    const TrackTable<DetM>::SlotList &slots = tracks.allSlots();
+    for(unsigned int i = 0; i < slots.size(); i++) {
+        DetM &detM = tracks.at(slots[i]);
+        
+        TrackView &view = snapshot.add(tracks.classOf(slots[i]), tracks.idOf(slots[i]));
+        view.det = detM.det;
+        view.msTime = detM.msTime;
+        view.state = detM.status.state;
+        if(immTracking) {
+            view.setState(detM.imm);
+        }
+        else {
+            view.setState(detM.kf);
+        }
     }
+    
+    snapshot.finish();
+    snapshots.publish();
 }
 
 
-/* =============================================================================
- * Converts ros::Time to miliseconds
+/* -----------------------------------------------------------------------------
+ * Publishes predictions of all confirmed tracks
  */
-int TrackerKalmanNode::rosTimeToMs(ros::Time stamp)
+void TrackerKalmanNode::publishPredictions(const TrackSnapshot &snapshot, const ros::Time &stamp)
 {
-    //std::cout << "Time: " << stamp.sec << " " << stamp.nsec << " " << stamp.sec * 1000 + stamp.nsec / 1000000 << std::endl;
-    return stamp.sec * 1000 + stamp.nsec / 1000000;
+    const vector<TrackView> &views = snapshot.views();
+    int64 time = rosTimeToMs(stamp);
+    
+    PredictionArrayPtr predArray(new PredictionArray);
+    predArray->header.stamp = stamp;
+    predArray->predictions.reserve(views.size());
+    predArray->states.reserve(views.size());
+    
+    for(unsigned int i = 0; i < views.size(); i++) {
+        if(!(views[i].state & BUT_OBJDET_TRACK_CONFIRMED)) continue;
+        
+        predArray->states.push_back(TrackState());
+        predArray->predictions.push_back(views[i].predict(time - views[i].msTime,
+            &predArray->states.back()));
+    }
+    
+    predictionsPub.publish(predArray);
 }
 
+
+/* -----------------------------------------------------------------------------
+ * Publishes predictions at a fixed rate
+ */
+void TrackerKalmanNode::predictionTimerCallback(const ros::WallTimerEvent &event)
+{
+    SnapshotRing<TrackSnapshot>::ReadRef snapshot(snapshots);
+    publishPredictions(*snapshot, ros::Time::now());
 }
 
 
-/* =============================================================================
- * Main function
+/* -----------------------------------------------------------------------------
+ * Callback function called when new detections are received
  */
-int main(int argc, char **argv)
+void TrackerKalmanNode::newDataCallback(const but_objdet_msgs::DetectionArrayConstPtr &detArrayMsg)
 {
-    // ROS initialization (the last argument is the name of a ROS node)
-    ros::init(argc, argv, "but_tracker_kalman");
+    if(shmTransport && !firstDelivery(*detArrayMsg)) {
+        return;
+    }
+    
+    TraceScope span("tracker ingest", detArrayMsg->header.stamp, detArrayMsg->header.seq);
+    MetricTimer waitTimer(ingestWaitTime);
+    boost::mutex::scoped_lock lock(memMutex);
+    waitTimer.stop();
+    MetricTimer timer(ingestTime);
+    detectionCount->add(detArrayMsg->detections.size());
 
-    // Create the object managing connection with ROS system
-    but_objdet::TrackerKalmanNode *tkn = new but_objdet::TrackerKalmanNode();
+   //ROS_ERROR("%d",detArrayMsg->detections.size());
     
-    // Enters a loop, calling message callbacks
-    while(ros::ok()) {
-        waitKey(10); // Process window events
-        ros::spinOnce(); // Call all the message callbacks waiting to be called
+    // Latencies of the received detections
+    int64 inputTime = ros::Time::now().toNSec();
+    for(unsigned int i = 0; i < detArrayMsg->detections.size(); i++) {
+        const Detection &det = detArrayMsg->detections[i];
+        if(!ownsClass(det.m_class)) continue;
+        
+        int64 captureTime = det.m_timestamp.toNSec();
+        int64 procTime = det.m_proc_timestamp.toNSec();
+        
+        // (detectors, which don't stamp detections, leave the times zero)
+        if(captureTime != 0 && procTime != 0) {
+            detectionLatency.add(det.m_class, captureTime, procTime);
+        }
+        if(procTime != 0) {
+            transportLatency.add(det.m_class, procTime, inputTime);
+        }
+        if(captureTime != 0) {
+            inputLatency.add(det.m_class, captureTime, inputTime);
+        }
     }
     
-    delete tkn;
+    int64 time = rosTimeToMs(detArrayMsg->header.stamp);
+    frameCounter++;
     
-    return 0;
-}
-
+    // Remove tracks, which weren't detected for a long time
+    MetricTimer expiryTimer(expireTime);
+    vector<uint64_t> expired;
+    lifecycle.expire(time, expired);
+    for(unsigned int i = 0; i < expired.size(); i++) {
+        eraseTrack(TrackHandle(expired[i] >> 32, expired[i] & 0xffffffff));
+    }
+    expiryTimer.stop();
+    
+    // Detections of several sources are converted into measurements of
+    // tracks in images of their sources
+    const vector<Detection> *detections = &detArrayMsg->detections;
+    vector<Detection> measurements;
+    vector<uint32_t> observers;
+    uint32_t sourceMask = 0;
+    vector<SourceBinding> bindings;
+    if(fusion.enabled()) {
+        fuseDetections(detArrayMsg->detections, time, measurements, observers, sourceMask, bindings);
+        detections = &measurements;
+    }
+    
+    vector<int> classes; // Classes present in the received detections
+    vector<unsigned int> anonymous; // Detections without an ID
+	
+    for(unsigned int i = 0; i < detections->size(); i++) {
+        const Detection &det = (*detections)[i];
+        
+        // Detections of classes of other shards (received e.g. from topics
+        // of sources)
+        if(!ownsClass(det.m_class)) continue;
+        
+        if(find(classes.begin(), classes.end(), det.m_class) == classes.end()) {
+            classes.push_back(det.m_class);
+        }
+        
+        // Detections without an ID are associated with tracks, when all
+        // the identified detections are processed
+        if(associateAnonymous && det.m_id == Detection::NO_ID) {
+            anonymous.push_back(i);
+            continue;
+        }
+        
+        updateTrack(det, time, observers.empty() ? 0 : observers[i]);
+    }
+    
+    if(!anonymous.empty()) {
+        vector<int> ids;
+        associateDetections(*detections, anonymous, time, ids);
+        
+        for(unsigned int i = 0; i < anonymous.size(); i++) {
+            Detection det = (*detections)[anonymous[i]];
+            det.m_id = ids[i];
+            updateTrack(det, time);
+        }
+    }
+    
+    // Objects of sources are bound to their new tracks, unless the tracks
+    // weren't created (no room for them), their IDs are then released (if no
+    // ID was assigned since, in the reverse order), so that a rejected object
+    // doesn't use up a new ID in every frame
+    for(int i = (int)bindings.size() - 1; i >= 0; i--) {
+        const SourceBinding &b = bindings[i];
+        if(tracks.find(b.objClass, b.trackId).valid()) {
+            fusion.bind(b);
+        }
+        else if(lastObjectIDs[b.objClass] == b.trackId) {
+            lastObjectIDs[b.objClass]--;
+        }
+    }
+    
+    // Count a miss for all tracks of the detected classes, which were not
+    // detected in this frame (tracks of other classes are possibly not
+    // detected by the detector at all, they are left to the time expiry)
+    vector<TrackHandle> toBeRemoved;
+    for(unsigned int c = 0; c < classes.size(); c++) {
+        const TrackTable<DetM>::SlotList &slots = tracks.classSlots(classes[c]);
+        for(unsigned int i = 0; i < slots.size(); i++) {
+            DetM &detM = tracks.at(slots[i]);
+            if(detM.frame == frameCounter) continue;
+            
+            // Objects, which were detected just by other sources
+            if(fusion.enabled() && !(detM.sources & sourceMask)) continue;
+            
+            if(lifecycle.miss(detM.status)) {
+                toBeRemoved.push_back(tracks.handleOf(slots[i]));
+            }
+        }
+    }
+    
+    // Remove tentative tracks, which were missed too many times
+    for(unsigned int i = 0; i < toBeRemoved.size(); i++) {
+        DetM *detM = tracks.get(toBeRemoved[i]);
+        lifecycle.removed(detM->status);
+        eraseTrack(toBeRemoved[i]);
+    }
+    
+    publishSnapshot(time);
+    trackCount->set(tracks.size());
+    
+    // Predictions for the time of the received detections
+    if(predictionsOnUpdate) {
+        publishPredictions(snapshots.last(), detArrayMsg->header.stamp);
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Tests if detections are received for the first time
+ */
+bool TrackerKalmanNode::firstDelivery(const DetectionArray &detArray)
+{
+    // Each array comes at most twice, arrays of detectors on other hosts
+    // come just once and they are forgotten after a while
+    const size_t maxDeliveries = 64;
+    
+    DeliveryKey key(detArray);
+    boost::mutex::scoped_lock lock(deliveryMutex);
+    
+    std::deque<DeliveryKey>::iterator it = std::find(deliveries.begin(), deliveries.end(), key);
+    if(it != deliveries.end()) {
+        deliveries.erase(it);
+        return false;
+    }
+    
+    deliveries.push_back(key);
+    if(deliveries.size() > maxDeliveries) {
+        deliveries.pop_front();
+    }
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Callback function called when new detections are received by a shard
+ */
+void TrackerKalmanNode::filteredDataCallback(const FilteredDetections::ConstPtr &detections)
+{
+    // The array shares the received message
+    newDataCallback(DetectionArrayConstPtr(detections, &detections->array));
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Creates a message for received detections
+ */
+FilteredDetections::Ptr TrackerKalmanNode::createFilteredDetections()
+{
+    return FilteredDetections::Ptr(new FilteredDetections(&ownedClasses));
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Callback function called when new detections are received from the topic
+ * of a source
+ */
+void TrackerKalmanNode::sourceDataCallback(const DetectionArrayConstPtr &detArrayMsg, int source)
+{
+    DetectionArrayPtr detArray(new DetectionArray(*detArrayMsg));
+    for(unsigned int i = 0; i < detArray->detections.size(); i++) {
+        Detection &det = detArray->detections[i];
+        det.m_source = source;
+        det.header.frame_id = fusion.camera(source).frameId;
+    }
+    
+    newDataCallback(detArray);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Converts detections of several sources into measurements of tracks
+ *
+ * Detections of each source are matched with tracks in the image of the source
+ * (by their IDs, or by predictions of tracks for detections without IDs), then
+ * the remaining detections are matched with tracks of other sources
+ * transferred into the image and the rest gets new tracks. Each detection is
+ * transferred into the image of its track and detections of one track are
+ * averaged.
+ */
+void TrackerKalmanNode::fuseDetections(const vector<Detection> &detections, int64 time,
+                                       vector<Detection> &measurements,
+                                       vector<uint32_t> &observers, uint32_t &sourceMask,
+                                       vector<SourceBinding> &bindings)
+{
+    measurements.clear();
+    observers.clear();
+    bindings.clear();
+    sourceMask = 0;
+    
+    // Sources of detections and tracks of objects known to their sources
+    vector<int> sources(detections.size(), -1);
+    vector<int> ids(detections.size(), (int)Detection::NO_ID);
+    for(unsigned int i = 0; i < detections.size(); i++) {
+        const Detection &det = detections[i];
+        if(!ownsClass(det.m_class)) continue;
+        
+        sources[i] = fusion.sourceOf(det);
+        if(sources[i] < 0) {
+            ROS_WARN_THROTTLE(10, "Detections of an unknown source %d (frame %s) are ignored.",
+                              det.m_source, det.header.frame_id.c_str());
+            continue;
+        }
+        sourceMask |= 1u << sources[i];
+        
+        if(det.m_id != Detection::NO_ID) {
+            int id = fusion.lookup(sources[i], det.m_class, det.m_id);
+            if(id != Detection::NO_ID && tracks.find(det.m_class, id).valid()) {
+                ids[i] = id;
+            }
+        }
+    }
+    
+    map<pair<int, int>, unsigned int> measured; // Measurement of each track
+    vector<unsigned int> counts; // Number of detections in each measurement
+    
+    for(int s = 0; s < (int)fusion.size(); s++) {
+        if(!(sourceMask & (1u << s))) continue;
+        
+        // Detections of the source (with the source given by both the index
+        // and the frame) and tracks they already belong to
+        vector<Detection> dets;
+        vector<unsigned int> indices, anonymous, unknown;
+        set<pair<int, int> > claimed;
+        for(unsigned int i = 0; i < detections.size(); i++) {
+            if(sources[i] != s) continue;
+            
+            dets.push_back(detections[i]);
+            dets.back().m_source = s;
+            dets.back().header.frame_id = fusion.camera(s).frameId;
+            indices.push_back(i);
+            
+            if(ids[i] != Detection::NO_ID) {
+                claimed.insert(make_pair(detections[i].m_class, ids[i]));
+            }
+            else if(associateAnonymous && detections[i].m_id == Detection::NO_ID) {
+                anonymous.push_back(dets.size() - 1);
+            }
+            else {
+                unknown.push_back(dets.size() - 1);
+            }
+        }
+        
+        // Detections without IDs are matched with tracks of the source
+        vector<int> matched;
+        if(!anonymous.empty()) {
+            matchTracks(dets, anonymous, s, true, time, claimed, matched);
+            for(unsigned int i = 0; i < anonymous.size(); i++) {
+                if(matched[i] != Detection::NO_ID) {
+                    ids[indices[anonymous[i]]] = matched[i];
+                    claimed.insert(make_pair(dets[anonymous[i]].m_class, matched[i]));
+                }
+                else {
+                    unknown.push_back(anonymous[i]);
+                }
+            }
+        }
+        
+        // New objects of the source are matched with tracks of other sources
+        // (detections without a depth can't be transferred)
+        vector<unsigned int> transferable;
+        for(unsigned int i = 0; i < unknown.size(); i++) {
+            if(dets[unknown[i]].m_pos_2D.z > 0) {
+                transferable.push_back(unknown[i]);
+            }
+        }
+        if(!transferable.empty()) {
+            matchTracks(dets, transferable, s, false, time, claimed, matched);
+            for(unsigned int i = 0; i < transferable.size(); i++) {
+                ids[indices[transferable[i]]] = matched[i];
+            }
+        }
+        
+        for(unsigned int i = 0; i < unknown.size(); i++) {
+            const Detection &det = dets[unknown[i]];
+            int &id = ids[indices[unknown[i]]];
+            if(id == Detection::NO_ID) {
+                id = getNewObjectID(det.m_class);
+            }
+            
+            // Objects identified by the detector keep their tracks
+            if(det.m_id != Detection::NO_ID) {
+                bindings.push_back(SourceBinding(s, det.m_class, det.m_id, id));
+            }
+        }
+        
+        // Measurements in images of the tracks
+        for(unsigned int i = 0; i < dets.size(); i++) {
+            Detection &det = dets[i];
+            det.m_id = ids[indices[i]];
+            
+            pair<int, int> key(det.m_class, det.m_id);
+            map<pair<int, int>, unsigned int>::iterator it = measured.find(key);
+            const DetM *detM = tracks.get(tracks.find(det.m_class, det.m_id));
+            
+            int target = s;
+            if(it != measured.end()) {
+                target = measurements[it->second].m_source;
+            }
+            else if(detM && detM->det.m_source >= 0 && detM->det.m_source < (int)fusion.size()) {
+                target = detM->det.m_source;
+            }
+            
+            Detection transferred;
+            if(target != s) {
+                if(!fusion.transfer(det, target, transferred)) continue;
+            }
+            const Detection &measurement = (target != s) ? transferred : det;
+            
+            if(it == measured.end()) {
+                it = measured.insert(make_pair(key, (unsigned int)measurements.size())).first;
+                measurements.push_back(measurement);
+                observers.push_back(0);
+                counts.push_back(0);
+            }
+            SourceFusion::combine(measurement, counts[it->second]++, measurements[it->second]);
+            observers[it->second] |= 1u << s;
+        }
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Matches detections of a source with predictions of tracks
+ */
+void TrackerKalmanNode::matchTracks(const vector<Detection> &detections,
+                                    const vector<unsigned int> &indices, int source, bool ownTracks,
+                                    int64 time, const set<pair<int, int> > &claimed,
+                                    vector<int> &ids)
+{
+    Objects detObjects(indices.size());
+    vector<int> classes;
+    for(unsigned int i = 0; i < indices.size(); i++) {
+        const Detection &det = detections[indices[i]];
+        detObjects[i].m_class = det.m_class;
+        detObjects[i].m_bb = cv::Rect(det.m_bb.x, det.m_bb.y, det.m_bb.width, det.m_bb.height);
+        
+        if(find(classes.begin(), classes.end(), det.m_class) == classes.end()) {
+            classes.push_back(det.m_class);
+        }
+    }
+    
+    // Predictions of tracks of the same classes in the image of the source
+    // (tracks of other sources, which already have an object of this source,
+    // are left out)
+    Objects predObjects;
+    vector<int> predIds;
+    for(unsigned int c = 0; c < classes.size(); c++) {
+        const TrackTable<DetM>::SlotList &slots = tracks.classSlots(classes[c]);
+        for(unsigned int i = 0; i < slots.size(); i++) {
+            DetM &detM = tracks.at(slots[i]);
+            int id = tracks.idOf(slots[i]);
+            int trackSource = detM.det.m_source;
+            
+            if(claimed.count(make_pair(classes[c], id)) ||
+               trackSource < 0 || trackSource >= (int)fusion.size() ||
+               (trackSource == source) != ownTracks ||
+               (!ownTracks && fusion.bound(source, classes[c], id))) {
+                continue;
+            }
+            
+            // The point of the detection moves with the box
+            const Mat &prediction = motion(detM).predict(time - detM.msTime);
+            Detection pred = detM.det;
+            pred.m_bb.x = cvRound(prediction.at<float>(0));
+            pred.m_bb.y = cvRound(prediction.at<float>(1));
+            pred.m_bb.width = cvRound(prediction.at<float>(2));
+            pred.m_bb.height = cvRound(prediction.at<float>(3));
+            pred.m_pos_2D.x += pred.m_bb.x - detM.det.m_bb.x;
+            pred.m_pos_2D.y += pred.m_bb.y - detM.det.m_bb.y;
+            
+            Detection transferred;
+            if(!ownTracks && !fusion.transfer(pred, source, transferred)) continue;
+            const but_objdet_msgs::Rect &bb = ownTracks ? pred.m_bb : transferred.m_bb;
+            
+            Object predObject;
+            predObject.m_class = classes[c];
+            predObject.m_bb = cv::Rect(bb.x, bb.y, bb.width, bb.height);
+            predObjects.push_back(predObject);
+            predIds.push_back(id);
+        }
+    }
+    
+    // Each track can be assigned to one detection at most
+    Matches matches;
+    matcher.match(detObjects, predObjects, matches);
+    
+    ids.assign(indices.size(), (int)Detection::NO_ID);
+    for(unsigned int i = 0; i < matches.size(); i++) {
+        if(matches[i].predId != -1) {
+            ids[i] = predIds[matches[i].predId];
+        }
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Updates the track of a detection (a new track is created if there is none)
+ */
+void TrackerKalmanNode::updateTrack(const Detection &det, int64 time, uint32_t sources)
+{
+    // Measurement of the bounding box
+    Mat measurement(1, 4, CV_32F);
+    measurement.at<float>(0) = det.m_bb.x;
+    measurement.at<float>(1) = det.m_bb.y;
+    measurement.at<float>(2) = det.m_bb.width;
+    measurement.at<float>(3) = det.m_bb.height;
+    
+    int64 priority = eviction.priority(det.m_score, time);
+    
+    // Check if the current detection is already in the memory
+    TrackHandle h = tracks.find(det.m_class, det.m_id);
+    DetM *detM = tracks.get(h);
+    
+    // When it was found => update
+    if(detM) {
+        //ROS_ERROR("Object ID found!");
+        // (the track could be moved by the optical flow in a newer image)
+        int64 timeFromLastUpdate = max(time - detM->msTime, (int64)0);
+        
+        detM->det = det;
+        detM->msTime = time;
+        detM->frame = frameCounter;
+        detM->sources = sources;
+        motion(*detM).update(measurement, timeFromLastUpdate);
+        lifecycle.hit(detM->status, time);
+        eviction.update(det.m_class, ((uint64_t)h.slot << 32) | h.generation, detM->priority, priority);
+        detM->priority = priority;
+    }
+    
+    // When it wasn't found => add it to memory and initialize the filter
+    // with the first measurement
+    else {
+        // ROS_ERROR("Object ID not found!");
+        if(!makeRoom(det.m_class, priority)) {
+            return;
+        }
+        
+        h = tracks.insert(det.m_class, det.m_id, DetM());
+        detM = tracks.get(h);
+        detM->det = det;
+        detM->msTime = time;
+        detM->frame = frameCounter;
+        detM->sources = sources;
+        createFilter(*detM);
+        motion(*detM).init(measurement, true);
+        detM->priority = priority;
+        lifecycle.created(detM->status, ((uint64_t)h.slot << 32) | h.generation, time);
+        historyArena.allocate(detM->history, det.m_class);
+        eviction.insert(det.m_class, ((uint64_t)h.slot << 32) | h.generation, priority);
+    }
+    
+    // The optical flow follows the box from the latest image (the detection
+    // is expected to come from it, an older one is corrected by the next
+    // detection)
+    if(flowTracking && !flowFrames.current().empty()) {
+        if(!detM->flow) {
+            detM->flow.reset(new TrackerFlow(&flowFrames));
+        }
+        cv::Rect bb(det.m_bb.x, det.m_bb.y, det.m_bb.width, det.m_bb.height);
+        if(!detM->flow->init(flowFrames.current(), bb)) {
+            detM->flow.reset();
+        }
+    }
+    
+    // Save the filtered state into the history of the track
+    Mat x, cov;
+    if(detM->history.valid() && motion(*detM).predictState(0, x, cov)) {
+        HistorySample sample;
+        sample.msTime = time;
+        for(int i = 0; i < 4; i++) {
+            sample.position[i] = x.at<float>(i, 0);
+            sample.velocity[i] = x.at<float>(i, 1);
+        }
+        historyArena.push(detM->history, sample);
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Removes tracks with the lowest priority if the number of tracks is limited
+ */
+bool TrackerKalmanNode::makeRoom(int objClass, int64 priority)
+{
+    uint64_t victim;
+    int victimClass;
+    TrackEviction::Admission admission;
+    while((admission = eviction.admit(objClass, priority, victim, victimClass)) == TrackEviction::EVICT) {
+        TrackHandle v(victim >> 32, victim & 0xffffffff);
+        lifecycle.removed(tracks.get(v)->status);
+        eraseTrack(v);
+    }
+    
+    return admission == TrackEviction::ADMIT;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Removes a track with all its data
+ */
+void TrackerKalmanNode::eraseTrack(const TrackHandle &h)
+{
+    DetM *detM = tracks.get(h);
+    if(!detM) return;
+    
+    historyArena.release(detM->history);
+    if(fusion.enabled()) {
+        fusion.unbind(tracks.classOf(h.slot), tracks.idOf(h.slot));
+    }
+    eviction.remove(tracks.classOf(h.slot), ((uint64_t)h.slot << 32) | h.generation, detM->priority);
+    tracks.erase(h);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Assigns IDs to detections without them - a detection gets the ID of the
+ * track, whose prediction it overlaps the most, or a new ID
+ */
+void TrackerKalmanNode::associateDetections(const vector<Detection> &detections,
+                                            const vector<unsigned int> &indices,
+                                            int64 time, vector<int> &ids)
+{
+    Objects detObjects(indices.size());
+    vector<int> classes;
+    for(unsigned int i = 0; i < indices.size(); i++) {
+        const Detection &det = detections[indices[i]];
+        detObjects[i].m_class = det.m_class;
+        detObjects[i].m_bb = cv::Rect(det.m_bb.x, det.m_bb.y, det.m_bb.width, det.m_bb.height);
+        
+        if(find(classes.begin(), classes.end(), det.m_class) == classes.end()) {
+            classes.push_back(det.m_class);
+        }
+    }
+    
+    // Predictions of tracks of the same classes for the time of detections
+    // (tracks already updated by identified detections are left out)
+    Objects predObjects;
+    vector<uint32_t> predSlots;
+    for(unsigned int c = 0; c < classes.size(); c++) {
+        const TrackTable<DetM>::SlotList &slots = tracks.classSlots(classes[c]);
+        for(unsigned int i = 0; i < slots.size(); i++) {
+            DetM &detM = tracks.at(slots[i]);
+            if(detM.frame == frameCounter) continue;
+            
+            const Mat &prediction = motion(detM).predict(time - detM.msTime);
+            Object pred;
+            pred.m_class = classes[c];
+            pred.m_bb = cv::Rect(cvRound(prediction.at<float>(0)), cvRound(prediction.at<float>(1)),
+                                 cvRound(prediction.at<float>(2)), cvRound(prediction.at<float>(3)));
+            predObjects.push_back(pred);
+            predSlots.push_back(slots[i]);
+        }
+    }
+    
+    // Each track can be assigned to one detection at most
+    Matches matches;
+    matcher.match(detObjects, predObjects, matches);
+    
+    ids.resize(indices.size());
+    for(unsigned int i = 0; i < matches.size(); i++) {
+        if(matches[i].predId != -1) {
+            ids[i] = tracks.idOf(predSlots[matches[i].predId]);
+        }
+        else {
+            ids[i] = getNewObjectID(detObjects[i].m_class);
+        }
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Generates a new object ID, which isn't used by any track of the class
+ */
+int TrackerKalmanNode::getNewObjectID(int objClass)
+{
+    int &lastID = lastObjectIDs[objClass];
+    
+    do {
+        // Limit the range of possible IDs
+        if(lastID >= 100000) lastID = 0;
+        ++lastID;
+    } while(tracks.find(objClass, lastID).valid());
+    
+    return lastID;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Resets the filter of a new track
+ */
+void TrackerKalmanNode::createFilter(DetM &detM)
+{
+    if(immTracking) {
+        detM.imm = IMMTracker();
+    }
+    else {
+        detM.kf = TrackerKalman();
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Callback function called when new Image is received. The image is used just
+ * for visualization of detections and predictions, thus it doesn't influence
+ * functionality of this node in any way.
+ */
+void TrackerKalmanNode::newImageCallback(const sensor_msgs::ImageConstPtr &imageMsg)
+{
+    // The latest image wins
+    {
+        boost::mutex::scoped_lock lock(renderMutex);
+        pendingImage = imageMsg;
+    }
+    renderCondition.notify_one();
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Callback function called when new Image is received and tracks are followed
+ * by optical flow between detections
+ */
+void TrackerKalmanNode::flowImageCallback(const sensor_msgs::ImageConstPtr &imageMsg)
+{
+    TraceScope span("tracker flow", imageMsg->header.stamp, imageMsg->header.seq);
+    
+    // Images of the topic are flipped, detections belong to the original
+    // ones (as in the visualization)
+    Mat image, gray;
+    try {
+        flip(cv_bridge::toCvShare(imageMsg)->image, image, 0);
+    }    catch (cv_bridge::Exception& e) {
+        ROS_ERROR("cv_bridge exception: %s", e.what());
+        return;
+    }
+    
+    if(image.channels() == 3) {
+        cvtColor(image, gray, CV_BGR2GRAY);
+    }
+    else if(image.depth() != CV_8U) {
+        image.convertTo(gray, CV_8U);
+    }
+    else {
+        gray = image;
+    }
+    
+    boost::mutex::scoped_lock lock(memMutex);
+    MetricTimer timer(flowTime);
+    
+    // Points of all the tracks are followed at once
+    flowFrames.next(gray);
+    
+    int64 time = rosTimeToMs(imageMsg->header.stamp);
+    bool updated = false;
+    
+    const TrackTable<DetM>::SlotList &slots = tracks.allSlots();
+    for(unsigned int i = 0; i < slots.size(); i++) {
+        DetM &detM = tracks.at(slots[i]);
+        if(!detM.flow) continue;
+        
+        cv::Rect bb;
+        if(!detM.flow->update(gray, bb)) {
+            detM.flow.reset(); // Started again by the next detection
+            continue;
+        }
+        if(time <= detM.msTime) continue;
+        
+        Mat measurement(1, 4, CV_32F);
+        measurement.at<float>(0) = bb.x;
+        measurement.at<float>(1) = bb.y;
+        measurement.at<float>(2) = bb.width;
+        measurement.at<float>(3) = bb.height;
+        
+        motion(detM).update(measurement, time - detM.msTime);
+        detM.msTime = time;
+        detM.det.m_pos_2D.x += bb.x - detM.det.m_bb.x;
+        detM.det.m_pos_2D.y += bb.y - detM.det.m_bb.y;
+        detM.det.m_bb.x = bb.x;
+        detM.det.m_bb.y = bb.y;
+        detM.det.m_bb.width = bb.width;
+        detM.det.m_bb.height = bb.height;
+        updated = true;
+    }
+    
+    if(updated) {
+        publishSnapshot(time);
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * The render thread - renders the latest received image at most
+ * at the visualization rate
+ */
+void TrackerKalmanNode::renderLoop()
+{
+    boost::system_time next = boost::get_system_time();
+    
+    while(true) {
+        sensor_msgs::ImageConstPtr imageMsg;
+        {
+            boost::mutex::scoped_lock lock(renderMutex);
+            
+            // Wait for an image and for the time of the next image (images
+            // received meanwhile replace the waiting one)
+            while(renderRunning && (!pendingImage || boost::get_system_time() < next)) {
+                if(!pendingImage) {
+                    renderCondition.wait(lock);
+                }
+                else {
+                    renderCondition.timed_wait(lock, next);
+                }
+            }
+            if(!renderRunning) break;
+            
+            imageMsg.swap(pendingImage);
+            
+            next = boost::get_system_time();
+            if(visualizationRate > 0) {
+                next += boost::posix_time::microseconds((int64)(1e6 / visualizationRate));
+            }
+        }
+        
+        // Nobody is interested in the images
+        if(annotatedPub.getNumSubscribers() == 0) continue;
+        
+        renderImage(imageMsg);
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Draws tracks into an image and publishes it
+ */
+void TrackerKalmanNode::renderImage(const sensor_msgs::ImageConstPtr &imageMsg)
+{
+    // Get an OpenCV Mat from the image message (the message data are shared,
+    // flip makes the copy)
+    Mat image;
+    try {
+        flip(cv_bridge::toCvShare(imageMsg)->image, image, 0);
+    }    catch (cv_bridge::Exception& e) {
+        ROS_ERROR("cv_bridge exception: %s", e.what());
+        return;
+    }
+    
+    // Convert to 3 channels - so we can visualize BB in color
+    Mat img3ch;
+    if(image.channels() != 3) {
+        cvtColor(image, img3ch, CV_GRAY2RGB, 3);
+    }
+    else {
+        image.copyTo(img3ch);
+    }
+
+    SnapshotRing<TrackSnapshot>::ReadRef snapshot(snapshots);
+    const vector<TrackView> &views = snapshot->views();
+    
+    int64 now = rosTimeToMs(ros::Time::now());
+    for(unsigned int i = 0; i < views.size(); i++) {
+        const TrackView &view = views[i];
+        
+        // Tracks of other cameras are in other images
+        if(fusion.enabled() && !imageMsg->header.frame_id.empty() &&
+           view.det.header.frame_id != imageMsg->header.frame_id) {
+            continue;
+        }
+        
+        // Visualize detection
+        const Detection &det = view.det;
+        rectangle(
+	        img3ch,
+	        cvPoint(det.m_bb.x, det.m_bb.y),
+	        cvPoint(det.m_bb.x + det.m_bb.width, det.m_bb.y + det.m_bb.height),
+	        cvScalar(255,255,255)
+	    );
+	    
+	    // Obtain and visualize corresponding prediction
+	    Detection pred = view.predict(now - view.msTime);
+
+        rectangle(
+	        img3ch,
+	        cvPoint(pred.m_bb.x, pred.m_bb.y),
+	        cvPoint(pred.m_bb.x + pred.m_bb.width, pred.m_bb.y + pred.m_bb.height),
+	        cvScalar(0,0,255)
+	    );
+    }
+    
+    cv_bridge::CvImage annotated;
+    annotated.header = imageMsg->header;
+    annotated.encoding = (image.channels() == 3) ? imageMsg->encoding : sensor_msgs::image_encodings::RGB8;
+    annotated.image = img3ch;
+    annotatedPub.publish(annotated.toImageMsg());
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Switches publishing of images with detections and predictions
+ */
+bool TrackerKalmanNode::setVisualization(but_objdet::SetVisualization::Request &req,
+                                         but_objdet::SetVisualization::Response &res)
+{
+    // (the subscription isn't changed under renderMutex, because shutdown
+    // waits for a running image callback)
+    boost::mutex::scoped_lock lock(visualizationMutex);
+    
+    {
+        boost::mutex::scoped_lock renderLock(renderMutex);
+        if(req.rate > 0) {
+            visualizationRate = req.rate;
+        }
+        else if(req.rate < 0) {
+            visualizationRate = 0;
+        }
+    }
+    
+    res.was_enabled = visualOutput;
+    if(req.enable && !visualOutput) {
+        imgSub = nh.subscribe(imageTopic, 1, &TrackerKalmanNode::newImageCallback, this);
+    }
+    else if(!req.enable && visualOutput) {
+        imgSub.shutdown();
+        
+        boost::mutex::scoped_lock renderLock(renderMutex);
+        pendingImage.reset();
+    }
+    visualOutput = req.enable;
+    
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Writes latencies collected since the last report into the log
+ */
+void TrackerKalmanNode::reportLatency(const ros::WallTimerEvent &event)
+{
+    detectionLatency.report();
+    transportLatency.report();
+    inputLatency.report();
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Writes all tracks into the track store file
+ */
+void TrackerKalmanNode::saveTracks()
+{
+    TrackStoreWriter writer;
+    
+    // The tracks are copied under the lock, the file is written without it
+    {
+        boost::mutex::scoped_lock lock(memMutex);
+        
+        // (the ingest thread, which publishes snapshots, is blocked by the lock)
+        writer.clear(snapshots.last().time(), frameCounter);
+        
+        for(map<int, int>::const_iterator it = lastObjectIDs.begin(); it != lastObjectIDs.end(); ++it) {
+            writer.addClass(it->first, it->second);
+        }
+        
+        const TrackTable<DetM>::SlotList &slots = tracks.allSlots();
+        for(unsigned int i = 0; i < slots.size(); i++) {
+            const DetM &detM = tracks.at(slots[i]);
+            const Mat &x = immTracking ? detM.imm.statePost() : detM.kf.statePost();
+            const Mat &P = immTracking ? detM.imm.errorCovPost() : detM.kf.errorCovPost();
+            if(x.empty() || x.rows > BUT_OBJDET_STORED_STATE) continue;
+            
+            StoredTrack track;
+            memset(&track, 0, sizeof(track));
+            track.objClass = tracks.classOf(slots[i]);
+            track.id = tracks.idOf(slots[i]);
+            track.msTime = detM.msTime;
+            track.state = detM.status.state;
+            track.secDerivate = (immTracking || detM.kf.secondDerivate()) ? 1 : 0;
+            track.stateSize = x.rows;
+            track.hits = detM.status.hits;
+            track.misses = detM.status.misses;
+            for(int r = 0; r < x.rows; r++) {
+                track.x[r] = x.at<float>(r);
+                for(int s = 0; s < x.rows; s++) {
+                    track.P[r * x.rows + s] = P.at<float>(r, s);
+                }
+            }
+            
+            writer.addTrack(track, detM.det);
+        }
+    }
+    
+    if(!writer.write(trackStoreFile)) {
+        ROS_ERROR("Failed to write tracks into %s.", trackStoreFile.c_str());
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Restores tracks from the track store file
+ */
+int64 TrackerKalmanNode::loadTracks()
+{
+    TrackStoreReader reader;
+    if(!reader.open(trackStoreFile)) {
+        return 0;
+    }
+    
+    boost::mutex::scoped_lock lock(memMutex);
+    
+    // The tracks are moved to the current time (the saved time is used if
+    // the clock isn't running yet, e.g. with a simulated time)
+    const TrackFileHeader &header = reader.header();
+    int64 now = max(rosTimeToMs(ros::Time::now()), (int64)header.time);
+    
+    for(uint32_t i = 0; i < header.nClasses; i++) {
+        lastObjectIDs[reader.storedClass(i).objClass] = reader.storedClass(i).lastId;
+    }
+    
+    unsigned int count = 0;
+    for(uint32_t i = 0; i < header.nTracks; i++) {
+        const StoredTrack &track = reader.track(i);
+        if(now - track.msTime > lifecycle.expiry() || track.stateSize > BUT_OBJDET_STORED_STATE) {
+            continue;
+        }
+        
+        DetM restored;
+        createFilter(restored);
+        Mat x(track.stateSize, 1, CV_32F, const_cast<float *>(track.x));
+        Mat P(track.stateSize, track.stateSize, CV_32F, const_cast<float *>(track.P));
+        bool secDerivate = (track.secDerivate != 0);
+        if(!reader.detection(i, restored.det) ||
+           !(immTracking ? restored.imm.restore(x, P, secDerivate) : restored.kf.restore(x, P, secDerivate))) {
+            continue;
+        }
+        if(immTracking) {
+            restored.imm.advance(now - track.msTime);
+        }
+        else {
+            restored.kf.advance(now - track.msTime);
+        }
+        restored.msTime = now;
+        restored.frame = frameCounter;
+        restored.sources = (restored.det.m_source >= 0 && restored.det.m_source < BUT_OBJDET_MAX_SOURCES) ?
+                           1u << restored.det.m_source : 0;
+        restored.status.state = track.state;
+        restored.status.hits = track.hits;
+        restored.status.misses = track.misses;
+        restored.priority = eviction.priority(restored.det.m_score, track.msTime);
+        
+        // The limits could be lowered since the tracks were saved
+        if(!makeRoom(track.objClass, restored.priority)) {
+            continue;
+        }
+        
+        TrackHandle h = tracks.insert(track.objClass, track.id, restored);
+        DetM *detM = tracks.get(h);
+        uint64_t key = ((uint64_t)h.slot << 32) | h.generation;
+        
+        // The expiry is still counted from the last detection
+        lifecycle.restored(detM->status, key, track.msTime);
+        historyArena.allocate(detM->history, track.objClass);
+        eviction.insert(track.objClass, key, detM->priority);
+        count++;
+    }
+    
+    ROS_INFO("Restored %u of %u tracks from %s.", count, header.nTracks, trackStoreFile.c_str());
+    return count ? now : 0;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Saves tracks periodically
+ */
+void TrackerKalmanNode::trackStoreTimerCallback(const ros::WallTimerEvent &event)
+{
+    saveTracks();
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Publishes the number of tracks and of tracks removed because of the limits
+ * and the metrics collected since the last diagnostics
+ */
+void TrackerKalmanNode::publishDiagnostics(const ros::WallTimerEvent &event)
+{
+    diagnostic_msgs::DiagnosticStatus status;
+    status.name = pnh.getNamespace() + ": tracks";
+    
+    {
+        boost::mutex::scoped_lock lock(memMutex);
+        
+        // A warning while tracks are evicted or rejected
+        const EvictionCounters &totals = eviction.totals();
+        if(totals.evicted != reportedEvictions.evicted || totals.rejected != reportedEvictions.rejected) {
+            status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+            status.message = "Track limit reached";
+        }
+        else {
+            status.level = diagnostic_msgs::DiagnosticStatus::OK;
+            status.message = "OK";
+        }
+        reportedEvictions = totals;
+        
+        status.values.push_back(keyValue("tracks", tracks.size()));
+        status.values.push_back(keyValue("max_tracks", eviction.limit()));
+        status.values.push_back(keyValue("evicted", totals.evicted));
+        status.values.push_back(keyValue("rejected", totals.rejected));
+        
+        const map<int, EvictionCounters> &counters = eviction.counters();
+        map<int, EvictionCounters>::const_iterator it;
+        for(it = counters.begin(); it != counters.end(); ++it) {
+            ostringstream prefix;
+            prefix << "class " << it->first << " ";
+            status.values.push_back(keyValue(prefix.str() + "tracks", tracks.classSlots(it->first).size()));
+            status.values.push_back(keyValue(prefix.str() + "max_tracks", eviction.classLimit(it->first)));
+            status.values.push_back(keyValue(prefix.str() + "evicted", it->second.evicted));
+            status.values.push_back(keyValue(prefix.str() + "rejected", it->second.rejected));
+        }
+    }
+    
+    uint64_t cacheHits, cacheMisses;
+    predictionCache.stats(cacheHits, cacheMisses);
+    status.values.push_back(keyValue("prediction cache hits", cacheHits));
+    status.values.push_back(keyValue("prediction cache misses", cacheMisses));
+    
+    diagnostic_msgs::DiagnosticArrayPtr array(new diagnostic_msgs::DiagnosticArray);
+    array->header.stamp = ros::Time::now();
+    array->status.push_back(status);
+    array->status.push_back(diagnostic_msgs::DiagnosticStatus());
+    metrics.summarize(array->status.back());
+    diagnosticsPub.publish(array);
+}
+
+
+/* =============================================================================
+ * Converts ros::Time to miliseconds
+ */
+int64 TrackerKalmanNode::rosTimeToMs(ros::Time stamp)
+{
+    //std::cout << "Time: " << stamp.sec << " " << stamp.nsec << " " << stamp.sec * 1000 + stamp.nsec / 1000000 << std::endl;
+    return (int64)stamp.sec * 1000 + stamp.nsec / 1000000;
+}
+
+}
@@ -0,0 +1,56 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Kalman tracker node wrapped as a nodelet, so that it can run
+ * in one process with the detector and receive detections without copying.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <boost/shared_ptr.hpp>
+
+#include "but_objdet/tracker/tracker_kalman_node.h"
+
+
+namespace but_objdet
+{
+
+/**
+ * Nodelet running TrackerKalmanNode.
+ */
+class TrackerKalmanNodelet : public nodelet::Nodelet
+{
+private:
+    virtual void onInit()
+    {
+        node.reset(new TrackerKalmanNode(getNodeHandle(), getPrivateNodeHandle()));
+    }
+
+    boost::shared_ptr<TrackerKalmanNode> node;
+};
+
+}
+
+PLUGINLIB_DECLARE_CLASS(but_objdet, TrackerKalmanNodelet, but_objdet::TrackerKalmanNodelet, nodelet::Nodelet)
+
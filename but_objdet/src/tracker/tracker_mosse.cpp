@@ -0,0 +1,238 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "but_objdet/tracker/tracker_mosse.h"
+
+using namespace cv;
+using namespace std;
+
+// Width of the desired output peak [px of the filter]
+const double peakSigma = 2.0;
+
+// Number of distorted copies of the first image used to learn the filter
+const int initSamples = 8;
+
+// Half size of the area around the peak excluded from the sidelobe
+const int peakRadius = 5;
+
+
+namespace but_objdet
+{
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+TrackerMosse::TrackerMosse(int maxSize_, float learningRate_, float minPsr_)
+    : maxSize(max(maxSize_, 16))
+    , learningRate(learningRate_)
+    , minPsr(minPsr_)
+    , scale(1)
+    , psr(0)
+{
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Initialization with the first image of the object
+ */
+bool TrackerMosse::init(const Mat& gray, const Rect& bb)
+{
+    if(bb.width < 8 || bb.height < 8 || gray.empty()) return false;
+
+    boxSize = Size2f((float)bb.width, (float)bb.height);
+    center = Point2f(bb.x + bb.width * 0.5f, bb.y + bb.height * 0.5f);
+    scale = max(1.0f, max(boxSize.width, boxSize.height) / maxSize);
+    filterSize = Size(getOptimalDFTSize(cvCeil(boxSize.width / scale)),
+                      getOptimalDFTSize(cvCeil(boxSize.height / scale)));
+
+    // Cosine window
+    window.create(filterSize, CV_32F);
+    for(int y = 0; y < filterSize.height; y++) {
+        float wy = 0.5f * (1 - cos(2 * CV_PI * y / (filterSize.height - 1)));
+        for(int x = 0; x < filterSize.width; x++) {
+            float wx = 0.5f * (1 - cos(2 * CV_PI * x / (filterSize.width - 1)));
+            window.at<float>(y, x) = wx * wy;
+        }
+    }
+
+    // Gaussian peak in the center
+    Mat g(filterSize, CV_32F);
+    for(int y = 0; y < filterSize.height; y++) {
+        for(int x = 0; x < filterSize.width; x++) {
+            double dx = x - filterSize.width / 2, dy = y - filterSize.height / 2;
+            g.at<float>(y, x) = (float)exp(-(dx * dx + dy * dy) / (2 * peakSigma * peakSigma));
+        }
+    }
+    dft(g, G, DFT_COMPLEX_OUTPUT);
+
+    // The filter is learned from the image and its slightly rotated and
+    // scaled copies (always the same ones, so that results are repeatable)
+    Size sampleSize(cvRound(filterSize.width * scale), cvRound(filterSize.height * scale));
+    Mat patch, sample;
+    getRectSubPix(gray, sampleSize, center, patch);
+    if(scale > 1) {
+        resize(patch, patch, filterSize, 0, 0, INTER_AREA);
+    }
+
+    Mat F;
+    patchSpectrum(patch, F);
+    train(F, 1.0f);
+
+    RNG rng(0x4d4f53);
+    Point2f patchCenter(filterSize.width * 0.5f, filterSize.height * 0.5f);
+    for(int i = 0; i < initSamples; i++) {
+        double angle = rng.uniform(-10.0, 10.0);
+        double zoom = rng.uniform(0.95, 1.05);
+        Mat M = getRotationMatrix2D(patchCenter, angle, zoom);
+        warpAffine(patch, sample, M, filterSize, INTER_LINEAR, BORDER_REFLECT);
+
+        patchSpectrum(sample, F);
+        train(F, 1.0f / (i + 2)); // Average of all the samples
+    }
+
+    psr = 0;
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Finds the object in the next image
+ */
+bool TrackerMosse::update(const Mat& gray, Rect& bb)
+{
+    if(A.empty() || gray.empty()) return false;
+
+    Mat F;
+    spectrum(gray, F);
+
+    // Filter H* = A / B (B is real), the correlation is F * H*
+    vector<Mat> a, b;
+    split(A, a);
+    split(B, b);
+    Mat denominator = b[0] + 1e-5;
+    divide(a[0], denominator, a[0]);
+    divide(a[1], denominator, a[1]);
+    Mat H;
+    merge(a, H);
+
+    Mat R, response;
+    mulSpectrums(F, H, R, 0);
+    idft(R, response, DFT_SCALE | DFT_REAL_OUTPUT);
+
+    // Peak-to-sidelobe ratio (the sidelobe is everything except
+    // the surroundings of the peak)
+    double peak;
+    Point peakLoc;
+    minMaxLoc(response, NULL, &peak, NULL, &peakLoc);
+
+    Mat sidelobe(response.size(), CV_8U, Scalar(255));
+    rectangle(sidelobe, Point(peakLoc.x - peakRadius, peakLoc.y - peakRadius),
+              Point(peakLoc.x + peakRadius, peakLoc.y + peakRadius), Scalar(0), CV_FILLED);
+    Scalar mean, stddev;
+    meanStdDev(response, mean, stddev, sidelobe);
+    psr = (float)((peak - mean[0]) / (stddev[0] + 1e-5));
+
+    if(psr < minPsr) return false;
+
+    // Move to the peak and adapt the filter to the new image
+    Point2f moved(center.x + (peakLoc.x - filterSize.width / 2) * scale,
+                  center.y + (peakLoc.y - filterSize.height / 2) * scale);
+    if(moved.x < 0 || moved.y < 0 || moved.x >= gray.cols || moved.y >= gray.rows) {
+        return false;
+    }
+    center = moved;
+
+    spectrum(gray, F);
+    train(F, learningRate);
+
+    bb = Rect(cvRound(center.x - boxSize.width * 0.5f), cvRound(center.y - boxSize.height * 0.5f),
+              cvRound(boxSize.width), cvRound(boxSize.height));
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Returns the spectrum of the image around the center of the object
+ */
+void TrackerMosse::spectrum(const Mat& gray, Mat& F) const
+{
+    Size sampleSize(cvRound(filterSize.width * scale), cvRound(filterSize.height * scale));
+
+    Mat patch;
+    getRectSubPix(gray, sampleSize, center, patch);
+    if(scale > 1) {
+        resize(patch, patch, filterSize, 0, 0, INTER_AREA);
+    }
+
+    patchSpectrum(patch, F);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Returns the spectrum of a patch
+ */
+void TrackerMosse::patchSpectrum(const Mat& patch, Mat& F) const
+{
+    // Logarithm reduces effects of lighting, normalization of contrast
+    Mat f;
+    patch.convertTo(f, CV_32F);
+    f += 1.0;
+    log(f, f);
+
+    Scalar mean, stddev;
+    meanStdDev(f, mean, stddev);
+    f = (f - mean[0]) / (stddev[0] + 1e-5);
+    f = f.mul(window);
+
+    dft(f, F, DFT_COMPLEX_OUTPUT);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Adds a spectrum of the object into the filter
+ */
+void TrackerMosse::train(const Mat& F, float rate)
+{
+    // A = G * conj(F), B = F * conj(F)
+    Mat a, b;
+    mulSpectrums(G, F, a, 0, true);
+    mulSpectrums(F, F, b, 0, true);
+
+    if(rate >= 1 || A.empty()) {
+        A = a;
+        B = b;
+    }
+    else {
+        A = A * (1 - rate) + a * rate;
+        B = B * (1 - rate) + b * rate;
+    }
+}
+
+}
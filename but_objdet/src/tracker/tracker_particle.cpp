@@ -0,0 +1,372 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <boost/bind.hpp>
+
+#include "but_objdet/tracker/tracker_particle.h"
+
+using namespace cv;
+using namespace std;
+
+// The filter starts again from a measurement, which is farther from all
+// the particles than this number of standard deviations (per parameter)
+const float maxDistance = 3.0f;
+
+
+namespace but_objdet
+{
+
+/* =============================================================================
+ * Update of one of trackers updated in parallel
+ */
+static void updateOne(size_t i, const vector<ParticleTracker *> *trackers,
+                      const vector<Mat> *measurements, const vector<int64> *miliseconds)
+{
+    (*trackers)[i]->update((*measurements)[i], (*miliseconds)[i]);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+ParticleTracker::ParticleTracker(int particles, uint64 seed, float positionNoise_,
+                                 float velocityNoise_, float measurementNoise_)
+    : count(max(particles, 1))
+    , nParams(0)
+    , positionNoise(positionNoise_)
+    , velocityNoise(velocityNoise_)
+    , measurementNoise(measurementNoise_)
+    , rng(seed != 0 ? seed : (uint64)getTickCount() ^ (uint64)(size_t)this)
+{
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Copy constructor
+ */
+ParticleTracker::ParticleTracker(const ParticleTracker& pt)
+{
+    *this = pt;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Assignment (the returned matrix isn't shared by the copies)
+ */
+ParticleTracker& ParticleTracker::operator=(const ParticleTracker& pt)
+{
+    if(this == &pt) return *this;
+
+    count = pt.count;
+    nParams = pt.nParams;
+    positionNoise = pt.positionNoise;
+    velocityNoise = pt.velocityNoise;
+    measurementNoise = pt.measurementNoise;
+    rng = pt.rng;
+    particles = pt.particles;
+    weights = pt.weights;
+    temp = pt.temp.clone();
+
+    return *this;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Initialization with the first measurement
+ */
+bool ParticleTracker::init(const Mat& measurement, bool secDerivate)
+{
+    if(measurement.dims != 2 || measurement.type() != CV_32F) return false;
+    if(measurement.rows != 1 && measurement.cols != 1) return false;
+
+    // Weights of the particles are computed from the measurement noise
+    // (NaN is rejected too)
+    if(!(measurementNoise > 0.0f) || !(positionNoise >= 0.0f) || !(velocityNoise >= 0.0f)) return false;
+
+    nParams = (int)measurement.total();
+    particles.resize(2 * nParams * count);
+    weights.resize(count);
+    spread(measurement);
+
+    temp.create(2 * nParams, 1, CV_32F);
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Prediction for the given time since the last update
+ */
+const Mat& ParticleTracker::predict(int64 miliseconds)
+{
+    if(nParams == 0) return temp;
+
+    vector<double> means;
+    estimate(means);
+
+    float seconds = miliseconds / 1000.0f;
+    for(int i = 0; i < nParams; i++) {
+        temp.at<float>(i) = (float)(means[i] + means[nParams + i] * seconds);
+        temp.at<float>(nParams + i) = (float)means[nParams + i];
+    }
+
+    return temp;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Update with a new measurement
+ */
+const Mat& ParticleTracker::update(const Mat& measurement, int64 miliseconds)
+{
+    if(nParams == 0 || (int)measurement.total() != nParams) return temp;
+
+    propagate(miliseconds / 1000.0f);
+
+    // Log-likelihood of the measurement for each particle
+    likelihood.assign(count, 0.0f);
+    float *ll = &likelihood[0];
+    for(int i = 0; i < nParams; i++) {
+        const float *p = component(i);
+        float z = measurement.at<float>(i);
+        for(int k = 0; k < count; k++) {
+            float d = p[k] - z;
+            ll[k] += d * d;
+        }
+    }
+
+    float scale = -0.5f / (measurementNoise * measurementNoise);
+    float best = *min_element(likelihood.begin(), likelihood.end());
+    for(int k = 0; k < count; k++) {
+        ll[k] = (ll[k] - best) * scale;
+    }
+
+    // No particle is close to the measurement - the object moved in a way,
+    // which the filter didn't expect
+    float limit = maxDistance * measurementNoise;
+    if(best > limit * limit * nParams) {
+        spread(measurement);
+        return update(measurement, 0);
+    }
+
+    Mat llMat(1, count, CV_32F, ll);
+    exp(llMat, llMat);
+
+    float *w = &weights[0];
+    double sum = 0;
+    for(int k = 0; k < count; k++) {
+        w[k] *= ll[k];
+        sum += w[k];
+    }
+
+    // The best particle has the likelihood 1, so the sum isn't zero unless
+    // its weight underflowed
+    if(sum <= 0) {
+        fill(weights.begin(), weights.end(), 1.0f / count);
+    }
+    else {
+        double squares = 0;
+        float norm = (float)(1 / sum);
+        for(int k = 0; k < count; k++) {
+            w[k] *= norm;
+            squares += w[k] * w[k];
+        }
+
+        // Effective number of particles
+        if(1 / squares < count / 2) {
+            resample();
+        }
+    }
+
+    return predict(0);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Prediction of the full state and of its uncertainty
+ */
+bool ParticleTracker::predictState(int64 miliseconds, Mat& state, Mat& covariance)
+{
+    if(nParams == 0) return false;
+
+    float dt = max(miliseconds, (int64)0) / 1000.0f;
+
+    // Random changes of the particles until the requested time
+    double velocityVar = velocityNoise * velocityNoise * dt;
+    double positionVar = positionNoise * positionNoise * dt + velocityVar * dt * dt;
+
+    state.create(nParams, 3, CV_32F);
+    state.setTo(Scalar(0));
+    covariance.create(nParams, 6, CV_32F);
+    covariance.setTo(Scalar(0));
+
+    const float *w = &weights[0];
+    for(int i = 0; i < nParams; i++) {
+        const float *p = component(i);
+        const float *v = component(nParams + i);
+
+        double mp = 0, mv = 0;
+        for(int k = 0; k < count; k++) {
+            mp += w[k] * (p[k] + v[k] * dt);
+            mv += w[k] * v[k];
+        }
+
+        double pp = 0, pv = 0, vv = 0;
+        for(int k = 0; k < count; k++) {
+            double dp = p[k] + v[k] * dt - mp;
+            double dv = v[k] - mv;
+            pp += w[k] * dp * dp;
+            pv += w[k] * dp * dv;
+            vv += w[k] * dv * dv;
+        }
+
+        state.at<float>(i, 0) = (float)mp;
+        state.at<float>(i, 1) = (float)mv;
+        covariance.at<float>(i, 0) = (float)(pp + positionVar);
+        covariance.at<float>(i, 1) = (float)(pv + velocityVar * dt);
+        covariance.at<float>(i, 3) = (float)(vv + velocityVar);
+    }
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Updates several trackers in parallel
+ */
+void ParticleTracker::updateAll(const vector<ParticleTracker *>& trackers,
+                                const vector<Mat>& measurements,
+                                const vector<int64>& miliseconds,
+                                WorkerPool& pool)
+{
+    pool.run(trackers.size(), boost::bind(&updateOne, _1, &trackers, &measurements, &miliseconds));
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Moves the particles forward in time
+ */
+void ParticleTracker::propagate(float seconds)
+{
+    if(seconds <= 0) return;
+
+    noise.resize(count);
+    Mat noiseMat(1, count, CV_32F, &noise[0]);
+    const float *n = &noise[0];
+    double velocitySigma = velocityNoise * sqrt(seconds);
+    double positionSigma = positionNoise * sqrt(seconds);
+
+    for(int i = 0; i < nParams; i++) {
+        float *p = component(i);
+        float *v = component(nParams + i);
+
+        rng.fill(noiseMat, RNG::NORMAL, Scalar::all(0), Scalar::all(velocitySigma));
+        for(int k = 0; k < count; k++) {
+            v[k] += n[k];
+        }
+
+        rng.fill(noiseMat, RNG::NORMAL, Scalar::all(0), Scalar::all(positionSigma));
+        for(int k = 0; k < count; k++) {
+            p[k] += v[k] * seconds + n[k];
+        }
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Weighted means of positions and velocities
+ */
+void ParticleTracker::estimate(vector<double>& means) const
+{
+    means.assign(2 * nParams, 0.0);
+
+    const float *w = &weights[0];
+    for(int i = 0; i < 2 * nParams; i++) {
+        const float *x = component(i);
+        double sum = 0;
+        for(int k = 0; k < count; k++) {
+            sum += w[k] * x[k];
+        }
+        means[i] = sum;
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Systematic resampling
+ */
+void ParticleTracker::resample()
+{
+    // One random offset, the particles are then chosen at regular steps
+    // of the cumulative weight (O(count), a particle with the weight w gets
+    // floor(w * count) or one more copies)
+    indices.resize(count);
+    float step = 1.0f / count;
+    float position = rng.uniform(0.0f, step);
+    float cumulative = weights[0];
+    int i = 0;
+    for(int k = 0; k < count; k++) {
+        while(position > cumulative && i < count - 1) {
+            cumulative += weights[++i];
+        }
+        indices[k] = i;
+        position += step;
+    }
+
+    resampled.resize(particles.size());
+    const int *index = &indices[0];
+    for(int c = 0; c < 2 * nParams; c++) {
+        const float *src = component(c);
+        float *dst = &resampled[c * count];
+        for(int k = 0; k < count; k++) {
+            dst[k] = src[index[k]];
+        }
+    }
+
+    particles.swap(resampled);
+    fill(weights.begin(), weights.end(), step);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Spreads the particles around a measurement
+ */
+void ParticleTracker::spread(const Mat& measurement)
+{
+    for(int i = 0; i < nParams; i++) {
+        Mat p(1, count, CV_32F, component(i));
+        rng.fill(p, RNG::NORMAL, Scalar::all(measurement.at<float>(i)), Scalar::all(measurementNoise));
+
+        // The velocity is unknown, it is expected to be rather low
+        Mat v(1, count, CV_32F, component(nParams + i));
+        rng.fill(v, RNG::NORMAL, Scalar::all(0), Scalar::all(velocityNoise));
+    }
+
+    fill(weights.begin(), weights.end(), 1.0f / count);
+}
+
+}
@@ -0,0 +1,159 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "but_objdet/tracker/worker_pool.h"
+
+using namespace std;
+
+
+namespace but_objdet
+{
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+WorkerPool::WorkerPool(int threadCount)
+    : job(NULL)
+    , count(0)
+    , next(0)
+    , generation(0)
+    , busy(0)
+    , stopping(false)
+{
+    for(int i = 0; i < threadCount; i++) {
+        threads.push_back(new boost::thread(&WorkerPool::workerLoop, this));
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Destructor
+ */
+WorkerPool::~WorkerPool()
+{
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        stopping = true;
+    }
+    started.notify_all();
+
+    for(unsigned int i = 0; i < threads.size(); i++) {
+        threads[i]->join();
+        delete threads[i];
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * The pool shared by all trackers of a process
+ */
+WorkerPool &WorkerPool::shared()
+{
+    static WorkerPool pool(max((int)boost::thread::hardware_concurrency() - 1, 0));
+    return pool;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Calls the job for all the indices
+ */
+void WorkerPool::run(size_t jobCount, const Job &jobFunction)
+{
+    if(jobCount == 0) return;
+
+    // Small jobs aren't worth waking the threads
+    if(threads.empty() || jobCount == 1) {
+        for(size_t i = 0; i < jobCount; i++) {
+            jobFunction(i);
+        }
+        return;
+    }
+
+    boost::mutex::scoped_lock runLock(runMutex);
+
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        job = &jobFunction;
+        count = jobCount;
+        next = 0;
+        busy = (int)threads.size();
+        generation++;
+    }
+    started.notify_all();
+
+    work();
+
+    // The job must not be released while a thread still looks at it
+    boost::mutex::scoped_lock lock(mutex);
+    while(busy > 0) {
+        finished.wait(lock);
+    }
+    job = NULL;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Takes indices of the current job until all of them are taken
+ */
+void WorkerPool::work()
+{
+    for(;;) {
+        size_t i = __sync_fetch_and_add(&next, 1);
+        if(i >= count) break;
+        (*job)(i);
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * A thread of the pool
+ */
+void WorkerPool::workerLoop()
+{
+    unsigned int done = 0; // The last job this thread took part in
+
+    for(;;) {
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            while(!stopping && generation == done) {
+                started.wait(lock);
+            }
+            if(stopping) return;
+            done = generation;
+        }
+
+        work();
+
+        boost::mutex::scoped_lock lock(mutex);
+        if(--busy == 0) {
+            finished.notify_one();
+        }
+    }
+}
+
+}
@@ -0,0 +1,372 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <cstddef>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+
+#include "but_objdet/transport/shm_ring.h"
+
+using namespace std;
+
+// Identification of the shared memory segment layout
+#define SHM_RING_MAGIC   0x424f4452 // "BODR"
+#define SHM_RING_VERSION 4
+
+// Number of attempts to read the ring before the consumer goes to sleep
+#define SHM_RING_SPIN_COUNT 20000
+
+
+namespace but_objdet
+{
+
+/* -----------------------------------------------------------------------------
+ * Helper functions
+ */
+static int futexWait(volatile int32_t *addr, int32_t value, int timeoutMs)
+{
+    struct timespec ts;
+    ts.tv_sec = timeoutMs / 1000;
+    ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+    return syscall(SYS_futex, addr, FUTEX_WAIT, value, &ts, NULL, 0);
+}
+
+static int futexWake(volatile int32_t *addr)
+{
+    return syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static string shmName(const string& name)
+{
+    return (!name.empty() && name[0] == '/') ? name : "/" + name;
+}
+
+// Offset of the payload within a slot (everything after the sequence number)
+static const size_t SLOT_PAYLOAD_OFFSET = offsetof(ShmDetectionSlot, stamp);
+
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+ShmRing::ShmRing()
+    : header(NULL)
+    , slots(NULL)
+    , mappedSize(0)
+    , mask(0)
+{
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Destructor
+ */
+ShmRing::~ShmRing()
+{
+    close();
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Opens (and creates) the shared memory segment
+ */
+bool ShmRing::open(const string& name, unsigned int capacity)
+{
+    close();
+
+    // Capacity has to be a power of two (positions are masked)
+    unsigned int cap = 1;
+    while(cap < capacity) cap <<= 1;
+
+    string path = shmName(name);
+    bool creator = true;
+    int fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+    if(fd < 0) {
+        if(errno != EEXIST) return false;
+        creator = false;
+        fd = shm_open(path.c_str(), O_RDWR, 0666);
+        if(fd < 0) return false;
+    }
+
+    size_t size;
+    if(creator) {
+        size = sizeof(ShmRingHeader) + cap * sizeof(ShmDetectionSlot);
+        if(ftruncate(fd, size) != 0) {
+            ::close(fd);
+            shm_unlink(path.c_str());
+            return false;
+        }
+    }
+    else {
+        // The segment may still be initialized by its creator => wait a while
+        struct stat st;
+        int attempts = 1000;
+        while(fstat(fd, &st) == 0 && (size_t)st.st_size < sizeof(ShmRingHeader) && --attempts > 0) {
+            usleep(1000);
+        }
+        if(attempts == 0 || (size_t)st.st_size < sizeof(ShmRingHeader)) {
+            ::close(fd);
+            return false;
+        }
+        size = st.st_size;
+    }
+
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(addr == MAP_FAILED) return false;
+
+    header = static_cast<ShmRingHeader *>(addr);
+    slots = reinterpret_cast<ShmDetectionSlot *>(static_cast<char *>(addr) + sizeof(ShmRingHeader));
+    mappedSize = size;
+
+    if(creator) {
+        header->version = SHM_RING_VERSION;
+        header->capacity = cap;
+        header->slotSize = sizeof(ShmDetectionSlot);
+        header->head = 0;
+        header->tail = 0;
+        header->futex = 0;
+        header->waiters = 0;
+        header->dropped = 0;
+        header->producers = 0;
+        for(unsigned int i = 0; i < cap; i++) {
+            slots[i].sequence = i;
+        }
+
+        // Magic is written as the last one, it signals the segment is ready
+        __sync_synchronize();
+        header->magic = SHM_RING_MAGIC;
+    }
+    else {
+        int attempts = 1000;
+        while(header->magic != SHM_RING_MAGIC && --attempts > 0) {
+            usleep(1000);
+        }
+        __sync_synchronize();
+
+        // Check that the segment has the expected layout
+        if(header->magic != SHM_RING_MAGIC
+           || header->version != SHM_RING_VERSION
+           || header->slotSize != sizeof(ShmDetectionSlot)
+           || mappedSize < sizeof(ShmRingHeader) + (size_t)header->capacity * sizeof(ShmDetectionSlot)) {
+            close();
+            return false;
+        }
+        cap = header->capacity;
+    }
+
+    mask = cap - 1;
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Unmaps the shared memory segment
+ */
+void ShmRing::close()
+{
+    if(header) {
+        munmap(header, mappedSize);
+    }
+    header = NULL;
+    slots = NULL;
+    mappedSize = 0;
+    mask = 0;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Removes the shared memory segment
+ */
+void ShmRing::unlink(const string& name)
+{
+    shm_unlink(shmName(name).c_str());
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Writes a slot into the ring
+ *
+ * Each slot has a sequence number. A producer may write into a slot only
+ * if its sequence equals to the position being written, the consumer may read it
+ * only if the sequence equals to the position + 1 (bounded MPMC queue
+ * by D. Vyukov).
+ */
+bool ShmRing::push(const ShmDetectionSlot& slot)
+{
+    if(!header) return false;
+
+    ShmDetectionSlot *dst;
+    uint64_t pos = header->head;
+    for(;;) {
+        dst = &slots[pos & mask];
+        uint64_t seq = dst->sequence;
+        __sync_synchronize();
+        int64_t diff = (int64_t)seq - (int64_t)pos;
+
+        if(diff == 0) {
+            // The slot is free => try to reserve it
+            uint64_t prev = __sync_val_compare_and_swap(&header->head, pos, pos + 1);
+            if(prev == pos) break;
+            pos = prev;
+        }
+        else if(diff < 0) {
+            // The ring is full
+            __sync_fetch_and_add(&header->dropped, 1);
+            return false;
+        }
+        else {
+            pos = header->head;
+        }
+    }
+
+    memcpy(reinterpret_cast<char *>(dst) + SLOT_PAYLOAD_OFFSET,
+           reinterpret_cast<const char *>(&slot) + SLOT_PAYLOAD_OFFSET,
+           sizeof(ShmDetectionSlot) - SLOT_PAYLOAD_OFFSET);
+
+    // Publish the slot and wake up the consumer
+    __sync_synchronize();
+    dst->sequence = pos + 1;
+    __sync_fetch_and_add(&header->futex, 1);
+    if(header->waiters > 0) {
+        futexWake(&header->futex);
+    }
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Reads a slot from the ring (non-blocking)
+ */
+bool ShmRing::pop(ShmDetectionSlot& slot)
+{
+    if(!header) return false;
+
+    uint64_t pos = header->tail;
+    ShmDetectionSlot *src = &slots[pos & mask];
+    uint64_t seq = src->sequence;
+    __sync_synchronize();
+
+    if((int64_t)seq - (int64_t)(pos + 1) != 0) {
+        return false; // Empty
+    }
+
+    memcpy(reinterpret_cast<char *>(&slot) + SLOT_PAYLOAD_OFFSET,
+           reinterpret_cast<const char *>(src) + SLOT_PAYLOAD_OFFSET,
+           sizeof(ShmDetectionSlot) - SLOT_PAYLOAD_OFFSET);
+    slot.sequence = pos;
+
+    // Release the slot for producers
+    __sync_synchronize();
+    header->tail = pos + 1;
+    src->sequence = pos + mask + 1;
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Reads a slot from the ring (blocking)
+ */
+bool ShmRing::pop(ShmDetectionSlot& slot, int timeoutMs)
+{
+    if(!header) return false;
+
+    // Busy-wait for a while, a new detection usually arrives soon
+    for(int i = 0; i < SHM_RING_SPIN_COUNT; i++) {
+        if(pop(slot)) return true;
+        if((i & 0xff) == 0xff) sched_yield();
+    }
+
+    int64_t deadline = monotonicNs() + (int64_t)timeoutMs * 1000000;
+    for(;;) {
+        // Register as a waiter before checking the ring once more, so that
+        // a producer can't miss us
+        __sync_fetch_and_add(&header->waiters, 1);
+        int32_t value = header->futex;
+        if(pop(slot)) {
+            __sync_fetch_and_sub(&header->waiters, 1);
+            return true;
+        }
+
+        int64_t remaining = deadline - monotonicNs();
+        if(remaining <= 0) {
+            __sync_fetch_and_sub(&header->waiters, 1);
+            return false;
+        }
+        futexWait(&header->futex, value, (int)(remaining / 1000000) + 1);
+        __sync_fetch_and_sub(&header->waiters, 1);
+
+        if(pop(slot)) return true;
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Registers a new producer
+ */
+uint32_t ShmRing::addProducer()
+{
+    if(!header) return 0;
+
+    return __sync_add_and_fetch(&header->producers, 1);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Wakes up all waiting consumers
+ */
+void ShmRing::wakeAll()
+{
+    if(!header) return;
+
+    __sync_fetch_and_add(&header->futex, 1);
+    futexWake(&header->futex);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * CLOCK_MONOTONIC time in nanoseconds
+ */
+int64_t ShmRing::monotonicNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+}
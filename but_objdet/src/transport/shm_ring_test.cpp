@@ -0,0 +1,161 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Test of the shared-memory ring with two local processes
+ * (a producer and a consumer), measuring the detection handoff latency.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "but_objdet/transport/shm_ring.h"
+
+using namespace std;
+using namespace but_objdet;
+
+
+#define SHM_NAME "but_objdet_shm_ring_test"
+#define NUM_FRAMES 10000
+#define FRAME_PERIOD_US 200
+#define MAX_MEDIAN_LATENCY_US 10.0 // Target of the handoff latency
+
+// Consumer process - checks the received data and measures the latency
+int consume()
+{
+    ShmRing ring;
+    if(!ring.open(SHM_NAME)) {
+        printf("Consumer: cannot open the ring.\n");
+        return 1;
+    }
+
+    vector<int64_t> latencies;
+    latencies.reserve(NUM_FRAMES);
+    ShmDetectionSlot slot;
+    int errors = 0;
+
+    for(int i = 0; i < NUM_FRAMES; i++) {
+        if(!ring.pop(slot, 1000)) {
+            printf("Consumer: timeout after %d frames.\n", i);
+            return 1;
+        }
+        latencies.push_back(ShmRing::monotonicNs() - slot.writeTime);
+
+        // Verify the content written by the producer
+        if(slot.frameSeq != (uint32_t)i || slot.count != 1
+           || slot.detections[0].m_id != i || slot.detections[0].m_bb[2] != 100) {
+            errors++;
+        }
+    }
+
+    sort(latencies.begin(), latencies.end());
+    double median = latencies[latencies.size() / 2] / 1000.0;
+    printf("Handoff latency [us]: p50 = %.2f, p90 = %.2f, p99 = %.2f, max = %.2f\n",
+           median,
+           latencies[latencies.size() * 9 / 10] / 1000.0,
+           latencies[latencies.size() * 99 / 100] / 1000.0,
+           latencies.back() / 1000.0);
+    printf("Corrupted slots: %d, dropped slots: %u\n", errors, ring.dropped());
+
+    // The tail depends on scheduling of the machine, the median has to meet
+    // the target
+    if(median >= MAX_MEDIAN_LATENCY_US) {
+        printf("Consumer: median latency is over %.0f us.\n", MAX_MEDIAN_LATENCY_US);
+        errors++;
+    }
+
+    return errors == 0 ? 0 : 1;
+}
+
+// Producer process - writes one detection per frame
+int produce()
+{
+    ShmRing ring;
+    if(!ring.open(SHM_NAME)) {
+        printf("Producer: cannot open the ring.\n");
+        return 1;
+    }
+
+    ShmDetectionSlot slot;
+    for(int i = 0; i < NUM_FRAMES; i++) {
+        slot.stamp = i;
+        slot.frameSeq = i;
+        slot.part = 0;
+        slot.flags = BUT_OBJDET_SHM_LAST_PART;
+        slot.count = 1;
+        slot.detections[0].m_id = i;
+        slot.detections[0].m_class = 0;
+        slot.detections[0].m_bb[0] = 10;
+        slot.detections[0].m_bb[1] = 20;
+        slot.detections[0].m_bb[2] = 100;
+        slot.detections[0].m_bb[3] = 100;
+        slot.writeTime = ShmRing::monotonicNs();
+
+        while(!ring.push(slot)) {
+            usleep(10);
+        }
+        usleep(FRAME_PERIOD_US);
+    }
+
+    return 0;
+}
+
+int main()
+{
+    ShmRing::unlink(SHM_NAME);
+
+    // Create the ring before forking, so that both processes map the same one
+    ShmRing ring;
+    if(!ring.open(SHM_NAME)) {
+        printf("Cannot create the ring.\n");
+        return 1;
+    }
+
+    pid_t pid = fork();
+    if(pid < 0) {
+        printf("Fork failed.\n");
+        return 1;
+    }
+    if(pid == 0) {
+        exit(consume());
+    }
+
+    int result = produce();
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    ShmRing::unlink(SHM_NAME);
+
+    if(result != 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("FAILED\n");
+        return 1;
+    }
+    printf("OK\n");
+
+    return 0;
+}
@@ -0,0 +1,238 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include "but_objdet/transport/shm_transport.h"
+
+using namespace std;
+using namespace but_objdet_msgs;
+
+
+namespace but_objdet
+{
+
+/* -----------------------------------------------------------------------------
+ * Opens the ring for writing
+ */
+bool ShmDetectionPublisher::open(const string& name, unsigned int capacity)
+{
+    if(!ring.open(name, capacity)) return false;
+
+    producer = ring.addProducer();
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Writes detections into the ring, split into slots of at most
+ * BUT_OBJDET_SHM_MAX_DETECTIONS detections
+ */
+bool ShmDetectionPublisher::publish(const DetectionArray& detArray)
+{
+    if(!ring.isOpen()) return false;
+
+    bool ok = true;
+    unsigned int total = detArray.detections.size();
+    unsigned int i = 0;
+    slot.producer = producer;
+    slot.stamp = detArray.header.stamp.toNSec();
+    slot.frameSeq = detArray.header.seq;
+    slot.part = 0;
+    strncpy(slot.frameId, detArray.header.frame_id.c_str(), BUT_OBJDET_SHM_FRAME_ID - 1);
+    slot.frameId[BUT_OBJDET_SHM_FRAME_ID - 1] = '\0';
+
+    do {
+        slot.count = 0;
+        while(i < total && slot.count < BUT_OBJDET_SHM_MAX_DETECTIONS) {
+            const Detection &det = detArray.detections[i++];
+            ShmDetection &rec = slot.detections[slot.count++];
+
+            rec.m_timestamp = det.m_timestamp.toNSec();
+            rec.m_proc_timestamp = det.m_proc_timestamp.toNSec();
+            rec.m_id = det.m_id;
+            rec.m_class = det.m_class;
+            rec.m_score = det.m_score;
+            rec.m_pos_2D[0] = det.m_pos_2D.x;
+            rec.m_pos_2D[1] = det.m_pos_2D.y;
+            rec.m_pos_2D[2] = det.m_pos_2D.z;
+            rec.m_bb[0] = det.m_bb.x;
+            rec.m_bb[1] = det.m_bb.y;
+            rec.m_bb[2] = det.m_bb.width;
+            rec.m_bb[3] = det.m_bb.height;
+            rec.m_angle = det.m_angle;
+            rec.m_speed[0] = det.m_speed.x;
+            rec.m_speed[1] = det.m_speed.y;
+            rec.m_speed[2] = det.m_speed.z;
+            rec.m_source = det.m_source;
+        }
+        slot.flags = (i >= total) ? BUT_OBJDET_SHM_LAST_PART : 0;
+        slot.writeTime = ShmRing::monotonicNs();
+
+        ok = ring.push(slot) && ok;
+        slot.part++;
+    } while(i < total);
+
+    return ok;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Adds a slot to the array of its producer
+ */
+DetectionArrayPtr ShmDetectionAssembler::add(const ShmDetectionSlot& slot)
+{
+    Partial &p = partial[slot.producer];
+
+    // The first part of a new DetectionArray (an unfinished array of the same
+    // producer, whose remaining parts were dropped, is thrown away)
+    if(slot.part == 0) {
+        if(p.array) incompleteCount++;
+
+        p.array.reset(new DetectionArray);
+        p.array->header.stamp.fromNSec(slot.stamp);
+        p.array->header.seq = slot.frameSeq;
+        p.array->header.frame_id.assign(slot.frameId, strnlen(slot.frameId, BUT_OBJDET_SHM_FRAME_ID));
+        p.nextPart = 0;
+    }
+    else if(!p.array || p.array->header.seq != slot.frameSeq || slot.part != p.nextPart
+            || (int64_t)p.array->header.stamp.toNSec() != slot.stamp) {
+        if(p.array) incompleteCount++;
+
+        p.array.reset();
+        return DetectionArrayPtr();
+    }
+
+    DetectionArray &detArray = *p.array;
+    for(unsigned int i = 0; i < slot.count; i++) {
+        const ShmDetection &rec = slot.detections[i];
+        Detection det;
+
+        det.header = detArray.header;
+        det.m_timestamp.fromNSec(rec.m_timestamp);
+        det.m_proc_timestamp.fromNSec(rec.m_proc_timestamp);
+        det.m_id = rec.m_id;
+        det.m_class = rec.m_class;
+        det.m_score = rec.m_score;
+        det.m_pos_2D.x = rec.m_pos_2D[0];
+        det.m_pos_2D.y = rec.m_pos_2D[1];
+        det.m_pos_2D.z = rec.m_pos_2D[2];
+        det.m_bb.x = rec.m_bb[0];
+        det.m_bb.y = rec.m_bb[1];
+        det.m_bb.width = rec.m_bb[2];
+        det.m_bb.height = rec.m_bb[3];
+        det.m_angle = rec.m_angle;
+        det.m_speed.x = rec.m_speed[0];
+        det.m_speed.y = rec.m_speed[1];
+        det.m_speed.z = rec.m_speed[2];
+        det.m_source = rec.m_source;
+
+        detArray.detections.push_back(det);
+    }
+    p.nextPart++;
+
+    DetectionArrayPtr complete;
+    if(slot.flags & BUT_OBJDET_SHM_LAST_PART) {
+        complete.swap(p.array);
+    }
+    return complete;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Constructor
+ */
+ShmDetectionSubscriber::ShmDetectionSubscriber()
+    : running(false)
+{
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Destructor
+ */
+ShmDetectionSubscriber::~ShmDetectionSubscriber()
+{
+    stop();
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Opens the ring and starts the reading thread
+ */
+bool ShmDetectionSubscriber::start(const string& name, const Callback& cb, unsigned int capacity)
+{
+    stop();
+
+    if(!ring.open(name, capacity)) return false;
+
+    callback = cb;
+    running = true;
+    thread = boost::thread(&ShmDetectionSubscriber::run, this);
+
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Stops the reading thread
+ */
+void ShmDetectionSubscriber::stop()
+{
+    if(running) {
+        running = false;
+        ring.wakeAll();
+        thread.join();
+    }
+    ring.close();
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Reading thread - reassembles DetectionArrays from the slots
+ */
+void ShmDetectionSubscriber::run()
+{
+    ShmDetectionSlot slot;
+    uint32_t reported = 0;
+
+    while(running) {
+        if(!ring.pop(slot, 100)) continue;
+
+        DetectionArrayPtr detArray = assembler.add(slot);
+        if(assembler.incomplete() != reported) {
+            reported = assembler.incomplete();
+            ROS_WARN_THROTTLE(10, "%u incomplete detection arrays from shared memory were thrown away "
+                              "(%u slots dropped).", reported, ring.dropped());
+        }
+
+        if(detArray) {
+            callback(detArray);
+        }
+    }
+}
+
+}
@@ -0,0 +1,293 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Test of the shared-memory transport of DetectionArrays split
+ * into several slots - parts of arrays of two producers are interleaved
+ * (first in a given order, then by two producer processes writing at once)
+ * and each array has to be reassembled complete with its frame_id.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include <boost/bind.hpp>
+
+#include "but_objdet/transport/shm_transport.h"
+
+using namespace std;
+using namespace but_objdet;
+using namespace but_objdet_msgs;
+
+
+#define SHM_NAME "but_objdet_shm_transport_test"
+#define NUM_PRODUCERS 2
+#define NUM_FRAMES 2000
+#define NUM_DETECTIONS (2 * BUT_OBJDET_SHM_MAX_DETECTIONS + 5) // Three slots per array
+#define PART_PERIOD_US 100
+
+// Detections of a frame of a producer (ids encode the producer, the frame
+// and the index of the detection)
+DetectionArray makeArray(int producer, int frame)
+{
+    DetectionArray detArray;
+    detArray.header.seq = frame;
+    detArray.header.stamp.fromNSec(1000000ULL * (frame + 1));
+    ostringstream frameId;
+    frameId << "/camera_" << producer;
+    detArray.header.frame_id = frameId.str();
+
+    detArray.detections.resize(NUM_DETECTIONS);
+    for(int i = 0; i < NUM_DETECTIONS; i++) {
+        Detection &det = detArray.detections[i];
+        det.m_id = (producer * NUM_FRAMES + frame) * NUM_DETECTIONS + i;
+        det.m_class = producer;
+        det.m_bb.width = 100;
+        det.m_bb.height = 100;
+    }
+
+    return detArray;
+}
+
+// Checks a reassembled array, returns the producer (-1 if it is corrupted)
+int checkArray(const DetectionArray &detArray)
+{
+    if(detArray.detections.size() != NUM_DETECTIONS) return -1;
+
+    int producer = detArray.detections[0].m_class;
+    int frame = detArray.header.seq;
+    DetectionArray expected = makeArray(producer, frame);
+    if(detArray.header.frame_id != expected.header.frame_id
+       || detArray.header.stamp != expected.header.stamp) {
+        return -1;
+    }
+    for(int i = 0; i < NUM_DETECTIONS; i++) {
+        const Detection &det = detArray.detections[i];
+        if(det.m_id != expected.detections[i].m_id || det.m_class != producer
+           || det.m_bb.width != 100 || det.header.frame_id != expected.header.frame_id) {
+            return -1;
+        }
+    }
+
+    return producer;
+}
+
+// Splits arrays into slots as ShmDetectionPublisher does (through a private
+// ring), so that the slots can be written in any order
+class Encoder
+{
+public:
+    Encoder(const string &name_) : name(name_)
+    {
+        ShmRing::unlink(name);
+        ring.open(name, 16);
+        publisher.open(name);
+    }
+
+    ~Encoder()
+    {
+        ShmRing::unlink(name);
+    }
+
+    vector<ShmDetectionSlot> encode(const DetectionArray &detArray)
+    {
+        vector<ShmDetectionSlot> slots;
+        ShmDetectionSlot slot;
+        publisher.publish(detArray);
+        while(ring.pop(slot)) {
+            slots.push_back(slot);
+        }
+        return slots;
+    }
+
+private:
+    string name;
+    ShmRing ring;
+    ShmDetectionPublisher publisher;
+};
+
+// Parts of arrays of two producers are reassembled in a given order
+int testInterleaved()
+{
+    Encoder encoder(string(SHM_NAME) + "_encoder");
+    vector<ShmDetectionSlot> a = encoder.encode(makeArray(0, 1));
+    vector<ShmDetectionSlot> b = encoder.encode(makeArray(1, 1));
+    if(a.size() != 3 || b.size() != 3) {
+        printf("Interleaved: unexpected slots.\n");
+        return 1;
+    }
+
+    // The second array comes from another producer
+    for(size_t i = 0; i < b.size(); i++) {
+        b[i].producer = a[0].producer + 1;
+    }
+
+    // A0 B0 A1 B1 A2 B2, then A0 A2 (a dropped part) and a complete B
+    ShmDetectionAssembler assembler;
+    vector<DetectionArrayPtr> arrays;
+    for(int i = 0; i < 3; i++) {
+        arrays.push_back(assembler.add(a[i]));
+        arrays.push_back(assembler.add(b[i]));
+    }
+    arrays.push_back(assembler.add(a[0]));
+    arrays.push_back(assembler.add(a[2]));
+    for(int i = 0; i < 3; i++) {
+        arrays.push_back(assembler.add(b[i]));
+    }
+
+    int errors = 0;
+    for(size_t i = 0; i < arrays.size(); i++) {
+        bool complete = (i == 4 || i == 5 || i == 10);
+        if(complete != (arrays[i].get() != NULL) || (complete && checkArray(*arrays[i]) < 0)) {
+            errors++;
+        }
+    }
+    if(assembler.incomplete() != 1) {
+        errors++;
+    }
+
+    printf("Interleaved: %d errors, %u incomplete arrays\n", errors, assembler.incomplete());
+    return errors == 0 ? 0 : 1;
+}
+
+// Producer process - writes slots of its arrays with pauses between them,
+// so that they are interleaved with slots of the other producer
+int produce(int producer)
+{
+    ShmRing ring;
+    if(!ring.open(SHM_NAME, 256)) {
+        printf("Producer %d: cannot open the ring.\n", producer);
+        return 1;
+    }
+    uint32_t id = ring.addProducer();
+
+    ostringstream name;
+    name << SHM_NAME << "_encoder_" << producer;
+    Encoder encoder(name.str());
+
+    int dropped = 0;
+    for(int i = 0; i < NUM_FRAMES; i++) {
+        vector<ShmDetectionSlot> slots = encoder.encode(makeArray(producer, i));
+        for(size_t s = 0; s < slots.size(); s++) {
+            slots[s].producer = id;
+            if(!ring.push(slots[s])) {
+                dropped++;
+            }
+            usleep(PART_PERIOD_US);
+        }
+    }
+    if(dropped > 0) {
+        printf("Producer %d: %d slots dropped.\n", producer, dropped);
+    }
+
+    return dropped == 0 ? 0 : 1;
+}
+
+// Consumer - counts complete arrays of each producer
+struct Consumer
+{
+    Consumer() : corrupted(0)
+    {
+        for(int i = 0; i < NUM_PRODUCERS; i++) received[i] = 0;
+    }
+
+    void callback(const DetectionArrayConstPtr &detArray)
+    {
+        int producer = checkArray(*detArray);
+        if(producer < 0 || producer >= NUM_PRODUCERS) {
+            corrupted++;
+        }
+        else {
+            received[producer]++;
+        }
+    }
+
+    volatile int received[NUM_PRODUCERS];
+    volatile int corrupted;
+};
+
+// Two producer processes write into the ring at once
+int testProcesses()
+{
+    ShmRing::unlink(SHM_NAME);
+
+    Consumer consumer;
+    ShmDetectionSubscriber subscriber;
+    if(!subscriber.start(SHM_NAME, boost::bind(&Consumer::callback, &consumer, _1), 256)) {
+        printf("Cannot create the ring.\n");
+        return 1;
+    }
+
+    fflush(stdout);
+    vector<pid_t> pids;
+    for(int p = 0; p < NUM_PRODUCERS; p++) {
+        pid_t pid = fork();
+        if(pid < 0) {
+            printf("Fork failed.\n");
+            return 1;
+        }
+        if(pid == 0) {
+            exit(produce(p));
+        }
+        pids.push_back(pid);
+    }
+
+    int errors = 0;
+    for(size_t i = 0; i < pids.size(); i++) {
+        int status = 0;
+        waitpid(pids[i], &status, 0);
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) errors++;
+    }
+
+    // Wait until the subscriber reads the rest of the ring
+    usleep(500000);
+    subscriber.stop();
+    ShmRing::unlink(SHM_NAME);
+
+    for(int p = 0; p < NUM_PRODUCERS; p++) {
+        printf("Producer %d: %d of %d arrays\n", p, consumer.received[p], NUM_FRAMES);
+        if(consumer.received[p] != NUM_FRAMES) errors++;
+    }
+    printf("Corrupted arrays: %d\n", consumer.corrupted);
+
+    return (errors == 0 && consumer.corrupted == 0) ? 0 : 1;
+}
+
+int main()
+{
+    int result = testInterleaved();
+    result |= testProcesses();
+
+    if(result != 0) {
+        printf("FAILED\n");
+        return 1;
+    }
+    printf("OK\n");
+
+    return 0;
+}
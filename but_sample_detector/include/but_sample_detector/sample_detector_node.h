@@ -32,9 +32,18 @@
 
 #include <ros/ros.h> // Main header of ROS
 #include <sensor_msgs/Image.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include "but_objdet/but_objdet.h"
 #include "but_objdet/matcher/matcher_overlap.h"
+#include "but_objdet/tracker/visual_tracker.h"
+#include "but_objdet/tracker/tracker_flow.h"
+#include "but_objdet/transport/shm_transport.h"
+#include "but_objdet/stats/latency_stats.h"
+#include "but_objdet/stats/metrics.h"
+#include "but_objdet/record/log_writer.h"
+#include "but_objdet_msgs/PredictionArray.h"
 #include "but_sample_detector/sample_detector.h"
 
 
@@ -47,16 +56,41 @@ namespace but_sample_detector
 class SampleDetectorNode
 {
 public:
-	SampleDetectorNode();
+    /**
+     * Constructor.
+     * @param nh  NodeHandle used to subscribe and advertise topics.
+     * @param pnh  Private NodeHandle used to read parameters.
+     */
+	SampleDetectorNode(ros::NodeHandle nh = ros::NodeHandle(),
+	                   ros::NodeHandle pnh = ros::NodeHandle("~"));
 	virtual ~SampleDetectorNode();
 
+    /**
+     * Tests if detections are visualized in a window (window events have
+     * to be processed by the caller then).
+     */
+	bool isVisualOutput() const { return visualOutput; }
+
 private:
 	void rosInit();
 
 	void newDataCallback(const sensor_msgs::ImageConstPtr &image);
 
+	void detectObjects(const sensor_msgs::ImageConstPtr &imageMsg, const cv::Mat &image);
+
+	void startTracking(const cv::Mat &gray);
+
+	bool trackObjects(const sensor_msgs::ImageConstPtr &imageMsg, const cv::Mat &gray);
+
+	void predictionsCallback(const but_objdet_msgs::PredictionArrayConstPtr &predArray);
+
+	bool getPredictions(const ros::Time &stamp,
+	                    std::vector<but_objdet_msgs::Detection> &predDetections);
+
 	int getNewObjectID();
 
+	void reportLatency(const ros::WallTimerEvent &event);
+
 	but_objdet::Objects detections; // Current detections
 	but_objdet::Objects predictions; // Current predictions
 
@@ -64,6 +98,7 @@ private:
 	but_objdet::MatcherOverlap *matcherOverlap; // Matcher
 
 	ros::NodeHandle nh; // NodeHandle is the main access point for communication with ROS system
+	ros::NodeHandle pnh; // Private NodeHandle (parameters of the node)
 
 	ros::Subscriber dataSub;
 	
@@ -72,7 +107,37 @@ private:
 	ros::ServiceClient predictClient; // Client for comunication with tracker
 									  // (using PredictDetections service)
 
+	bool usePredictionTopic; // Use predictions pushed by tracker instead of the service
+	ros::Subscriber predictionsSub;
+	but_objdet_msgs::PredictionArrayConstPtr lastPredictions; // The latest pushed predictions
+	boost::mutex predictionsMutex; // Guards lastPredictions
+
+	bool trackerAssociation; // Publish detections without IDs, the tracker assigns them
+
+	bool useShm; // Publish detections also through shared memory
+	but_objdet::ShmDetectionPublisher shmPub; // Shared-memory publisher of detections
+
+	but_objdet::LogWriter recorder; // Recording of frames, predictions and detections
+
+	but_objdet::LatencyStats outputLatency; // Capture -> publishing of detections
+	ros::WallTimer latencyTimer; // Periodic report of latencies
+
+	but_objdet::MetricsRegistry metrics; // Metrics published as diagnostics
+	but_objdet::MetricHistogram *decodeTime, *predictTime, *detectTime;
+	but_objdet::MetricHistogram *matchTime, *publishTime, *frameTime, *trackTime;
+	but_objdet::MetricCounter *frameCount, *detectionCount, *predictFailures;
+	but_objdet::MetricCounter *keyframeCount, *trackedCount;
+
 	int lastObjectID; // Last assigned object ID
+
+	int keyframeInterval; // The detector runs every keyframeInterval frames
+	double minTrackingConfidence; // A keyframe is forced below this confidence
+	int framesSinceKeyframe;
+	bool flowTracking; // Optical flow trackers instead of MOSSE
+	but_objdet::FlowFrames flowFrames; // Images shared by the flow trackers (must outlive them)
+	std::vector<boost::shared_ptr<but_objdet::VisualTracker> > visualTrackers; // Trackers of the detections
+
+	bool visualOutput; // Visualize detections in a window
 };
 
 }
@@ -120,8 +120,10 @@ detection.m_angle = 0;
 
 detection.m_mask = Mat(cvSize(0, 0), CV_8U);
 
-detection.m_timestamp = 0;
+detection.m_timestamp = 0; // filled in by the node (capture time of the image)
+detection.m_proc_timestamp = 0;
 detection.m_speed = cv::Point3f(0,0,0);
+detection.m_source = 0; // a single camera
 
 
 
@@ -0,0 +1,68 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: Tomas Hodan (xhodan04@stud.fit.vutbr.cz)
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Date: 01/04/2012
+ * Description: Standalone executable of the sample detector node (the same node
+ * can be loaded as a nodelet, see sample_detector_nodelet.cpp).
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ros/ros.h> // Main header of ROS
+#include <ros/callback_queue.h>
+#include <opencv2/highgui/highgui.hpp> // OpenCV available within a vision_opencv ROS stack
+
+#include "but_sample_detector/sample_detector_node.h"
+
+
+/* =============================================================================
+ * Main function
+ */
+int main(int argc, char **argv)
+{
+    // ROS initialization (the last argument is the name of a ROS node)
+    ros::init(argc, argv, "but_sample_detector");
+
+    // Create the object managing connection with ROS system
+    but_sample_detector::SampleDetectorNode *sdm = new but_sample_detector::SampleDetectorNode();
+    
+    // Enters a loop
+    // (you can replace the following while-loop with ros::spin(); if you do not
+    // want to open any window or e.g. handle a key press event)
+    //--------------------------------------------------------------------------
+    //ros::spin();
+    while(ros::ok()) {
+        if(sdm->isVisualOutput()) {
+            cv::waitKey(10); // Process window events
+            
+            // You can do some other stuff here (e.g. handle a key press event)
+            ros::spinOnce(); // Call all the message callbacks waiting to be called
+        }
+        else {
+            ros::getGlobalCallbackQueue()->callAvailable(ros::WallDuration(0.1));
+        }
+    }
+    
+    delete sdm;
+    
+    return 0;
+}
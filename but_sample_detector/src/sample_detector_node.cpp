@@ -39,6 +39,10 @@
 #include "but_objdet/services_list.h" // Names of services provided by but_objdet package
 #include "but_objdet/convertor/convertor.h" // Translator from but_objdet messages to standard C++ structures
 #include "but_objdet/matcher/matcher_overlap.h" // Matcher (based on overlap)
+#include "but_objdet/tracker/track_snapshot.h" // Extrapolation of pushed predictions
+#include "but_objdet/stats/trace_buffer.h" // Spans of processed frames
+#include "but_objdet/tracker/tracker_mosse.h" // Visual tracking between keyframes
+#include "but_objdet/tracker/tracker_flow.h"
 #include "but_objdet/PredictDetections.h" // Autogenerated service class
 #include "but_objdet_msgs/DetectionArray.h" // Message transfering detections/predictions
 
@@ -49,12 +53,9 @@ using namespace std;
 using namespace but_objdet;
 using namespace but_objdet_msgs;
 
-// If set to 1, detections will be visualized. If a tracker node is used, it is
-// better to visualize the detections together with predictions there.
-#define VISUAL_OUTPUT 1
-
 const string imageTopic = "/camera/rgb/image_color";
 const string detectionTopic = "/but_objdet/detections";
+const string predictionTopic = "/but_objdet/predictions";
 
 
 namespace but_sample_detector
@@ -63,13 +64,24 @@ namespace but_sample_detector
 /* -----------------------------------------------------------------------------
  * Constructor
  */
-SampleDetectorNode::SampleDetectorNode()
+SampleDetectorNode::SampleDetectorNode(ros::NodeHandle nh_, ros::NodeHandle pnh_)
+    : nh(nh_)
+    , pnh(pnh_)
+    , outputLatency("capture -> detector output")
+    , metrics(pnh_.getNamespace() + ": metrics")
+    , lastObjectID(0)
+    , framesSinceKeyframe(0)
+    , flowTracking(false)
 {   
     sampleDetector = new but_sample_detector::SampleDetector(); // Detector
     matcherOverlap = new but_objdet::MatcherOverlap(); // Matcher
     
+    // Visualization can be switched off by a parameter (e.g. when running
+    // as a nodelet, where nobody processes window events)
+    pnh.param("visual_output", visualOutput, true);
+
     // Create a window to show the incoming video and set its mouse event handler
-    if(VISUAL_OUTPUT) {
+    if(visualOutput) {
         namedWindow("Sample detector", CV_WINDOW_AUTOSIZE);
     }
     
@@ -96,9 +108,97 @@ void SampleDetectorNode::rosInit()
     // (the name of the service is defined in but_objdet/services_list.h)
     predictClient = nh.serviceClient<but_objdet::PredictDetections>(BUT_OBJDET_PredictDetections_SRV);
 
+    // Alternatively keep the latest predictions pushed by the tracker (it has
+    // to be started with ~prediction_rate or ~predictions_on_update), so that
+    // no service call is made for every frame
+    pnh.param("use_prediction_topic", usePredictionTopic, false);
+
+    // Detections can be published without IDs, which are then assigned by
+    // the tracker (the detector doesn't need predictions for matching then)
+    pnh.param("tracker_association", trackerAssociation, false);
+    if(usePredictionTopic) {
+        predictionsSub = nh.subscribe(predictionTopic, 1, &SampleDetectorNode::predictionsCallback, this);
+    }
+
     // Advertise that this node is going to publish on the specified topic
     // (the second argument is the size of publishing queue)
     detectionsPub = nh.advertise<but_objdet_msgs::DetectionArray>(detectionTopic, 10);
+
+    // Optionally publish detections also through shared memory (faster
+    // transport for a tracker running on the same host)
+    std::string shmName;
+    pnh.param("shm_transport", useShm, false);
+    pnh.param("shm_name", shmName, BUT_OBJDET_Detections_SHM);
+    if(useShm && !shmPub.open(shmName)) {
+        ROS_ERROR("Failed to open shared memory ring %s.", shmName.c_str());
+        useShm = false;
+    }
+    
+    // Optionally record frames, predictions and detections for later replay
+    // (see but_objdet_replay)
+    std::string recordFile, recordEncoding;
+    double recordScale;
+    int recordQuality;
+    pnh.param("record", recordFile, std::string(""));
+    pnh.param("record_scale", recordScale, 1.0);
+    pnh.param("record_encoding", recordEncoding, std::string("raw"));
+    pnh.param("record_quality", recordQuality, -1);
+    if(!recordFile.empty()) {
+        if(recorder.open(recordFile)) {
+            LogFrameEncoding enc = LOG_FRAME_RAW;
+            if(recordEncoding == "jpeg") enc = LOG_FRAME_JPEG;
+            else if(recordEncoding == "png") enc = LOG_FRAME_PNG;
+            recorder.setFrameFormat(recordScale, enc, recordQuality);
+            ROS_INFO("Recording into %s.", recordFile.c_str());
+        }
+        else {
+            ROS_ERROR("Failed to open log %s for recording.", recordFile.c_str());
+        }
+    }
+    
+    // The detector can run just on keyframes, objects are followed by visual
+    // trackers between them (1 = the detector runs on every frame); a frame
+    // is also a keyframe, when the confidence of tracking of an object falls
+    // below ~min_tracking_confidence (peak-to-sidelobe ratio of the MOSSE
+    // correlation filter, or the fraction of followed points of the optical
+    // flow tracker)
+    pnh.param("keyframe_interval", keyframeInterval, 1);
+    std::string visualTracker;
+    pnh.param("visual_tracker", visualTracker, std::string("mosse"));
+    flowTracking = (visualTracker == "flow");
+    if(!flowTracking && visualTracker != "mosse") {
+        ROS_WARN("Unknown visual tracker %s, using mosse.", visualTracker.c_str());
+    }
+    pnh.param("min_tracking_confidence", minTrackingConfidence, flowTracking ? 0.5 : 7.0);
+    
+    // Periodically report latencies of detections (0 = never)
+    double reportPeriod;
+    pnh.param("latency_report_period", reportPeriod, 10.0);
+    if(reportPeriod > 0) {
+        latencyTimer = nh.createWallTimer(ros::WallDuration(reportPeriod),
+            &SampleDetectorNode::reportLatency, this);
+    }
+
+    // Durations of steps of processing of a frame (published as diagnostics)
+    decodeTime = metrics.histogram("decode");
+    predictTime = metrics.histogram("predict");
+    detectTime = metrics.histogram("detect");
+    matchTime = metrics.histogram("match");
+    publishTime = metrics.histogram("publish");
+    frameTime = metrics.histogram("frame");
+    trackTime = metrics.histogram("track");
+    keyframeCount = metrics.counter("keyframes");
+    trackedCount = metrics.counter("tracked objects");
+    frameCount = metrics.counter("frames");
+    detectionCount = metrics.counter("detections");
+    predictFailures = metrics.counter("predict failures");
+
+    double metricsPeriod;
+    pnh.param("metrics_period", metricsPeriod, 5.0);
+    metrics.start(nh, metricsPeriod);
+
+    // Spans of the steps of processing of frames (~trace_file)
+    but_objdet::traceInit(pnh);
     
     // Subscribe to the /cam3d/rgb/image_raw topic (just example for this sample
     // detector, you can subscribe to any other topics)
@@ -115,50 +215,135 @@ void SampleDetectorNode::rosInit()
 void SampleDetectorNode::newDataCallback(const sensor_msgs::ImageConstPtr &imageMsg)
 {   
     //ROS_INFO("New data.");
+    but_objdet::MetricTimer frameTimer(frameTime);
+    but_objdet::TraceScope frameSpan("detector", imageMsg->header.stamp, imageMsg->header.seq);
+    frameCount->add();
 
-    // Get an OpenCV Mat from the image message
+    // Get an OpenCV Mat from the image message (data of the message are
+    // shared, a copy is made only if the image is going to be drawn into)
+    but_objdet::MetricTimer decodeTimer(decodeTime);
+    but_objdet::TraceScope decodeSpan("decode", imageMsg->header.stamp, imageMsg->header.seq);
     Mat image;
     try {
-        image = cv_bridge::toCvCopy(imageMsg)->image;
+        image = cv_bridge::toCvShare(imageMsg)->image;
+        if(visualOutput) {
+            image = image.clone();
+        }
     }
     catch (cv_bridge::Exception& e) {
         ROS_ERROR("cv_bridge exception: %s", e.what());
         return;
     }
+    decodeTimer.stop();
+    decodeSpan.stop();
     
-    // 1) Obtain predictions from tracker via service
-    //--------------------------------------------------------------------------
-    // When using simulated Clock time, now() returns time 0 until first message
-    // has been received on /clock topic => wait for that.
-    ros::Time reqTime;
-    do {
-        reqTime = ros::Time::now();
-    } while(reqTime.sec == 0);
+    if(recorder.isOpen()) {
+        recorder.writeFrame(*imageMsg, image);
+    }
     
-    // Instance of the autogenerated service class providing service
-	// for prediction of detections
-	but_objdet::PredictDetections predictSrv;
+    // Between keyframes the objects of the last keyframe are just followed
+    // by visual trackers (they keep their IDs), the detector runs every
+    // ~keyframe_interval frames or when an object is lost
+    Mat gray;
+    if(keyframeInterval > 1) {
+        if(image.channels() == 3) {
+            cvtColor(image, gray, CV_BGR2GRAY);
+        }
+        else if(image.depth() != CV_8U) {
+            image.convertTo(gray, CV_8U);
+        }
+        else {
+            gray = image;
+        }
 
-    // Create a request
-    // (in this example, class_id nor object_id is specified, so predictions
-    // for all detections is returned)
-    //---------------------------------
-    predictSrv.request.header.stamp = reqTime;
-    predictSrv.request.object_id = -1;
-    predictSrv.request.class_id = -1;
+        // Points of all the flow trackers are followed at once
+        if(flowTracking) {
+            but_objdet::MetricTimer trackTimer(trackTime);
+            flowFrames.next(gray);
+        }
+    }
     
-    // Send request to tracker (ROS node) to obtain predictions
-    // (using PredictDetections service)
-    //---------------------------------
-    // Call the service (calls are blocking, it returns once the call is done)
-    if(predictClient.call(predictSrv)) {
-        // Translate Detection msgs to butObjects
-        predictions = Convertor::detectionsToButObjects(predictSrv.response.predictions);
+    if(!trackObjects(imageMsg, gray)) {
+        detectObjects(imageMsg, image);
+        startTracking(gray);
     }
-    else {
-        std::string errMsg = "Failed to call service " + BUT_OBJDET_PredictDetections_SRV + ".";
-        ROS_ERROR("%s", errMsg.c_str());
+    
+    // 6) Publish new detections (it is subscribed by tracker)
+    // The message is published as a shared pointer, so that a tracker running
+    // as a nodelet in the same process receives it without copying.
+    //--------------------------------------------------------------------------
+    but_objdet::MetricTimer publishTimer(publishTime);
+    but_objdet::TraceScope publishSpan("publish", imageMsg->header.stamp, imageMsg->header.seq);
+    DetectionArrayPtr detArray(new DetectionArray);
+    detArray->header = imageMsg->header;
+
+    // Translate butObjects to Detection msgs
+    detArray->detections = Convertor::butObjectsToDetections(detections, imageMsg->header);
+    if(useShm) {
+        shmPub.publish(*detArray);
     }
+    detectionsPub.publish(detArray);
+    if(recorder.isOpen()) {
+        recorder.writeDetections(*detArray);
+    }
+    publishTimer.stop();
+    publishSpan.stop();
+
+    int64 pubTime = ros::Time::now().toNSec();
+    for(unsigned int i = 0; i < detections.size(); i++) {
+        outputLatency.add(detections[i].m_class, detections[i].m_timestamp, pubTime);
+    }
+    frameTimer.stop(); // Visualization isn't counted
+    frameSpan.stop();
+
+    // Show the fake bounding box - just to demonstrate that the sample detector
+    // works within ROS!
+    //--------------------------------------------------------------------------
+    // (frames left to the tracking can be without detections)
+    if(visualOutput) {
+        if(!detections.empty()) {
+            cv::Rect bb = detections[0].m_bb;
+            rectangle(
+                image,
+                cvPoint(bb.x, bb.y),
+                cvPoint(bb.x + bb.width, bb.y + bb.height),
+                cvScalar(255,255,255)
+            );
+        }
+        imshow("Sample detector", image);
+    }
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Runs the detector on a frame and assigns IDs to the detected objects
+ */
+void SampleDetectorNode::detectObjects(const sensor_msgs::ImageConstPtr &imageMsg, const Mat &image)
+{
+    // 1) Obtain predictions from tracker for the time of the frame
+    //--------------------------------------------------------------------------
+    // (the current time is used if the image isn't stamped)
+    ros::Time reqTime = imageMsg->header.stamp;
+    if(reqTime.isZero()) {
+        reqTime = ros::Time::now();
+    }
+    
+    // (with the association done by tracker, predictions are used only if
+    // they are available without a service call)
+    but_objdet::MetricTimer predictTimer(predictTime);
+    but_objdet::TraceScope predictSpan("predict", imageMsg->header.stamp, imageMsg->header.seq);
+    but_objdet::PredictDetections::Response predResponse;
+    if((!trackerAssociation || usePredictionTopic) &&
+       getPredictions(reqTime, predResponse.predictions)) {
+        // Translate Detection msgs to butObjects
+        predictions = Convertor::detectionsToButObjects(predResponse.predictions);
+        
+        if(recorder.isOpen()) {
+            recorder.writePredictions(reqTime, predResponse);
+        }
+    }
+    predictTimer.stop();
+    predictSpan.stop();
     
     // 2) Provide predictions to detector (so it can consider it during
     // detection process)
@@ -167,19 +352,44 @@ void SampleDetectorNode::newDataCallback(const sensor_msgs::ImageConstPtr &image
 
     // 3) Detection (sample detector returns always just one fake detection)
     //--------------------------------------------------------------------------
+    but_objdet::MetricTimer detectTimer(detectTime);
+    but_objdet::TraceScope detectSpan("detect", imageMsg->header.stamp, imageMsg->header.seq);
     sampleDetector->detect(image, Mat(), detections, 0);
+    detectTimer.stop();
+    detectSpan.stop();
+    detectionCount->add(detections.size());
+    
+    // Stamp detections with the capture time of the image and the time
+    // when they were detected (used to measure latency of the pipeline)
+    int64 procTime = ros::Time::now().toNSec();
+    for(unsigned int i = 0; i < detections.size(); i++) {
+        if(detections[i].m_timestamp == 0) {
+            detections[i].m_timestamp = imageMsg->header.stamp.toNSec();
+        }
+        detections[i].m_proc_timestamp = procTime;
+    }
     
     // 4) Match detections and predictions
     // To each detection is assigned the most similar prediction or none, if
     // there is no prediction, where the overlapping area represents at least
     // minOverlap% of both, detection BB and prediction BB (BB = Bounding Box).
     // The assigned prediction must have the same value of m_class (= class ID)
-    // as the detection.
+    // as the detection. With the association done by tracker, the detections
+    // are published without IDs.
     //--------------------------------------------------------------------------
+    but_objdet::MetricTimer matchTimer(matchTime);
+    but_objdet::TraceScope matchSpan("match", imageMsg->header.stamp, imageMsg->header.seq);
     Matches matches;
-    matcherOverlap->setMinOverlap(50); // minOverlap = 50%
-    if (detections.size() >= predictions.size())
-        matcherOverlap->match(detections, predictions, matches);
+    if(trackerAssociation) {
+        for(unsigned int i = 0; i < detections.size(); i++) {
+            detections[i].m_id = Detection::NO_ID;
+        }
+    }
+    else {
+        matcherOverlap->setMinOverlap(50); // minOverlap = 50%
+        if (detections.size() >= predictions.size())
+            matcherOverlap->match(detections, predictions, matches);
+    }
 
     // 5) Modify m_id and m_class of each detection based on matched prediction
     //--------------------------------------------------------------------------
@@ -194,71 +404,167 @@ void SampleDetectorNode::newDataCallback(const sensor_msgs::ImageConstPtr &image
             detections[i].m_id = getNewObjectID();
         }
     }
-    
-    // 6) Publish new detections (it is subscribed by tracker)
-    //--------------------------------------------------------------------------
-    DetectionArray detArray;
-    detArray.header = imageMsg->header;
+    matchTimer.stop();
+    matchSpan.stop();
+}
 
-    // Translate butObjects to Detection msgs
-    detArray.detections = Convertor::butObjectsToDetections(detections, imageMsg->header);
-    detectionsPub.publish(detArray);
 
-    // Show the fake bounding box - just to demonstrate that the sample detector
-    // works within ROS!
-    //--------------------------------------------------------------------------
-    if(VISUAL_OUTPUT) {
-        cv::Rect bb = detections[0].m_bb;
-	    rectangle(
-	        image,
-	        cvPoint(bb.x, bb.y),
-	        cvPoint(bb.x + bb.width, bb.y + bb.height),
-	        cvScalar(255,255,255)
-	    );
-	    imshow("Sample detector", image);
-	}
+/* -----------------------------------------------------------------------------
+ * Starts visual tracking of the detected objects
+ */
+void SampleDetectorNode::startTracking(const Mat &gray)
+{
+    keyframeCount->add();
+    framesSinceKeyframe = 0;
+    visualTrackers.clear();
+    if(keyframeInterval <= 1) return;
+
+    for(unsigned int i = 0; i < detections.size(); i++) {
+        boost::shared_ptr<but_objdet::VisualTracker> tracker;
+        if(flowTracking) {
+            tracker.reset(new but_objdet::TrackerFlow(&flowFrames, 20, (float)minTrackingConfidence));
+        }
+        else {
+            tracker.reset(new but_objdet::TrackerMosse(64, 0.125f, (float)minTrackingConfidence));
+        }
+
+        // The next frame is a keyframe if an object cannot be tracked
+        if(!tracker->init(gray, detections[i].m_bb)) {
+            framesSinceKeyframe = keyframeInterval;
+        }
+        visualTrackers.push_back(tracker);
+    }
 }
 
 
-/* =============================================================================
- * Generates a new object ID
+/* -----------------------------------------------------------------------------
+ * Follows the objects of the last keyframe in a frame between keyframes
  */
-int SampleDetectorNode::getNewObjectID()
+bool SampleDetectorNode::trackObjects(const sensor_msgs::ImageConstPtr &imageMsg, const Mat &gray)
 {
-    // Limit the range of possible IDs
-    if(lastObjectID >= 100000) lastObjectID = 0;
-    
-    return ++lastObjectID;
-}
+    if(keyframeInterval <= 1 || ++framesSinceKeyframe >= keyframeInterval) return false;
+    if(visualTrackers.size() != detections.size()) return false;
+
+    but_objdet::MetricTimer trackTimer(trackTime);
+    but_objdet::TraceScope trackSpan("track", imageMsg->header.stamp, imageMsg->header.seq);
+
+    // All the objects have to be found, otherwise the detector is run
+    std::vector<cv::Rect> boxes(detections.size());
+    for(unsigned int i = 0; i < detections.size(); i++) {
+        boxes[i] = detections[i].m_bb;
+        if(!visualTrackers[i]->update(gray, boxes[i])) return false;
+    }
 
+    int64 procTime = ros::Time::now().toNSec();
+    for(unsigned int i = 0; i < detections.size(); i++) {
+        Object &obj = detections[i];
+        obj.m_pos_2D.x += boxes[i].x - obj.m_bb.x;
+        obj.m_pos_2D.y += boxes[i].y - obj.m_bb.y;
+        obj.m_bb = boxes[i];
+        obj.m_timestamp = imageMsg->header.stamp.toNSec();
+        obj.m_proc_timestamp = procTime;
+    }
+    trackedCount->add(detections.size());
+
+    return true;
 }
 
 
-/* =============================================================================
- * Main function
+/* -----------------------------------------------------------------------------
+ * Function called when predictions are pushed by the tracker
  */
-int main(int argc, char **argv)
+void SampleDetectorNode::predictionsCallback(const but_objdet_msgs::PredictionArrayConstPtr &predArray)
 {
-    // ROS initialization (the last argument is the name of a ROS node)
-    ros::init(argc, argv, "but_sample_detector");
+    // The last stage of a frame - predictions pushed after the update by its
+    // detections (their stamp is the stamp of the frame)
+    but_objdet::TraceScope span("consumer", predArray->header.stamp, predArray->header.seq);
+    
+    // Just the pointer is kept, the message isn't copied
+    boost::mutex::scoped_lock lock(predictionsMutex);
+    lastPredictions = predArray;
+}
+
 
-    // Create the object managing connection with ROS system
-    but_sample_detector::SampleDetectorNode *sdm = new but_sample_detector::SampleDetectorNode();
+/* -----------------------------------------------------------------------------
+ * Obtains predictions of detections for the given time (either from the
+ * latest pushed predictions or from the tracker via service)
+ */
+bool SampleDetectorNode::getPredictions(const ros::Time &stamp,
+                                        std::vector<Detection> &predDetections)
+{
+    predDetections.clear();
     
-    // Enters a loop
-    // (you can replace the following while-loop with ros::spin(); if you do not
-    // want to open any window or e.g. handle a key press event)
-    //--------------------------------------------------------------------------
-    //ros::spin();
-    while(ros::ok()) {
-        waitKey(10); // Process window events
+    if(usePredictionTopic) {
+        PredictionArrayConstPtr predArray;
+        {
+            boost::mutex::scoped_lock lock(predictionsMutex);
+            predArray = lastPredictions;
+        }
+        
+        // Nothing has been received yet
+        if(!predArray) return true;
         
-        // You can do some other stuff here (e.g. handle a key press event)
-        ros::spinOnce(); // Call all the message callbacks waiting to be called
+        // Extrapolate the predictions from the time they were made for
+        // to the requested time
+        int64 predTime = ((int64)stamp.toNSec() - (int64)predArray->header.stamp.toNSec()) / 1000000;
+        TrackView view;
+        for(unsigned int i = 0; i < predArray->predictions.size(); i++) {
+            if(i >= predArray->states.size()) {
+                predDetections.push_back(predArray->predictions[i]);
+                continue;
+            }
+            view.fromState(predArray->predictions[i], predArray->states[i], 0);
+            predDetections.push_back(view.predict(predTime));
+        }
+        return true;
     }
     
-    delete sdm;
+    // Instance of the autogenerated service class providing service
+	// for prediction of detections
+	but_objdet::PredictDetections predictSrv;
+
+    // Create a request
+    // (in this example, class_id nor object_id is specified, so predictions
+    // for all detections is returned)
+    //---------------------------------
+    predictSrv.request.header.stamp = stamp;
+    predictSrv.request.object_id = -1;
+    predictSrv.request.class_id = -1;
     
-    return 0;
+    // Send request to tracker (ROS node) to obtain predictions
+    // (using PredictDetections service)
+    //---------------------------------
+    // Call the service (calls are blocking, it returns once the call is done)
+    if(!predictClient.call(predictSrv)) {
+        predictFailures->add();
+        std::string errMsg = "Failed to call service " + BUT_OBJDET_PredictDetections_SRV + ".";
+        ROS_ERROR("%s", errMsg.c_str());
+        return false;
+    }
+    
+    predDetections.swap(predictSrv.response.predictions);
+    return true;
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Writes latencies collected since the last report into the log
+ */
+void SampleDetectorNode::reportLatency(const ros::WallTimerEvent &event)
+{
+    outputLatency.report();
+}
+
+
+/* =============================================================================
+ * Generates a new object ID
+ */
+int SampleDetectorNode::getNewObjectID()
+{
+    // Limit the range of possible IDs
+    if(lastObjectID >= 100000) lastObjectID = 0;
+    
+    return ++lastObjectID;
 }
 
+}
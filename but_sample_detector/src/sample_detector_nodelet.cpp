@@ -0,0 +1,60 @@
+/******************************************************************************
+ * \file
+ *
+ * $Id:$
+ *
+ * Copyright (C) Brno University of Technology
+ *
+ * This file is part of software developed by dcgm-robotics@FIT group.
+ *
+ * Author: dcgm-robotics@FIT group
+ * Supervised by: Vitezslav Beran (beranv@fit.vutbr.cz), Michal Spanel (spanel@fit.vutbr.cz)
+ * Description: Sample detector node wrapped as a nodelet.
+ *
+ * This file is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <boost/shared_ptr.hpp>
+
+#include "but_sample_detector/sample_detector_node.h"
+
+
+namespace but_sample_detector
+{
+
+/**
+ * Nodelet running SampleDetectorNode.
+ */
+class SampleDetectorNodelet : public nodelet::Nodelet
+{
+private:
+    virtual void onInit()
+    {
+        // Nobody processes HighGUI events within a nodelet manager
+        if(!getPrivateNodeHandle().hasParam("visual_output")) {
+            getPrivateNodeHandle().setParam("visual_output", false);
+        }
+
+        node.reset(new SampleDetectorNode(getNodeHandle(), getPrivateNodeHandle()));
+    }
+
+    boost::shared_ptr<SampleDetectorNode> node;
+};
+
+}
+
+PLUGINLIB_DECLARE_CLASS(but_sample_detector, SampleDetectorNodelet, but_sample_detector::SampleDetectorNodelet, nodelet::Nodelet)
+